@@ -0,0 +1,787 @@
+/**
+ * @file bench.h
+ * @brief Microbenchmark harness
+ * @author pucitos
+ *
+ * Benchmarks register themselves with BENCH() or BENCH_ARGS() and time only
+ * the body of BENCH_LOOP(), so setup and teardown stay out of the numbers.
+ * Each benchmark is warmed up, its iteration count is calibrated so a sample
+ * lasts long enough to swamp clock overhead, and then it is sampled
+ * repeatedly. Results report min/median/p99 per iteration plus throughput,
+ * and can be written to CSV or JSON and compared against a stored CSV
+ * baseline. Timing uses hrclock.h ticks.
+ *
+ * @code
+ * BENCH_ARGS(str_trim, 16, 256) {
+ *   char *buf = safe_malloc(b->arg + 1);
+ *   bench_set_bytes(b, b->arg);
+ *   BENCH_LOOP(b) {
+ *     memset(buf, ' ', b->arg);
+ *     buf[b->arg] = '\0';
+ *     BENCH_DO_NOT_OPTIMIZE(str_trim(buf));
+ *   }
+ *   free(buf);
+ * }
+ *
+ * BENCH_MAIN()
+ * @endcode
+ *
+ * Registration macros rely on constructor functions (GCC/Clang); elsewhere
+ * call bench_register() from main() before bench_main().
+ *
+ * Benchmarks may be spread over several files that share one registry:
+ * define BENCH_IMPLEMENTATION in exactly one of them (normally the one with
+ * BENCH_MAIN()) before including this header.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "hrclock.h"
+#include "json.h"
+#include "wildcard.h"
+#include <stdint.h>
+
+#ifndef _WIN32
+#define BENCH_HAVE_THREADS 1
+#include <pthread.h>
+#endif
+
+/**
+ * @brief Maximum length of a benchmark name, including any "/arg" suffix
+ */
+#define BENCH_NAME_MAX 96
+
+/**
+ * @brief Default run parameters, overridable on the command line
+ */
+#define BENCH_DEFAULT_MIN_TIME_MS 500.0
+#define BENCH_DEFAULT_WARMUP_MS 50.0
+#define BENCH_DEFAULT_SAMPLES 50
+#define BENCH_DEFAULT_THRESHOLD 10.0
+
+/**
+ * @brief State passed to every benchmark function
+ */
+typedef struct {
+  size_t iterations;     /* Loop count for this sample; read by BENCH_LOOP */
+  size_t arg;            /* Argument from BENCH_ARGS(), 0 otherwise */
+  double bytes_per_iter; /* Set with bench_set_bytes() for throughput */
+  double items_per_iter; /* Set with bench_set_items() for throughput */
+  uint64_t start;        /* Ticks at loop entry */
+  uint64_t end;          /* Ticks at loop exit */
+  bool timed;            /* Whether BENCH_LOOP ran to completion */
+} BenchState;
+
+/**
+ * @brief Benchmark entry point
+ */
+typedef void (*BenchFn)(BenchState *b);
+
+/**
+ * @brief A registered benchmark
+ */
+typedef struct {
+  char name[BENCH_NAME_MAX];
+  BenchFn fn;
+  size_t arg;
+} BenchCase;
+
+/**
+ * @brief Measured statistics for one benchmark, in nanoseconds per iteration
+ */
+typedef struct {
+  char name[BENCH_NAME_MAX];
+  size_t iterations; /* Iterations per sample after calibration */
+  size_t samples;
+  double min_ns;
+  double median_ns;
+  double p99_ns;
+  double mean_ns;
+  double bytes_per_iter;
+  double items_per_iter;
+} BenchResult;
+
+/**
+ * @brief Run configuration
+ */
+typedef struct {
+  double min_time_ms;        /* Total measured time per benchmark */
+  double warmup_ms;          /* Time spent running before sampling */
+  size_t samples;            /* Number of timed samples */
+  const char *filter;        /* Glob over benchmark names, or NULL */
+  const char *csv_path;      /* Write results as CSV, or NULL */
+  const char *json_path;     /* Write results as JSON, or NULL */
+  const char *baseline_path; /* CSV from a previous run, or NULL */
+  double threshold;          /* Median slowdown in percent that fails */
+} BenchConfig;
+
+/* ========== SHARED STATE ========== */
+
+#ifdef BENCH_IMPLEMENTATION
+BenchCase *bench_cases = NULL;
+size_t bench_case_count = 0;
+size_t bench_case_capacity = 0;
+#else
+extern BenchCase *bench_cases;
+extern size_t bench_case_count;
+extern size_t bench_case_capacity;
+#endif /* BENCH_IMPLEMENTATION */
+
+/* ========== BENCHMARK API ========== */
+
+/**
+ * @brief Keep a value (scalar or pointer) alive so the computation that
+ * produced it cannot be optimized away
+ */
+#ifdef __GNUC__
+#define BENCH_DO_NOT_OPTIMIZE(x) __asm__ __volatile__("" : : "g"(x) : "memory")
+#define BENCH_CLOBBER() __asm__ __volatile__("" : : : "memory")
+#else
+static volatile uintptr_t bench_sink;
+#define BENCH_DO_NOT_OPTIMIZE(x) (bench_sink = (uintptr_t)(x))
+#define BENCH_CLOBBER() ((void)bench_sink)
+#endif
+
+/**
+ * @brief Start the timer; used by BENCH_LOOP
+ */
+static inline size_t bench_start_timer(BenchState *b) {
+  b->timed = false;
+  b->start = hrclock_ticks();
+  return 0;
+}
+
+/**
+ * @brief Stop the timer; used by BENCH_LOOP
+ *
+ * @return false, so it can terminate the loop condition
+ */
+static inline bool bench_stop_timer(BenchState *b) {
+  b->end = hrclock_ticks();
+  b->timed = true;
+  return false;
+}
+
+/**
+ * @brief The timed loop of a benchmark; runs b->iterations times
+ */
+#define BENCH_LOOP(b)                                                          \
+  for (size_t bench_i_ = bench_start_timer(b);                                 \
+       bench_i_ < (b)->iterations || bench_stop_timer(b); bench_i_++)
+
+/**
+ * @brief Declare bytes processed per iteration for throughput reporting
+ */
+static inline void bench_set_bytes(BenchState *b, double bytes) {
+  b->bytes_per_iter = bytes;
+}
+
+/**
+ * @brief Declare items processed per iteration for throughput reporting
+ */
+static inline void bench_set_items(BenchState *b, double items) {
+  b->items_per_iter = items;
+}
+
+/**
+ * @brief Register a benchmark
+ *
+ * @param name Benchmark name
+ * @param fn Benchmark function
+ */
+static inline void bench_register(const char *name, BenchFn fn) {
+  if (bench_case_count == bench_case_capacity) {
+    bench_case_capacity = bench_case_capacity ? bench_case_capacity * 2 : 32;
+    bench_cases = (BenchCase *)safe_realloc(
+        bench_cases, bench_case_capacity * sizeof(BenchCase));
+  }
+  BenchCase *c = &bench_cases[bench_case_count++];
+  snprintf(c->name, sizeof(c->name), "%s", name);
+  c->fn = fn;
+  c->arg = 0;
+}
+
+/**
+ * @brief Register a benchmark with an argument, named "name/arg"
+ *
+ * @param name Benchmark name
+ * @param fn Benchmark function
+ * @param arg Value exposed as b->arg
+ */
+static inline void bench_register_arg(const char *name, BenchFn fn,
+                                      size_t arg) {
+  char full[BENCH_NAME_MAX];
+  snprintf(full, sizeof(full), "%s/%zu", name, arg);
+  bench_register(full, fn);
+  bench_cases[bench_case_count - 1].arg = arg;
+}
+
+#ifdef __GNUC__
+
+/**
+ * @brief Define and register a benchmark
+ */
+#define BENCH(name)                                                            \
+  static void bench_fn_##name(BenchState *b);                                  \
+  __attribute__((constructor)) static void bench_reg_##name(void) {            \
+    bench_register(#name, bench_fn_##name);                                    \
+  }                                                                            \
+  static void bench_fn_##name(BenchState *b)
+
+/**
+ * @brief Define a benchmark and register it once per argument
+ */
+#define BENCH_ARGS(name, ...)                                                  \
+  static void bench_fn_##name(BenchState *b);                                  \
+  __attribute__((constructor)) static void bench_reg_##name(void) {            \
+    static const size_t args[] = {__VA_ARGS__};                                \
+    for (size_t i = 0; i < sizeof(args) / sizeof(args[0]); i++)                \
+      bench_register_arg(#name, bench_fn_##name, args[i]);                     \
+  }                                                                            \
+  static void bench_fn_##name(BenchState *b)
+
+#endif /* __GNUC__ */
+
+#ifdef BENCH_HAVE_THREADS
+
+#define BENCH_MAX_THREADS 64
+
+/**
+ * @brief Work run by each thread of bench_threads()
+ *
+ * @param ctx Caller context
+ * @param thread Thread index in [0, threads)
+ * @param iterations Number of operations to perform
+ */
+typedef void (*BenchThreadFn)(void *ctx, size_t thread, size_t iterations);
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  size_t ready;
+  bool go;
+  BenchThreadFn fn;
+  void *ctx;
+  size_t iterations;
+} BenchGate;
+
+typedef struct {
+  BenchGate *gate;
+  size_t index;
+} BenchWorker;
+
+static void *bench_thread_main(void *arg) {
+  BenchWorker *w = (BenchWorker *)arg;
+  BenchGate *g = w->gate;
+
+  pthread_mutex_lock(&g->lock);
+  g->ready++;
+  pthread_cond_broadcast(&g->cond);
+  while (!g->go)
+    pthread_cond_wait(&g->cond, &g->lock);
+  pthread_mutex_unlock(&g->lock);
+
+  g->fn(g->ctx, w->index, g->iterations);
+  return NULL;
+}
+
+/**
+ * @brief Time b->iterations operations on each of several threads
+ *
+ * Use in place of BENCH_LOOP. Threads are started before the timer and
+ * released together, so the measurement covers only the parallel work: one
+ * iteration is one operation on every thread. If a thread cannot be created,
+ * the ones already started exit without doing any work and the sample is left
+ * untimed, so the benchmark is reported as failed.
+ *
+ * @param b Benchmark state
+ * @param threads Number of threads (1 to BENCH_MAX_THREADS)
+ * @param fn Work for each thread
+ * @param ctx Passed through to fn
+ */
+static inline void bench_threads(BenchState *b, size_t threads,
+                                 BenchThreadFn fn, void *ctx) {
+  pthread_t ids[BENCH_MAX_THREADS];
+  BenchWorker workers[BENCH_MAX_THREADS];
+  BenchGate gate;
+
+  if (threads == 0)
+    threads = 1;
+  if (threads > BENCH_MAX_THREADS)
+    threads = BENCH_MAX_THREADS;
+
+  pthread_mutex_init(&gate.lock, NULL);
+  pthread_cond_init(&gate.cond, NULL);
+  gate.ready = 0;
+  gate.go = false;
+  gate.fn = fn;
+  gate.ctx = ctx;
+  gate.iterations = b->iterations;
+
+  size_t started = 0;
+  for (; started < threads; started++) {
+    workers[started].gate = &gate;
+    workers[started].index = started;
+    if (pthread_create(&ids[started], NULL, bench_thread_main,
+                       &workers[started]) != 0) {
+      fprintf(stderr, "Error: Could not create benchmark thread %zu of %zu\n",
+              started + 1, threads);
+      break;
+    }
+  }
+
+  pthread_mutex_lock(&gate.lock);
+  while (gate.ready < started)
+    pthread_cond_wait(&gate.cond, &gate.lock);
+  if (started == threads)
+    bench_start_timer(b);
+  else
+    gate.iterations = 0;
+  gate.go = true;
+  pthread_cond_broadcast(&gate.cond);
+  pthread_mutex_unlock(&gate.lock);
+
+  for (size_t i = 0; i < started; i++)
+    pthread_join(ids[i], NULL);
+  if (started == threads)
+    bench_stop_timer(b);
+
+  pthread_cond_destroy(&gate.cond);
+  pthread_mutex_destroy(&gate.lock);
+}
+
+#endif /* BENCH_HAVE_THREADS */
+
+/* ========== INTERNAL HELPERS ========== */
+
+/**
+ * @brief Run one sample and return its duration in nanoseconds
+ *
+ * @return uint64_t Duration, or UINT64_MAX if the benchmark never completed
+ * BENCH_LOOP
+ */
+static inline uint64_t bench_sample(const BenchCase *c, size_t iterations,
+                                    BenchState *b) {
+  memset(b, 0, sizeof(*b));
+  b->iterations = iterations;
+  b->arg = c->arg;
+  c->fn(b);
+  if (!b->timed)
+    return UINT64_MAX;
+  return hrclock_elapsed_ns(b->start, b->end);
+}
+
+static inline int bench_compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Format a duration with a unit that keeps 3-4 significant digits
+ */
+static inline const char *bench_format_time(double ns, char *buffer,
+                                            size_t size) {
+  if (ns < 1e3)
+    snprintf(buffer, size, "%.2f ns", ns);
+  else if (ns < 1e6)
+    snprintf(buffer, size, "%.2f us", ns / 1e3);
+  else if (ns < 1e9)
+    snprintf(buffer, size, "%.2f ms", ns / 1e6);
+  else
+    snprintf(buffer, size, "%.2f s", ns / 1e9);
+  return buffer;
+}
+
+/**
+ * @brief Format the throughput of a result, or "-" if none was declared
+ */
+static inline const char *bench_format_rate(const BenchResult *r,
+                                            char *buffer, size_t size) {
+  double per_sec = 1e9 / r->median_ns;
+  if (r->bytes_per_iter > 0) {
+    double rate = r->bytes_per_iter * per_sec;
+    if (rate >= 1e9)
+      snprintf(buffer, size, "%.2f GB/s", rate / 1e9);
+    else
+      snprintf(buffer, size, "%.2f MB/s", rate / 1e6);
+  } else if (r->items_per_iter > 0) {
+    snprintf(buffer, size, "%.2f M/s", r->items_per_iter * per_sec / 1e6);
+  } else {
+    snprintf(buffer, size, "-");
+  }
+  return buffer;
+}
+
+/**
+ * @brief Look up the median of a benchmark in a baseline CSV file
+ *
+ * @return double Median in nanoseconds, or -1 if not found
+ */
+static inline double bench_baseline_median(FILE *file, const char *name) {
+  char line[512];
+
+  rewind(file);
+  while (fgets(line, sizeof(line), file) != NULL) {
+    char *comma = strchr(line, ',');
+    if (comma == NULL || (size_t)(comma - line) != strlen(name) ||
+        strncmp(line, name, strlen(name)) != 0)
+      continue;
+
+    /* name,iterations,samples,min_ns,median_ns,... */
+    char *field = comma;
+    for (int i = 0; i < 3 && field != NULL; i++)
+      field = strchr(field + 1, ',');
+    if (field == NULL)
+      return -1;
+    return strtod(field + 1, NULL);
+  }
+  return -1;
+}
+
+/* ========== RUNNING ========== */
+
+/**
+ * @brief Fill a configuration with the default parameters
+ *
+ * @param config Configuration to initialize
+ */
+static inline void bench_config_init(BenchConfig *config) {
+  memset(config, 0, sizeof(*config));
+  config->min_time_ms = BENCH_DEFAULT_MIN_TIME_MS;
+  config->warmup_ms = BENCH_DEFAULT_WARMUP_MS;
+  config->samples = BENCH_DEFAULT_SAMPLES;
+  config->threshold = BENCH_DEFAULT_THRESHOLD;
+}
+
+/**
+ * @brief Warm up, calibrate and measure one benchmark
+ *
+ * The iteration count grows until one sample takes at least
+ * min_time_ms / samples and warmup_ms has elapsed; then the configured number
+ * of samples is taken at that count.
+ *
+ * @param c Benchmark to run
+ * @param config Run parameters
+ * @param result Receives the statistics
+ * @return true on success, false if a sample was not timed (the benchmark
+ * does not use BENCH_LOOP, or bench_threads() failed)
+ */
+static inline bool bench_run_case(const BenchCase *c, const BenchConfig *config,
+                                  BenchResult *result) {
+  BenchState state;
+  size_t samples = config->samples ? config->samples : 1;
+  double target_ns = config->min_time_ms * 1e6 / (double)samples;
+  uint64_t warmup_ns = (uint64_t)(config->warmup_ms * 1e6);
+  uint64_t warmup_start = hrclock_ns();
+  size_t iterations = 1;
+
+  for (;;) {
+    uint64_t ns = bench_sample(c, iterations, &state);
+    if (ns == UINT64_MAX)
+      return false;
+    if ((double)ns >= target_ns) {
+      if (hrclock_ns() - warmup_start >= warmup_ns)
+        break;
+      continue;
+    }
+    double scale = ns > 0 ? target_ns / (double)ns * 1.2 : 10.0;
+    if (scale > 10.0)
+      scale = 10.0;
+    size_t next = (size_t)((double)iterations * scale);
+    iterations = next > iterations ? next : iterations + 1;
+  }
+
+  double *per_iter = (double *)safe_malloc(samples * sizeof(double));
+  double sum = 0;
+  for (size_t i = 0; i < samples; i++) {
+    per_iter[i] =
+        (double)bench_sample(c, iterations, &state) / (double)iterations;
+    sum += per_iter[i];
+  }
+  qsort(per_iter, samples, sizeof(double), bench_compare_double);
+
+  memcpy(result->name, c->name, sizeof(result->name));
+  result->iterations = iterations;
+  result->samples = samples;
+  result->min_ns = per_iter[0];
+  result->median_ns = samples % 2 ? per_iter[samples / 2]
+                                  : (per_iter[samples / 2 - 1] +
+                                     per_iter[samples / 2]) /
+                                        2;
+  result->p99_ns = per_iter[(samples * 99 + 99) / 100 - 1];
+  result->mean_ns = sum / (double)samples;
+  result->bytes_per_iter = state.bytes_per_iter;
+  result->items_per_iter = state.items_per_iter;
+
+  free(per_iter);
+  return true;
+}
+
+/**
+ * @brief Run every registered benchmark that matches the filter
+ *
+ * Prints a table to stdout as benchmarks finish.
+ *
+ * @param config Run parameters
+ * @param count Receives the number of results
+ * @return BenchResult* Newly allocated results in registration order, or
+ * NULL if the filter is empty or matches no benchmark
+ */
+static inline BenchResult *bench_run(const BenchConfig *config,
+                                     size_t *count) {
+  WildcardSet *filter = NULL;
+  size_t matched = 0;
+  size_t n = 0;
+
+  *count = 0;
+  if (config->filter != NULL) {
+    filter = config->filter[0] != '\0'
+                 ? wildcard_compile(config->filter, WILDCARD_NOPATH)
+                 : NULL;
+    for (size_t i = 0; filter != NULL && i < bench_case_count; i++)
+      matched += wildcard_matches(filter, bench_cases[i].name);
+    if (matched == 0) {
+      fprintf(stderr, "Error: No benchmark matches --filter=%s\n",
+              config->filter);
+      wildcard_free(filter);
+      return NULL;
+    }
+  }
+
+  BenchResult *results =
+      (BenchResult *)safe_calloc(bench_case_count + 1, sizeof(BenchResult));
+
+  printf("%-40s %12s %12s %12s %12s %14s\n", "benchmark", "iterations", "min",
+         "median", "p99", "throughput");
+  for (size_t i = 0; i < bench_case_count; i++) {
+    const BenchCase *c = &bench_cases[i];
+    char min[32], median[32], p99[32], rate[32];
+
+    if (filter != NULL && !wildcard_matches(filter, c->name))
+      continue;
+    if (!bench_run_case(c, config, &results[n])) {
+      fprintf(stderr,
+              "Error: benchmark %s did not complete a timed loop\n", c->name);
+      continue;
+    }
+
+    BenchResult *r = &results[n++];
+    printf("%-40s %12zu %12s %12s %12s %14s\n", r->name, r->iterations,
+           bench_format_time(r->min_ns, min, sizeof(min)),
+           bench_format_time(r->median_ns, median, sizeof(median)),
+           bench_format_time(r->p99_ns, p99, sizeof(p99)),
+           bench_format_rate(r, rate, sizeof(rate)));
+    fflush(stdout);
+  }
+
+  wildcard_free(filter);
+  *count = n;
+  return results;
+}
+
+/* ========== EXPORT ========== */
+
+/**
+ * @brief Write results as CSV, one row per benchmark
+ *
+ * @param path Output file
+ * @param results Results from bench_run()
+ * @param count Number of results
+ * @return true on success, false if the file cannot be written
+ */
+static inline bool bench_write_csv(const char *path, const BenchResult *results,
+                                   size_t count) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", path);
+    return false;
+  }
+
+  fprintf(file, "name,iterations,samples,min_ns,median_ns,p99_ns,mean_ns,"
+                "bytes_per_iter,items_per_iter\n");
+  for (size_t i = 0; i < count; i++) {
+    const BenchResult *r = &results[i];
+    fprintf(file, "%s,%zu,%zu,%.3f,%.3f,%.3f,%.3f,%.0f,%.0f\n", r->name,
+            r->iterations, r->samples, r->min_ns, r->median_ns, r->p99_ns,
+            r->mean_ns, r->bytes_per_iter, r->items_per_iter);
+  }
+  return fclose(file) == 0;
+}
+
+/**
+ * @brief Write results as a JSON array of objects
+ *
+ * @param path Output file
+ * @param results Results from bench_run()
+ * @param count Number of results
+ * @return true on success, false if the file cannot be written
+ */
+static inline bool bench_write_json(const char *path,
+                                    const BenchResult *results, size_t count) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", path);
+    return false;
+  }
+
+  fprintf(file, "[\n");
+  for (size_t i = 0; i < count; i++) {
+    const BenchResult *r = &results[i];
+    char *name = json_escape_alloc(r->name);
+    fprintf(file,
+            "  {\"name\": \"%s\", \"iterations\": %zu, \"samples\": %zu, "
+            "\"min_ns\": %.3f, \"median_ns\": %.3f, \"p99_ns\": %.3f, "
+            "\"mean_ns\": %.3f, \"bytes_per_iter\": %.0f, "
+            "\"items_per_iter\": %.0f}%s\n",
+            name, r->iterations, r->samples, r->min_ns, r->median_ns,
+            r->p99_ns, r->mean_ns, r->bytes_per_iter, r->items_per_iter,
+            i + 1 < count ? "," : "");
+    free(name);
+  }
+  fprintf(file, "]\n");
+  return fclose(file) == 0;
+}
+
+/**
+ * @brief Compare medians against a baseline CSV written by bench_write_csv()
+ *
+ * Prints the change for every benchmark. Benchmarks with no row in the
+ * baseline are reported as missing and count as failures, so a stale baseline
+ * cannot leave new benchmarks unchecked.
+ *
+ * @param path Baseline file
+ * @param results Results from bench_run()
+ * @param count Number of results
+ * @param threshold Slowdown in percent that counts as a regression
+ * @return int Number of regressions plus missing benchmarks, or -1 if the
+ * baseline cannot be read
+ */
+static inline int bench_compare_baseline(const char *path,
+                                         const BenchResult *results,
+                                         size_t count, double threshold) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Error: Could not open baseline %s\n", path);
+    return -1;
+  }
+
+  int regressions = 0;
+  int missing = 0;
+  printf("\n%-40s %12s %12s %9s\n", "vs baseline", "baseline", "current",
+         "change");
+  for (size_t i = 0; i < count; i++) {
+    const BenchResult *r = &results[i];
+    double base = bench_baseline_median(file, r->name);
+    char before[32], after[32];
+
+    if (base <= 0) {
+      printf("%-40s %12s %12s %9s  MISSING\n", r->name, "-",
+             bench_format_time(r->median_ns, after, sizeof(after)), "-");
+      missing++;
+      continue;
+    }
+    double change = (r->median_ns - base) / base * 100.0;
+    bool regressed = change > threshold;
+    regressions += regressed;
+    printf("%-40s %12s %12s %+8.1f%%%s\n", r->name,
+           bench_format_time(base, before, sizeof(before)),
+           bench_format_time(r->median_ns, after, sizeof(after)), change,
+           regressed ? "  REGRESSION" : "");
+  }
+
+  fclose(file);
+  fflush(stdout);
+  if (missing > 0)
+    fprintf(stderr, "Error: %d benchmarks missing from baseline %s\n",
+            missing, path);
+  return regressions + missing;
+}
+
+/* ========== COMMAND LINE ========== */
+
+/**
+ * @brief Parse options, run benchmarks, export and compare results
+ *
+ * Options: --filter=GLOB, --min-time=MS, --warmup=MS, --samples=N,
+ * --csv=FILE, --json=FILE, --baseline=FILE, --threshold=PCT, --list.
+ *
+ * @param argc Argument count from main()
+ * @param argv Argument vector from main()
+ * @return int EXIT_SUCCESS, or EXIT_FAILURE on bad options, I/O errors or
+ * baseline regressions
+ */
+static inline int bench_main(int argc, char **argv) {
+  BenchConfig config;
+  bool list = false;
+
+  bench_config_init(&config);
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = strchr(arg, '=');
+    value = value ? value + 1 : "";
+
+    if (str_starts_with(arg, "--filter="))
+      config.filter = value;
+    else if (str_starts_with(arg, "--min-time="))
+      config.min_time_ms = atof(value);
+    else if (str_starts_with(arg, "--warmup="))
+      config.warmup_ms = atof(value);
+    else if (str_starts_with(arg, "--samples="))
+      config.samples = (size_t)strtoul(value, NULL, 10);
+    else if (str_starts_with(arg, "--csv="))
+      config.csv_path = value;
+    else if (str_starts_with(arg, "--json="))
+      config.json_path = value;
+    else if (str_starts_with(arg, "--baseline="))
+      config.baseline_path = value;
+    else if (str_starts_with(arg, "--threshold="))
+      config.threshold = atof(value);
+    else if (strcmp(arg, "--list") == 0)
+      list = true;
+    else {
+      fprintf(stderr,
+              "Usage: %s [--filter=GLOB] [--min-time=MS] [--warmup=MS] "
+              "[--samples=N] [--csv=FILE] [--json=FILE] [--baseline=FILE] "
+              "[--threshold=PCT] [--list]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (list) {
+    for (size_t i = 0; i < bench_case_count; i++)
+      printf("%s\n", bench_cases[i].name);
+    return EXIT_SUCCESS;
+  }
+
+  printf("clock: %s, %.3f ticks/ns, %.1f ns/read\n\n", hrclock_source_name(),
+         hrclock_ticks_per_ns(), hrclock_overhead_ns(100000));
+
+  size_t count;
+  BenchResult *results = bench_run(&config, &count);
+  int status = EXIT_SUCCESS;
+  if (results == NULL)
+    return EXIT_FAILURE;
+
+  if (config.csv_path && !bench_write_csv(config.csv_path, results, count))
+    status = EXIT_FAILURE;
+  if (config.json_path && !bench_write_json(config.json_path, results, count))
+    status = EXIT_FAILURE;
+  if (config.baseline_path &&
+      bench_compare_baseline(config.baseline_path, results, count,
+                             config.threshold) != 0)
+    status = EXIT_FAILURE;
+
+  free(results);
+  return status;
+}
+
+/**
+ * @brief Define main() to run all registered benchmarks
+ */
+#define BENCH_MAIN()                                                           \
+  int main(int argc, char **argv) { return bench_main(argc, argv); }
+
+#endif /* BENCH_H */
@@ -0,0 +1,176 @@
+/**
+ * @file bench_ratelimit.c
+ * @brief Throughput benchmarks for the limiters in ratelimit.h
+ *
+ * Shared limiters are hammered from 1, 2, 4 and 8 threads to measure CAS
+ * contention; the keyed map is measured both with one key per thread and with
+ * every thread spread over a large key set.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -pthread -I. bench/bench_ratelimit.c -o bench_ratelimit
+ *   ./bench_ratelimit
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define BENCH_IMPLEMENTATION
+#define HRCLOCK_IMPLEMENTATION
+
+#include "bench.h"
+#include "ratelimit.h"
+
+#define BENCH_THREAD_COUNTS 1, 2, 4, 8
+#define BENCH_KEYS 4096
+
+/* ========== FIXTURES ========== */
+
+/**
+ * @brief Keys "client-0" .. "client-4095", built on first use
+ */
+static const char *bench_key(size_t index) {
+  static char keys[BENCH_KEYS][16];
+  static bool built = false;
+
+  if (!built) {
+    for (size_t i = 0; i < BENCH_KEYS; i++)
+      snprintf(keys[i], sizeof(keys[i]), "client-%zu", i);
+    built = true;
+  }
+  return keys[index % BENCH_KEYS];
+}
+
+/* A high rate keeps most calls on the grant path, the common case */
+static void bench_token_bucket(RateLimiter *rl) {
+  ratelimit_token_bucket_init(rl, 1e9, 1000000);
+}
+
+static void bench_sliding_window(RateLimiter *rl) {
+  ratelimit_sliding_window_init(rl, RATELIMIT_WINDOW_MAX, 1000000);
+}
+
+/* ========== SINGLE LIMITER ========== */
+
+BENCH(token_bucket_allow) {
+  RateLimiter rl;
+  bench_token_bucket(&rl);
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(ratelimit_allow(&rl)); }
+}
+
+BENCH(token_bucket_denied) {
+  RateLimiter rl;
+  ratelimit_token_bucket_init(&rl, 1, 1);
+  ratelimit_allow(&rl);
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(ratelimit_allow(&rl)); }
+}
+
+BENCH(sliding_window_allow) {
+  RateLimiter rl;
+  bench_sliding_window(&rl);
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(ratelimit_allow(&rl)); }
+}
+
+BENCH(time_null_compare) {
+  time_t last = 0;
+  int count = 0;
+  BENCH_LOOP(b) {
+    time_t now = time(NULL);
+    if (now != last) {
+      last = now;
+      count = 0;
+    }
+    BENCH_DO_NOT_OPTIMIZE(++count <= 1000);
+  }
+}
+
+static void bench_allow_worker(void *ctx, size_t thread, size_t iterations) {
+  RateLimiter *rl = (RateLimiter *)ctx;
+  (void)thread;
+  for (size_t i = 0; i < iterations; i++)
+    BENCH_DO_NOT_OPTIMIZE(ratelimit_allow(rl));
+}
+
+BENCH_ARGS(token_bucket_threads, BENCH_THREAD_COUNTS) {
+  RateLimiter rl;
+  bench_token_bucket(&rl);
+  bench_set_items(b, (double)b->arg);
+  bench_threads(b, b->arg, bench_allow_worker, &rl);
+}
+
+BENCH_ARGS(sliding_window_threads, BENCH_THREAD_COUNTS) {
+  RateLimiter rl;
+  bench_sliding_window(&rl);
+  bench_set_items(b, (double)b->arg);
+  bench_threads(b, b->arg, bench_allow_worker, &rl);
+}
+
+/* ========== KEYED LIMITERS ========== */
+
+BENCH(map_allow_one_key) {
+  RateLimiter proto;
+  bench_token_bucket(&proto);
+  RateLimitMap *map = ratelimit_map_new(&proto);
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(ratelimit_map_allow(map, "client")); }
+  ratelimit_map_free(map);
+}
+
+BENCH(map_allow_many_keys) {
+  RateLimiter proto;
+  bench_token_bucket(&proto);
+  RateLimitMap *map = ratelimit_map_new(&proto);
+  size_t i = 0;
+  BENCH_LOOP(b) {
+    BENCH_DO_NOT_OPTIMIZE(ratelimit_map_allow(map, bench_key(i++)));
+  }
+  ratelimit_map_free(map);
+}
+
+static void bench_map_own_key_worker(void *ctx, size_t thread,
+                                     size_t iterations) {
+  RateLimitMap *map = (RateLimitMap *)ctx;
+  const char *key = bench_key(thread);
+  for (size_t i = 0; i < iterations; i++)
+    BENCH_DO_NOT_OPTIMIZE(ratelimit_map_allow(map, key));
+}
+
+static void bench_map_spread_worker(void *ctx, size_t thread,
+                                    size_t iterations) {
+  RateLimitMap *map = (RateLimitMap *)ctx;
+  for (size_t i = 0; i < iterations; i++)
+    BENCH_DO_NOT_OPTIMIZE(
+        ratelimit_map_allow(map, bench_key(thread * 7919 + i)));
+}
+
+BENCH_ARGS(map_own_key_threads, BENCH_THREAD_COUNTS) {
+  RateLimiter proto;
+  bench_token_bucket(&proto);
+  RateLimitMap *map = ratelimit_map_new(&proto);
+  bench_key(0);
+  bench_set_items(b, (double)b->arg);
+  bench_threads(b, b->arg, bench_map_own_key_worker, map);
+  ratelimit_map_free(map);
+}
+
+BENCH_ARGS(map_spread_threads, BENCH_THREAD_COUNTS) {
+  RateLimiter proto;
+  bench_token_bucket(&proto);
+  RateLimitMap *map = ratelimit_map_new(&proto);
+  bench_key(0);
+  bench_set_items(b, (double)b->arg);
+  bench_threads(b, b->arg, bench_map_spread_worker, map);
+  ratelimit_map_free(map);
+}
+
+/* ========== LOG SITES ========== */
+
+BENCH(log_rate_limited_suppressed) {
+  log_init("/dev/null", LOG_INFO);
+  BENCH_LOOP(b) { LOG_RATE_LIMITED(LOG_WARNING, 10, "client %d flood", 7); }
+  log_close();
+}
+
+BENCH(log_every_n_skipped) {
+  log_init("/dev/null", LOG_INFO);
+  BENCH_LOOP(b) { LOG_EVERY_N(LOG_WARNING, 1000000, "client %d flood", 7); }
+  log_close();
+}
+
+BENCH_MAIN()
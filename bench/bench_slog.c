@@ -0,0 +1,83 @@
+/**
+ * @file bench_slog.c
+ * @brief Encoding cost of slog.h lines against an equivalent snprintf
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -pthread -I. bench/bench_slog.c -o bench_slog
+ *   ./bench_slog
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define BENCH_IMPLEMENTATION
+#define HRCLOCK_IMPLEMENTATION
+
+#include "bench.h"
+#include "slog.h"
+
+#define BENCH_EPOCH_NS 1740830400123456789LL
+
+/* ========== ENCODING ========== */
+
+static const SlogField *bench_fields(void) {
+  static SlogField fields[4];
+  fields[0] = slog_str("path", "/api/v1/orders");
+  fields[1] = slog_int("status", 200);
+  fields[2] = slog_uint("bytes", 18342);
+  fields[3] = slog_double("ms", 1.25);
+  return fields;
+}
+
+BENCH(slog_encode_json) {
+  char line[SLOG_LINE_MAX];
+  const SlogField *fields = bench_fields();
+  BENCH_LOOP(b) {
+    BENCH_DO_NOT_OPTIMIZE(slog_encode(SLOG_JSON, line, sizeof(line),
+                                      BENCH_EPOCH_NS, LOG_INFO,
+                                      "request done", fields, 4));
+  }
+}
+
+BENCH(slog_encode_logfmt) {
+  char line[SLOG_LINE_MAX];
+  const SlogField *fields = bench_fields();
+  BENCH_LOOP(b) {
+    BENCH_DO_NOT_OPTIMIZE(slog_encode(SLOG_LOGFMT, line, sizeof(line),
+                                      BENCH_EPOCH_NS, LOG_INFO,
+                                      "request done", fields, 4));
+  }
+}
+
+BENCH(snprintf_json) {
+  char line[SLOG_LINE_MAX];
+  char ts[ISOTIME_MAX_LEN];
+  BENCH_LOOP(b) {
+    isotime_format(BENCH_EPOCH_NS, 3, 0, ts, sizeof(ts));
+    BENCH_DO_NOT_OPTIMIZE(snprintf(
+        line, sizeof(line),
+        "{\"ts\":\"%s\",\"level\":\"%s\",\"msg\":\"%s\",\"path\":\"%s\","
+        "\"status\":%d,\"bytes\":%llu,\"ms\":%.15g}\n",
+        ts, "info", "request done", "/api/v1/orders", 200, 18342ULL, 1.25));
+  }
+}
+
+/* ========== LOGGING ========== */
+
+BENCH(slog_devnull) {
+  log_init("/dev/null", LOG_INFO);
+  BENCH_LOOP(b) {
+    SLOG(LOG_INFO, "request done", slog_str("path", "/api/v1/orders"),
+         slog_int("status", 200), slog_double("ms", 1.25));
+  }
+  log_close();
+}
+
+BENCH(slog_filtered) {
+  log_init("/dev/null", LOG_WARNING);
+  BENCH_LOOP(b) {
+    SLOG(LOG_INFO, "request done", slog_str("path", "/api/v1/orders"),
+         slog_int("status", 200), slog_double("ms", 1.25));
+  }
+  log_close();
+}
+
+BENCH_MAIN()
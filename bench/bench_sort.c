@@ -0,0 +1,131 @@
+/**
+ * @file bench_sort.c
+ * @brief Compare sort.h against qsort()
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -pthread -I. bench/bench_sort.c -o bench_sort && ./bench_sort
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "sort.h"
+
+#define BENCH_N 1000000
+#define BENCH_THREADS 4
+
+SORT_DEFINE(sort_int, int, SORT_LESS)
+
+static int compare_int(const void *a, const void *b) {
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+static int compare_str(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static double now_ms(void) {
+  static struct timespec origin;
+  struct timespec ts;
+  if (origin.tv_sec == 0)
+    clock_gettime(CLOCK_MONOTONIC, &origin);
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return time_elapsed_ms(&origin, &ts);
+}
+
+static void report(const char *name, double baseline, double ms) {
+  printf("  %-32s %9.2f ms  %6.2fx\n", name, ms, baseline / ms);
+}
+
+static void bench_ints(const char *label, const int *input, size_t n) {
+  int *arr = (int *)safe_malloc(n * sizeof(int));
+  double start, base;
+
+  printf("%s (%zu ints)\n", label, n);
+
+  memcpy(arr, input, n * sizeof(int));
+  start = now_ms();
+  qsort(arr, n, sizeof(int), compare_int);
+  base = now_ms() - start;
+  report("qsort", base, base);
+
+  memcpy(arr, input, n * sizeof(int));
+  start = now_ms();
+  sort_int(arr, n);
+  report("SORT_DEFINE pdqsort", base, now_ms() - start);
+
+  memcpy(arr, input, n * sizeof(int));
+  start = now_ms();
+  sort_i32((int32_t *)arr, n);
+  report("sort_i32 radix", base, now_ms() - start);
+
+#ifdef SORT_HAVE_THREADS
+  memcpy(arr, input, n * sizeof(int));
+  start = now_ms();
+  sort_int_parallel(arr, n, BENCH_THREADS);
+  report("pdqsort parallel (4 threads)", base, now_ms() - start);
+#endif
+
+  free(arr);
+}
+
+static void bench_strings(const char *label, const char **input, size_t n) {
+  const char **arr = (const char **)safe_malloc(n * sizeof(const char *));
+  double start, base;
+
+  printf("%s (%zu strings)\n", label, n);
+
+  memcpy(arr, input, n * sizeof(const char *));
+  start = now_ms();
+  qsort(arr, n, sizeof(const char *), compare_str);
+  base = now_ms() - start;
+  report("qsort + strcmp", base, base);
+
+  memcpy(arr, input, n * sizeof(const char *));
+  start = now_ms();
+  sort_strings(arr, n);
+  report("sort_strings MSD radix", base, now_ms() - start);
+
+#ifdef SORT_HAVE_THREADS
+  memcpy(arr, input, n * sizeof(const char *));
+  start = now_ms();
+  sort_strings_parallel(arr, n, BENCH_THREADS);
+  report("MSD radix parallel (4 threads)", base, now_ms() - start);
+#endif
+
+  free(arr);
+}
+
+int main(void) {
+  int *ints = (int *)safe_malloc(BENCH_N * sizeof(int));
+  const char **strs = (const char **)safe_malloc(BENCH_N * sizeof(char *));
+
+  srand(42);
+  for (size_t i = 0; i < BENCH_N; i++)
+    ints[i] = rand();
+  bench_ints("Random", ints, BENCH_N);
+
+  for (size_t i = 0; i < BENCH_N; i++)
+    ints[i] = (int)i + (i % 100 == 0 ? rand() % 1000 : 0);
+  bench_ints("Nearly sorted", ints, BENCH_N);
+
+  for (size_t i = 0; i < BENCH_N; i++)
+    ints[i] = rand() % 16;
+  bench_ints("Few unique", ints, BENCH_N);
+
+  // File-path-like keys with long shared prefixes
+  for (size_t i = 0; i < BENCH_N; i++) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "src/module%02d/file%07d.c", rand() % 40,
+             rand() % 10000000);
+    strs[i] = str_duplicate(buf);
+  }
+  bench_strings("Paths", strs, BENCH_N);
+
+  for (size_t i = 0; i < BENCH_N; i++)
+    free((void *)strs[i]);
+  free(strs);
+  free(ints);
+  return 0;
+}
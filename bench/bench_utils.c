@@ -0,0 +1,367 @@
+/**
+ * @file bench_utils.c
+ * @brief Benchmarks for the functions in utils.h
+ *
+ * Strings and files are measured at 16 B, 4 KB and 1 MB; build with
+ * -DBENCH_HUGE to add 1 GB (needs a few GB of memory and temporary disk).
+ * Functions that are safe to call concurrently are also measured on 1, 2, 4
+ * and 8 threads. clear_screen() and pause_screen() are interactive and the
+ * DEBUG_PRINT and ASSERT macros are single printf/branch wrappers, so they
+ * are not measured.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -pthread -I. bench/bench_utils.c -o bench_utils && ./bench_utils
+ *
+ * Refresh the stored baseline, or compare against it:
+ *   ./bench_utils --csv=bench/baseline.csv
+ *   ./bench_utils --baseline=bench/baseline.csv
+ *
+ * Temporary files go to $TMPDIR (default /tmp).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define BENCH_IMPLEMENTATION
+#define HRCLOCK_IMPLEMENTATION
+
+#include "bench.h"
+
+#ifdef BENCH_HUGE
+#define BENCH_SIZES 16, 4096, 1 << 20, 1 << 30
+#else
+#define BENCH_SIZES 16, 4096, 1 << 20
+#endif
+
+#define BENCH_THREAD_COUNTS 1, 2, 4, 8
+
+/* ========== FIXTURES ========== */
+
+/**
+ * @brief Text of the given length with four trailing spaces, reused across
+ * samples
+ */
+static char *bench_text(size_t size) {
+  static char *text = NULL;
+  static size_t text_size = 0;
+
+  if (text_size != size) {
+    free(text);
+    text = (char *)safe_malloc(size + 1);
+    for (size_t i = 0; i < size; i++)
+      text[i] = (char)('a' + i % 26);
+    for (size_t i = size > 4 ? size - 4 : 0; i < size; i++)
+      text[i] = ' ';
+    text[size] = '\0';
+    text_size = size;
+  }
+  return text;
+}
+
+/**
+ * @brief Path of a temporary file of the given size, created on first use
+ */
+static const char *bench_file(size_t size) {
+  static char path[256];
+  static size_t file_size_created = (size_t)-1;
+
+  if (file_size_created != size) {
+    const char *dir = getenv("TMPDIR");
+    snprintf(path, sizeof(path), "%s/bench_utils_%zu.tmp",
+             dir != NULL ? dir : "/tmp", size);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+      fprintf(stderr, "Error: Could not create %s\n", path);
+      exit(EXIT_FAILURE);
+    }
+    const char *chunk = bench_text(size < 65536 ? size : 65536);
+    size_t chunk_len = strlen(chunk);
+    for (size_t written = 0; written < size; written += chunk_len) {
+      size_t n = size - written < chunk_len ? size - written : chunk_len;
+      fwrite(chunk, 1, n, file);
+    }
+    fclose(file);
+    file_size_created = size;
+  }
+  return path;
+}
+
+static void bench_remove_files(void) {
+  static const size_t sizes[] = {BENCH_SIZES};
+  const char *dir = getenv("TMPDIR");
+  char path[256];
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    snprintf(path, sizeof(path), "%s/bench_utils_%zu.tmp",
+             dir != NULL ? dir : "/tmp", sizes[i]);
+    remove(path);
+  }
+}
+
+/* ========== MEMORY UTILITIES ========== */
+
+BENCH_ARGS(safe_malloc, BENCH_SIZES) {
+  BENCH_LOOP(b) {
+    void *p = safe_malloc(b->arg);
+    BENCH_DO_NOT_OPTIMIZE(p);
+    free(p);
+  }
+}
+
+BENCH_ARGS(safe_calloc, BENCH_SIZES) {
+  bench_set_bytes(b, (double)b->arg);
+  BENCH_LOOP(b) {
+    void *p = safe_calloc(1, b->arg);
+    BENCH_DO_NOT_OPTIMIZE(p);
+    free(p);
+  }
+}
+
+BENCH_ARGS(safe_realloc, BENCH_SIZES) {
+  bench_set_bytes(b, (double)(b->arg / 2));
+  BENCH_LOOP(b) {
+    void *p = safe_malloc(b->arg / 2 + 1);
+    memset(p, 1, b->arg / 2 + 1);
+    p = safe_realloc(p, b->arg);
+    BENCH_DO_NOT_OPTIMIZE(p);
+    free(p);
+  }
+}
+
+BENCH(safe_free) {
+  BENCH_LOOP(b) {
+    void *p = safe_malloc(64);
+    safe_free(&p);
+    BENCH_DO_NOT_OPTIMIZE(p);
+  }
+}
+
+static void bench_malloc_worker(void *ctx, size_t thread, size_t iterations) {
+  (void)ctx;
+  (void)thread;
+  for (size_t i = 0; i < iterations; i++) {
+    void *p = safe_malloc(256);
+    BENCH_DO_NOT_OPTIMIZE(p);
+    safe_free(&p);
+  }
+}
+
+BENCH_ARGS(safe_malloc_threads, BENCH_THREAD_COUNTS) {
+  bench_set_items(b, (double)b->arg);
+  bench_threads(b, b->arg, bench_malloc_worker, NULL);
+}
+
+/* ========== STRING UTILITIES ========== */
+
+BENCH_ARGS(str_duplicate, BENCH_SIZES) {
+  const char *text = bench_text(b->arg);
+  bench_set_bytes(b, (double)b->arg);
+  BENCH_LOOP(b) {
+    char *copy = str_duplicate(text);
+    BENCH_DO_NOT_OPTIMIZE(copy);
+    free(copy);
+  }
+}
+
+BENCH_ARGS(str_starts_with, BENCH_SIZES) {
+  const char *text = bench_text(b->arg);
+  char *prefix = str_duplicate(text);
+  prefix[b->arg / 2] = '\0';
+  bench_set_bytes(b, (double)b->arg);
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(str_starts_with(text, prefix)); }
+  free(prefix);
+}
+
+BENCH_ARGS(str_ends_with, BENCH_SIZES) {
+  const char *text = bench_text(b->arg);
+  const char *suffix = text + b->arg / 2;
+  bench_set_bytes(b, (double)b->arg);
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(str_ends_with(text, suffix)); }
+}
+
+BENCH_ARGS(str_trim, BENCH_SIZES) {
+  char *text = bench_text(b->arg);
+  size_t tail = b->arg > 4 ? b->arg - 4 : 0;
+  bench_set_bytes(b, (double)b->arg);
+  BENCH_LOOP(b) {
+    BENCH_DO_NOT_OPTIMIZE(str_trim(text));
+    memset(text + tail, ' ', b->arg - tail);
+  }
+}
+
+/* ========== TIME UTILITIES ========== */
+
+BENCH(get_timestamp) {
+  char buffer[32];
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(get_timestamp(buffer, 20)); }
+}
+
+BENCH(get_timestamp_ex_us) {
+  char buffer[32];
+  BENCH_LOOP(b) {
+    BENCH_DO_NOT_OPTIMIZE(
+        get_timestamp_ex(buffer, sizeof(buffer), TIMESTAMP_US));
+  }
+}
+
+static void bench_timestamp_worker(void *ctx, size_t thread,
+                                   size_t iterations) {
+  char buffer[32];
+  (void)ctx;
+  (void)thread;
+  for (size_t i = 0; i < iterations; i++)
+    BENCH_DO_NOT_OPTIMIZE(get_timestamp(buffer, sizeof(buffer)));
+}
+
+BENCH_ARGS(get_timestamp_threads, BENCH_THREAD_COUNTS) {
+  bench_set_items(b, (double)b->arg);
+  bench_threads(b, b->arg, bench_timestamp_worker, NULL);
+}
+
+BENCH(time_elapsed_ms) {
+  struct timespec start = {1, 250000000};
+  struct timespec end = {3, 500000000};
+  BENCH_LOOP(b) {
+    BENCH_CLOBBER();
+    BENCH_DO_NOT_OPTIMIZE(time_elapsed_ms(&start, &end));
+  }
+}
+
+/* ========== LOGGING UTILITIES ========== */
+
+BENCH(log_message_filtered) {
+  log_init("/dev/null", LOG_WARNING);
+  BENCH_LOOP(b) { log_message(LOG_DEBUG, "request %d took %s", 42, "1.5ms"); }
+  log_close();
+}
+
+BENCH(log_message_devnull) {
+  log_init("/dev/null", LOG_INFO);
+  BENCH_LOOP(b) { log_message(LOG_INFO, "request %d took %s", 42, "1.5ms"); }
+  log_close();
+}
+
+BENCH(log_message_sinks) {
+  log_init("/dev/null", LOG_INFO);
+  log_sink_add(log_sink_file("/dev/null", LOG_INFO, 65536));
+  log_sink_add(log_sink_ring(1 << 20, LOG_DEBUG));
+  BENCH_LOOP(b) { log_message(LOG_INFO, "request %d took %s", 42, "1.5ms"); }
+  log_close();
+}
+
+BENCH(log_macro_filtered) {
+  log_init("/dev/null", LOG_WARNING);
+  BENCH_LOOP(b) { LOG_DEBUGF("request %d took %s", 42, "1.5ms"); }
+  log_close();
+}
+
+LOG_CATEGORY_DEFINE(bench_category, "bench");
+
+BENCH(log_category_filtered) {
+  log_init("/dev/null", LOG_DEBUG);
+  log_category_set("bench", LOG_WARNING);
+  BENCH_LOOP(b) { LOG_CAT(bench_category, LOG_DEBUG, "request %d", 42); }
+  log_category_reset("bench");
+  log_close();
+}
+
+BENCH(log_macro_devnull) {
+  log_init("/dev/null", LOG_INFO);
+  BENCH_LOOP(b) { LOG_INFOF("request %d took %s", 42, "1.5ms"); }
+  log_close();
+}
+
+BENCH(log_message_file) {
+  const char *dir = getenv("TMPDIR");
+  char path[256];
+  snprintf(path, sizeof(path), "%s/bench_utils_log.tmp",
+           dir != NULL ? dir : "/tmp");
+
+  log_init(path, LOG_INFO);
+  BENCH_LOOP(b) { log_message(LOG_INFO, "request %d took %s", 42, "1.5ms"); }
+  log_close();
+  remove(path);
+}
+
+static void bench_log_worker(void *ctx, size_t thread, size_t iterations) {
+  (void)ctx;
+  for (size_t i = 0; i < iterations; i++)
+    log_message(LOG_INFO, "thread %zu request %zu", thread, i);
+}
+
+BENCH_ARGS(log_message_threads, BENCH_THREAD_COUNTS) {
+  log_init("/dev/null", LOG_INFO);
+  bench_set_items(b, (double)b->arg);
+  bench_threads(b, b->arg, bench_log_worker, NULL);
+  log_close();
+}
+
+BENCH_ARGS(log_message_async_threads, BENCH_THREAD_COUNTS) {
+  log_init("/dev/null", LOG_INFO);
+  log_async_start(1 << 16, LOG_OVERFLOW_BLOCK);
+  bench_set_items(b, (double)b->arg);
+  bench_threads(b, b->arg, bench_log_worker, NULL);
+  log_close();
+}
+
+/* ========== FILE UTILITIES ========== */
+
+BENCH(file_exists) {
+  const char *path = bench_file(16);
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(file_exists(path)); }
+}
+
+BENCH(file_exists_missing) {
+  BENCH_LOOP(b) {
+    BENCH_DO_NOT_OPTIMIZE(file_exists("/nonexistent/bench_utils.tmp"));
+  }
+}
+
+BENCH(file_size) {
+  const char *path = bench_file(4096);
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(file_size(path)); }
+}
+
+BENCH_ARGS(file_read_all, BENCH_SIZES) {
+  const char *path = bench_file(b->arg);
+  bench_set_bytes(b, (double)b->arg);
+  BENCH_LOOP(b) {
+    char *content = file_read_all(path);
+    BENCH_DO_NOT_OPTIMIZE(content);
+    free(content);
+  }
+}
+
+/* ========== RANDOM UTILITIES ========== */
+
+BENCH(random_init) {
+  BENCH_LOOP(b) {
+    random_init();
+    BENCH_CLOBBER();
+  }
+}
+
+BENCH(random_int) {
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(random_int(1, 6)); }
+}
+
+BENCH(random_double) {
+  BENCH_LOOP(b) { BENCH_DO_NOT_OPTIMIZE(random_double(0.0, 1.0)); }
+}
+
+static void bench_random_worker(void *ctx, size_t thread, size_t iterations) {
+  (void)ctx;
+  (void)thread;
+  for (size_t i = 0; i < iterations; i++)
+    BENCH_DO_NOT_OPTIMIZE(random_int(1, 6));
+}
+
+BENCH_ARGS(random_int_threads, BENCH_THREAD_COUNTS) {
+  bench_set_items(b, (double)b->arg);
+  bench_threads(b, b->arg, bench_random_worker, NULL);
+}
+
+int main(int argc, char **argv) {
+  int status = bench_main(argc, argv);
+  bench_remove_files();
+  return status;
+}
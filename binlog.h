@@ -0,0 +1,965 @@
+/**
+ * @file binlog.h
+ * @brief Deferred-formatting binary logger
+ * @author pucitos
+ *
+ * BINLOG(level, "format", args...) does not format anything on the calling
+ * thread. It copies a pointer to the call site (format string, level,
+ * argument types), an hrclock_ns() timestamp and the raw argument values
+ * into a per-thread lock-free ring buffer; strings are copied by value. A
+ * background thread, or binlog_flush(), later either formats the records into
+ * ordinary log lines or writes them to a compact binary file that
+ * binlog_decode() (see tools/binlog_decode.c) turns into text offline.
+ *
+ * Argument types are captured at compile time with _Generic, so only
+ * integers, floating point values, strings (char *) and void pointers are
+ * accepted, at most BINLOG_MAX_ARGS of them; cast anything else. Width and
+ * precision given as '*' are not supported. Without C11 _Generic, BINLOG()
+ * falls back to log_message().
+ *
+ * Records use the level filter and line format of log_message(). Full rings
+ * drop records and count them (binlog_dropped()). A thread's ring is handed to
+ * the next new thread when it exits, so short-lived threads do not leak rings.
+ *
+ * The thread registry is shared across translation units: define
+ * BINLOG_IMPLEMENTATION in exactly one source file before including this
+ * header.
+ */
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include "hrclock.h"
+#include <stdint.h>
+
+#ifndef UTILS_HAVE_ATOMICS
+#error "binlog.h needs C11 atomics or GCC-compatible atomic builtins"
+#endif
+
+/**
+ * @brief Bytes per thread ring buffer; must be a power of two
+ */
+#ifndef BINLOG_BUFFER_BYTES
+#define BINLOG_BUFFER_BYTES (1 << 20)
+#endif
+
+/**
+ * @brief Longest string argument kept; longer strings are truncated
+ */
+#ifndef BINLOG_STRING_MAX
+#define BINLOG_STRING_MAX 1024
+#endif
+
+/**
+ * @brief Milliseconds between background flushes
+ */
+#ifndef BINLOG_FLUSH_MS
+#define BINLOG_FLUSH_MS 10
+#endif
+
+#define BINLOG_MAX_ARGS 9
+#define BINLOG_LINE_MAX 4096
+#define BINLOG_MAGIC "BINLOG1\n"
+
+/* Record kinds in the ring */
+#define BINLOG_PAD 0
+#define BINLOG_RECORD 1
+
+/**
+ * @brief Static description of one BINLOG() call site
+ */
+typedef struct {
+  const char *format;
+  const char *file;
+  unsigned line;
+  LogLevel level;
+  unsigned nargs;
+  unsigned char types[BINLOG_MAX_ARGS];
+  uint32_t id; /* Assigned by the writer, 0 until first written */
+} BinlogSite;
+
+/**
+ * @brief Header of each record in a ring; arguments follow
+ */
+typedef struct {
+  uint32_t size; /* Bytes including this header, multiple of 8 */
+  uint32_t kind; /* BINLOG_RECORD, or BINLOG_PAD up to the ring end */
+  const BinlogSite *site;
+  uint64_t ns; /* hrclock_ns() at the call */
+} BinlogHeader;
+
+/**
+ * @brief Single-producer, single-consumer byte ring owned by one thread
+ */
+typedef struct BinlogBuffer {
+  UTILS_ATOMIC size_t head; /* Bytes written; advanced by the owner */
+  UTILS_ATOMIC size_t tail; /* Bytes consumed; advanced by the writer */
+  UTILS_ATOMIC uint64_t dropped;
+  UTILS_ATOMIC int owned; /* Cleared when the owning thread exits */
+  struct BinlogBuffer *next;
+  unsigned char data[BINLOG_BUFFER_BYTES];
+} BinlogBuffer;
+
+/* ========== SHARED STATE ========== */
+
+#ifdef BINLOG_IMPLEMENTATION
+UTILS_ATOMIC int binlog_active;
+BinlogBuffer *UTILS_ATOMIC binlog_buffers;
+UTILS_THREAD_LOCAL BinlogBuffer *binlog_local;
+FILE *binlog_out;
+bool binlog_binary;
+uint32_t binlog_next_site;
+bool *binlog_sites_written;
+size_t binlog_sites_capacity;
+uint64_t binlog_origin_mono;
+int64_t binlog_origin_epoch;
+#ifdef UTILS_HAVE_THREADS
+pthread_mutex_t binlog_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_once_t binlog_key_once = PTHREAD_ONCE_INIT;
+pthread_key_t binlog_key;
+pthread_t binlog_flusher;
+UTILS_ATOMIC int binlog_flusher_state;
+#endif
+#else
+extern UTILS_ATOMIC int binlog_active;
+extern BinlogBuffer *UTILS_ATOMIC binlog_buffers;
+extern UTILS_THREAD_LOCAL BinlogBuffer *binlog_local;
+extern FILE *binlog_out;
+extern bool binlog_binary;
+extern uint32_t binlog_next_site;
+extern bool *binlog_sites_written;
+extern size_t binlog_sites_capacity;
+extern uint64_t binlog_origin_mono;
+extern int64_t binlog_origin_epoch;
+#ifdef UTILS_HAVE_THREADS
+extern pthread_mutex_t binlog_lock;
+extern pthread_once_t binlog_key_once;
+extern pthread_key_t binlog_key;
+extern pthread_t binlog_flusher;
+extern UTILS_ATOMIC int binlog_flusher_state;
+#endif
+#endif /* BINLOG_IMPLEMENTATION */
+
+/* ========== INTERNAL HELPERS ========== */
+
+#ifdef UTILS_HAVE_THREADS
+/* Hands the ring to the next new thread; unread records stay in it */
+static void binlog_release_thread(void *arg) {
+  UTILS_STORE_RELEASE(&((BinlogBuffer *)arg)->owned, 0);
+}
+
+static void binlog_create_key(void) {
+  pthread_key_create(&binlog_key, binlog_release_thread);
+}
+#endif
+
+/**
+ * @brief Give the calling thread a ring, reusing one from an exited thread
+ */
+static inline BinlogBuffer *binlog_register_thread(void) {
+  BinlogBuffer *b;
+
+  for (b = UTILS_LOAD_ACQUIRE(&binlog_buffers); b != NULL; b = b->next) {
+    int expected = 0;
+    if (UTILS_LOAD_RELAXED(&b->owned) == 0 &&
+        UTILS_CAS(&b->owned, &expected, 1))
+      break;
+  }
+
+  if (b == NULL) {
+    b = (BinlogBuffer *)safe_calloc(1, sizeof(BinlogBuffer));
+    b->owned = 1;
+    BinlogBuffer *head = UTILS_LOAD(&binlog_buffers);
+    do {
+      b->next = head;
+    } while (!UTILS_CAS(&binlog_buffers, &head, b));
+  }
+
+#ifdef UTILS_HAVE_THREADS
+  pthread_once(&binlog_key_once, binlog_create_key);
+  pthread_setspecific(binlog_key, b);
+#endif
+  binlog_local = b;
+  return b;
+}
+
+static inline bool binlog_is_signed(unsigned char type) {
+  return type == 'i' || type == 'l' || type == 'q';
+}
+
+/**
+ * @brief Width in bits of the argument behind a type tag
+ */
+static inline unsigned binlog_type_bits(unsigned char type) {
+  if (type == 'i' || type == 'u')
+    return (unsigned)sizeof(int) * 8;
+  if (type == 'l' || type == 'L')
+    return (unsigned)sizeof(long) * 8;
+  return 64;
+}
+
+/**
+ * @brief Bytes an argument list occupies once encoded
+ */
+static inline size_t binlog_args_size(const BinlogSite *site, va_list args) {
+  size_t size = 0;
+  for (unsigned i = 0; i < site->nargs; i++) {
+    switch (site->types[i]) {
+    case 's': {
+      const char *s = va_arg(args, const char *);
+      size_t len = s != NULL ? strlen(s) : 6;
+      size += 4 + (len < BINLOG_STRING_MAX ? len : BINLOG_STRING_MAX) + 1;
+      break;
+    }
+    case 'i':
+    case 'u':
+      (void)va_arg(args, int);
+      size += 8;
+      break;
+    case 'l':
+    case 'L':
+      (void)va_arg(args, long);
+      size += 8;
+      break;
+    case 'q':
+    case 'Q':
+      (void)va_arg(args, long long);
+      size += 8;
+      break;
+    case 'd':
+      (void)va_arg(args, double);
+      size += 8;
+      break;
+    default:
+      (void)va_arg(args, void *);
+      size += 8;
+      break;
+    }
+  }
+  return size;
+}
+
+/**
+ * @brief Encode arguments: 8 bytes per scalar, u32 length + bytes + NUL per
+ * string
+ */
+static inline void binlog_encode_args(unsigned char *p, const BinlogSite *site,
+                                      va_list args) {
+  for (unsigned i = 0; i < site->nargs; i++) {
+    uint64_t value;
+    switch (site->types[i]) {
+    case 's': {
+      const char *s = va_arg(args, const char *);
+      if (s == NULL)
+        s = "(null)";
+      size_t len = strlen(s);
+      uint32_t n =
+          (uint32_t)(len < BINLOG_STRING_MAX ? len : BINLOG_STRING_MAX);
+      memcpy(p, &n, 4);
+      memcpy(p + 4, s, n);
+      p[4 + n] = '\0';
+      p += 4 + n + 1;
+      continue;
+    }
+    case 'i':
+      value = (uint64_t)(int64_t)va_arg(args, int);
+      break;
+    case 'u':
+      value = va_arg(args, unsigned int);
+      break;
+    case 'l':
+      value = (uint64_t)(int64_t)va_arg(args, long);
+      break;
+    case 'L':
+      value = va_arg(args, unsigned long);
+      break;
+    case 'q':
+      value = (uint64_t)va_arg(args, long long);
+      break;
+    case 'Q':
+      value = va_arg(args, unsigned long long);
+      break;
+    case 'd': {
+      double d = va_arg(args, double);
+      memcpy(&value, &d, 8);
+      break;
+    }
+    default:
+      value = (uint64_t)(uintptr_t)va_arg(args, void *);
+      break;
+    }
+    memcpy(p, &value, 8);
+    p += 8;
+  }
+}
+
+/**
+ * @brief printf one conversion with a decoded argument
+ */
+static inline int binlog_format_one(char *out, size_t size, char *spec,
+                                    size_t spec_len, char conv,
+                                    unsigned char type, const unsigned char *p,
+                                    const unsigned char *end) {
+  uint64_t raw = 0;
+
+  if (type == 's') {
+    uint32_t n;
+    if (end - p < 4)
+      return -1;
+    memcpy(&n, p, 4);
+    if ((size_t)(end - p) < 4 + (size_t)n + 1)
+      return -1;
+    if (conv != 's')
+      return snprintf(out, size, "(?)");
+    spec[spec_len++] = 's';
+    spec[spec_len] = '\0';
+    return snprintf(out, size, spec, (const char *)p + 4);
+  }
+
+  if (end - p < 8)
+    return -1;
+  memcpy(&raw, p, 8);
+
+  if (strchr("eEfFgGaA", conv) != NULL) {
+    double d;
+    if (type == 'd')
+      memcpy(&d, &raw, 8);
+    else if (binlog_is_signed(type))
+      d = (double)(int64_t)raw;
+    else
+      d = (double)raw;
+    spec[spec_len++] = conv;
+    spec[spec_len] = '\0';
+    return snprintf(out, size, spec, d);
+  }
+
+  if (conv == 'p') {
+    spec[spec_len++] = 'p';
+    spec[spec_len] = '\0';
+    return snprintf(out, size, spec, (void *)(uintptr_t)raw);
+  }
+
+  if (conv == 's')
+    return snprintf(out, size, "(?)");
+
+  if (type == 'd') {
+    double d;
+    memcpy(&d, &raw, 8);
+    raw = (uint64_t)(int64_t)d;
+  }
+
+  /* Print at the argument's own width, as printf would: -1 is ffffffff */
+  unsigned bits = binlog_type_bits(type);
+  if (bits < 64) {
+    uint64_t mask = (1ULL << bits) - 1;
+    raw &= mask;
+    if ((conv == 'd' || conv == 'i') && (raw >> (bits - 1)) != 0)
+      raw |= ~mask;
+  }
+  if (conv == 'c') {
+    spec[spec_len++] = 'c';
+    spec[spec_len] = '\0';
+    return snprintf(out, size, spec, (int)raw);
+  }
+  spec[spec_len++] = 'l';
+  spec[spec_len++] = 'l';
+  spec[spec_len++] = conv;
+  spec[spec_len] = '\0';
+  if (conv == 'd' || conv == 'i')
+    return snprintf(out, size, spec, (long long)(int64_t)raw);
+  return snprintf(out, size, spec, (unsigned long long)raw);
+}
+
+/**
+ * @brief Size of one encoded argument at p, or 0 if truncated
+ */
+static inline size_t binlog_arg_size(unsigned char type,
+                                     const unsigned char *p,
+                                     const unsigned char *end) {
+  if (type != 's')
+    return end - p >= 8 ? 8 : 0;
+  uint32_t n;
+  if (end - p < 4)
+    return 0;
+  memcpy(&n, p, 4);
+  return (size_t)(end - p) >= 4 + (size_t)n + 1 ? 4 + (size_t)n + 1 : 0;
+}
+
+/**
+ * @brief Expand a format string with encoded arguments
+ *
+ * @return size_t Length written (truncated to size - 1)
+ */
+static inline size_t binlog_format_message(char *out, size_t size,
+                                           const char *format,
+                                           const unsigned char *types,
+                                           unsigned nargs,
+                                           const unsigned char *args,
+                                           size_t args_len) {
+  const unsigned char *p = args;
+  const unsigned char *end = args + args_len;
+  unsigned arg = 0;
+  size_t len = 0;
+
+  if (size == 0)
+    return 0;
+
+  for (const char *f = format; *f != '\0' && len < size - 1; f++) {
+    if (*f != '%' || f[1] == '%') {
+      out[len++] = *f;
+      f += (*f == '%');
+      continue;
+    }
+
+    /* %[flags][width][.precision][length]conversion */
+    char spec[40];
+    size_t spec_len = 0;
+    bool star = false;
+    const char *start = f++;
+    spec[spec_len++] = '%';
+    while (*f != '\0' && strchr("-+ #0123456789.*", *f) != NULL &&
+           spec_len < 24) {
+      star |= *f == '*';
+      spec[spec_len++] = *f++;
+    }
+    while (*f != '\0' && strchr("hljztL", *f) != NULL)
+      f++;
+    /* '*' would read its width from an argument that was never recorded */
+    if (*f == '\0' || arg >= nargs || star) {
+      size_t n = (size_t)(f - start) + (*f != '\0');
+      if (n > size - 1 - len)
+        n = size - 1 - len;
+      memcpy(out + len, start, n);
+      len += n;
+      if (*f == '\0')
+        break;
+      continue;
+    }
+
+    int n = binlog_format_one(out + len, size - len, spec, spec_len, *f,
+                              types[arg], p, end);
+    if (n < 0)
+      break;
+    len += (size_t)n < size - len ? (size_t)n : size - 1 - len;
+    p += binlog_arg_size(types[arg], p, end);
+    arg++;
+  }
+  out[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief Format "[timestamp] [LEVEL] message\n" the way log_message() does
+ */
+static inline size_t binlog_format_line(char *out, size_t size,
+                                        int64_t epoch_ns, LogLevel level,
+                                        const char *format,
+                                        const unsigned char *types,
+                                        unsigned nargs,
+                                        const unsigned char *args,
+                                        size_t args_len) {
+  static const char *names[] = {"DEBUG", "INFO", "WARNING", "ERROR", "FATAL"};
+  int flags = LOG_TIMESTAMP_FLAGS;
+  time_t seconds = (time_t)(epoch_ns / 1000000000);
+  long nanos = (long)(epoch_ns % 1000000000);
+  struct tm t;
+  char timestamp[32];
+
+#ifdef _WIN32
+  if (flags & TIMESTAMP_UTC)
+    gmtime_s(&t, &seconds);
+  else
+    localtime_s(&t, &seconds);
+#else
+  if (flags & TIMESTAMP_UTC)
+    gmtime_r(&seconds, &t);
+  else
+    localtime_r(&seconds, &t);
+#endif
+  size_t ts = strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &t);
+  if (flags & TIMESTAMP_US)
+    snprintf(timestamp + ts, sizeof(timestamp) - ts, ".%06ld", nanos / 1000);
+  else if (flags & TIMESTAMP_MS)
+    snprintf(timestamp + ts, sizeof(timestamp) - ts, ".%03ld",
+             nanos / 1000000);
+
+  int head = snprintf(out, size, "[%s] [%s] ", timestamp,
+                      names[level <= LOG_FATAL ? level : LOG_FATAL]);
+  size_t len = (size_t)head < size ? (size_t)head : size - 1;
+  len += binlog_format_message(out + len, size - len - 1, format, types, nargs,
+                               args, args_len);
+  out[len++] = '\n';
+  out[len] = '\0';
+  return len;
+}
+
+static inline void binlog_put_u32(FILE *f, uint32_t v) { fwrite(&v, 4, 1, f); }
+
+static inline void binlog_put_u64(FILE *f, uint64_t v) { fwrite(&v, 8, 1, f); }
+
+static inline void binlog_put_string(FILE *f, const char *s) {
+  uint32_t n = (uint32_t)strlen(s);
+  binlog_put_u32(f, n);
+  fwrite(s, 1, n, f);
+}
+
+/**
+ * @brief Write a site definition to the binary file the first time it is used
+ */
+static inline void binlog_write_site(BinlogSite *site) {
+  if (site->id == 0)
+    site->id = ++binlog_next_site;
+
+  if (site->id >= binlog_sites_capacity) {
+    size_t capacity = binlog_sites_capacity ? binlog_sites_capacity * 2 : 64;
+    while (capacity <= site->id)
+      capacity *= 2;
+    binlog_sites_written = (bool *)safe_realloc(binlog_sites_written,
+                                                capacity * sizeof(bool));
+    memset(binlog_sites_written + binlog_sites_capacity, 0,
+           (capacity - binlog_sites_capacity) * sizeof(bool));
+    binlog_sites_capacity = capacity;
+  }
+  if (binlog_sites_written[site->id])
+    return;
+
+  fputc('S', binlog_out);
+  binlog_put_u32(binlog_out, site->id);
+  fputc((int)site->level, binlog_out);
+  fputc((int)site->nargs, binlog_out);
+  fwrite(site->types, 1, site->nargs, binlog_out);
+  binlog_put_string(binlog_out, site->format);
+  binlog_put_string(binlog_out, site->file);
+  binlog_put_u32(binlog_out, site->line);
+  binlog_sites_written[site->id] = true;
+}
+
+/**
+ * @brief Write one record as text or binary
+ */
+static inline void binlog_write_record(const BinlogHeader *h) {
+  BinlogSite *site = (BinlogSite *)h->site;
+  const unsigned char *args = (const unsigned char *)(h + 1);
+  size_t args_len = h->size - sizeof(BinlogHeader);
+  int64_t epoch_ns =
+      binlog_origin_epoch + (int64_t)(h->ns - binlog_origin_mono);
+
+  if (binlog_binary) {
+    binlog_write_site(site);
+    fputc('R', binlog_out);
+    binlog_put_u32(binlog_out, site->id);
+    binlog_put_u64(binlog_out, (uint64_t)epoch_ns);
+    binlog_put_u32(binlog_out, (uint32_t)args_len);
+    fwrite(args, 1, args_len, binlog_out);
+    return;
+  }
+
+  char line[BINLOG_LINE_MAX];
+  size_t len = binlog_format_line(line, sizeof(line), epoch_ns, site->level,
+                                  site->format, site->types, site->nargs,
+                                  args, args_len);
+  fwrite(line, 1, len, binlog_out);
+}
+
+/* ========== RECORDING ========== */
+
+/**
+ * @brief Copy one call's arguments into the calling thread's ring
+ *
+ * Called by BINLOG(); the variadic arguments must match site->types.
+ */
+static inline void binlog_record(const BinlogSite *site, ...) {
+  if (!UTILS_LOAD_RELAXED(&binlog_active) || !log_enabled(site->level))
+    return;
+
+  uint64_t ns = hrclock_ns();
+  BinlogBuffer *b = binlog_local != NULL ? binlog_local
+                                         : binlog_register_thread();
+  va_list args;
+  va_start(args, site);
+  size_t size = sizeof(BinlogHeader) + binlog_args_size(site, args);
+  va_end(args);
+  size = (size + 7) & ~(size_t)7;
+
+  size_t head = UTILS_LOAD_RELAXED(&b->head);
+  size_t offset = head & (BINLOG_BUFFER_BYTES - 1);
+  size_t pad = BINLOG_BUFFER_BYTES - offset < size
+                   ? BINLOG_BUFFER_BYTES - offset
+                   : 0;
+  if (size > BINLOG_BUFFER_BYTES / 2 ||
+      head + pad + size - UTILS_LOAD_ACQUIRE(&b->tail) > BINLOG_BUFFER_BYTES) {
+    UTILS_STORE(&b->dropped, UTILS_LOAD_RELAXED(&b->dropped) + 1);
+    return;
+  }
+
+  if (pad > 0) {
+    BinlogHeader filler = {(uint32_t)pad, BINLOG_PAD, NULL, 0};
+    memcpy(b->data + offset, &filler, 8);
+    offset = 0;
+  }
+
+  BinlogHeader header = {(uint32_t)size, BINLOG_RECORD, site, ns};
+  memcpy(b->data + offset, &header, sizeof(header));
+  va_start(args, site);
+  binlog_encode_args(b->data + offset + sizeof(header), site, args);
+  va_end(args);
+  UTILS_STORE_RELEASE(&b->head, head + pad + size);
+}
+
+#define BINLOG_CONCAT_(a, b) a##b
+#define BINLOG_CONCAT(a, b) BINLOG_CONCAT_(a, b)
+
+#define BINLOG_NARGS(...)                                                      \
+  BINLOG_NARGS_(__VA_ARGS__, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, _)
+#define BINLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, _9, n, ...) n
+
+/**
+ * @brief Type tag of one argument after default argument promotion
+ */
+#define BINLOG_TYPE(x)                                                         \
+  _Generic((x),                                                                \
+      _Bool: 'i',                                                              \
+      char: 'i',                                                               \
+      signed char: 'i',                                                        \
+      unsigned char: 'i',                                                      \
+      short: 'i',                                                              \
+      unsigned short: 'i',                                                     \
+      int: 'i',                                                                \
+      unsigned int: 'u',                                                       \
+      long: 'l',                                                               \
+      unsigned long: 'L',                                                      \
+      long long: 'q',                                                          \
+      unsigned long long: 'Q',                                                 \
+      float: 'd',                                                              \
+      double: 'd',                                                             \
+      char *: 's',                                                             \
+      const char *: 's',                                                       \
+      void *: 'p',                                                             \
+      const void *: 'p')
+
+#define BINLOG_TYPES_0(f) 0
+#define BINLOG_TYPES_1(f, a) BINLOG_TYPE(a)
+#define BINLOG_TYPES_2(f, a, ...) BINLOG_TYPE(a), BINLOG_TYPES_1(f, __VA_ARGS__)
+#define BINLOG_TYPES_3(f, a, ...) BINLOG_TYPE(a), BINLOG_TYPES_2(f, __VA_ARGS__)
+#define BINLOG_TYPES_4(f, a, ...) BINLOG_TYPE(a), BINLOG_TYPES_3(f, __VA_ARGS__)
+#define BINLOG_TYPES_5(f, a, ...) BINLOG_TYPE(a), BINLOG_TYPES_4(f, __VA_ARGS__)
+#define BINLOG_TYPES_6(f, a, ...) BINLOG_TYPE(a), BINLOG_TYPES_5(f, __VA_ARGS__)
+#define BINLOG_TYPES_7(f, a, ...) BINLOG_TYPE(a), BINLOG_TYPES_6(f, __VA_ARGS__)
+#define BINLOG_TYPES_8(f, a, ...) BINLOG_TYPE(a), BINLOG_TYPES_7(f, __VA_ARGS__)
+#define BINLOG_TYPES_9(f, a, ...) BINLOG_TYPE(a), BINLOG_TYPES_8(f, __VA_ARGS__)
+#define BINLOG_TYPES(...)                                                      \
+  BINLOG_CONCAT(BINLOG_TYPES_, BINLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+/**
+ * @brief Log with deferred formatting: BINLOG(LOG_INFO, "x=%d", x)
+ *
+ * The format must be a string literal (or otherwise outlive the process's
+ * logging) and take at most BINLOG_MAX_ARGS arguments.
+ */
+#define BINLOG(level, ...)                                                     \
+  do {                                                                         \
+    static BinlogSite binlog_site_ = {                                         \
+        BINLOG_FIRST(__VA_ARGS__, _), __FILE__, __LINE__, level,               \
+        BINLOG_NARGS(__VA_ARGS__), {BINLOG_TYPES(__VA_ARGS__)}, 0};            \
+    binlog_record(&binlog_site_ BINLOG_REST(__VA_ARGS__));                     \
+  } while (0)
+#define BINLOG_FIRST(f, ...) f
+#define BINLOG_REST(...)                                                       \
+  BINLOG_CONCAT(BINLOG_REST_, BINLOG_HAS_ARGS(__VA_ARGS__))(__VA_ARGS__)
+#define BINLOG_HAS_ARGS(...)                                                   \
+  BINLOG_NARGS_(__VA_ARGS__, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, _)
+#define BINLOG_REST_0(f)
+#define BINLOG_REST_1(f, ...) , __VA_ARGS__
+#else
+#define BINLOG(level, ...) log_message(level, __VA_ARGS__)
+#endif
+
+/* ========== OUTPUT ========== */
+
+/**
+ * @brief Drain every thread's ring to the output
+ *
+ * Safe to call from any thread while others keep logging.
+ *
+ * @return size_t Number of records written
+ */
+static inline size_t binlog_flush(void) {
+  size_t written = 0;
+
+#ifdef UTILS_HAVE_THREADS
+  pthread_mutex_lock(&binlog_lock);
+#endif
+  if (binlog_out == NULL)
+    goto done;
+
+  for (BinlogBuffer *b = UTILS_LOAD_ACQUIRE(&binlog_buffers); b != NULL;
+       b = b->next) {
+    size_t head = UTILS_LOAD_ACQUIRE(&b->head);
+    size_t tail = UTILS_LOAD_RELAXED(&b->tail);
+
+    while (tail != head) {
+      BinlogHeader h;
+      const unsigned char *p = b->data + (tail & (BINLOG_BUFFER_BYTES - 1));
+      memcpy(&h, p, 8);
+      if (h.kind == BINLOG_RECORD) {
+        binlog_write_record((const BinlogHeader *)p);
+        written++;
+      }
+      tail += h.size;
+    }
+    UTILS_STORE_RELEASE(&b->tail, tail);
+  }
+  fflush(binlog_out);
+
+done:
+#ifdef UTILS_HAVE_THREADS
+  pthread_mutex_unlock(&binlog_lock);
+#endif
+  return written;
+}
+
+/**
+ * @brief Records lost because a ring buffer was full
+ */
+static inline uint64_t binlog_dropped(void) {
+  uint64_t total = 0;
+  for (BinlogBuffer *b = UTILS_LOAD_ACQUIRE(&binlog_buffers); b != NULL;
+       b = b->next)
+    total += UTILS_LOAD(&b->dropped);
+  return total;
+}
+
+#ifdef UTILS_HAVE_THREADS
+static void *binlog_flusher_main(void *arg) {
+  struct timespec delay = {BINLOG_FLUSH_MS / 1000,
+                           (BINLOG_FLUSH_MS % 1000) * 1000000L};
+  (void)arg;
+
+  while (UTILS_LOAD_ACQUIRE(&binlog_flusher_state) == 1) {
+    nanosleep(&delay, NULL);
+    binlog_flush();
+  }
+  return NULL;
+}
+#endif
+
+/**
+ * @brief Start capturing BINLOG() records
+ *
+ * Text output appends log_message()-style lines to path (stdout if NULL).
+ * Binary output writes path for later decoding with binlog_decode(). On POSIX
+ * systems a background thread flushes every BINLOG_FLUSH_MS; elsewhere call
+ * binlog_flush() periodically.
+ *
+ * @param path Output file, or NULL for stdout (text only)
+ * @param binary true for the binary format
+ * @return true on success, false if the file cannot be opened or capture is
+ * already running
+ */
+static inline bool binlog_start(const char *path, bool binary) {
+  if (binlog_out != NULL || (binary && path == NULL))
+    return false;
+
+  if (path == NULL) {
+    binlog_out = stdout;
+  } else {
+    binlog_out = fopen(path, binary ? "wb" : "a");
+    if (binlog_out == NULL) {
+      fprintf(stderr, "Error: Could not open log file %s\n", path);
+      return false;
+    }
+  }
+  binlog_binary = binary;
+
+  /* Discard records left over from a previous capture */
+  for (BinlogBuffer *b = UTILS_LOAD_ACQUIRE(&binlog_buffers); b != NULL;
+       b = b->next) {
+    UTILS_STORE_RELEASE(&b->tail, UTILS_LOAD_ACQUIRE(&b->head));
+    UTILS_STORE(&b->dropped, 0);
+  }
+  if (binlog_sites_written != NULL)
+    memset(binlog_sites_written, 0, binlog_sites_capacity * sizeof(bool));
+
+  struct timespec now;
+#ifdef TIME_UTC
+  timespec_get(&now, TIME_UTC);
+#else
+  clock_gettime(CLOCK_REALTIME, &now);
+#endif
+  binlog_origin_mono = hrclock_ns();
+  binlog_origin_epoch = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+  if (binary)
+    fwrite(BINLOG_MAGIC, 1, sizeof(BINLOG_MAGIC) - 1, binlog_out);
+
+  UTILS_STORE(&binlog_active, 1);
+#ifdef UTILS_HAVE_THREADS
+  UTILS_STORE_RELEASE(&binlog_flusher_state, 1);
+  if (pthread_create(&binlog_flusher, NULL, binlog_flusher_main, NULL) != 0)
+    UTILS_STORE(&binlog_flusher_state, 0);
+#endif
+  return true;
+}
+
+/**
+ * @brief Stop capturing, write remaining records and close the output
+ *
+ * @return uint64_t Records dropped during the capture
+ */
+static inline uint64_t binlog_stop(void) {
+  UTILS_STORE(&binlog_active, 0);
+
+#ifdef UTILS_HAVE_THREADS
+  if (UTILS_LOAD(&binlog_flusher_state) == 1) {
+    UTILS_STORE_RELEASE(&binlog_flusher_state, 0);
+    pthread_join(binlog_flusher, NULL);
+  }
+#endif
+
+  binlog_flush();
+  uint64_t dropped = binlog_dropped();
+
+#ifdef UTILS_HAVE_THREADS
+  pthread_mutex_lock(&binlog_lock);
+#endif
+  if (binlog_out != NULL) {
+    if (binlog_binary && dropped > 0) {
+      fputc('D', binlog_out);
+      binlog_put_u64(binlog_out, dropped);
+    }
+    if (binlog_out != stdout)
+      fclose(binlog_out);
+    else
+      fflush(binlog_out);
+    binlog_out = NULL;
+  }
+#ifdef UTILS_HAVE_THREADS
+  pthread_mutex_unlock(&binlog_lock);
+#endif
+  return dropped;
+}
+
+/* ========== DECODING ========== */
+
+typedef struct {
+  char *format;
+  LogLevel level;
+  unsigned nargs;
+  unsigned char types[BINLOG_MAX_ARGS];
+} BinlogDecodedSite;
+
+static inline bool binlog_get_u32(FILE *f, uint32_t *v) {
+  return fread(v, 4, 1, f) == 1;
+}
+
+static inline char *binlog_get_string(FILE *f) {
+  uint32_t n;
+  if (!binlog_get_u32(f, &n) || n > (1u << 20))
+    return NULL;
+  char *s = (char *)safe_malloc(n + 1);
+  if (fread(s, 1, n, f) != n) {
+    free(s);
+    return NULL;
+  }
+  s[n] = '\0';
+  return s;
+}
+
+/**
+ * @brief Convert a binary log written by binlog_start(path, true) to text
+ *
+ * @param in Binary log opened for reading
+ * @param out Destination for log_message()-style lines
+ * @return true if the whole input was valid
+ */
+static inline bool binlog_decode(FILE *in, FILE *out) {
+  char magic[sizeof(BINLOG_MAGIC) - 1];
+  BinlogDecodedSite *sites = NULL;
+  size_t capacity = 0;
+  unsigned char *args = NULL;
+  size_t args_capacity = 0;
+  bool ok = false;
+  int kind;
+
+  if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) ||
+      memcmp(magic, BINLOG_MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "Error: Not a binary log\n");
+    return false;
+  }
+
+  while ((kind = fgetc(in)) != EOF) {
+    uint32_t id;
+    if (kind == 'D') {
+      uint64_t dropped;
+      if (fread(&dropped, 8, 1, in) != 1)
+        goto done;
+      fprintf(out, "(%llu records dropped)\n", (unsigned long long)dropped);
+      continue;
+    }
+    if ((kind != 'S' && kind != 'R') || !binlog_get_u32(in, &id))
+      goto done;
+
+    if (kind == 'S') {
+      if (id >= capacity) {
+        size_t grown = capacity ? capacity : 64;
+        while (grown <= id)
+          grown *= 2;
+        sites = (BinlogDecodedSite *)safe_realloc(
+            sites, grown * sizeof(BinlogDecodedSite));
+        memset(sites + capacity, 0,
+               (grown - capacity) * sizeof(BinlogDecodedSite));
+        capacity = grown;
+      }
+      BinlogDecodedSite *s = &sites[id];
+      int level = fgetc(in);
+      int nargs = fgetc(in);
+      uint32_t line;
+      if (level < 0 || level > LOG_FATAL || nargs < 0 ||
+          nargs > BINLOG_MAX_ARGS ||
+          fread(s->types, 1, (size_t)nargs, in) != (size_t)nargs)
+        goto done;
+      free(s->format);
+      s->format = binlog_get_string(in);
+      char *file = binlog_get_string(in);
+      bool complete =
+          s->format != NULL && file != NULL && binlog_get_u32(in, &line);
+      free(file);
+      if (!complete)
+        goto done;
+      s->level = (LogLevel)level;
+      s->nargs = (unsigned)nargs;
+      continue;
+    }
+
+    uint64_t epoch_ns;
+    uint32_t args_len;
+    if (id >= capacity || sites[id].format == NULL ||
+        fread(&epoch_ns, 8, 1, in) != 1 || !binlog_get_u32(in, &args_len) ||
+        args_len > BINLOG_BUFFER_BYTES)
+      goto done;
+    if (args_len > args_capacity) {
+      args = (unsigned char *)safe_realloc(args, args_len);
+      args_capacity = args_len;
+    }
+    if (fread(args, 1, args_len, in) != args_len)
+      goto done;
+
+    char line[BINLOG_LINE_MAX];
+    size_t len = binlog_format_line(
+        line, sizeof(line), (int64_t)epoch_ns, sites[id].level,
+        sites[id].format, sites[id].types, sites[id].nargs, args, args_len);
+    fwrite(line, 1, len, out);
+  }
+  ok = true;
+
+done:
+  if (!ok)
+    fprintf(stderr, "Error: Truncated or corrupt binary log\n");
+  for (size_t i = 0; i < capacity; i++)
+    free(sites[i].format);
+  free(sites);
+  free(args);
+  return ok;
+}
+
+#endif /* BINLOG_H */
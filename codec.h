@@ -0,0 +1,1077 @@
+/**
+ * @file codec.h
+ * @brief Base64 and hex encoding and decoding
+ * @author pucitos
+ *
+ * Codecs for binary blobs in logs and wire formats. On x86 the bulk of the
+ * work runs in AVX2 or SSSE3 code selected at runtime; every other platform,
+ * and every input tail, uses table-driven scalar code that produces identical
+ * output. Define CODEC_NO_SIMD to force the scalar paths.
+ *
+ * Decoders never write past the decoded length and never write ahead of the
+ * input they have consumed, so dst may be the same buffer as src for in-place
+ * decoding.
+ */
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "utils.h"
+#include <stdint.h>
+
+#if !defined(CODEC_NO_SIMD) && defined(__GNUC__) &&                           \
+    (defined(__x86_64__) || defined(__i386__))
+#define CODEC_X86 1
+#include <immintrin.h>
+#define CODEC_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+/**
+ * @brief Base64 flags
+ */
+#define BASE64_URL 0x1    /* URL-safe alphabet with '-' and '_' */
+#define BASE64_NOPAD 0x2  /* Omit '=' padding when encoding */
+#define BASE64_STRICT 0x4 /* Reject whitespace, bad padding, stray bits */
+
+/**
+ * @brief Hex flags
+ */
+#define HEX_UPPER 0x1 /* Encode with uppercase digits */
+
+/**
+ * @brief Streaming base64 encoder state
+ */
+typedef struct {
+  int flags;
+  int carry_len;
+  unsigned char carry[2];
+} Base64Encoder;
+
+/**
+ * @brief Streaming base64 decoder state
+ */
+typedef struct {
+  int flags;
+  int quad_len;
+  int pad;
+  bool done;
+  bool failed;
+  unsigned char quad[4];
+} Base64Decoder;
+
+/**
+ * @brief Streaming hex decoder state
+ */
+typedef struct {
+  int pending; /* high nibble waiting for its pair, or -1 */
+  bool failed;
+} HexDecoder;
+
+/* Scalar lookup: 0-63 digit, -1 invalid, -2 whitespace, -3 padding. Both
+ * alphabets are accepted here; strict mode checks the exact characters. */
+static const int8_t base64_decode_table[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -2, -2, -1, -1, -2, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, 62, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -3, -1, -1,
+    -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static const int8_t hex_decode_table[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/* ========== INTERNAL HELPERS ========== */
+
+static inline const char *base64_alphabet(int flags) {
+  return (flags & BASE64_URL) ? "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                "abcdefghijklmnopqrstuvwxyz0123456789-_"
+                              : "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                "abcdefghijklmnopqrstuvwxyz0123456789+/";
+}
+
+/**
+ * @brief Check that a decoded digit came from the selected alphabet
+ */
+static inline bool base64_digit_ok(unsigned char c, int value, int flags) {
+  if (value < 62 || !(flags & BASE64_STRICT))
+    return true;
+  return c == (unsigned char)base64_alphabet(flags)[value];
+}
+
+#ifdef CODEC_X86
+
+CODEC_TARGET("ssse3")
+static inline __m128i base64_lookup_ssse3(__m128i idx, int flags) {
+  char c62 = (flags & BASE64_URL) ? '-' : '+';
+  char c63 = (flags & BASE64_URL) ? '_' : '/';
+  const __m128i shift = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, (char)(c62 - 62),
+      (char)(c63 - 63), 'A', 0, 0);
+  __m128i result = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+  __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+  result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+  return _mm_add_epi8(_mm_shuffle_epi8(shift, result), idx);
+}
+
+CODEC_TARGET("ssse3")
+static inline size_t base64_encode_ssse3(const unsigned char *src, size_t len,
+                                         char *dst, int flags) {
+  const __m128i shuf =
+      _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 12, dst += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+    in = _mm_shuffle_epi8(in, shuf);
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    __m128i idx = _mm_or_si128(t1, t3);
+    _mm_storeu_si128((__m128i *)dst, base64_lookup_ssse3(idx, flags));
+  }
+  return i;
+}
+
+CODEC_TARGET("avx2")
+static inline __m256i base64_lookup_avx2(__m256i idx, int flags) {
+  char c62 = (flags & BASE64_URL) ? '-' : '+';
+  char c63 = (flags & BASE64_URL) ? '_' : '/';
+  const __m256i shift = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, (char)(c62 - 62),
+      (char)(c63 - 63), 'A', 0, 0, 'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      (char)(c62 - 62), (char)(c63 - 63), 'A', 0, 0);
+  __m256i result = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+  __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+  result =
+      _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+  return _mm256_add_epi8(_mm256_shuffle_epi8(shift, result), idx);
+}
+
+CODEC_TARGET("avx2")
+static inline size_t base64_encode_avx2(const unsigned char *src, size_t len,
+                                        char *dst, int flags) {
+  const __m256i shuf = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10,
+                                        9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6,
+                                        8, 7, 10, 9, 11, 10);
+  size_t i = 0;
+
+  for (; i + 28 <= len; i += 24, dst += 32) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i hi = _mm_loadu_si128((const __m128i *)(src + i + 12));
+    __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    in = _mm256_shuffle_epi8(in, shuf);
+    __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    __m256i idx = _mm256_or_si256(t1, t3);
+    _mm256_storeu_si256((__m256i *)dst, base64_lookup_avx2(idx, flags));
+  }
+  return i;
+}
+
+/**
+ * @brief Decode 16 characters into 12 bytes
+ *
+ * @return true if all 16 characters belonged to the alphabet
+ */
+CODEC_TARGET("ssse3")
+static inline bool base64_decode16_ssse3(const char *src, unsigned char *dst,
+                                         int flags) {
+  char c62 = (flags & BASE64_URL) ? '-' : '+';
+  char c63 = (flags & BASE64_URL) ? '_' : '/';
+  __m128i v = _mm_loadu_si128((const __m128i *)src);
+
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+  __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  __m128i s62 = _mm_cmpeq_epi8(v, _mm_set1_epi8(c62));
+  __m128i s63 = _mm_cmpeq_epi8(v, _mm_set1_epi8(c63));
+  __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower),
+                               _mm_or_si128(digit, _mm_or_si128(s62, s63)));
+  if (_mm_movemask_epi8(valid) != 0xffff)
+    return false;
+
+  __m128i delta = _mm_and_si128(upper, _mm_set1_epi8(-65));
+  delta = _mm_or_si128(delta, _mm_and_si128(lower, _mm_set1_epi8(-71)));
+  delta = _mm_or_si128(delta, _mm_and_si128(digit, _mm_set1_epi8(4)));
+  delta = _mm_or_si128(delta,
+                       _mm_and_si128(s62, _mm_set1_epi8((char)(62 - c62))));
+  delta = _mm_or_si128(delta,
+                       _mm_and_si128(s63, _mm_set1_epi8((char)(63 - c63))));
+  v = _mm_add_epi8(v, delta);
+
+  v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+  v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+  v = _mm_shuffle_epi8(
+      v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+  uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+  _mm_storel_epi64((__m128i *)dst, v);
+  memcpy(dst + 8, &tail, 4);
+  return true;
+}
+
+/**
+ * @brief Decode 32 characters into 24 bytes
+ *
+ * @return true if all 32 characters belonged to the alphabet
+ */
+CODEC_TARGET("avx2")
+static inline bool base64_decode32_avx2(const char *src, unsigned char *dst,
+                                        int flags) {
+  char c62 = (flags & BASE64_URL) ? '-' : '+';
+  char c63 = (flags & BASE64_URL) ? '_' : '/';
+  __m256i v = _mm256_loadu_si256((const __m256i *)src);
+
+  __m256i upper =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+  __m256i lower =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+  __m256i digit =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+  __m256i s62 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c62));
+  __m256i s63 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c63));
+  __m256i valid =
+      _mm256_or_si256(_mm256_or_si256(upper, lower),
+                      _mm256_or_si256(digit, _mm256_or_si256(s62, s63)));
+  if (_mm256_movemask_epi8(valid) != -1)
+    return false;
+
+  __m256i delta = _mm256_and_si256(upper, _mm256_set1_epi8(-65));
+  delta =
+      _mm256_or_si256(delta, _mm256_and_si256(lower, _mm256_set1_epi8(-71)));
+  delta = _mm256_or_si256(delta, _mm256_and_si256(digit, _mm256_set1_epi8(4)));
+  delta = _mm256_or_si256(
+      delta, _mm256_and_si256(s62, _mm256_set1_epi8((char)(62 - c62))));
+  delta = _mm256_or_si256(
+      delta, _mm256_and_si256(s63, _mm256_set1_epi8((char)(63 - c63))));
+  v = _mm256_add_epi8(v, delta);
+
+  v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+  v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+  v = _mm256_shuffle_epi8(
+      v, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1,
+                          -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+                          -1, -1));
+  v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+  _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(v));
+  _mm_storel_epi64((__m128i *)(dst + 16), _mm256_extracti128_si256(v, 1));
+  return true;
+}
+
+CODEC_TARGET("ssse3")
+static inline size_t hex_encode_ssse3(const unsigned char *src, size_t len,
+                                      char *dst, int flags) {
+  const __m128i lut = (flags & HEX_UPPER)
+                          ? _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6',
+                                          '7', '8', '9', 'A', 'B', 'C', 'D',
+                                          'E', 'F')
+                          : _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6',
+                                          '7', '8', '9', 'a', 'b', 'c', 'd',
+                                          'e', 'f');
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16, dst += 32) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i hi = _mm_shuffle_epi8(
+        lut, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+    __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, nibble));
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+  return i;
+}
+
+CODEC_TARGET("avx2")
+static inline size_t hex_encode_avx2(const unsigned char *src, size_t len,
+                                     char *dst, int flags) {
+  const __m256i lut = (flags & HEX_UPPER)
+                          ? _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6',
+                                             '7', '8', '9', 'A', 'B', 'C', 'D',
+                                             'E', 'F', '0', '1', '2', '3', '4',
+                                             '5', '6', '7', '8', '9', 'A', 'B',
+                                             'C', 'D', 'E', 'F')
+                          : _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6',
+                                             '7', '8', '9', 'a', 'b', 'c', 'd',
+                                             'e', 'f', '0', '1', '2', '3', '4',
+                                             '5', '6', '7', '8', '9', 'a', 'b',
+                                             'c', 'd', 'e', 'f');
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32, dst += 64) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i hi = _mm256_shuffle_epi8(
+        lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, nibble));
+    __m256i a = _mm256_unpacklo_epi8(hi, lo);
+    __m256i b = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256((__m256i *)dst, _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + 32),
+                        _mm256_permute2x128_si256(a, b, 0x31));
+  }
+  return i;
+}
+
+CODEC_TARGET("ssse3")
+static inline __m128i hex_values_ssse3(__m128i v, __m128i *valid) {
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(folded, _mm_set1_epi8('f' + 1)));
+  *valid = _mm_or_si128(digit, alpha);
+  return _mm_or_si128(
+      _mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+      _mm_and_si128(alpha, _mm_sub_epi8(folded, _mm_set1_epi8('a' - 10))));
+}
+
+CODEC_TARGET("ssse3")
+static inline size_t hex_decode_ssse3(const char *src, size_t len,
+                                      unsigned char *dst) {
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32, dst += 16) {
+    __m128i ok_a, ok_b;
+    __m128i a = hex_values_ssse3(_mm_loadu_si128((const __m128i *)(src + i)),
+                                 &ok_a);
+    __m128i b = hex_values_ssse3(
+        _mm_loadu_si128((const __m128i *)(src + i + 16)), &ok_b);
+    if (_mm_movemask_epi8(_mm_and_si128(ok_a, ok_b)) != 0xffff)
+      break;
+    a = _mm_maddubs_epi16(a, _mm_set1_epi16(0x0110));
+    b = _mm_maddubs_epi16(b, _mm_set1_epi16(0x0110));
+    _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(a, b));
+  }
+  return i;
+}
+
+CODEC_TARGET("avx2")
+static inline __m256i hex_values_avx2(__m256i v, __m256i *valid) {
+  __m256i digit =
+      _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+  __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i alpha =
+      _mm256_and_si256(_mm256_cmpgt_epi8(folded, _mm256_set1_epi8('a' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), folded));
+  *valid = _mm256_or_si256(digit, alpha);
+  return _mm256_or_si256(
+      _mm256_and_si256(digit, _mm256_sub_epi8(v, _mm256_set1_epi8('0'))),
+      _mm256_and_si256(alpha,
+                       _mm256_sub_epi8(folded, _mm256_set1_epi8('a' - 10))));
+}
+
+CODEC_TARGET("avx2")
+static inline size_t hex_decode_avx2(const char *src, size_t len,
+                                     unsigned char *dst) {
+  size_t i = 0;
+
+  for (; i + 64 <= len; i += 64, dst += 32) {
+    __m256i ok_a, ok_b;
+    __m256i a = hex_values_avx2(
+        _mm256_loadu_si256((const __m256i *)(src + i)), &ok_a);
+    __m256i b = hex_values_avx2(
+        _mm256_loadu_si256((const __m256i *)(src + i + 32)), &ok_b);
+    if (_mm256_movemask_epi8(_mm256_and_si256(ok_a, ok_b)) != -1)
+      break;
+    a = _mm256_maddubs_epi16(a, _mm256_set1_epi16(0x0110));
+    b = _mm256_maddubs_epi16(b, _mm256_set1_epi16(0x0110));
+    __m256i packed = _mm256_packus_epi16(a, b);
+    _mm256_storeu_si256((__m256i *)dst,
+                        _mm256_permute4x64_epi64(packed, 0xd8));
+  }
+  return i;
+}
+
+#endif /* CODEC_X86 */
+
+/**
+ * @brief Encode whole 3-byte groups
+ *
+ * @return size_t Number of input bytes consumed (a multiple of 3)
+ */
+static inline size_t base64_encode_groups(const unsigned char *src, size_t len,
+                                          char *dst, int flags) {
+  const char *alphabet = base64_alphabet(flags);
+  size_t i = 0;
+
+#ifdef CODEC_X86
+  if (__builtin_cpu_supports("avx2"))
+    i = base64_encode_avx2(src, len, dst, flags);
+  else if (__builtin_cpu_supports("ssse3"))
+    i = base64_encode_ssse3(src, len, dst, flags);
+  dst += i / 3 * 4;
+#endif
+
+  for (; i + 3 <= len; i += 3, dst += 4) {
+    uint32_t v = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) |
+                 src[i + 2];
+    dst[0] = alphabet[v >> 18];
+    dst[1] = alphabet[(v >> 12) & 63];
+    dst[2] = alphabet[(v >> 6) & 63];
+    dst[3] = alphabet[v & 63];
+  }
+  return i;
+}
+
+/**
+ * @brief Encode the final 1 or 2 bytes of a stream
+ *
+ * @return size_t Number of characters written
+ */
+static inline size_t base64_encode_tail(const unsigned char *src, size_t len,
+                                        char *dst, int flags) {
+  const char *alphabet = base64_alphabet(flags);
+  size_t n;
+
+  if (len == 0)
+    return 0;
+
+  uint32_t v = (uint32_t)src[0] << 16;
+  if (len > 1)
+    v |= (uint32_t)src[1] << 8;
+
+  dst[0] = alphabet[v >> 18];
+  dst[1] = alphabet[(v >> 12) & 63];
+  n = 2;
+  if (len > 1)
+    dst[n++] = alphabet[(v >> 6) & 63];
+  if (!(flags & BASE64_NOPAD)) {
+    while (n < 4)
+      dst[n++] = '=';
+  }
+  return n;
+}
+
+/**
+ * @brief Decode as many clean 4-character groups as possible
+ *
+ * Stops at the first group containing whitespace, padding or an invalid
+ * character and leaves it for the caller's slow path.
+ *
+ * @param consumed Receives the number of characters consumed
+ * @return size_t Number of bytes written
+ */
+static inline size_t base64_decode_groups(const char *src, size_t len,
+                                          unsigned char *dst, int flags,
+                                          size_t *consumed) {
+  size_t i = 0;
+  size_t o = 0;
+
+#ifdef CODEC_X86
+  if (__builtin_cpu_supports("avx2")) {
+    for (; i + 32 <= len; i += 32, o += 24) {
+      if (!base64_decode32_avx2(src + i, dst + o, flags))
+        break;
+    }
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    for (; i + 16 <= len; i += 16, o += 12) {
+      if (!base64_decode16_ssse3(src + i, dst + o, flags))
+        break;
+    }
+  }
+#endif
+
+  for (; i + 4 <= len; i += 4, o += 3) {
+    const unsigned char *s = (const unsigned char *)src + i;
+    int a = base64_decode_table[s[0]];
+    int b = base64_decode_table[s[1]];
+    int c = base64_decode_table[s[2]];
+    int d = base64_decode_table[s[3]];
+
+    if ((a | b | c | d) < 0 || !base64_digit_ok(s[0], a, flags) ||
+        !base64_digit_ok(s[1], b, flags) || !base64_digit_ok(s[2], c, flags) ||
+        !base64_digit_ok(s[3], d, flags))
+      break;
+
+    uint32_t v = ((uint32_t)a << 18) | ((uint32_t)b << 12) |
+                 ((uint32_t)c << 6) | (uint32_t)d;
+    dst[o] = (unsigned char)(v >> 16);
+    dst[o + 1] = (unsigned char)(v >> 8);
+    dst[o + 2] = (unsigned char)v;
+  }
+
+  *consumed = i;
+  return o;
+}
+
+/* ========== BASE64 ========== */
+
+/**
+ * @brief Number of characters needed to encode len bytes
+ *
+ * @param len Input length in bytes
+ * @param flags BASE64_* flags
+ * @return size_t Encoded length, excluding the NUL terminator
+ */
+static inline size_t base64_encoded_length(size_t len, int flags) {
+  if (flags & BASE64_NOPAD)
+    return len / 3 * 4 + (len % 3 ? len % 3 + 1 : 0);
+  return (len + 2) / 3 * 4;
+}
+
+/**
+ * @brief Upper bound on the bytes produced by decoding len characters
+ *
+ * @param len Input length in characters
+ * @return size_t Maximum decoded length
+ */
+static inline size_t base64_decoded_max(size_t len) {
+  return len / 4 * 3 + (len % 4 > 1 ? len % 4 - 1 : 0);
+}
+
+/**
+ * @brief Encode a buffer into a caller-provided string
+ *
+ * @param src Bytes to encode
+ * @param len Number of bytes
+ * @param dst Destination with room for base64_encoded_length() + 1 chars
+ * @param flags BASE64_* flags
+ * @return size_t Number of characters written, excluding the NUL terminator
+ */
+static inline size_t base64_encode(const void *src, size_t len, char *dst,
+                                   int flags) {
+  if ((src == NULL && len > 0) || dst == NULL)
+    return 0;
+
+  const unsigned char *in = (const unsigned char *)src;
+  size_t done = base64_encode_groups(in, len, dst, flags);
+  size_t n = done / 3 * 4;
+
+  n += base64_encode_tail(in + done, len - done, dst + n, flags);
+  dst[n] = '\0';
+  return n;
+}
+
+/**
+ * @brief Encode a buffer into a newly allocated string
+ *
+ * @param src Bytes to encode
+ * @param len Number of bytes
+ * @param flags BASE64_* flags
+ * @return char* Newly allocated NUL-terminated string, or NULL on error
+ */
+static inline char *base64_encode_alloc(const void *src, size_t len,
+                                        int flags) {
+  if (src == NULL && len > 0)
+    return NULL;
+
+  char *dst = (char *)safe_malloc(base64_encoded_length(len, flags) + 1);
+  base64_encode(src, len, dst, flags);
+  return dst;
+}
+
+/**
+ * @brief Initialize a streaming encoder
+ *
+ * @param enc Encoder state
+ * @param flags BASE64_* flags
+ */
+static inline void base64_encoder_init(Base64Encoder *enc, int flags) {
+  enc->flags = flags;
+  enc->carry_len = 0;
+}
+
+/**
+ * @brief Encode the next chunk of a stream
+ *
+ * Up to two trailing bytes are held back until more input or
+ * base64_encoder_final() arrives.
+ *
+ * @param enc Encoder state
+ * @param src Bytes to encode
+ * @param len Number of bytes
+ * @param dst Destination with room for (len + 2) / 3 * 4 chars
+ * @return size_t Number of characters written (not NUL-terminated)
+ */
+static inline size_t base64_encoder_update(Base64Encoder *enc, const void *src,
+                                           size_t len, char *dst) {
+  const unsigned char *in = (const unsigned char *)src;
+  size_t n = 0;
+
+  if (enc == NULL || (src == NULL && len > 0) || dst == NULL)
+    return 0;
+
+  if (enc->carry_len > 0) {
+    unsigned char group[3];
+    size_t take = (size_t)(3 - enc->carry_len);
+
+    if (len < take) {
+      memcpy(enc->carry + enc->carry_len, in, len);
+      enc->carry_len += (int)len;
+      return 0;
+    }
+    memcpy(group, enc->carry, (size_t)enc->carry_len);
+    memcpy(group + enc->carry_len, in, take);
+    base64_encode_groups(group, 3, dst, enc->flags);
+    in += take;
+    len -= take;
+    n = 4;
+    enc->carry_len = 0;
+  }
+
+  size_t done = base64_encode_groups(in, len, dst + n, enc->flags);
+  n += done / 3 * 4;
+  enc->carry_len = (int)(len - done);
+  memcpy(enc->carry, in + done, len - done);
+  return n;
+}
+
+/**
+ * @brief Flush the last partial group of a stream
+ *
+ * @param enc Encoder state
+ * @param dst Destination with room for 4 characters
+ * @return size_t Number of characters written (not NUL-terminated)
+ */
+static inline size_t base64_encoder_final(Base64Encoder *enc, char *dst) {
+  if (enc == NULL || dst == NULL)
+    return 0;
+
+  size_t n = base64_encode_tail(enc->carry, (size_t)enc->carry_len, dst,
+                                enc->flags);
+  enc->carry_len = 0;
+  return n;
+}
+
+/**
+ * @brief Initialize a streaming decoder
+ *
+ * Without BASE64_STRICT the decoder skips whitespace, accepts missing padding
+ * and accepts characters from either alphabet.
+ *
+ * @param dec Decoder state
+ * @param flags BASE64_* flags
+ */
+static inline void base64_decoder_init(Base64Decoder *dec, int flags) {
+  memset(dec, 0, sizeof(*dec));
+  dec->flags = flags;
+}
+
+/**
+ * @brief Emit a group that was terminated early by padding or end of input
+ *
+ * @return size_t Number of bytes written, or (size_t)-1 if the group is
+ * invalid
+ */
+static inline size_t base64_decoder_flush(Base64Decoder *dec,
+                                          unsigned char *dst) {
+  const unsigned char *q = dec->quad;
+  size_t n;
+
+  if (dec->quad_len < 2)
+    return (size_t)-1;
+
+  uint32_t v = ((uint32_t)q[0] << 18) | ((uint32_t)q[1] << 12);
+  if (dec->quad_len == 3)
+    v |= (uint32_t)q[2] << 6;
+
+  // Canonical encodings leave the unused low bits zero
+  if ((dec->flags & BASE64_STRICT) &&
+      (dec->quad_len == 2 ? (q[1] & 0x0f) : (q[2] & 0x03)) != 0)
+    return (size_t)-1;
+
+  dst[0] = (unsigned char)(v >> 16);
+  n = 1;
+  if (dec->quad_len == 3)
+    dst[n++] = (unsigned char)(v >> 8);
+  dec->quad_len = 0;
+  return n;
+}
+
+/**
+ * @brief Decode the next chunk of a stream
+ *
+ * @param dec Decoder state
+ * @param src Characters to decode
+ * @param len Number of characters
+ * @param dst Destination with room for base64_decoded_max(len) + 3 bytes; may
+ * alias src
+ * @param out_len Receives the number of bytes written
+ * @return true on success, false on malformed input
+ */
+static inline bool base64_decoder_update(Base64Decoder *dec, const char *src,
+                                         size_t len, void *dst,
+                                         size_t *out_len) {
+  unsigned char *out = (unsigned char *)dst;
+  size_t i = 0;
+
+  if (out_len != NULL)
+    *out_len = 0;
+  if (dec == NULL || (src == NULL && len > 0) || dst == NULL || dec->failed)
+    return false;
+
+  while (i < len && !dec->failed) {
+    if (dec->quad_len == 0 && dec->pad == 0 && !dec->done) {
+      size_t consumed;
+      out += base64_decode_groups(src + i, len - i, out, dec->flags, &consumed);
+      i += consumed;
+      if (i == len)
+        break;
+    }
+
+    unsigned char c = (unsigned char)src[i++];
+    int v = base64_decode_table[c];
+
+    if (v == -2 && !(dec->flags & BASE64_STRICT))
+      continue;
+
+    if (v == -3 && !dec->done && dec->quad_len >= 2 &&
+        !((dec->flags & BASE64_STRICT) && (dec->flags & BASE64_NOPAD))) {
+      if (++dec->pad + dec->quad_len == 4) {
+        size_t n = base64_decoder_flush(dec, out);
+        if (n == (size_t)-1) {
+          dec->failed = true;
+          break;
+        }
+        out += n;
+        dec->done = true;
+      }
+      continue;
+    }
+
+    if (v < 0 || dec->pad > 0 || dec->done ||
+        !base64_digit_ok(c, v, dec->flags)) {
+      dec->failed = true;
+      break;
+    }
+
+    dec->quad[dec->quad_len++] = (unsigned char)v;
+    if (dec->quad_len == 4) {
+      const unsigned char *q = dec->quad;
+      out[0] = (unsigned char)((q[0] << 2) | (q[1] >> 4));
+      out[1] = (unsigned char)((q[1] << 4) | (q[2] >> 2));
+      out[2] = (unsigned char)((q[2] << 6) | q[3]);
+      out += 3;
+      dec->quad_len = 0;
+    }
+  }
+
+  if (out_len != NULL)
+    *out_len = (size_t)(out - (unsigned char *)dst);
+  return !dec->failed;
+}
+
+/**
+ * @brief Finish a stream and flush an unpadded final group
+ *
+ * @param dec Decoder state
+ * @param dst Destination with room for 2 bytes
+ * @param out_len Receives the number of bytes written
+ * @return true if the stream ended on a valid boundary, false otherwise
+ */
+static inline bool base64_decoder_final(Base64Decoder *dec, void *dst,
+                                        size_t *out_len) {
+  if (out_len != NULL)
+    *out_len = 0;
+  if (dec == NULL || dst == NULL || dec->failed)
+    return false;
+
+  if (dec->done || (dec->quad_len == 0 && dec->pad == 0))
+    return true;
+
+  // Padding started but did not complete the group
+  if (dec->pad > 0)
+    return false;
+  if ((dec->flags & BASE64_STRICT) && !(dec->flags & BASE64_NOPAD))
+    return false;
+
+  size_t n = base64_decoder_flush(dec, (unsigned char *)dst);
+  if (n == (size_t)-1)
+    return false;
+  if (out_len != NULL)
+    *out_len = n;
+  return true;
+}
+
+/**
+ * @brief Decode a complete base64 string
+ *
+ * @param src Characters to decode
+ * @param len Number of characters
+ * @param dst Destination with room for base64_decoded_max(len) bytes; may be
+ * the same buffer as src
+ * @param out_len Receives the number of bytes written
+ * @param flags BASE64_* flags
+ * @return true on success, false on malformed input
+ */
+static inline bool base64_decode(const char *src, size_t len, void *dst,
+                                 size_t *out_len, int flags) {
+  Base64Decoder dec;
+  size_t n = 0;
+  size_t tail = 0;
+
+  base64_decoder_init(&dec, flags);
+  if (!base64_decoder_update(&dec, src, len, dst, &n) ||
+      !base64_decoder_final(&dec, (unsigned char *)dst + n, &tail)) {
+    if (out_len != NULL)
+      *out_len = 0;
+    return false;
+  }
+  if (out_len != NULL)
+    *out_len = n + tail;
+  return true;
+}
+
+/**
+ * @brief Decode a complete base64 string into a newly allocated buffer
+ *
+ * @param src NUL-terminated characters to decode
+ * @param out_len Receives the decoded length (may be NULL)
+ * @param flags BASE64_* flags
+ * @return void* Newly allocated buffer (NUL-terminated for convenience), or
+ * NULL on malformed input
+ */
+static inline void *base64_decode_alloc(const char *src, size_t *out_len,
+                                        int flags) {
+  if (src == NULL)
+    return NULL;
+
+  size_t len = strlen(src);
+  size_t n;
+  unsigned char *dst =
+      (unsigned char *)safe_malloc(base64_decoded_max(len) + 1);
+
+  if (!base64_decode(src, len, dst, &n, flags)) {
+    free(dst);
+    return NULL;
+  }
+  dst[n] = '\0';
+  if (out_len != NULL)
+    *out_len = n;
+  return dst;
+}
+
+/* ========== HEX ========== */
+
+/**
+ * @brief Encode a buffer as hex into a caller-provided string
+ *
+ * @param src Bytes to encode
+ * @param len Number of bytes
+ * @param dst Destination with room for 2 * len + 1 chars
+ * @param flags HEX_* flags
+ * @return size_t Number of characters written, excluding the NUL terminator
+ */
+static inline size_t hex_encode(const void *src, size_t len, char *dst,
+                                int flags) {
+  const char *digits =
+      (flags & HEX_UPPER) ? "0123456789ABCDEF" : "0123456789abcdef";
+  const unsigned char *in = (const unsigned char *)src;
+  size_t i = 0;
+
+  if ((src == NULL && len > 0) || dst == NULL)
+    return 0;
+
+#ifdef CODEC_X86
+  if (__builtin_cpu_supports("avx2"))
+    i = hex_encode_avx2(in, len, dst, flags);
+  else if (__builtin_cpu_supports("ssse3"))
+    i = hex_encode_ssse3(in, len, dst, flags);
+#endif
+
+  for (; i < len; i++) {
+    dst[2 * i] = digits[in[i] >> 4];
+    dst[2 * i + 1] = digits[in[i] & 0x0f];
+  }
+  dst[2 * len] = '\0';
+  return 2 * len;
+}
+
+/**
+ * @brief Encode a buffer as hex into a newly allocated string
+ *
+ * @param src Bytes to encode
+ * @param len Number of bytes
+ * @param flags HEX_* flags
+ * @return char* Newly allocated NUL-terminated string, or NULL on error
+ */
+static inline char *hex_encode_alloc(const void *src, size_t len, int flags) {
+  if (src == NULL && len > 0)
+    return NULL;
+
+  char *dst = (char *)safe_malloc(2 * len + 1);
+  hex_encode(src, len, dst, flags);
+  return dst;
+}
+
+/**
+ * @brief Initialize a streaming hex decoder
+ *
+ * @param dec Decoder state
+ */
+static inline void hex_decoder_init(HexDecoder *dec) {
+  dec->pending = -1;
+  dec->failed = false;
+}
+
+/**
+ * @brief Decode the next chunk of a hex stream
+ *
+ * Chunks may split a byte between two calls.
+ *
+ * @param dec Decoder state
+ * @param src Characters to decode (either case)
+ * @param len Number of characters
+ * @param dst Destination with room for len / 2 + 1 bytes; may alias src
+ * @param out_len Receives the number of bytes written
+ * @return true on success, false on a non-hex character
+ */
+static inline bool hex_decoder_update(HexDecoder *dec, const char *src,
+                                      size_t len, void *dst, size_t *out_len) {
+  unsigned char *out = (unsigned char *)dst;
+  const unsigned char *in = (const unsigned char *)src;
+  size_t i = 0;
+
+  if (out_len != NULL)
+    *out_len = 0;
+  if (dec == NULL || (src == NULL && len > 0) || dst == NULL || dec->failed)
+    return false;
+
+  if (dec->pending >= 0 && len > 0) {
+    int lo = hex_decode_table[in[0]];
+    if (lo < 0) {
+      dec->failed = true;
+      return false;
+    }
+    *out++ = (unsigned char)((dec->pending << 4) | lo);
+    dec->pending = -1;
+    i = 1;
+  }
+
+#ifdef CODEC_X86
+  size_t done = 0;
+  if (__builtin_cpu_supports("avx2"))
+    done = hex_decode_avx2(src + i, len - i, out);
+  if (__builtin_cpu_supports("ssse3"))
+    done += hex_decode_ssse3(src + i + done, len - i - done, out + done / 2);
+  out += done / 2;
+  i += done;
+#endif
+
+  for (; i + 2 <= len; i += 2) {
+    int hi = hex_decode_table[in[i]];
+    int lo = hex_decode_table[in[i + 1]];
+    if ((hi | lo) < 0) {
+      dec->failed = true;
+      if (out_len != NULL)
+        *out_len = (size_t)(out - (unsigned char *)dst);
+      return false;
+    }
+    *out++ = (unsigned char)((hi << 4) | lo);
+  }
+
+  if (i < len) {
+    dec->pending = hex_decode_table[in[i]];
+    if (dec->pending < 0)
+      dec->failed = true;
+  }
+
+  if (out_len != NULL)
+    *out_len = (size_t)(out - (unsigned char *)dst);
+  return !dec->failed;
+}
+
+/**
+ * @brief Finish a hex stream
+ *
+ * @param dec Decoder state
+ * @return true if no half byte is left over, false otherwise
+ */
+static inline bool hex_decoder_final(HexDecoder *dec) {
+  return dec != NULL && !dec->failed && dec->pending < 0;
+}
+
+/**
+ * @brief Decode a complete hex string
+ *
+ * @param src Characters to decode (either case)
+ * @param len Number of characters (must be even)
+ * @param dst Destination with room for len / 2 bytes; may be the same buffer
+ * as src
+ * @param out_len Receives the number of bytes written
+ * @return true on success, false on odd length or a non-hex character
+ */
+static inline bool hex_decode(const char *src, size_t len, void *dst,
+                              size_t *out_len) {
+  HexDecoder dec;
+
+  if (len % 2 != 0) {
+    if (out_len != NULL)
+      *out_len = 0;
+    return false;
+  }
+  hex_decoder_init(&dec);
+  return hex_decoder_update(&dec, src, len, dst, out_len) &&
+         hex_decoder_final(&dec);
+}
+
+/**
+ * @brief Decode a complete hex string into a newly allocated buffer
+ *
+ * @param src NUL-terminated characters to decode
+ * @param out_len Receives the decoded length (may be NULL)
+ * @return void* Newly allocated buffer (NUL-terminated for convenience), or
+ * NULL on malformed input
+ */
+static inline void *hex_decode_alloc(const char *src, size_t *out_len) {
+  if (src == NULL)
+    return NULL;
+
+  size_t len = strlen(src);
+  size_t n;
+  unsigned char *dst = (unsigned char *)safe_malloc(len / 2 + 1);
+
+  if (!hex_decode(src, len, dst, &n)) {
+    free(dst);
+    return NULL;
+  }
+  dst[n] = '\0';
+  if (out_len != NULL)
+    *out_len = n;
+  return dst;
+}
+
+#endif /* CODEC_H */
@@ -0,0 +1,691 @@
+/**
+ * @file histogram.h
+ * @brief High dynamic range histogram for latency distributions
+ * @author pucitos
+ *
+ * Records non-negative integer values (typically nanoseconds) into a fixed
+ * array of log-linear buckets, keeping a chosen number of significant decimal
+ * digits across the whole trackable range. Recording is O(1) and never
+ * allocates; memory is fixed at creation (about 270 KB for 1 ns to 1 hour at
+ * 3 digits).
+ *
+ * Counters are atomic with relaxed ordering. A histogram recorded by a single
+ * thread (histogram_record()) can be merged into an aggregate by another
+ * thread at any time without locks, so the usual pattern is one recorder per
+ * thread plus a reporter that periodically calls histogram_merge() on each
+ * and histogram_interval() on the aggregate. histogram_record_atomic() allows
+ * several writers on one histogram at the cost of locked instructions.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "utils.h"
+#include <stdint.h>
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L &&               \
+    !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define HISTOGRAM_ATOMIC _Atomic
+#define HISTOGRAM_LOAD(p) atomic_load_explicit(p, memory_order_relaxed)
+#define HISTOGRAM_STORE(p, v) atomic_store_explicit(p, v, memory_order_relaxed)
+#define HISTOGRAM_FETCH_ADD(p, v)                                              \
+  atomic_fetch_add_explicit(p, v, memory_order_relaxed)
+#define HISTOGRAM_CAS(p, expected, v)                                          \
+  atomic_compare_exchange_weak_explicit(p, expected, v, memory_order_relaxed, \
+                                        memory_order_relaxed)
+#elif defined(__GNUC__)
+#define HISTOGRAM_ATOMIC
+#define HISTOGRAM_LOAD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define HISTOGRAM_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define HISTOGRAM_FETCH_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define HISTOGRAM_CAS(p, expected, v)                                          \
+  __atomic_compare_exchange_n(p, expected, v, true, __ATOMIC_RELAXED,          \
+                              __ATOMIC_RELAXED)
+#else
+#error "histogram.h needs C11 atomics or GCC-compatible atomic builtins"
+#endif
+
+#define HISTOGRAM_SERIAL_MAGIC "HDR1"
+
+/**
+ * @brief Fixed-size high dynamic range histogram
+ */
+typedef struct {
+  uint64_t lowest;  /* Smallest value distinguishable from 0 */
+  uint64_t highest; /* Largest trackable value */
+  int digits;       /* Significant decimal digits kept */
+  int unit_magnitude;
+  int sub_bucket_half_count_magnitude;
+  uint32_t sub_bucket_count;
+  uint32_t sub_bucket_half_count;
+  uint64_t sub_bucket_mask;
+  uint32_t bucket_count;
+  size_t counts_len;
+  HISTOGRAM_ATOMIC uint64_t total;
+  HISTOGRAM_ATOMIC uint64_t min;
+  HISTOGRAM_ATOMIC uint64_t max;
+  HISTOGRAM_ATOMIC uint64_t *counts;
+} Histogram;
+
+/**
+ * @brief Headline statistics of a histogram
+ */
+typedef struct {
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+  double mean;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+} HistogramSummary;
+
+/* ========== INTERNAL HELPERS ========== */
+
+static inline int histogram_clz64(uint64_t v) {
+#ifdef __GNUC__
+  return __builtin_clzll(v);
+#else
+  int n = 0;
+  while (!(v & 0x8000000000000000ULL)) {
+    v <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static inline int histogram_bucket_index(const Histogram *h, uint64_t value) {
+  int pow2ceiling = 64 - histogram_clz64(value | h->sub_bucket_mask);
+  return pow2ceiling - h->unit_magnitude -
+         (h->sub_bucket_half_count_magnitude + 1);
+}
+
+static inline uint32_t histogram_sub_bucket_index(const Histogram *h,
+                                                  uint64_t value, int bucket) {
+  return (uint32_t)(value >> (bucket + h->unit_magnitude));
+}
+
+static inline size_t histogram_counts_index(const Histogram *h,
+                                            uint64_t value) {
+  int bucket = histogram_bucket_index(h, value);
+  uint32_t sub = histogram_sub_bucket_index(h, value, bucket);
+  return ((size_t)(bucket + 1) << h->sub_bucket_half_count_magnitude) + sub -
+         h->sub_bucket_half_count;
+}
+
+static inline uint64_t histogram_value_at_index(const Histogram *h,
+                                                size_t index) {
+  int bucket = (int)(index >> h->sub_bucket_half_count_magnitude) - 1;
+  uint32_t sub = (uint32_t)(index & (h->sub_bucket_half_count - 1)) +
+                 h->sub_bucket_half_count;
+  if (bucket < 0) {
+    sub -= h->sub_bucket_half_count;
+    bucket = 0;
+  }
+  return (uint64_t)sub << (bucket + h->unit_magnitude);
+}
+
+/**
+ * @brief Width of the bucket that holds a value
+ */
+static inline uint64_t histogram_range_size(const Histogram *h,
+                                            uint64_t value) {
+  int bucket = histogram_bucket_index(h, value);
+  uint32_t sub = histogram_sub_bucket_index(h, value, bucket);
+  if (sub >= h->sub_bucket_count)
+    bucket++;
+  return 1ULL << (h->unit_magnitude + bucket);
+}
+
+/**
+ * @brief Largest value that shares a bucket with the given value
+ */
+static inline uint64_t histogram_highest_equivalent(const Histogram *h,
+                                                    uint64_t value) {
+  int bucket = histogram_bucket_index(h, value);
+  uint64_t lowest = (uint64_t)histogram_sub_bucket_index(h, value, bucket)
+                    << (bucket + h->unit_magnitude);
+  return lowest + histogram_range_size(h, value) - 1;
+}
+
+static inline void histogram_update_min_max(Histogram *h, uint64_t value,
+                                            bool shared) {
+  uint64_t cur = HISTOGRAM_LOAD(&h->min);
+  while (value < cur) {
+    if (!shared) {
+      HISTOGRAM_STORE(&h->min, value);
+      break;
+    }
+    if (HISTOGRAM_CAS(&h->min, &cur, value))
+      break;
+  }
+
+  cur = HISTOGRAM_LOAD(&h->max);
+  while (value > cur) {
+    if (!shared) {
+      HISTOGRAM_STORE(&h->max, value);
+      break;
+    }
+    if (HISTOGRAM_CAS(&h->max, &cur, value))
+      break;
+  }
+}
+
+static inline size_t histogram_put_varint(unsigned char *out, uint64_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    out[n++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (unsigned char)v;
+  return n;
+}
+
+static inline bool histogram_get_varint(const unsigned char *in, size_t len,
+                                        size_t *pos, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64 && *pos < len; shift += 7) {
+    unsigned char byte = in[(*pos)++];
+    *v |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+/* ========== CREATION ========== */
+
+/**
+ * @brief Create a histogram
+ *
+ * @param lowest Smallest value distinguishable from 0 (>= 1); use 1 for ns
+ * @param highest Largest value to track (>= 2 * lowest)
+ * @param digits Significant decimal digits to keep (1-5)
+ * @return Histogram* New histogram, or NULL if the parameters are invalid
+ */
+static inline Histogram *histogram_new(uint64_t lowest, uint64_t highest,
+                                       int digits) {
+  if (lowest < 1 || digits < 1 || digits > 5 || highest / 2 < lowest)
+    return NULL;
+
+  uint64_t single_unit = 2;
+  for (int i = 0; i < digits; i++)
+    single_unit *= 10;
+
+  int sub_bucket_count_magnitude = 0;
+  while ((1ULL << sub_bucket_count_magnitude) < single_unit)
+    sub_bucket_count_magnitude++;
+
+  Histogram *h = (Histogram *)safe_calloc(1, sizeof(Histogram));
+  h->lowest = lowest;
+  h->highest = highest;
+  h->digits = digits;
+  h->unit_magnitude = 63 - histogram_clz64(lowest);
+  h->sub_bucket_half_count_magnitude = sub_bucket_count_magnitude - 1;
+  h->sub_bucket_count = 1U << sub_bucket_count_magnitude;
+  h->sub_bucket_half_count = h->sub_bucket_count / 2;
+  h->sub_bucket_mask = (uint64_t)(h->sub_bucket_count - 1) << h->unit_magnitude;
+
+  if (h->unit_magnitude + sub_bucket_count_magnitude > 63) {
+    free(h);
+    return NULL;
+  }
+
+  uint64_t smallest_untrackable = (uint64_t)h->sub_bucket_count
+                                  << h->unit_magnitude;
+  uint32_t buckets = 1;
+  while (smallest_untrackable <= highest) {
+    if (smallest_untrackable > UINT64_MAX / 2) {
+      buckets++;
+      break;
+    }
+    smallest_untrackable <<= 1;
+    buckets++;
+  }
+  h->bucket_count = buckets;
+  h->counts_len = (size_t)(buckets + 1) * h->sub_bucket_half_count;
+  h->counts = (HISTOGRAM_ATOMIC uint64_t *)safe_calloc(h->counts_len,
+                                                       sizeof(uint64_t));
+  HISTOGRAM_STORE(&h->min, UINT64_MAX);
+  return h;
+}
+
+/**
+ * @brief Create an empty histogram with the same layout as another
+ *
+ * @param h Template histogram
+ * @return Histogram* New histogram, or NULL if h is NULL
+ */
+static inline Histogram *histogram_new_like(const Histogram *h) {
+  if (h == NULL)
+    return NULL;
+  return histogram_new(h->lowest, h->highest, h->digits);
+}
+
+/**
+ * @brief Free a histogram
+ *
+ * @param h Histogram to free (may be NULL)
+ */
+static inline void histogram_free(Histogram *h) {
+  if (h == NULL)
+    return;
+  free((void *)h->counts);
+  free(h);
+}
+
+/**
+ * @brief Clear all recorded values
+ *
+ * Not safe against concurrent recording into the same histogram.
+ *
+ * @param h Histogram to clear
+ */
+static inline void histogram_reset(Histogram *h) {
+  if (h == NULL)
+    return;
+  for (size_t i = 0; i < h->counts_len; i++)
+    HISTOGRAM_STORE(&h->counts[i], 0);
+  HISTOGRAM_STORE(&h->total, 0);
+  HISTOGRAM_STORE(&h->min, UINT64_MAX);
+  HISTOGRAM_STORE(&h->max, 0);
+}
+
+/* ========== RECORDING ========== */
+
+/**
+ * @brief Record a value several times; single writer only
+ *
+ * @param h Histogram owned by the calling thread
+ * @param value Value to record
+ * @param count Number of occurrences
+ * @return true on success, false if value exceeds the trackable range
+ */
+static inline bool histogram_record_n(Histogram *h, uint64_t value,
+                                      uint64_t count) {
+  size_t index = histogram_counts_index(h, value);
+  if (index >= h->counts_len)
+    return false;
+
+  HISTOGRAM_STORE(&h->counts[index], HISTOGRAM_LOAD(&h->counts[index]) + count);
+  HISTOGRAM_STORE(&h->total, HISTOGRAM_LOAD(&h->total) + count);
+  histogram_update_min_max(h, value, false);
+  return true;
+}
+
+/**
+ * @brief Record a value; single writer only
+ *
+ * @param h Histogram owned by the calling thread
+ * @param value Value to record
+ * @return true on success, false if value exceeds the trackable range
+ */
+static inline bool histogram_record(Histogram *h, uint64_t value) {
+  return histogram_record_n(h, value, 1);
+}
+
+/**
+ * @brief Record a value into a histogram shared by several writers
+ *
+ * @param h Histogram
+ * @param value Value to record
+ * @return true on success, false if value exceeds the trackable range
+ */
+static inline bool histogram_record_atomic(Histogram *h, uint64_t value) {
+  size_t index = histogram_counts_index(h, value);
+  if (index >= h->counts_len)
+    return false;
+
+  HISTOGRAM_FETCH_ADD(&h->counts[index], 1);
+  HISTOGRAM_FETCH_ADD(&h->total, 1);
+  histogram_update_min_max(h, value, true);
+  return true;
+}
+
+/* ========== MERGING AND SNAPSHOTS ========== */
+
+/**
+ * @brief Add every value recorded in src to dst
+ *
+ * Reads src with relaxed atomic loads, so it may run while src's owner keeps
+ * recording; values recorded concurrently land in this merge or the next.
+ * dst must not be written by anyone else during the merge.
+ *
+ * @param dst Destination histogram
+ * @param src Source histogram
+ * @return uint64_t Number of values dropped because they exceed dst's range
+ */
+static inline uint64_t histogram_merge(Histogram *dst, const Histogram *src) {
+  uint64_t dropped = 0;
+  bool same = dst->unit_magnitude == src->unit_magnitude &&
+              dst->sub_bucket_count == src->sub_bucket_count;
+  uint64_t total = 0;
+  uint64_t kept_max = 0;
+
+  for (size_t i = 0; i < src->counts_len; i++) {
+    uint64_t count = HISTOGRAM_LOAD(&src->counts[i]);
+    if (count == 0)
+      continue;
+
+    if (same && i < dst->counts_len) {
+      HISTOGRAM_STORE(&dst->counts[i], HISTOGRAM_LOAD(&dst->counts[i]) + count);
+      total += count;
+      kept_max =
+          histogram_highest_equivalent(dst, histogram_value_at_index(dst, i));
+    } else if (histogram_record_n(dst, histogram_value_at_index(src, i),
+                                  count)) {
+      continue;
+    } else {
+      dropped += count;
+    }
+  }
+  HISTOGRAM_STORE(&dst->total, HISTOGRAM_LOAD(&dst->total) + total);
+
+  uint64_t min = HISTOGRAM_LOAD(&src->min);
+  uint64_t max = HISTOGRAM_LOAD(&src->max);
+  /* If only the low buckets fit, the top kept bucket bounds the maximum */
+  if (min <= max && histogram_counts_index(dst, max) >= dst->counts_len)
+    max = kept_max;
+  if (min <= max) {
+    histogram_update_min_max(dst, min, false);
+    histogram_update_min_max(dst, max, false);
+  }
+  return dropped;
+}
+
+/**
+ * @brief Copy the contents of one histogram into another of the same layout
+ *
+ * @param dst Destination, overwritten
+ * @param src Source
+ * @return true on success, false if the layouts differ
+ */
+static inline bool histogram_copy(Histogram *dst, const Histogram *src) {
+  if (dst->counts_len != src->counts_len ||
+      dst->unit_magnitude != src->unit_magnitude ||
+      dst->sub_bucket_count != src->sub_bucket_count)
+    return false;
+
+  histogram_reset(dst);
+  histogram_merge(dst, src);
+  return true;
+}
+
+/**
+ * @brief Extract the values recorded since the previous interval
+ *
+ * Computes out = cumulative - previous and then stores cumulative into
+ * previous. Because counters only grow, this works on a live aggregate
+ * without pausing recorders. The interval's min and max are bucket bounds.
+ *
+ * @param cumulative Histogram that keeps accumulating (e.g. an aggregate)
+ * @param previous State from the last call; start with an empty histogram
+ * @param out Receives the interval histogram
+ * @return true on success, false if the layouts differ
+ */
+static inline bool histogram_interval(const Histogram *cumulative,
+                                      Histogram *previous, Histogram *out) {
+  if (previous->counts_len != cumulative->counts_len ||
+      out->counts_len != cumulative->counts_len ||
+      previous->sub_bucket_count != cumulative->sub_bucket_count ||
+      out->sub_bucket_count != cumulative->sub_bucket_count ||
+      previous->unit_magnitude != cumulative->unit_magnitude ||
+      out->unit_magnitude != cumulative->unit_magnitude)
+    return false;
+
+  uint64_t total = 0;
+  histogram_reset(out);
+  for (size_t i = 0; i < cumulative->counts_len; i++) {
+    uint64_t now = HISTOGRAM_LOAD(&cumulative->counts[i]);
+    uint64_t before = HISTOGRAM_LOAD(&previous->counts[i]);
+    HISTOGRAM_STORE(&previous->counts[i], now);
+    if (now <= before)
+      continue;
+
+    uint64_t value = histogram_value_at_index(cumulative, i);
+    HISTOGRAM_STORE(&out->counts[i], now - before);
+    histogram_update_min_max(out, value, false);
+    histogram_update_min_max(out, histogram_highest_equivalent(out, value),
+                             false);
+    total += now - before;
+  }
+  HISTOGRAM_STORE(&out->total, total);
+  HISTOGRAM_STORE(&previous->total, HISTOGRAM_LOAD(&cumulative->total));
+  HISTOGRAM_STORE(&previous->min, HISTOGRAM_LOAD(&cumulative->min));
+  HISTOGRAM_STORE(&previous->max, HISTOGRAM_LOAD(&cumulative->max));
+  return true;
+}
+
+/* ========== QUERIES ========== */
+
+/**
+ * @brief Number of recorded values
+ */
+static inline uint64_t histogram_count(const Histogram *h) {
+  return HISTOGRAM_LOAD(&h->total);
+}
+
+/**
+ * @brief Smallest recorded value, or 0 if empty
+ */
+static inline uint64_t histogram_min(const Histogram *h) {
+  uint64_t min = HISTOGRAM_LOAD(&h->min);
+  return min == UINT64_MAX ? 0 : min;
+}
+
+/**
+ * @brief Largest recorded value, or 0 if empty
+ */
+static inline uint64_t histogram_max(const Histogram *h) {
+  return HISTOGRAM_LOAD(&h->max);
+}
+
+/**
+ * @brief Value at a given percentile
+ *
+ * The result is the highest value equivalent (within the configured
+ * precision) to the recorded value at that rank, capped at the maximum.
+ *
+ * @param h Histogram to query
+ * @param percentile Percentile in [0, 100]
+ * @return uint64_t Value at the percentile, or 0 if empty
+ */
+static inline uint64_t histogram_value_at_percentile(const Histogram *h,
+                                                     double percentile) {
+  uint64_t total = histogram_count(h);
+  if (total == 0)
+    return 0;
+  if (percentile <= 0)
+    return histogram_min(h);
+  if (percentile > 100)
+    percentile = 100;
+
+  double exact = percentile / 100.0 * (double)total;
+  uint64_t target = (uint64_t)exact;
+  if ((double)target < exact)
+    target++;
+  if (target == 0)
+    target = 1;
+
+  uint64_t running = 0;
+  uint64_t max = histogram_max(h);
+  for (size_t i = 0; i < h->counts_len; i++) {
+    running += HISTOGRAM_LOAD(&h->counts[i]);
+    if (running >= target) {
+      uint64_t value =
+          histogram_highest_equivalent(h, histogram_value_at_index(h, i));
+      return value < max ? value : max;
+    }
+  }
+  return max;
+}
+
+/**
+ * @brief Mean of the recorded values, using bucket midpoints
+ */
+static inline double histogram_mean(const Histogram *h) {
+  uint64_t total = histogram_count(h);
+  if (total == 0)
+    return 0.0;
+
+  double sum = 0.0;
+  for (size_t i = 0; i < h->counts_len; i++) {
+    uint64_t count = HISTOGRAM_LOAD(&h->counts[i]);
+    if (count == 0)
+      continue;
+    uint64_t value = histogram_value_at_index(h, i);
+    double mid = (double)value + (double)(histogram_range_size(h, value) / 2);
+    sum += mid * (double)count;
+  }
+  return sum / (double)total;
+}
+
+/**
+ * @brief Compute count, min, max, mean and the p50/p90/p99/p99.9 values
+ *
+ * @param h Histogram to summarize
+ * @param summary Receives the statistics
+ */
+static inline void histogram_summary(const Histogram *h,
+                                     HistogramSummary *summary) {
+  summary->count = histogram_count(h);
+  summary->min = histogram_min(h);
+  summary->max = histogram_max(h);
+  summary->mean = histogram_mean(h);
+  summary->p50 = histogram_value_at_percentile(h, 50.0);
+  summary->p90 = histogram_value_at_percentile(h, 90.0);
+  summary->p99 = histogram_value_at_percentile(h, 99.0);
+  summary->p999 = histogram_value_at_percentile(h, 99.9);
+}
+
+/**
+ * @brief Print a percentile distribution table
+ *
+ * @param h Histogram to print
+ * @param file Output stream
+ * @param scale Divisor applied to values, e.g. 1000.0 to print ns as us
+ */
+static inline void histogram_print(const Histogram *h, FILE *file,
+                                   double scale) {
+  static const double percentiles[] = {0,    50,    75,     90,     95,  99,
+                                       99.9, 99.99, 99.999, 100.0};
+  if (scale <= 0)
+    scale = 1.0;
+
+  fprintf(file, "%12s %12s\n", "percentile", "value");
+  for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+    fprintf(file, "%12.3f %12.3f\n", percentiles[i],
+            (double)histogram_value_at_percentile(h, percentiles[i]) / scale);
+  fprintf(file, "count=%llu mean=%.3f\n",
+          (unsigned long long)histogram_count(h), histogram_mean(h) / scale);
+}
+
+/* ========== SERIALIZATION ========== */
+
+/**
+ * @brief Encode a histogram into a compact, portable byte buffer
+ *
+ * Layout: "HDR1" followed by LEB128 varints for the parameters, min, max,
+ * total and counts. A set low bit marks a run of empty buckets (length in
+ * the remaining bits, minus one); a clear low bit marks a count. Feed the
+ * result to base64_encode() for text transport.
+ *
+ * @param h Histogram to encode
+ * @param out_len Receives the encoded length
+ * @return unsigned char* Newly allocated buffer
+ */
+static inline unsigned char *histogram_serialize(const Histogram *h,
+                                                 size_t *out_len) {
+  size_t used = h->counts_len;
+  while (used > 0 && HISTOGRAM_LOAD(&h->counts[used - 1]) == 0)
+    used--;
+
+  unsigned char *buf = (unsigned char *)safe_malloc(4 + 7 * 10 + used * 10);
+  size_t n = 4;
+  memcpy(buf, HISTOGRAM_SERIAL_MAGIC, 4);
+  n += histogram_put_varint(buf + n, (uint64_t)h->digits);
+  n += histogram_put_varint(buf + n, h->lowest);
+  n += histogram_put_varint(buf + n, h->highest);
+  n += histogram_put_varint(buf + n, HISTOGRAM_LOAD(&h->min));
+  n += histogram_put_varint(buf + n, HISTOGRAM_LOAD(&h->max));
+  n += histogram_put_varint(buf + n, HISTOGRAM_LOAD(&h->total));
+  n += histogram_put_varint(buf + n, (uint64_t)used);
+
+  for (size_t i = 0; i < used;) {
+    uint64_t count = HISTOGRAM_LOAD(&h->counts[i]);
+    if (count != 0) {
+      n += histogram_put_varint(buf + n, count << 1);
+      i++;
+      continue;
+    }
+    uint64_t zeros = 0;
+    while (i < used && HISTOGRAM_LOAD(&h->counts[i]) == 0) {
+      zeros++;
+      i++;
+    }
+    n += histogram_put_varint(buf + n, ((zeros - 1) << 1) | 1);
+  }
+
+  *out_len = n;
+  return buf;
+}
+
+/**
+ * @brief Decode a buffer produced by histogram_serialize()
+ *
+ * @param data Encoded bytes
+ * @param len Number of bytes
+ * @return Histogram* New histogram, or NULL on malformed input
+ */
+static inline Histogram *histogram_deserialize(const unsigned char *data,
+                                               size_t len) {
+  uint64_t digits, lowest, highest, min, max, total, used;
+  size_t pos = 4;
+
+  if (data == NULL || len < 4 || memcmp(data, HISTOGRAM_SERIAL_MAGIC, 4) != 0)
+    return NULL;
+  if (!histogram_get_varint(data, len, &pos, &digits) ||
+      !histogram_get_varint(data, len, &pos, &lowest) ||
+      !histogram_get_varint(data, len, &pos, &highest) ||
+      !histogram_get_varint(data, len, &pos, &min) ||
+      !histogram_get_varint(data, len, &pos, &max) ||
+      !histogram_get_varint(data, len, &pos, &total) ||
+      !histogram_get_varint(data, len, &pos, &used) || digits > 5)
+    return NULL;
+
+  Histogram *h = histogram_new(lowest, highest, (int)digits);
+  if (h == NULL)
+    return NULL;
+  if (used > h->counts_len) {
+    histogram_free(h);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < used;) {
+    uint64_t v;
+    if (!histogram_get_varint(data, len, &pos, &v)) {
+      histogram_free(h);
+      return NULL;
+    }
+    if (!(v & 1)) {
+      HISTOGRAM_STORE(&h->counts[i++], v >> 1);
+      continue;
+    }
+    uint64_t zeros = (v >> 1) + 1;
+    if (zeros > used - i) {
+      histogram_free(h);
+      return NULL;
+    }
+    i += (size_t)zeros;
+  }
+
+  HISTOGRAM_STORE(&h->min, min);
+  HISTOGRAM_STORE(&h->max, max);
+  HISTOGRAM_STORE(&h->total, total);
+  return h;
+}
+
+#endif /* HISTOGRAM_H */
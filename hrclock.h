@@ -0,0 +1,343 @@
+/**
+ * @file hrclock.h
+ * @brief High-resolution monotonic clock
+ * @author pucitos
+ *
+ * hrclock_ticks() returns a raw, monotonic tick count and hrclock_ns()
+ * returns nanoseconds on the CLOCK_MONOTONIC timeline. On x86 CPUs with an
+ * invariant TSC, ticks come straight from rdtsc and are converted with a
+ * fixed-point multiply calibrated against CLOCK_MONOTONIC on first use;
+ * elsewhere ticks are CLOCK_MONOTONIC nanoseconds.
+ *
+ * Per-read overhead (measured with hrclock_overhead_ns(), x86-64, -O2):
+ * - hrclock_ticks() with TSC:  ~7-20 ns, no syscall and no conversion
+ * - hrclock_ns() with TSC:     about the same, plus one 64x64 multiply
+ * - CLOCK_MONOTONIC fallback:  ~20-40 ns via the vDSO, far more under
+ *                              hypervisors without a stable clocksource
+ * In tight loops, read hrclock_ticks() and convert once at the end with
+ * hrclock_ticks_to_ns(). rdtsc is not serializing, so very short regions
+ * may be reordered by a few instructions.
+ *
+ * Define HRCLOCK_NO_TSC to always use the fallback clock.
+ *
+ * The calibration is shared by the whole process, so every file converts
+ * ticks with the same rate: define HRCLOCK_IMPLEMENTATION in exactly one
+ * source file before including this header (or a header that includes it,
+ * such as bench.h, trace.h or ratelimit.h).
+ */
+
+#ifndef HRCLOCK_H
+#define HRCLOCK_H
+
+#include "utils.h"
+#include <stdint.h>
+
+#if !defined(HRCLOCK_NO_TSC) && defined(__GNUC__) &&                          \
+    (defined(__x86_64__) || defined(__i386__))
+#define HRCLOCK_X86 1
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/**
+ * @brief Time spent busy-waiting while calibrating the TSC, in nanoseconds
+ */
+#ifndef HRCLOCK_CALIBRATION_NS
+#define HRCLOCK_CALIBRATION_NS 10000000ULL
+#endif
+
+/**
+ * @brief Fixed-point shift used for tick to nanosecond conversion
+ */
+#define HRCLOCK_SHIFT 32
+
+/**
+ * @brief Tick source selected at initialization
+ */
+typedef enum { HRCLOCK_SOURCE_MONOTONIC, HRCLOCK_SOURCE_TSC } HrclockSource;
+
+/**
+ * @brief Calibration state shared by the conversion functions
+ */
+typedef struct {
+  UTILS_ATOMIC int initialized; /* Set once the fields below are valid */
+  HrclockSource source;
+  uint64_t base_ticks; /* Tick count at calibration */
+  uint64_t base_ns;    /* CLOCK_MONOTONIC time at base_ticks */
+  uint64_t ns_mult;    /* ns = ticks * ns_mult >> HRCLOCK_SHIFT */
+  uint64_t tick_mult;  /* ticks = ns * tick_mult >> HRCLOCK_SHIFT */
+  double ticks_per_ns;
+} Hrclock;
+
+/* ========== SHARED STATE ========== */
+
+#ifdef HRCLOCK_IMPLEMENTATION
+Hrclock hrclock_state;
+#ifdef UTILS_HAVE_THREADS
+pthread_once_t hrclock_once = PTHREAD_ONCE_INIT;
+#endif
+#else
+extern Hrclock hrclock_state;
+#ifdef UTILS_HAVE_THREADS
+extern pthread_once_t hrclock_once;
+#endif
+#endif /* HRCLOCK_IMPLEMENTATION */
+
+/* ========== INTERNAL HELPERS ========== */
+
+/**
+ * @brief Read the fallback monotonic clock in nanoseconds
+ */
+static inline uint64_t hrclock_monotonic_ns(void) {
+#ifdef _WIN32
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+  if (freq.QuadPart == 0)
+    QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000ULL +
+         (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000ULL /
+             (uint64_t)freq.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Compute (value * mult) >> HRCLOCK_SHIFT without overflow
+ */
+static inline uint64_t hrclock_scale(uint64_t value, uint64_t mult) {
+#ifdef __SIZEOF_INT128__
+  __extension__ typedef unsigned __int128 u128;
+  return (uint64_t)(((u128)value * mult) >> HRCLOCK_SHIFT);
+#else
+  /* 32x32-bit partial products; only the lowest one has bits shifted out */
+  uint64_t vh = value >> 32, vl = value & 0xffffffffULL;
+  uint64_t mh = mult >> 32, ml = mult & 0xffffffffULL;
+  return ((vh * mh) << 32) + vh * ml + vl * mh + ((vl * ml) >> HRCLOCK_SHIFT);
+#endif
+}
+
+#ifdef HRCLOCK_X86
+
+/**
+ * @brief Check CPUID for a TSC that ticks at a constant rate in all P/C-states
+ */
+static inline bool hrclock_has_invariant_tsc(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+    return false;
+  __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+  return (edx & (1u << 8)) != 0;
+}
+
+/**
+ * @brief Sample the TSC and the monotonic clock as close together as possible
+ *
+ * Takes the pair with the shortest TSC bracket out of a few attempts so a
+ * preemption between the two reads does not skew calibration.
+ */
+static inline void hrclock_sample(uint64_t *ticks, uint64_t *ns) {
+  uint64_t best = UINT64_MAX;
+  for (int i = 0; i < 5; i++) {
+    uint64_t t0 = __rdtsc();
+    uint64_t n = hrclock_monotonic_ns();
+    uint64_t t1 = __rdtsc();
+    if (t1 - t0 < best) {
+      best = t1 - t0;
+      *ticks = t0 + (t1 - t0) / 2;
+      *ns = n;
+    }
+  }
+}
+
+#endif /* HRCLOCK_X86 */
+
+/* ========== INITIALIZATION ========== */
+
+/**
+ * @brief Select the tick source and calibrate it against CLOCK_MONOTONIC
+ */
+static inline void hrclock_calibrate(void) {
+  Hrclock *c = &hrclock_state;
+
+  c->source = HRCLOCK_SOURCE_MONOTONIC;
+  c->base_ticks = 0;
+  c->base_ns = 0;
+  c->ns_mult = 1ULL << HRCLOCK_SHIFT;
+  c->tick_mult = 1ULL << HRCLOCK_SHIFT;
+  c->ticks_per_ns = 1.0;
+
+#ifdef HRCLOCK_X86
+  if (hrclock_has_invariant_tsc()) {
+    uint64_t t0 = 0, n0 = 0, t1 = 0, n1 = 0;
+    hrclock_sample(&t0, &n0);
+    do {
+      hrclock_sample(&t1, &n1);
+    } while (n1 - n0 < HRCLOCK_CALIBRATION_NS);
+
+    double ticks_per_ns = (double)(t1 - t0) / (double)(n1 - n0);
+    if (t1 > t0 && ticks_per_ns > 0.01 && ticks_per_ns < 100.0) {
+      c->source = HRCLOCK_SOURCE_TSC;
+      c->base_ticks = t1;
+      c->base_ns = n1;
+      c->ticks_per_ns = ticks_per_ns;
+      c->ns_mult = (uint64_t)((double)(1ULL << HRCLOCK_SHIFT) / ticks_per_ns);
+      c->tick_mult = (uint64_t)((double)(1ULL << HRCLOCK_SHIFT) * ticks_per_ns);
+    }
+  }
+#endif
+
+  UTILS_STORE_RELEASE(&c->initialized, 1);
+}
+
+/**
+ * @brief Calibrate once per process, the first time any file reads the clock
+ */
+static inline const Hrclock *hrclock_get(void) {
+  if (UTILS_UNLIKELY(!UTILS_LOAD_ACQUIRE(&hrclock_state.initialized))) {
+#ifdef UTILS_HAVE_THREADS
+    pthread_once(&hrclock_once, hrclock_calibrate);
+#else
+    hrclock_calibrate();
+#endif
+  }
+  return &hrclock_state;
+}
+
+/**
+ * @brief Calibrate the clock now instead of on first use
+ *
+ * The first read of the clock calibrates it automatically; call this at
+ * startup to keep the busy-wait of HRCLOCK_CALIBRATION_NS (10 ms by default)
+ * out of the first measurement. Calling it again recalibrates, which is only
+ * safe while no other thread reads the clock.
+ *
+ * @return true if the TSC fast path is in use, false for the fallback clock
+ */
+static inline bool hrclock_init(void) {
+  if (UTILS_LOAD_ACQUIRE(&hrclock_state.initialized))
+    hrclock_calibrate();
+  return hrclock_get()->source == HRCLOCK_SOURCE_TSC;
+}
+
+/* ========== READING ========== */
+
+/**
+ * @brief Read the raw monotonic tick counter
+ *
+ * Cheapest read available; convert differences with hrclock_ticks_to_ns().
+ *
+ * @return uint64_t Current tick count
+ */
+static inline uint64_t hrclock_ticks(void) {
+#ifdef HRCLOCK_X86
+  if (hrclock_get()->source == HRCLOCK_SOURCE_TSC)
+    return __rdtsc();
+#endif
+  return hrclock_monotonic_ns();
+}
+
+/**
+ * @brief Convert a tick interval to nanoseconds
+ *
+ * @param ticks Difference between two hrclock_ticks() readings
+ * @return uint64_t Interval in nanoseconds
+ */
+static inline uint64_t hrclock_ticks_to_ns(uint64_t ticks) {
+  const Hrclock *c = hrclock_get();
+  if (c->source != HRCLOCK_SOURCE_TSC)
+    return ticks;
+  return hrclock_scale(ticks, c->ns_mult);
+}
+
+/**
+ * @brief Convert a nanosecond interval to ticks
+ *
+ * @param ns Interval in nanoseconds
+ * @return uint64_t Interval in ticks
+ */
+static inline uint64_t hrclock_ns_to_ticks(uint64_t ns) {
+  const Hrclock *c = hrclock_get();
+  if (c->source != HRCLOCK_SOURCE_TSC)
+    return ns;
+  return hrclock_scale(ns, c->tick_mult);
+}
+
+/**
+ * @brief Read the monotonic clock in nanoseconds
+ *
+ * Values share the CLOCK_MONOTONIC epoch, so they can be compared with
+ * clock_gettime() readings taken in the same process.
+ *
+ * @return uint64_t Current monotonic time in nanoseconds
+ */
+static inline uint64_t hrclock_ns(void) {
+#ifdef HRCLOCK_X86
+  const Hrclock *c = hrclock_get();
+  if (c->source == HRCLOCK_SOURCE_TSC) {
+    uint64_t ticks = __rdtsc() - c->base_ticks;
+    return c->base_ns + hrclock_scale(ticks, c->ns_mult);
+  }
+#endif
+  return hrclock_monotonic_ns();
+}
+
+/**
+ * @brief Nanoseconds elapsed between two tick readings
+ *
+ * @param start Earlier hrclock_ticks() reading
+ * @param end Later hrclock_ticks() reading
+ * @return uint64_t Elapsed time in nanoseconds
+ */
+static inline uint64_t hrclock_elapsed_ns(uint64_t start, uint64_t end) {
+  return hrclock_ticks_to_ns(end - start);
+}
+
+/* ========== INTROSPECTION ========== */
+
+/**
+ * @brief Name of the tick source in use
+ *
+ * @return const char* "tsc" or "monotonic"
+ */
+static inline const char *hrclock_source_name(void) {
+  return hrclock_get()->source == HRCLOCK_SOURCE_TSC ? "tsc" : "monotonic";
+}
+
+/**
+ * @brief Calibrated tick rate
+ *
+ * @return double Ticks per nanosecond (1.0 for the fallback clock)
+ */
+static inline double hrclock_ticks_per_ns(void) {
+  return hrclock_get()->ticks_per_ns;
+}
+
+/**
+ * @brief Measure the cost of one hrclock_ticks() read on this machine
+ *
+ * @param iterations Number of back-to-back reads to average over
+ * @return double Average nanoseconds per read
+ */
+static inline double hrclock_overhead_ns(size_t iterations) {
+  if (iterations == 0)
+    return 0.0;
+
+  volatile uint64_t sink = 0;
+  uint64_t start = hrclock_ticks();
+  for (size_t i = 0; i < iterations; i++)
+    sink += hrclock_ticks();
+  uint64_t end = hrclock_ticks();
+  (void)sink;
+
+  return (double)hrclock_elapsed_ns(start, end) / (double)iterations;
+}
+
+#endif /* HRCLOCK_H */
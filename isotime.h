@@ -0,0 +1,412 @@
+/**
+ * @file isotime.h
+ * @brief Fast ISO-8601 / RFC-3339 timestamp formatting and parsing
+ * @author pucitos
+ *
+ * Converts signed nanoseconds since the Unix epoch to and from text such as
+ * 2024-03-01T12:34:56.789012Z or 2024-03-01T14:34:56+02:00 without strftime,
+ * strptime, gmtime or the locale. Dates use the branch-free civil calendar
+ * algorithms by Howard Hinnant (proleptic Gregorian), and digits are written
+ * two at a time from a lookup table, so formatting is a few divisions and
+ * stores into a caller-provided buffer.
+ *
+ * Every int64_t nanosecond value (years 1677 to 2262) round-trips except
+ * INT64_MIN, which is reserved for ISOTIME_INVALID. The batch functions work
+ * on arrays and reuse the date part while consecutive timestamps fall on the
+ * same day, which is the common case for sorted logs.
+ */
+
+#ifndef ISOTIME_H
+#define ISOTIME_H
+
+#include "utils.h"
+#include <stdint.h>
+
+/**
+ * @brief Buffer size that fits any formatted timestamp plus the terminator
+ *
+ * YYYY-MM-DDTHH:MM:SS.fffffffff+hh:mm is 35 characters.
+ */
+#define ISOTIME_MAX_LEN 36
+
+/**
+ * @brief Marks entries that isotime_parse_batch() could not parse
+ */
+#define ISOTIME_INVALID INT64_MIN
+
+#define ISOTIME_NS_PER_SEC 1000000000LL
+#define ISOTIME_SEC_PER_DAY 86400LL
+
+/* ========== CIVIL CALENDAR ========== */
+
+/**
+ * @brief Days since 1970-01-01 for a proleptic Gregorian date
+ *
+ * @param year Year (may be negative)
+ * @param month Month, 1-12
+ * @param day Day of month, 1-31
+ * @return int64_t Days relative to the epoch (negative before 1970)
+ */
+static inline int64_t isotime_days_from_civil(int year, unsigned month,
+                                              unsigned day) {
+  int64_t y = (int64_t)year - (month <= 2);
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+/**
+ * @brief Proleptic Gregorian date for a number of days since 1970-01-01
+ *
+ * @param days Days relative to the epoch
+ * @param year Output year
+ * @param month Output month, 1-12
+ * @param day Output day of month, 1-31
+ */
+static inline void isotime_civil_from_days(int64_t days, int *year,
+                                           unsigned *month, unsigned *day) {
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  unsigned doe = (unsigned)(days - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+
+  *day = doy - (153 * mp + 2) / 5 + 1;
+  *month = mp < 10 ? mp + 3 : mp - 9;
+  *year = (int)((int64_t)yoe + era * 400 + (*month <= 2));
+}
+
+/**
+ * @brief Number of days in a month
+ *
+ * @param year Year (for February)
+ * @param month Month, 1-12
+ * @return unsigned Days in the month
+ */
+static inline unsigned isotime_days_in_month(int year, unsigned month) {
+  if (month == 2)
+    return (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) ? 29 : 28;
+  return 30 + ((month ^ (month >> 3)) & 1);
+}
+
+/* ========== INTERNAL HELPERS ========== */
+
+static const char isotime_digits[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536"
+    "37383940414243444546474849505152535455565758596061626364656667686970717273"
+    "7475767778798081828384858687888990919293949596979899";
+
+static const int64_t isotime_pow10[10] = {
+    1,      10,      100,      1000,      10000,
+    100000, 1000000, 10000000, 100000000, 1000000000};
+
+static inline void isotime_put2(char *p, unsigned value) {
+  memcpy(p, isotime_digits + 2 * value, 2);
+}
+
+static inline int64_t isotime_floor_div(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  return q - (a % b < 0);
+}
+
+static inline int64_t isotime_split(int64_t epoch_ns, int64_t *nanos) {
+  int64_t r = epoch_ns % ISOTIME_NS_PER_SEC;
+  *nanos = r < 0 ? r + ISOTIME_NS_PER_SEC : r;
+  return epoch_ns / ISOTIME_NS_PER_SEC - (r < 0);
+}
+
+/* Writes YYYY-MM-DDT (11 characters) */
+static inline void isotime_put_date(char *p, int64_t days) {
+  int year;
+  unsigned month, day;
+  isotime_civil_from_days(days, &year, &month, &day);
+  isotime_put2(p, (unsigned)year / 100);
+  isotime_put2(p + 2, (unsigned)year % 100);
+  p[4] = '-';
+  isotime_put2(p + 5, month);
+  p[7] = '-';
+  isotime_put2(p + 8, day);
+  p[10] = 'T';
+}
+
+/* Writes HH:MM:SS[.fff][Z|+hh:mm] and returns its length */
+static inline size_t isotime_put_time(char *p, int64_t second_of_day,
+                                      int64_t nanos, int precision,
+                                      int offset_minutes) {
+  unsigned s = (unsigned)second_of_day;
+  size_t len = 8;
+
+  isotime_put2(p, s / 3600);
+  p[2] = ':';
+  isotime_put2(p + 3, s / 60 % 60);
+  p[5] = ':';
+  isotime_put2(p + 6, s % 60);
+
+  if (precision > 0) {
+    uint32_t frac = (uint32_t)(nanos / isotime_pow10[9 - precision]);
+    p[len] = '.';
+    for (int i = precision; i > 0; i--) {
+      p[len + (size_t)i] = (char)('0' + frac % 10);
+      frac /= 10;
+    }
+    len += (size_t)precision + 1;
+  }
+
+  if (offset_minutes == 0) {
+    p[len++] = 'Z';
+  } else {
+    unsigned off = (unsigned)(offset_minutes < 0 ? -offset_minutes
+                                                 : offset_minutes);
+    p[len] = offset_minutes < 0 ? '-' : '+';
+    isotime_put2(p + len + 1, off / 60);
+    p[len + 3] = ':';
+    isotime_put2(p + len + 4, off % 60);
+    len += 6;
+  }
+  return len;
+}
+
+static inline bool isotime_get_digits(const char *p, int count,
+                                      unsigned *value) {
+  unsigned v = 0;
+  for (int i = 0; i < count; i++) {
+    unsigned d = (unsigned)(unsigned char)p[i] - '0';
+    if (d > 9)
+      return false;
+    v = v * 10 + d;
+  }
+  *value = v;
+  return true;
+}
+
+static inline bool isotime_valid_args(int precision, int offset_minutes) {
+  return precision >= 0 && precision <= 9 && offset_minutes > -24 * 60 &&
+         offset_minutes < 24 * 60;
+}
+
+/* ========== FORMATTING ========== */
+
+/**
+ * @brief Format nanoseconds since the epoch as an RFC-3339 timestamp
+ *
+ * The time is shown in the zone given by offset_minutes: 0 gives a trailing
+ * 'Z', anything else the local time followed by +hh:mm or -hh:mm. Fractional
+ * seconds are truncated to the requested number of digits.
+ *
+ * @param epoch_ns Nanoseconds since 1970-01-01T00:00:00Z
+ * @param precision Fractional second digits, 0-9 (3 = ms, 6 = us, 9 = ns)
+ * @param offset_minutes UTC offset in minutes, e.g. 120 for +02:00
+ * @param buffer Output buffer (ISOTIME_MAX_LEN always suffices)
+ * @param size Size of the output buffer
+ * @return size_t Length written excluding the terminator, or 0 if the
+ * arguments are invalid or the buffer is too small
+ */
+static inline size_t isotime_format(int64_t epoch_ns, int precision,
+                                     int offset_minutes, char *buffer,
+                                     size_t size) {
+  if (buffer == NULL || !isotime_valid_args(precision, offset_minutes))
+    return 0;
+
+  size_t need = 20 + (precision > 0 ? (size_t)precision + 1 : 0) +
+                (offset_minutes != 0 ? 6 : 1);
+  if (size < need)
+    return 0;
+
+  int64_t nanos;
+  int64_t secs = isotime_split(epoch_ns, &nanos);
+  secs += (int64_t)offset_minutes * 60;
+  int64_t days = isotime_floor_div(secs, ISOTIME_SEC_PER_DAY);
+
+  isotime_put_date(buffer, days);
+  size_t len = 11 + isotime_put_time(buffer + 11,
+                                     secs - days * ISOTIME_SEC_PER_DAY, nanos,
+                                     precision, offset_minutes);
+  buffer[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief Format an array of timestamps into fixed-width slots
+ *
+ * Timestamp i is written, NUL-terminated, at out + i * stride. The date part
+ * is only recomputed when the day changes.
+ *
+ * @param epoch_ns Timestamps in nanoseconds since the epoch
+ * @param count Number of timestamps
+ * @param precision Fractional second digits, 0-9
+ * @param offset_minutes UTC offset in minutes
+ * @param out Output array of count * stride bytes
+ * @param stride Bytes per slot (ISOTIME_MAX_LEN always suffices)
+ * @return size_t Number of timestamps written: count on success, 0 if the
+ * arguments are invalid or stride is too small
+ */
+static inline size_t isotime_format_batch(const int64_t *epoch_ns,
+                                          size_t count, int precision,
+                                          int offset_minutes, char *out,
+                                          size_t stride) {
+  if (epoch_ns == NULL || out == NULL ||
+      !isotime_valid_args(precision, offset_minutes))
+    return 0;
+
+  size_t need = 20 + (precision > 0 ? (size_t)precision + 1 : 0) +
+                (offset_minutes != 0 ? 6 : 1);
+  if (stride < need)
+    return 0;
+
+  int64_t cached_day = INT64_MIN;
+  char date[11];
+
+  for (size_t i = 0; i < count; i++) {
+    char *p = out + i * stride;
+    int64_t nanos;
+    int64_t secs = isotime_split(epoch_ns[i], &nanos);
+    secs += (int64_t)offset_minutes * 60;
+    int64_t days = isotime_floor_div(secs, ISOTIME_SEC_PER_DAY);
+
+    if (days != cached_day) {
+      isotime_put_date(date, days);
+      cached_day = days;
+    }
+    memcpy(p, date, sizeof(date));
+    size_t len = 11 + isotime_put_time(p + 11,
+                                       secs - days * ISOTIME_SEC_PER_DAY,
+                                       nanos, precision, offset_minutes);
+    p[len] = '\0';
+  }
+  return count;
+}
+
+/* ========== PARSING ========== */
+
+/**
+ * @brief Parse an RFC-3339 timestamp
+ *
+ * Accepts YYYY-MM-DD, a 'T', 't' or ' ' separator, HH:MM:SS, an optional
+ * fraction of 1 to 9 digits (further digits are truncated), and a zone of
+ * 'Z', 'z', +hh:mm, -hh:mm, +hhmm or -hhmm. A leap second (:60) is accepted
+ * and lands on the following second.
+ *
+ * @param text Input text; it does not need to be NUL-terminated
+ * @param length Number of characters available in text
+ * @param epoch_ns Output nanoseconds since the epoch (UTC)
+ * @param offset_minutes Output UTC offset that was given, or NULL
+ * @return size_t Characters consumed, or 0 if the text is not a valid
+ * timestamp or is out of range for int64_t nanoseconds
+ */
+static inline size_t isotime_parse(const char *text, size_t length,
+                                   int64_t *epoch_ns, int *offset_minutes) {
+  unsigned year, month, day, hour, minute, second;
+
+  if (text == NULL || epoch_ns == NULL || length < 20)
+    return 0;
+  if (!isotime_get_digits(text, 4, &year) || text[4] != '-' ||
+      !isotime_get_digits(text + 5, 2, &month) || text[7] != '-' ||
+      !isotime_get_digits(text + 8, 2, &day) ||
+      (text[10] != 'T' && text[10] != 't' && text[10] != ' ') ||
+      !isotime_get_digits(text + 11, 2, &hour) || text[13] != ':' ||
+      !isotime_get_digits(text + 14, 2, &minute) || text[16] != ':' ||
+      !isotime_get_digits(text + 17, 2, &second))
+    return 0;
+
+  if (month < 1 || month > 12 || day < 1 ||
+      day > isotime_days_in_month((int)year, month) || hour > 23 ||
+      minute > 59 || second > 60)
+    return 0;
+
+  size_t pos = 19;
+  int64_t nanos = 0;
+  if (text[pos] == '.') {
+    size_t start = ++pos;
+    while (pos < length && (unsigned)(unsigned char)text[pos] - '0' <= 9) {
+      if (pos - start < 9)
+        nanos = nanos * 10 + (text[pos] - '0');
+      pos++;
+    }
+    size_t digits = pos - start;
+    if (digits == 0 || pos >= length)
+      return 0;
+    if (digits < 9)
+      nanos *= isotime_pow10[9 - digits];
+  }
+
+  int offset = 0;
+  char zone = text[pos];
+  if (zone == 'Z' || zone == 'z') {
+    pos++;
+  } else if (zone == '+' || zone == '-') {
+    unsigned oh, om;
+    if (pos + 5 > length || !isotime_get_digits(text + pos + 1, 2, &oh))
+      return 0;
+    size_t mpos = pos + 3;
+    if (text[mpos] == ':') {
+      if (pos + 6 > length)
+        return 0;
+      mpos++;
+    }
+    if (!isotime_get_digits(text + mpos, 2, &om) || oh > 23 || om > 59)
+      return 0;
+    offset = (int)(oh * 60 + om);
+    if (zone == '-')
+      offset = -offset;
+    pos = mpos + 2;
+  } else {
+    return 0;
+  }
+
+  int64_t secs = isotime_days_from_civil((int)year, month, day) *
+                     ISOTIME_SEC_PER_DAY +
+                 (int64_t)(hour * 3600 + minute * 60 + second) -
+                 (int64_t)offset * 60;
+
+  /* INT64_MIN itself is reserved for ISOTIME_INVALID */
+  const int64_t max_secs = INT64_MAX / ISOTIME_NS_PER_SEC;
+  const int64_t min_secs = INT64_MIN / ISOTIME_NS_PER_SEC - 1;
+  if (secs > max_secs || secs < min_secs ||
+      (secs == max_secs && nanos > INT64_MAX % ISOTIME_NS_PER_SEC) ||
+      (secs == min_secs &&
+       nanos <= ISOTIME_NS_PER_SEC + INT64_MIN % ISOTIME_NS_PER_SEC))
+    return 0;
+
+  if (secs < 0)
+    *epoch_ns = (secs + 1) * ISOTIME_NS_PER_SEC + (nanos - ISOTIME_NS_PER_SEC);
+  else
+    *epoch_ns = secs * ISOTIME_NS_PER_SEC + nanos;
+  if (offset_minutes != NULL)
+    *offset_minutes = offset;
+  return pos;
+}
+
+/**
+ * @brief Parse an array of NUL-terminated timestamps
+ *
+ * Entries that are NULL, invalid or followed by extra characters are stored
+ * as ISOTIME_INVALID.
+ *
+ * @param texts Input strings
+ * @param count Number of strings
+ * @param epoch_ns Output array of count timestamps
+ * @return size_t Number of entries parsed successfully
+ */
+static inline size_t isotime_parse_batch(const char *const *texts,
+                                         size_t count, int64_t *epoch_ns) {
+  size_t parsed = 0;
+
+  if (texts == NULL || epoch_ns == NULL)
+    return 0;
+
+  for (size_t i = 0; i < count; i++) {
+    size_t length = texts[i] != NULL ? strlen(texts[i]) : 0;
+    if (length > 0 && isotime_parse(texts[i], length, &epoch_ns[i], NULL) ==
+                          length) {
+      parsed++;
+    } else {
+      epoch_ns[i] = ISOTIME_INVALID;
+    }
+  }
+  return parsed;
+}
+
+#endif /* ISOTIME_H */
@@ -0,0 +1,369 @@
+/**
+ * @file json.h
+ * @brief JSON string escaping and unescaping
+ * @author pucitos
+ *
+ * Escaping scans ahead for the next quote, backslash or control character
+ * 16 or 32 bytes at a time and copies the clean span in bulk, so typical text
+ * that needs few escapes moves at memcpy speed. Unescaping uses the same
+ * scanner and decodes \uXXXX sequences, including surrogate pairs, to UTF-8.
+ * Define JSON_NO_SIMD to force the scalar scanner.
+ */
+
+#ifndef JSON_H
+#define JSON_H
+
+#include "utils.h"
+#include <stdint.h>
+
+#if !defined(JSON_NO_SIMD) && defined(__GNUC__) &&                            \
+    (defined(__x86_64__) || defined(__i386__))
+#define JSON_X86 1
+#include <immintrin.h>
+#define JSON_TARGET(isa) __attribute__((target(isa), noinline))
+#endif
+
+/* ========== INTERNAL HELPERS ========== */
+
+static inline bool json_needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+#ifdef JSON_X86
+
+JSON_TARGET("sse2")
+static size_t json_scan_sse2(const char *src, size_t len) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1f);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+    int mask = _mm_movemask_epi8(hit);
+    if (mask != 0)
+      return i + (size_t)__builtin_ctz((unsigned int)mask);
+  }
+  return i;
+}
+
+JSON_TARGET("avx2")
+static size_t json_scan_avx2(const char *src, size_t len) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i control = _mm256_set1_epi8(0x1f);
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i hit = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                        _mm256_cmpeq_epi8(v, backslash)),
+        _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+    if (mask != 0)
+      return i + (size_t)__builtin_ctz(mask);
+  }
+  return i;
+}
+
+#endif /* JSON_X86 */
+
+/**
+ * @brief Append a code point as UTF-8
+ *
+ * @return size_t Number of bytes written (1-4)
+ */
+static inline size_t json_put_utf8(char *dst, uint32_t cp) {
+  if (cp < 0x80) {
+    dst[0] = (char)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    dst[0] = (char)(0xc0 | (cp >> 6));
+    dst[1] = (char)(0x80 | (cp & 0x3f));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    dst[0] = (char)(0xe0 | (cp >> 12));
+    dst[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    dst[2] = (char)(0x80 | (cp & 0x3f));
+    return 3;
+  }
+  dst[0] = (char)(0xf0 | (cp >> 18));
+  dst[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+  dst[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+  dst[3] = (char)(0x80 | (cp & 0x3f));
+  return 4;
+}
+
+/**
+ * @brief Parse four hex digits
+ *
+ * @return long The value, or -1 if any digit is invalid
+ */
+static inline long json_parse_hex4(const char *src) {
+  long v = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = src[i];
+    v <<= 4;
+    if (c >= '0' && c <= '9')
+      v |= c - '0';
+    else if (c >= 'a' && c <= 'f')
+      v |= c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      v |= c - 'A' + 10;
+    else
+      return -1;
+  }
+  return v;
+}
+
+/* ========== SCANNING ========== */
+
+/**
+ * @brief Find the next byte that must be escaped inside a JSON string
+ *
+ * @param src Bytes to scan
+ * @param len Number of bytes
+ * @return size_t Offset of the first quote, backslash or control character,
+ * or len if there is none
+ */
+static inline size_t json_find_escape(const char *src, size_t len) {
+  size_t i = 0;
+
+  if (src == NULL)
+    return len;
+
+#ifdef JSON_X86
+  if (len >= 32 && __builtin_cpu_supports("avx2")) {
+    i = json_scan_avx2(src, len);
+    if (i < len && json_needs_escape((unsigned char)src[i]))
+      return i;
+  }
+  if (len - i >= 16)
+    i += json_scan_sse2(src + i, len - i);
+#endif
+
+  while (i < len && !json_needs_escape((unsigned char)src[i]))
+    i++;
+  return i;
+}
+
+/* ========== ESCAPING ========== */
+
+/**
+ * @brief Exact length of the escaped form of a buffer
+ *
+ * @param src Bytes to escape
+ * @param len Number of bytes
+ * @return size_t Escaped length, excluding quotes and NUL terminator
+ */
+static inline size_t json_escaped_length(const char *src, size_t len) {
+  size_t total = len;
+  size_t i = 0;
+
+  while ((i += json_find_escape(src + i, len - i)) < len) {
+    unsigned char c = (unsigned char)src[i++];
+    bool shorthand = c == '"' || c == '\\' || c == '\b' || c == '\f' ||
+                     c == '\n' || c == '\r' || c == '\t';
+    total += shorthand ? 1 : 5;
+  }
+  return total;
+}
+
+/**
+ * @brief Escape a buffer for use inside a JSON string literal
+ *
+ * Quotes are not added. Bytes >= 0x80 are copied unchanged, so valid UTF-8
+ * input produces valid UTF-8 output.
+ *
+ * @param src Bytes to escape
+ * @param len Number of bytes
+ * @param dst Destination with room for json_escaped_length() + 1 chars, or
+ * 6 * len + 1 as a cheap upper bound
+ * @return size_t Number of characters written, excluding the NUL terminator
+ */
+static inline size_t json_escape(const char *src, size_t len, char *dst) {
+  static const char hex[] = "0123456789abcdef";
+  size_t i = 0;
+  size_t o = 0;
+
+  if ((src == NULL && len > 0) || dst == NULL)
+    return 0;
+
+  for (;;) {
+    size_t clean = json_find_escape(src + i, len - i);
+    memcpy(dst + o, src + i, clean);
+    i += clean;
+    o += clean;
+    if (i == len)
+      break;
+
+    unsigned char c = (unsigned char)src[i++];
+    dst[o++] = '\\';
+    switch (c) {
+    case '"':
+      dst[o++] = '"';
+      break;
+    case '\\':
+      dst[o++] = '\\';
+      break;
+    case '\b':
+      dst[o++] = 'b';
+      break;
+    case '\f':
+      dst[o++] = 'f';
+      break;
+    case '\n':
+      dst[o++] = 'n';
+      break;
+    case '\r':
+      dst[o++] = 'r';
+      break;
+    case '\t':
+      dst[o++] = 't';
+      break;
+    default:
+      dst[o++] = 'u';
+      dst[o++] = '0';
+      dst[o++] = '0';
+      dst[o++] = hex[c >> 4];
+      dst[o++] = hex[c & 0x0f];
+      break;
+    }
+  }
+
+  dst[o] = '\0';
+  return o;
+}
+
+/**
+ * @brief Escape a NUL-terminated string into a newly allocated string
+ *
+ * @param str String to escape
+ * @return char* Newly allocated escaped string, or NULL if str is NULL
+ */
+static inline char *json_escape_alloc(const char *str) {
+  if (str == NULL)
+    return NULL;
+
+  size_t len = strlen(str);
+  char *dst = (char *)safe_malloc(json_escaped_length(str, len) + 1);
+  json_escape(str, len, dst);
+  return dst;
+}
+
+/* ========== UNESCAPING ========== */
+
+/**
+ * @brief Decode the body of a JSON string literal
+ *
+ * Handles every JSON escape, converts \uXXXX (with surrogate pairs) to UTF-8
+ * and rejects unescaped quotes, control characters, unknown escapes and
+ * unpaired surrogates. The output is never longer than the input.
+ *
+ * @param src String body without the surrounding quotes
+ * @param len Number of characters
+ * @param dst Destination with room for len + 1 bytes; may be the same buffer
+ * as src
+ * @param out_len Receives the decoded length (may be NULL)
+ * @return true on success, false on malformed input
+ */
+static inline bool json_unescape(const char *src, size_t len, char *dst,
+                                 size_t *out_len) {
+  size_t i = 0;
+  size_t o = 0;
+
+  if (out_len != NULL)
+    *out_len = 0;
+  if ((src == NULL && len > 0) || dst == NULL)
+    return false;
+
+  for (;;) {
+    size_t clean = json_find_escape(src + i, len - i);
+    if (dst + o != src + i)
+      memmove(dst + o, src + i, clean);
+    i += clean;
+    o += clean;
+    if (i == len)
+      break;
+
+    if (src[i] != '\\' || i + 1 == len)
+      return false;
+
+    char c = src[i + 1];
+    i += 2;
+    switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+      dst[o++] = c;
+      break;
+    case 'b':
+      dst[o++] = '\b';
+      break;
+    case 'f':
+      dst[o++] = '\f';
+      break;
+    case 'n':
+      dst[o++] = '\n';
+      break;
+    case 'r':
+      dst[o++] = '\r';
+      break;
+    case 't':
+      dst[o++] = '\t';
+      break;
+    case 'u': {
+      long cp = len - i >= 4 ? json_parse_hex4(src + i) : -1;
+      if (cp < 0 || (cp >= 0xdc00 && cp <= 0xdfff))
+        return false;
+      i += 4;
+
+      if (cp >= 0xd800 && cp <= 0xdbff) {
+        long low = -1;
+        if (len - i >= 6 && src[i] == '\\' && src[i + 1] == 'u')
+          low = json_parse_hex4(src + i + 2);
+        if (low < 0xdc00 || low > 0xdfff)
+          return false;
+        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+        i += 6;
+      }
+      o += json_put_utf8(dst + o, (uint32_t)cp);
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+
+  dst[o] = '\0';
+  if (out_len != NULL)
+    *out_len = o;
+  return true;
+}
+
+/**
+ * @brief Decode a JSON string body into a newly allocated string
+ *
+ * @param str String body without the surrounding quotes
+ * @return char* Newly allocated decoded string, or NULL on malformed input
+ */
+static inline char *json_unescape_alloc(const char *str) {
+  if (str == NULL)
+    return NULL;
+
+  size_t len = strlen(str);
+  char *dst = (char *)safe_malloc(len + 1);
+  if (!json_unescape(str, len, dst, NULL)) {
+    free(dst);
+    return NULL;
+  }
+  return dst;
+}
+
+#endif /* JSON_H */
@@ -0,0 +1,331 @@
+/**
+ * @file perfcount.h
+ * @brief Wall time, thread CPU time and hardware counters for code regions
+ * @author pucitos
+ *
+ * Wall time alone cannot tell CPU work from waiting. A PerfSample records
+ * wall time (hrclock_ns()), the calling thread's CPU time and, on Linux where
+ * perf_event_open() is permitted, user-space cycles, instructions, cache
+ * misses and branch misses. Counters are opened per thread, as one group so
+ * they are scheduled together, and scaled when the kernel multiplexes them.
+ *
+ * Containers and VMs often block perf_event_open() (seccomp,
+ * kernel.perf_event_paranoid > 2, no PMU). Opening then still succeeds with
+ * only wall and CPU time valid; check PerfSample.valid or
+ * perfcount_status() before trusting the hardware fields.
+ */
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+/*
+ * syscall() is a glibc extension, declared only under _DEFAULT_SOURCE. This
+ * takes effect when perfcount.h comes before any system header; otherwise
+ * define _DEFAULT_SOURCE (or _GNU_SOURCE) at the top of the source file.
+ */
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE) && !defined(_GNU_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "hrclock.h"
+#include <stdint.h>
+
+#ifdef __linux__
+#define PERFCOUNT_HAVE_EVENTS 1
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Flags in PerfSample.valid
+ */
+#define PERFCOUNT_WALL 1
+#define PERFCOUNT_CPU 2
+#define PERFCOUNT_CYCLES 4
+#define PERFCOUNT_INSTRUCTIONS 8
+#define PERFCOUNT_CACHE_MISSES 16
+#define PERFCOUNT_BRANCH_MISSES 32
+
+#define PERFCOUNT_EVENTS 4
+
+/**
+ * @brief One measurement, or the difference between two
+ */
+typedef struct {
+  unsigned valid; /* PERFCOUNT_* flags for the fields below */
+  uint64_t wall_ns;
+  uint64_t cpu_ns;
+  uint64_t cycles;
+  uint64_t instructions;
+  uint64_t cache_misses;
+  uint64_t branch_misses;
+} PerfSample;
+
+/**
+ * @brief Counters opened for one thread
+ */
+typedef struct {
+  int fds[PERFCOUNT_EVENTS]; /* -1 when the event could not be opened */
+  int leader;                /* Group leader fd, or -1 */
+  unsigned valid;            /* PERFCOUNT_* flags that can be measured */
+  int error;                 /* errno from the failed leader open, or 0 */
+} PerfCounters;
+
+/* ========== INTERNAL HELPERS ========== */
+
+/**
+ * @brief Thread CPU time in nanoseconds, or 0 if unsupported
+ */
+static inline uint64_t perfcount_thread_cpu_ns(void) {
+#ifdef _WIN32
+  FILETIME created, exited, kernel, user;
+  if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+    return 0;
+  uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+  uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+  return (k + u) * 100;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#else
+  return 0;
+#endif
+}
+
+#ifdef PERFCOUNT_HAVE_EVENTS
+static const struct {
+  uint64_t config;
+  unsigned flag;
+} perfcount_events[PERFCOUNT_EVENTS] = {
+    {PERF_COUNT_HW_CPU_CYCLES, PERFCOUNT_CYCLES},
+    {PERF_COUNT_HW_INSTRUCTIONS, PERFCOUNT_INSTRUCTIONS},
+    {PERF_COUNT_HW_CACHE_MISSES, PERFCOUNT_CACHE_MISSES},
+    {PERF_COUNT_HW_BRANCH_MISSES, PERFCOUNT_BRANCH_MISSES},
+};
+
+static inline int perfcount_open_event(uint64_t config, int group) {
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                     PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+/* ========== COUNTERS ========== */
+
+/**
+ * @brief Open counters for the calling thread
+ *
+ * Wall and CPU time are always available. Hardware events that cannot be
+ * opened are left out; see perfcount_status() for the reason.
+ *
+ * @param pc Counters to initialize; read them only from the same thread
+ * @return true if at least one hardware counter is available
+ */
+static inline bool perfcount_open(PerfCounters *pc) {
+  pc->leader = -1;
+  pc->error = 0;
+  pc->valid = PERFCOUNT_WALL;
+  /* Calibrate here, not between the CPU and wall reads of the first sample */
+  hrclock_get();
+  if (perfcount_thread_cpu_ns() != 0)
+    pc->valid |= PERFCOUNT_CPU;
+  for (int i = 0; i < PERFCOUNT_EVENTS; i++)
+    pc->fds[i] = -1;
+
+#ifdef PERFCOUNT_HAVE_EVENTS
+  if (getenv("PERFCOUNT_DISABLE") != NULL)
+    return false;
+
+  for (int i = 0; i < PERFCOUNT_EVENTS; i++) {
+    int fd = perfcount_open_event(perfcount_events[i].config, pc->leader);
+    if (fd < 0) {
+      if (pc->leader < 0)
+        pc->error = errno;
+      continue;
+    }
+    if (pc->leader < 0)
+      pc->leader = fd;
+    pc->fds[i] = fd;
+    pc->valid |= perfcount_events[i].flag;
+  }
+  if (pc->leader >= 0)
+    pc->error = 0;
+#else
+  pc->error = ENOSYS;
+#endif
+  return pc->leader >= 0;
+}
+
+/**
+ * @brief Close counters opened by perfcount_open()
+ *
+ * @param pc Counters to close
+ */
+static inline void perfcount_close(PerfCounters *pc) {
+#ifdef PERFCOUNT_HAVE_EVENTS
+  for (int i = 0; i < PERFCOUNT_EVENTS; i++) {
+    if (pc->fds[i] >= 0)
+      close(pc->fds[i]);
+    pc->fds[i] = -1;
+  }
+#endif
+  pc->leader = -1;
+  pc->valid &= PERFCOUNT_WALL | PERFCOUNT_CPU;
+}
+
+/**
+ * @brief Describe why hardware counters are or are not available
+ *
+ * @param pc Counters after perfcount_open()
+ * @return const char* Static description
+ */
+static inline const char *perfcount_status(const PerfCounters *pc) {
+  if (pc->leader >= 0)
+    return "hardware counters available";
+  switch (pc->error) {
+  case 0:
+    return "hardware counters disabled";
+  case EACCES:
+  case EPERM:
+    return "perf_event_open not permitted (perf_event_paranoid or seccomp)";
+  case ENOENT:
+  case EOPNOTSUPP:
+    return "no hardware PMU (virtual machine?)";
+  case ENOSYS:
+    return "perf_event_open not supported on this platform";
+  default:
+    return "perf_event_open failed";
+  }
+}
+
+/**
+ * @brief Take a measurement of the calling thread
+ *
+ * @param pc Counters opened by this thread
+ * @param out Sample to fill
+ */
+static inline void perfcount_read(const PerfCounters *pc, PerfSample *out) {
+  memset(out, 0, sizeof(*out));
+  out->valid = pc->valid;
+
+#ifdef PERFCOUNT_HAVE_EVENTS
+  if (pc->leader >= 0) {
+    /* nr, time_enabled, time_running, then {value, id} per event */
+    uint64_t data[3 + 2 * PERFCOUNT_EVENTS];
+    ssize_t n = read(pc->leader, data, sizeof(data));
+    if (n < (ssize_t)(3 * sizeof(uint64_t))) {
+      out->valid &= PERFCOUNT_WALL | PERFCOUNT_CPU;
+    } else {
+      uint64_t nr = data[0];
+      double scale = data[2] > 0 && data[2] < data[1]
+                         ? (double)data[1] / (double)data[2]
+                         : 1.0;
+      uint64_t *fields[PERFCOUNT_EVENTS] = {
+          &out->cycles, &out->instructions, &out->cache_misses,
+          &out->branch_misses};
+
+      /* Values come back in the order the events were opened */
+      size_t slot = 0;
+      for (int i = 0; i < PERFCOUNT_EVENTS && slot < nr; i++) {
+        if (pc->fds[i] < 0)
+          continue;
+        uint64_t value = data[3 + 2 * slot];
+        *fields[i] = scale == 1.0 ? value : (uint64_t)((double)value * scale);
+        slot++;
+      }
+      if (data[2] == 0)
+        out->valid &= PERFCOUNT_WALL | PERFCOUNT_CPU;
+    }
+  }
+#endif
+
+  out->cpu_ns = perfcount_thread_cpu_ns();
+  out->wall_ns = hrclock_ns();
+}
+
+/**
+ * @brief Difference between two samples of the same thread
+ *
+ * @param start Earlier sample
+ * @param end Later sample
+ * @param delta Output; only fields valid in both samples are set
+ */
+static inline void perfcount_diff(const PerfSample *start,
+                                  const PerfSample *end, PerfSample *delta) {
+  delta->valid = start->valid & end->valid;
+  delta->wall_ns = end->wall_ns - start->wall_ns;
+  delta->cpu_ns = end->cpu_ns - start->cpu_ns;
+  delta->cycles = end->cycles - start->cycles;
+  delta->instructions = end->instructions - start->instructions;
+  delta->cache_misses = end->cache_misses - start->cache_misses;
+  delta->branch_misses = end->branch_misses - start->branch_misses;
+}
+
+/**
+ * @brief Instructions per cycle of a delta
+ *
+ * @return double IPC, or 0 if cycles or instructions were not measured
+ */
+static inline double perfcount_ipc(const PerfSample *delta) {
+  unsigned need = PERFCOUNT_CYCLES | PERFCOUNT_INSTRUCTIONS;
+  if ((delta->valid & need) != need || delta->cycles == 0)
+    return 0.0;
+  return (double)delta->instructions / (double)delta->cycles;
+}
+
+/**
+ * @brief Fraction of wall time the thread spent on the CPU
+ *
+ * @return double Between 0 and 1 (roughly), or 0 if CPU time is unavailable
+ */
+static inline double perfcount_cpu_ratio(const PerfSample *delta) {
+  if (!(delta->valid & PERFCOUNT_CPU) || delta->wall_ns == 0)
+    return 0.0;
+  return (double)delta->cpu_ns / (double)delta->wall_ns;
+}
+
+/**
+ * @brief Print a delta on one line, skipping unavailable fields
+ *
+ * @param label Prefix for the line (may be NULL)
+ * @param delta Difference from perfcount_diff()
+ * @param file Output stream
+ */
+static inline void perfcount_print(const char *label, const PerfSample *delta,
+                                   FILE *file) {
+  if (label != NULL)
+    fprintf(file, "%s: ", label);
+  fprintf(file, "wall %.3f ms", (double)delta->wall_ns / 1e6);
+  if (delta->valid & PERFCOUNT_CPU)
+    fprintf(file, ", cpu %.3f ms (%.0f%%)", (double)delta->cpu_ns / 1e6,
+            perfcount_cpu_ratio(delta) * 100.0);
+  if (delta->valid & PERFCOUNT_CYCLES)
+    fprintf(file, ", %llu cycles", (unsigned long long)delta->cycles);
+  if (delta->valid & PERFCOUNT_INSTRUCTIONS)
+    fprintf(file, ", %llu instructions",
+            (unsigned long long)delta->instructions);
+  if ((delta->valid & PERFCOUNT_CYCLES) &&
+      (delta->valid & PERFCOUNT_INSTRUCTIONS))
+    fprintf(file, " (IPC %.2f)", perfcount_ipc(delta));
+  if (delta->valid & PERFCOUNT_CACHE_MISSES)
+    fprintf(file, ", %llu cache misses",
+            (unsigned long long)delta->cache_misses);
+  if (delta->valid & PERFCOUNT_BRANCH_MISSES)
+    fprintf(file, ", %llu branch misses",
+            (unsigned long long)delta->branch_misses);
+  fputc('\n', file);
+}
+
+#endif /* PERFCOUNT_H */
@@ -0,0 +1,580 @@
+/**
+ * @file ratelimit.h
+ * @brief Lock-free token-bucket and sliding-window rate limiters
+ * @author pucitos
+ *
+ * Both limiters keep their whole state in one 64-bit atomic updated with a
+ * compare-and-swap, so any number of threads can share one limiter without
+ * locks. Time comes from hrclock_ns(); the *_at variants take an explicit
+ * monotonic timestamp instead.
+ *
+ * - Token bucket: sustained rate with bursts, implemented as GCRA (the
+ *   state is the theoretical arrival time of the next request).
+ * - Sliding window: at most `limit` events per window, estimated from the
+ *   current and previous fixed windows weighted by overlap. Limits are capped
+ *   at RATELIMIT_WINDOW_MAX because both counts are packed into the state.
+ *
+ * RateLimitMap holds one limiter per string key (client, IP, log site...)
+ * in a hash table split into independently locked stripes.
+ *
+ * LOG_RATE_LIMITED() gives each log call site its own static sliding-window
+ * limiter and reports how many lines it dropped with the next one it lets
+ * through.
+ */
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include "hrclock.h"
+#include <stdint.h>
+
+#ifndef _WIN32
+#define RATELIMIT_HAVE_THREADS 1
+#include <pthread.h>
+#endif
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L &&               \
+    !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define RATELIMIT_ATOMIC _Atomic
+#define RATELIMIT_LOAD(p) atomic_load_explicit(p, memory_order_relaxed)
+#define RATELIMIT_STORE(p, v) atomic_store_explicit(p, v, memory_order_relaxed)
+#define RATELIMIT_FETCH_ADD(p, v)                                              \
+  atomic_fetch_add_explicit(p, v, memory_order_relaxed)
+#define RATELIMIT_FETCH_SUB(p, v)                                              \
+  atomic_fetch_sub_explicit(p, v, memory_order_relaxed)
+#define RATELIMIT_CAS(p, expected, v)                                          \
+  atomic_compare_exchange_weak_explicit(p, expected, v, memory_order_relaxed, \
+                                        memory_order_relaxed)
+#elif defined(__GNUC__)
+#define RATELIMIT_ATOMIC
+#define RATELIMIT_LOAD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define RATELIMIT_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define RATELIMIT_FETCH_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define RATELIMIT_FETCH_SUB(p, v) __atomic_fetch_sub(p, v, __ATOMIC_RELAXED)
+#define RATELIMIT_CAS(p, expected, v)                                          \
+  __atomic_compare_exchange_n(p, expected, v, true, __ATOMIC_RELAXED,          \
+                              __ATOMIC_RELAXED)
+#else
+#error "ratelimit.h needs C11 atomics or GCC-compatible atomic builtins"
+#endif
+
+#define RATELIMIT_COUNT_BITS 21
+#define RATELIMIT_WINDOW_MAX ((1ULL << RATELIMIT_COUNT_BITS) - 1)
+#define RATELIMIT_ID_BITS (64 - 2 * RATELIMIT_COUNT_BITS)
+/* Windows a caller's timestamp may trail the stored window by */
+#define RATELIMIT_WINDOW_LAG 64
+
+/**
+ * @brief Number of independently locked stripes in a RateLimitMap
+ */
+#ifndef RATELIMIT_MAP_STRIPES
+#define RATELIMIT_MAP_STRIPES 64
+#endif
+
+/**
+ * @brief Limiter algorithm
+ */
+typedef enum { RATELIMIT_TOKEN_BUCKET, RATELIMIT_SLIDING_WINDOW } RateLimitKind;
+
+/**
+ * @brief A rate limiter; safe to share between threads
+ */
+typedef struct {
+  RateLimitKind kind;
+  uint64_t interval; /* Token bucket: ns per token. Window: window length */
+  uint64_t limit;    /* Token bucket: burst in ns. Window: events per window */
+  RATELIMIT_ATOMIC uint64_t state;
+} RateLimiter;
+
+/**
+ * @brief Static initializer for a sliding-window limiter
+ *
+ * Equivalent to ratelimit_sliding_window_init() for constant arguments, so
+ * limiters with static storage need no setup call. The arguments are not
+ * checked: limit must be 1 to RATELIMIT_WINDOW_MAX and window_ns nonzero.
+ */
+#define RATELIMIT_SLIDING_WINDOW_INIT(limit, window_ns)                        \
+  {RATELIMIT_SLIDING_WINDOW, (window_ns), (limit), 0}
+
+typedef struct RateLimitEntry {
+  struct RateLimitEntry *next;
+  uint64_t hash;
+  RATELIMIT_ATOMIC uint64_t last_used;
+  RateLimiter limiter;
+  char key[];
+} RateLimitEntry;
+
+typedef struct {
+#ifdef RATELIMIT_HAVE_THREADS
+  pthread_mutex_t lock;
+#endif
+  RateLimitEntry **buckets;
+  size_t bucket_count;
+  size_t count;
+} RateLimitStripe;
+
+/**
+ * @brief Per-key limiters sharing one configuration
+ */
+typedef struct {
+  RateLimiter prototype;
+  RateLimitStripe stripes[RATELIMIT_MAP_STRIPES];
+} RateLimitMap;
+
+/* ========== INTERNAL HELPERS ========== */
+
+static inline uint64_t ratelimit_hash(const char *key) {
+  uint64_t h = 14695981039346656037ULL;
+  for (; *key; key++) {
+    h ^= (unsigned char)*key;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static inline uint64_t ratelimit_pack(uint64_t id, uint64_t prev,
+                                      uint64_t curr) {
+  return (id << (2 * RATELIMIT_COUNT_BITS)) | (prev << RATELIMIT_COUNT_BITS) |
+         curr;
+}
+
+static inline bool ratelimit_bucket_allow(RateLimiter *rl, uint64_t n,
+                                          uint64_t now) {
+  uint64_t cost = n * rl->interval;
+  uint64_t tat = RATELIMIT_LOAD(&rl->state);
+
+  for (;;) {
+    uint64_t start = tat > now ? tat : now;
+    if (start + cost - now > rl->limit)
+      return false;
+    if (RATELIMIT_CAS(&rl->state, &tat, start + cost))
+      return true;
+  }
+}
+
+/*
+ * Windows between the stored window and the caller's. A thread that read
+ * the clock just before another one moved the state to a newer window sees
+ * an id slightly ahead of its own; it counts against the stored window from
+ * its start, so the id never moves backwards and that window's count is
+ * never reset. Ids wrap, so only a lag of up to RATELIMIT_WINDOW_LAG windows
+ * is told apart from a state left idle for most of the id range.
+ */
+static inline uint64_t ratelimit_window_age(uint64_t window, uint64_t id,
+                                            uint64_t *elapsed) {
+  const uint64_t id_mask = (1ULL << RATELIMIT_ID_BITS) - 1;
+  uint64_t age = (window - id) & id_mask;
+
+  if (age > id_mask - RATELIMIT_WINDOW_LAG) {
+    *elapsed = 0;
+    return 0;
+  }
+  return age;
+}
+
+static inline bool ratelimit_window_allow(RateLimiter *rl, uint64_t n,
+                                          uint64_t now) {
+  const uint64_t count_mask = RATELIMIT_WINDOW_MAX;
+  const uint64_t id_mask = (1ULL << RATELIMIT_ID_BITS) - 1;
+  uint64_t window = now / rl->interval;
+  uint64_t state = RATELIMIT_LOAD(&rl->state);
+
+  for (;;) {
+    uint64_t id = state >> (2 * RATELIMIT_COUNT_BITS);
+    uint64_t prev = (state >> RATELIMIT_COUNT_BITS) & count_mask;
+    uint64_t curr = state & count_mask;
+    uint64_t elapsed = now % rl->interval;
+    uint64_t age = ratelimit_window_age(window, id, &elapsed);
+
+    if (age == 1) {
+      prev = curr;
+      curr = 0;
+    } else if (age != 0) {
+      prev = 0;
+      curr = 0;
+    }
+
+    double weight = (double)(rl->interval - elapsed) / (double)rl->interval;
+    if ((double)prev * weight + (double)(curr + n) > (double)rl->limit)
+      return false;
+
+    uint64_t next = ratelimit_pack(age == 0 ? id : window & id_mask, prev,
+                                   curr + n);
+    if (RATELIMIT_CAS(&rl->state, &state, next))
+      return true;
+  }
+}
+
+/* ========== LIMITERS ========== */
+
+/**
+ * @brief Initialize a token bucket
+ *
+ * @param rl Limiter to initialize
+ * @param rate Tokens added per second (> 0)
+ * @param burst Bucket capacity in tokens (>= 1); the bucket starts full
+ * @return true on success, false if the parameters are invalid
+ */
+static inline bool ratelimit_token_bucket_init(RateLimiter *rl, double rate,
+                                               uint64_t burst) {
+  if (rl == NULL || !(rate > 0) || burst == 0)
+    return false;
+
+  double interval = 1e9 / rate;
+  if (interval < 1)
+    interval = 1;
+  if (interval * (double)burst > 9.2e18)
+    return false;
+
+  rl->kind = RATELIMIT_TOKEN_BUCKET;
+  rl->interval = (uint64_t)interval;
+  rl->limit = rl->interval * burst;
+  RATELIMIT_STORE(&rl->state, 0);
+  return true;
+}
+
+/**
+ * @brief Initialize a sliding-window counter
+ *
+ * @param rl Limiter to initialize
+ * @param limit Events allowed per window (1 to RATELIMIT_WINDOW_MAX)
+ * @param window_ns Window length in nanoseconds
+ * @return true on success, false if the parameters are invalid
+ */
+static inline bool ratelimit_sliding_window_init(RateLimiter *rl,
+                                                 uint64_t limit,
+                                                 uint64_t window_ns) {
+  if (rl == NULL || limit == 0 || limit > RATELIMIT_WINDOW_MAX ||
+      window_ns == 0)
+    return false;
+
+  rl->kind = RATELIMIT_SLIDING_WINDOW;
+  rl->interval = window_ns;
+  rl->limit = limit;
+  RATELIMIT_STORE(&rl->state, 0);
+  return true;
+}
+
+/**
+ * @brief Try to take n permits at a given monotonic time
+ *
+ * @param rl Limiter
+ * @param n Permits to take
+ * @param now_ns Monotonic time in nanoseconds, e.g. from hrclock_ns()
+ * @return true if the permits were granted, false if rate limited
+ */
+static inline bool ratelimit_allow_n_at(RateLimiter *rl, uint64_t n,
+                                        uint64_t now_ns) {
+  if (n == 0)
+    return true;
+  if (rl->kind == RATELIMIT_TOKEN_BUCKET) {
+    if (n > rl->limit / rl->interval)
+      return false;
+    return ratelimit_bucket_allow(rl, n, now_ns);
+  }
+  if (n > rl->limit)
+    return false;
+  return ratelimit_window_allow(rl, n, now_ns);
+}
+
+/**
+ * @brief Try to take n permits now
+ *
+ * @param rl Limiter
+ * @param n Permits to take
+ * @return true if the permits were granted, false if rate limited
+ */
+static inline bool ratelimit_allow_n(RateLimiter *rl, uint64_t n) {
+  return ratelimit_allow_n_at(rl, n, hrclock_ns());
+}
+
+/**
+ * @brief Try to take one permit now
+ *
+ * @param rl Limiter
+ * @return true if allowed, false if rate limited
+ */
+static inline bool ratelimit_allow(RateLimiter *rl) {
+  return ratelimit_allow_n_at(rl, 1, hrclock_ns());
+}
+
+/**
+ * @brief Permits currently available
+ *
+ * @param rl Limiter
+ * @param now_ns Monotonic time in nanoseconds
+ * @return uint64_t Permits that could be taken at now_ns
+ */
+static inline uint64_t ratelimit_available_at(const RateLimiter *rl,
+                                              uint64_t now_ns) {
+  uint64_t state = RATELIMIT_LOAD(&rl->state);
+
+  if (rl->kind == RATELIMIT_TOKEN_BUCKET) {
+    uint64_t backlog = state > now_ns ? state - now_ns : 0;
+    return backlog >= rl->limit ? 0 : (rl->limit - backlog) / rl->interval;
+  }
+
+  const uint64_t count_mask = RATELIMIT_WINDOW_MAX;
+  uint64_t elapsed = now_ns % rl->interval;
+  uint64_t age = ratelimit_window_age(
+      now_ns / rl->interval, state >> (2 * RATELIMIT_COUNT_BITS), &elapsed);
+  uint64_t prev = (state >> RATELIMIT_COUNT_BITS) & count_mask;
+  uint64_t curr = state & count_mask;
+  if (age == 1) {
+    prev = curr;
+    curr = 0;
+  } else if (age != 0) {
+    prev = curr = 0;
+  }
+
+  double weight = (double)(rl->interval - elapsed) / (double)rl->interval;
+  double used = (double)prev * weight + (double)curr;
+  return used >= (double)rl->limit ? 0 : (uint64_t)((double)rl->limit - used);
+}
+
+/* ========== KEYED LIMITERS ========== */
+
+/**
+ * @brief Create a map of per-key limiters
+ *
+ * @param prototype Initialized limiter copied (fresh) for every new key
+ * @return RateLimitMap* New map, or NULL if prototype is NULL
+ */
+static inline RateLimitMap *ratelimit_map_new(const RateLimiter *prototype) {
+  if (prototype == NULL)
+    return NULL;
+
+  RateLimitMap *map = (RateLimitMap *)safe_calloc(1, sizeof(RateLimitMap));
+  map->prototype.kind = prototype->kind;
+  map->prototype.interval = prototype->interval;
+  map->prototype.limit = prototype->limit;
+  for (size_t i = 0; i < RATELIMIT_MAP_STRIPES; i++) {
+#ifdef RATELIMIT_HAVE_THREADS
+    pthread_mutex_init(&map->stripes[i].lock, NULL);
+#endif
+    map->stripes[i].bucket_count = 16;
+    map->stripes[i].buckets =
+        (RateLimitEntry **)safe_calloc(16, sizeof(RateLimitEntry *));
+  }
+  return map;
+}
+
+/**
+ * @brief Free a map and all of its limiters
+ *
+ * @param map Map to free (may be NULL)
+ */
+static inline void ratelimit_map_free(RateLimitMap *map) {
+  if (map == NULL)
+    return;
+
+  for (size_t i = 0; i < RATELIMIT_MAP_STRIPES; i++) {
+    RateLimitStripe *s = &map->stripes[i];
+    for (size_t b = 0; b < s->bucket_count; b++) {
+      RateLimitEntry *e = s->buckets[b];
+      while (e != NULL) {
+        RateLimitEntry *next = e->next;
+        free(e);
+        e = next;
+      }
+    }
+    free(s->buckets);
+#ifdef RATELIMIT_HAVE_THREADS
+    pthread_mutex_destroy(&s->lock);
+#endif
+  }
+  free(map);
+}
+
+static inline void ratelimit_stripe_grow(RateLimitStripe *s) {
+  size_t count = s->bucket_count * 2;
+  RateLimitEntry **buckets =
+      (RateLimitEntry **)safe_calloc(count, sizeof(RateLimitEntry *));
+
+  for (size_t b = 0; b < s->bucket_count; b++) {
+    RateLimitEntry *e = s->buckets[b];
+    while (e != NULL) {
+      RateLimitEntry *next = e->next;
+      size_t slot = (size_t)(e->hash / RATELIMIT_MAP_STRIPES) & (count - 1);
+      e->next = buckets[slot];
+      buckets[slot] = e;
+      e = next;
+    }
+  }
+  free(s->buckets);
+  s->buckets = buckets;
+  s->bucket_count = count;
+}
+
+/**
+ * @brief Try to take n permits from the limiter for a key at a given time
+ *
+ * Creates the key's limiter on first use.
+ *
+ * @param map Map
+ * @param key NUL-terminated key
+ * @param n Permits to take
+ * @param now_ns Monotonic time in nanoseconds
+ * @return true if allowed, false if rate limited
+ */
+static inline bool ratelimit_map_allow_n_at(RateLimitMap *map, const char *key,
+                                            uint64_t n, uint64_t now_ns) {
+  uint64_t hash = ratelimit_hash(key);
+  RateLimitStripe *s = &map->stripes[hash % RATELIMIT_MAP_STRIPES];
+
+#ifdef RATELIMIT_HAVE_THREADS
+  pthread_mutex_lock(&s->lock);
+#endif
+  size_t slot = (size_t)(hash / RATELIMIT_MAP_STRIPES) & (s->bucket_count - 1);
+  RateLimitEntry *e = s->buckets[slot];
+  while (e != NULL && (e->hash != hash || strcmp(e->key, key) != 0))
+    e = e->next;
+
+  if (e == NULL) {
+    size_t len = strlen(key) + 1;
+    e = (RateLimitEntry *)safe_malloc(sizeof(RateLimitEntry) + len);
+    memcpy(e->key, key, len);
+    e->hash = hash;
+    e->limiter.kind = map->prototype.kind;
+    e->limiter.interval = map->prototype.interval;
+    e->limiter.limit = map->prototype.limit;
+    RATELIMIT_STORE(&e->limiter.state, 0);
+    e->next = s->buckets[slot];
+    s->buckets[slot] = e;
+    if (++s->count > s->bucket_count)
+      ratelimit_stripe_grow(s);
+  }
+
+  RATELIMIT_STORE(&e->last_used, now_ns);
+  bool allowed = ratelimit_allow_n_at(&e->limiter, n, now_ns);
+#ifdef RATELIMIT_HAVE_THREADS
+  pthread_mutex_unlock(&s->lock);
+#endif
+  return allowed;
+}
+
+/**
+ * @brief Try to take one permit from the limiter for a key now
+ *
+ * @param map Map
+ * @param key NUL-terminated key
+ * @return true if allowed, false if rate limited
+ */
+static inline bool ratelimit_map_allow(RateLimitMap *map, const char *key) {
+  return ratelimit_map_allow_n_at(map, key, 1, hrclock_ns());
+}
+
+/**
+ * @brief Number of keys currently tracked
+ */
+static inline size_t ratelimit_map_size(RateLimitMap *map) {
+  size_t total = 0;
+  for (size_t i = 0; i < RATELIMIT_MAP_STRIPES; i++) {
+#ifdef RATELIMIT_HAVE_THREADS
+    pthread_mutex_lock(&map->stripes[i].lock);
+#endif
+    total += map->stripes[i].count;
+#ifdef RATELIMIT_HAVE_THREADS
+    pthread_mutex_unlock(&map->stripes[i].lock);
+#endif
+  }
+  return total;
+}
+
+/**
+ * @brief Drop keys not used for a while
+ *
+ * Pick idle_ns at least as long as the limiter needs to fully recover
+ * (burst interval or two windows) so pruning never resets a throttled key.
+ *
+ * @param map Map
+ * @param idle_ns Minimum idle time for a key to be removed
+ * @return size_t Number of keys removed
+ */
+static inline size_t ratelimit_map_prune(RateLimitMap *map, uint64_t idle_ns) {
+  uint64_t now = hrclock_ns();
+  size_t removed = 0;
+
+  for (size_t i = 0; i < RATELIMIT_MAP_STRIPES; i++) {
+    RateLimitStripe *s = &map->stripes[i];
+#ifdef RATELIMIT_HAVE_THREADS
+    pthread_mutex_lock(&s->lock);
+#endif
+    for (size_t b = 0; b < s->bucket_count; b++) {
+      RateLimitEntry **link = &s->buckets[b];
+      while (*link != NULL) {
+        RateLimitEntry *e = *link;
+        uint64_t last = RATELIMIT_LOAD(&e->last_used);
+        if (now > last && now - last >= idle_ns) {
+          *link = e->next;
+          free(e);
+          s->count--;
+          removed++;
+        } else {
+          link = &e->next;
+        }
+      }
+    }
+#ifdef RATELIMIT_HAVE_THREADS
+    pthread_mutex_unlock(&s->lock);
+#endif
+  }
+  return removed;
+}
+
+/* ========== LOG SITES ========== */
+
+/**
+ * @brief Take one permit for a log call site, tracking what was dropped
+ *
+ * @param rl The site's limiter
+ * @param suppressed The site's count of rejected calls
+ * @param reported Output: rejected calls to report now when allowed, else 0
+ * @return true if the line should be written
+ */
+static inline bool ratelimit_log_allow(RateLimiter *rl,
+                                       RATELIMIT_ATOMIC uint64_t *suppressed,
+                                       uint64_t *reported) {
+  *reported = 0;
+  if (!ratelimit_allow(rl)) {
+    RATELIMIT_FETCH_ADD(suppressed, 1);
+    return false;
+  }
+  /* Subtract what was read so rejections racing with us are kept */
+  uint64_t count = RATELIMIT_LOAD(suppressed);
+  if (count > 0)
+    RATELIMIT_FETCH_SUB(suppressed, count);
+  *reported = count;
+  return true;
+}
+
+/**
+ * @brief Log at most per_second lines per second from this call site
+ *
+ * Each call site has its own static, lock-free sliding-window limiter, so one
+ * flooding site does not silence the others. Rejected calls are counted and
+ * reported as a "suppressed N messages" line, from the same site, just before
+ * the next line that gets through. per_second must be an integer constant
+ * from 1 to RATELIMIT_WINDOW_MAX. Like LOG_AT(), calls below LOG_MIN_LEVEL or
+ * the runtime level are dropped first, without touching the limiter.
+ */
+#define LOG_RATE_LIMITED(level, per_second, ...)                               \
+  do {                                                                         \
+    if ((level) >= LOG_MIN_LEVEL && log_enabled(level)) {                      \
+      static const LogSite log_site_ = {__FILE__, __LINE__, __func__, NULL};   \
+      static RateLimiter log_limiter_ =                                        \
+          RATELIMIT_SLIDING_WINDOW_INIT(per_second, 1000000000ULL);            \
+      static RATELIMIT_ATOMIC uint64_t log_suppressed_;                        \
+      uint64_t log_reported_;                                                  \
+      if (ratelimit_log_allow(&log_limiter_, &log_suppressed_,                 \
+                              &log_reported_)) {                               \
+        if (log_reported_ > 0)                                                 \
+          log_message_at(level, &log_site_, "suppressed %llu messages",        \
+                         (unsigned long long)log_reported_);                   \
+        log_message_at(level, &log_site_, __VA_ARGS__);                        \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+#endif /* RATELIMIT_H */
@@ -0,0 +1,743 @@
+/**
+ * @file rope.h
+ * @brief Balanced rope for large mutable text
+ * @author pucitos
+ *
+ * A rope stores text as a B-tree of fixed-size chunks. Every leaf sits at the
+ * same depth and each node caches the byte length of its subtree, so insert,
+ * delete and positional lookup cost O(log n) instead of the O(n) memmove a
+ * flat buffer needs. Text is treated as raw bytes and may contain NULs.
+ */
+
+#ifndef ROPE_H
+#define ROPE_H
+
+#include "utils.h"
+
+/**
+ * @brief Maximum number of bytes stored in one leaf chunk
+ */
+#ifndef ROPE_LEAF_MAX
+#define ROPE_LEAF_MAX 2048
+#endif
+
+/**
+ * @brief Maximum number of children of an internal node
+ */
+#ifndef ROPE_BRANCH_MAX
+#define ROPE_BRANCH_MAX 16
+#endif
+
+#define ROPE_LEAF_MIN (ROPE_LEAF_MAX / 4)
+#define ROPE_BRANCH_MIN (ROPE_BRANCH_MAX / 2)
+#define ROPE_MAX_HEIGHT 64
+
+/**
+ * @brief Rope tree node; leaves have height 0 and hold text
+ */
+typedef struct RopeNode {
+  size_t len; /* bytes in this subtree */
+  int height; /* 0 for leaves */
+  int count;  /* number of children, internal nodes only */
+  union {
+    char text[ROPE_LEAF_MAX];
+    struct RopeNode *child[ROPE_BRANCH_MAX];
+  } u;
+} RopeNode;
+
+/**
+ * @brief Rope handle
+ */
+typedef struct {
+  RopeNode *root;
+} Rope;
+
+/**
+ * @brief Chunk iterator over a rope
+ *
+ * Yields the leaf chunks in order as pointers into the rope itself, so the
+ * text can be written out without copying. Any modification of the rope
+ * invalidates the iterator.
+ */
+typedef struct {
+  const RopeNode *path[ROPE_MAX_HEIGHT];
+  int index[ROPE_MAX_HEIGHT];
+  int depth;     /* entries in path, 0 when exhausted */
+  size_t offset; /* start offset inside the current leaf */
+} RopeIter;
+
+/* ========== INTERNAL NODE HELPERS ========== */
+
+static inline RopeNode *rope_node_new(int height) {
+  RopeNode *node = (RopeNode *)safe_malloc(sizeof(RopeNode));
+  node->len = 0;
+  node->height = height;
+  node->count = 0;
+  return node;
+}
+
+static inline void rope_node_free(RopeNode *node) {
+  if (node == NULL)
+    return;
+
+  if (node->height > 0) {
+    for (int i = 0; i < node->count; i++)
+      rope_node_free(node->u.child[i]);
+  }
+  free(node);
+}
+
+static inline void rope_node_recount(RopeNode *node) {
+  node->len = 0;
+  for (int i = 0; i < node->count; i++)
+    node->len += node->u.child[i]->len;
+}
+
+static inline bool rope_node_underfull(const RopeNode *node) {
+  if (node->height == 0)
+    return node->len < ROPE_LEAF_MIN;
+  return node->count < ROPE_BRANCH_MIN;
+}
+
+static inline void rope_node_fix(RopeNode **child, int *count, int pos);
+
+/**
+ * @brief Merge siblings child[i] and child[i + 1], or share their contents
+ * evenly when they do not fit into a single node
+ */
+static inline void rope_node_merge_pair(RopeNode **child, int *count, int i) {
+  RopeNode *a = child[i];
+  RopeNode *b = child[i + 1];
+
+  if (a->height == 0) {
+    size_t total = a->len + b->len;
+
+    if (total <= ROPE_LEAF_MAX) {
+      memcpy(a->u.text + a->len, b->u.text, b->len);
+      a->len = total;
+      free(b);
+      memmove(child + i + 1, child + i + 2,
+              (size_t)(*count - i - 2) * sizeof(RopeNode *));
+      (*count)--;
+      return;
+    }
+
+    size_t left = total / 2;
+    if (a->len < left) {
+      size_t move = left - a->len;
+      memcpy(a->u.text + a->len, b->u.text, move);
+      memmove(b->u.text, b->u.text + move, b->len - move);
+    } else {
+      size_t move = a->len - left;
+      memmove(b->u.text + move, b->u.text, b->len);
+      memcpy(b->u.text, a->u.text + left, move);
+    }
+    a->len = left;
+    b->len = total - left;
+    return;
+  }
+
+  RopeNode *tmp[2 * ROPE_BRANCH_MAX];
+  int n = 0;
+  for (int k = 0; k < a->count; k++)
+    tmp[n++] = a->u.child[k];
+  for (int k = 0; k < b->count; k++)
+    tmp[n++] = b->u.child[k];
+
+  // The grandchildren meeting at the seam may be underfull themselves
+  int seam = a->count - 1;
+  rope_node_fix(tmp, &n, seam + 1);
+  rope_node_fix(tmp, &n, seam);
+
+  if (n <= ROPE_BRANCH_MAX) {
+    memcpy(a->u.child, tmp, (size_t)n * sizeof(RopeNode *));
+    a->count = n;
+    rope_node_recount(a);
+    free(b);
+    memmove(child + i + 1, child + i + 2,
+            (size_t)(*count - i - 2) * sizeof(RopeNode *));
+    (*count)--;
+    return;
+  }
+
+  a->count = (n + 1) / 2;
+  b->count = n - a->count;
+  memcpy(a->u.child, tmp, (size_t)a->count * sizeof(RopeNode *));
+  memcpy(b->u.child, tmp + a->count, (size_t)b->count * sizeof(RopeNode *));
+  rope_node_recount(a);
+  rope_node_recount(b);
+}
+
+/**
+ * @brief Restore the minimum fill of child[pos] by merging it with a sibling
+ */
+static inline void rope_node_fix(RopeNode **child, int *count, int pos) {
+  while (*count > 1 && pos < *count && rope_node_underfull(child[pos])) {
+    if (pos + 1 == *count)
+      pos--;
+    rope_node_merge_pair(child, count, pos);
+  }
+}
+
+/**
+ * @brief Insert at most ROPE_LEAF_MAX bytes into a subtree
+ *
+ * @return RopeNode* New right sibling if the node had to split, else NULL
+ */
+static inline RopeNode *rope_node_insert(RopeNode *node, size_t pos,
+                                         const char *data, size_t len) {
+  if (node->height == 0) {
+    if (node->len + len <= ROPE_LEAF_MAX) {
+      memmove(node->u.text + pos + len, node->u.text + pos, node->len - pos);
+      memcpy(node->u.text + pos, data, len);
+      node->len += len;
+      return NULL;
+    }
+
+    char tmp[2 * ROPE_LEAF_MAX];
+    size_t total = node->len + len;
+    memcpy(tmp, node->u.text, pos);
+    memcpy(tmp + pos, data, len);
+    memcpy(tmp + pos + len, node->u.text + pos, node->len - pos);
+
+    RopeNode *right = rope_node_new(0);
+    node->len = total / 2;
+    right->len = total - node->len;
+    memcpy(node->u.text, tmp, node->len);
+    memcpy(right->u.text, tmp + node->len, right->len);
+    return right;
+  }
+
+  int i = 0;
+  while (i < node->count - 1 && pos > node->u.child[i]->len) {
+    pos -= node->u.child[i]->len;
+    i++;
+  }
+
+  RopeNode *split = rope_node_insert(node->u.child[i], pos, data, len);
+  node->len += len;
+  if (split == NULL)
+    return NULL;
+
+  if (node->count < ROPE_BRANCH_MAX) {
+    memmove(node->u.child + i + 2, node->u.child + i + 1,
+            (size_t)(node->count - i - 1) * sizeof(RopeNode *));
+    node->u.child[i + 1] = split;
+    node->count++;
+    return NULL;
+  }
+
+  RopeNode *tmp[ROPE_BRANCH_MAX + 1];
+  int n = node->count + 1;
+  memcpy(tmp, node->u.child, (size_t)(i + 1) * sizeof(RopeNode *));
+  tmp[i + 1] = split;
+  memcpy(tmp + i + 2, node->u.child + i + 1,
+         (size_t)(node->count - i - 1) * sizeof(RopeNode *));
+
+  RopeNode *right = rope_node_new(node->height);
+  node->count = (n + 1) / 2;
+  right->count = n - node->count;
+  memcpy(node->u.child, tmp, (size_t)node->count * sizeof(RopeNode *));
+  memcpy(right->u.child, tmp + node->count,
+         (size_t)right->count * sizeof(RopeNode *));
+  rope_node_recount(node);
+  rope_node_recount(right);
+  return right;
+}
+
+/**
+ * @brief Delete bytes [start, end) from a subtree; the range must not cover
+ * the whole subtree
+ */
+static inline void rope_node_delete(RopeNode *node, size_t start, size_t end) {
+  if (node->height == 0) {
+    memmove(node->u.text + start, node->u.text + end, node->len - end);
+    node->len -= end - start;
+    return;
+  }
+
+  RopeNode **child = node->u.child;
+  int kept = 0;
+  int first = -1, last = -1;
+  size_t offset = 0;
+
+  for (int i = 0; i < node->count; i++) {
+    RopeNode *c = child[i];
+    size_t c_start = offset;
+    size_t c_end = offset + c->len;
+    offset = c_end;
+
+    if (c_end <= start || c_start >= end) {
+      child[kept++] = c;
+      continue;
+    }
+
+    if (start <= c_start && c_end <= end) {
+      rope_node_free(c);
+      continue;
+    }
+
+    size_t from = start > c_start ? start - c_start : 0;
+    size_t to = (end < c_end ? end : c_end) - c_start;
+    rope_node_delete(c, from, to);
+
+    if (first < 0)
+      first = kept;
+    else
+      last = kept;
+    child[kept++] = c;
+  }
+
+  node->count = kept;
+  node->len -= end - start;
+
+  if (last >= 0)
+    rope_node_fix(child, &node->count, last);
+  if (first >= 0)
+    rope_node_fix(child, &node->count, first);
+}
+
+/**
+ * @brief Build a balanced tree bottom-up from an array of leaves
+ *
+ * @param nodes Array of leaves, reused as scratch space and freed
+ * @param count Number of leaves (at least 1)
+ */
+static inline RopeNode *rope_node_build(RopeNode **nodes, size_t count) {
+  int height = 0;
+
+  while (count > 1) {
+    size_t groups = (count + ROPE_BRANCH_MAX - 1) / ROPE_BRANCH_MAX;
+    size_t next = 0;
+    height++;
+
+    for (size_t g = 0; g < groups; g++) {
+      size_t from = count * g / groups;
+      size_t to = count * (g + 1) / groups;
+      RopeNode *parent = rope_node_new(height);
+      for (size_t k = from; k < to; k++)
+        parent->u.child[parent->count++] = nodes[k];
+      rope_node_recount(parent);
+      nodes[next++] = parent;
+    }
+    count = next;
+  }
+
+  RopeNode *root = nodes[0];
+  free(nodes);
+  return root;
+}
+
+/* ========== CONSTRUCTION ========== */
+
+/**
+ * @brief Create an empty rope
+ *
+ * @return Rope* Newly allocated rope
+ */
+static inline Rope *rope_new(void) {
+  Rope *rope = (Rope *)safe_malloc(sizeof(Rope));
+  rope->root = rope_node_new(0);
+  return rope;
+}
+
+/**
+ * @brief Create a rope holding a copy of a buffer
+ *
+ * Leaves are packed evenly in a single pass, so this is the preferred way to
+ * convert the output of file_read_all() into a rope.
+ *
+ * @param data Bytes to copy (may be NULL if len is 0)
+ * @param len Number of bytes
+ * @return Rope* Newly allocated rope, or NULL if data is NULL and len > 0
+ */
+static inline Rope *rope_from_buffer(const char *data, size_t len) {
+  if (data == NULL && len > 0)
+    return NULL;
+  if (len == 0)
+    return rope_new();
+
+  size_t count = (len + ROPE_LEAF_MAX - 1) / ROPE_LEAF_MAX;
+  RopeNode **leaves = (RopeNode **)safe_malloc(count * sizeof(RopeNode *));
+
+  for (size_t i = 0; i < count; i++) {
+    size_t from = len * i / count;
+    size_t to = len * (i + 1) / count;
+    leaves[i] = rope_node_new(0);
+    leaves[i]->len = to - from;
+    memcpy(leaves[i]->u.text, data + from, to - from);
+  }
+
+  Rope *rope = (Rope *)safe_malloc(sizeof(Rope));
+  rope->root = rope_node_build(leaves, count);
+  return rope;
+}
+
+/**
+ * @brief Create a rope from a NUL-terminated string
+ *
+ * @param str String to copy
+ * @return Rope* Newly allocated rope, or NULL if str is NULL
+ */
+static inline Rope *rope_from_string(const char *str) {
+  if (str == NULL)
+    return NULL;
+  return rope_from_buffer(str, strlen(str));
+}
+
+/**
+ * @brief Load a file straight into a rope
+ *
+ * Reads the file chunk by chunk into leaves, so unlike file_read_all() no
+ * second full-size copy of the content is ever held in memory.
+ *
+ * @param filename Path to the file
+ * @return Rope* Newly allocated rope, or NULL on error
+ */
+static inline Rope *rope_from_file(const char *filename) {
+  if (filename == NULL)
+    return NULL;
+
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
+    return NULL;
+
+  size_t capacity = 64;
+  size_t count = 0;
+  RopeNode **leaves = (RopeNode **)safe_malloc(capacity * sizeof(RopeNode *));
+
+  for (;;) {
+    RopeNode *leaf = rope_node_new(0);
+    leaf->len = fread(leaf->u.text, 1, ROPE_LEAF_MAX, file);
+    if (leaf->len == 0) {
+      free(leaf);
+      break;
+    }
+    if (count == capacity) {
+      capacity *= 2;
+      leaves = (RopeNode **)safe_realloc(leaves, capacity * sizeof(RopeNode *));
+    }
+    leaves[count++] = leaf;
+  }
+
+  bool failed = ferror(file) != 0;
+  fclose(file);
+
+  if (failed) {
+    for (size_t i = 0; i < count; i++)
+      free(leaves[i]);
+    free(leaves);
+    return NULL;
+  }
+
+  Rope *rope = (Rope *)safe_malloc(sizeof(Rope));
+  if (count == 0) {
+    free(leaves);
+    rope->root = rope_node_new(0);
+    return rope;
+  }
+
+  if (count > 1) {
+    int pair = 2;
+    rope_node_fix(leaves + count - 2, &pair, 1);
+    count -= (size_t)(2 - pair);
+  }
+  rope->root = rope_node_build(leaves, count);
+  return rope;
+}
+
+/**
+ * @brief Free a rope and all of its chunks
+ *
+ * @param rope Rope to free (may be NULL)
+ */
+static inline void rope_free(Rope *rope) {
+  if (rope == NULL)
+    return;
+  rope_node_free(rope->root);
+  free(rope);
+}
+
+/* ========== QUERIES ========== */
+
+/**
+ * @brief Get the length of a rope in bytes
+ *
+ * @param rope Rope to query
+ * @return size_t Number of bytes, 0 for NULL
+ */
+static inline size_t rope_length(const Rope *rope) {
+  return rope == NULL ? 0 : rope->root->len;
+}
+
+/**
+ * @brief Get the byte at a position in O(log n)
+ *
+ * @param rope Rope to query
+ * @param pos Byte offset
+ * @return int The byte as an unsigned char, or -1 if pos is out of range
+ */
+static inline int rope_char_at(const Rope *rope, size_t pos) {
+  if (rope == NULL || pos >= rope->root->len)
+    return -1;
+
+  const RopeNode *node = rope->root;
+  while (node->height > 0) {
+    int i = 0;
+    while (pos >= node->u.child[i]->len) {
+      pos -= node->u.child[i]->len;
+      i++;
+    }
+    node = node->u.child[i];
+  }
+  return (unsigned char)node->u.text[pos];
+}
+
+/* ========== ITERATION ========== */
+
+/**
+ * @brief Position an iterator at a byte offset
+ *
+ * @param it Iterator to initialize
+ * @param rope Rope to iterate
+ * @param pos Byte offset of the first chunk (clamped to the rope length)
+ */
+static inline void rope_iter_init(RopeIter *it, const Rope *rope, size_t pos) {
+  it->depth = 0;
+  it->offset = 0;
+  if (rope == NULL)
+    return;
+
+  const RopeNode *node = rope->root;
+  if (pos > node->len)
+    pos = node->len;
+
+  for (;;) {
+    it->path[it->depth] = node;
+    if (node->height == 0)
+      break;
+
+    int i = 0;
+    while (i < node->count - 1 && pos >= node->u.child[i]->len) {
+      pos -= node->u.child[i]->len;
+      i++;
+    }
+    it->index[it->depth++] = i;
+    node = node->u.child[i];
+  }
+  it->depth++;
+  it->offset = pos;
+}
+
+/**
+ * @brief Get the next chunk of text
+ *
+ * @param it Iterator
+ * @param data Receives a pointer to the chunk (not NUL-terminated)
+ * @param len Receives the chunk length
+ * @return true if a chunk was returned, false at the end of the rope
+ */
+static inline bool rope_iter_next(RopeIter *it, const char **data,
+                                  size_t *len) {
+  while (it->depth > 0) {
+    const RopeNode *leaf = it->path[it->depth - 1];
+    size_t offset = it->offset;
+
+    // Advance to the leftmost leaf of the next subtree
+    it->offset = 0;
+    it->depth--;
+    while (it->depth > 0) {
+      const RopeNode *parent = it->path[it->depth - 1];
+      if (++it->index[it->depth - 1] < parent->count)
+        break;
+      it->depth--;
+    }
+    if (it->depth > 0) {
+      const RopeNode *node =
+          it->path[it->depth - 1]->u.child[it->index[it->depth - 1]];
+      for (;;) {
+        it->path[it->depth] = node;
+        if (node->height == 0)
+          break;
+        it->index[it->depth++] = 0;
+        node = node->u.child[0];
+      }
+      it->depth++;
+    }
+
+    if (offset < leaf->len) {
+      *data = leaf->u.text + offset;
+      *len = leaf->len - offset;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Copy a range of the rope into a caller buffer
+ *
+ * Costs O(log n + len): the start is located through the tree and the bytes
+ * are copied chunk by chunk.
+ *
+ * @param rope Rope to read
+ * @param pos Byte offset of the range
+ * @param len Maximum number of bytes to copy
+ * @param out Destination buffer of at least len bytes (not NUL-terminated)
+ * @return size_t Number of bytes copied
+ */
+static inline size_t rope_slice(const Rope *rope, size_t pos, size_t len,
+                                char *out) {
+  if (rope == NULL || out == NULL || pos >= rope->root->len)
+    return 0;
+
+  RopeIter it;
+  const char *chunk;
+  size_t chunk_len;
+  size_t copied = 0;
+
+  rope_iter_init(&it, rope, pos);
+  while (copied < len && rope_iter_next(&it, &chunk, &chunk_len)) {
+    size_t n = len - copied < chunk_len ? len - copied : chunk_len;
+    memcpy(out + copied, chunk, n);
+    copied += n;
+  }
+  return copied;
+}
+
+/**
+ * @brief Flatten a rope into a newly allocated NUL-terminated string
+ *
+ * @param rope Rope to flatten
+ * @return char* Newly allocated string, or NULL if rope is NULL
+ */
+static inline char *rope_to_string(const Rope *rope) {
+  if (rope == NULL)
+    return NULL;
+
+  size_t len = rope->root->len;
+  char *str = (char *)safe_malloc(len + 1);
+  rope_slice(rope, 0, len, str);
+  str[len] = '\0';
+  return str;
+}
+
+/**
+ * @brief Write the whole rope to a stream without flattening it
+ *
+ * @param rope Rope to write
+ * @param file Destination stream
+ * @return true if every chunk was written, false otherwise
+ */
+static inline bool rope_write(const Rope *rope, FILE *file) {
+  if (rope == NULL || file == NULL)
+    return false;
+
+  RopeIter it;
+  const char *chunk;
+  size_t chunk_len;
+
+  rope_iter_init(&it, rope, 0);
+  while (rope_iter_next(&it, &chunk, &chunk_len)) {
+    if (fwrite(chunk, 1, chunk_len, file) != chunk_len)
+      return false;
+  }
+  return true;
+}
+
+/* ========== MODIFICATION ========== */
+
+/**
+ * @brief Insert bytes at a position in O(log n) per chunk
+ *
+ * @param rope Rope to modify
+ * @param pos Byte offset to insert at (0..length)
+ * @param data Bytes to insert
+ * @param len Number of bytes
+ * @return true on success, false if pos is out of range or data is NULL
+ */
+static inline bool rope_insert(Rope *rope, size_t pos, const char *data,
+                               size_t len) {
+  if (rope == NULL || pos > rope->root->len || (data == NULL && len > 0))
+    return false;
+
+  while (len > 0) {
+    size_t piece = len < ROPE_LEAF_MAX ? len : ROPE_LEAF_MAX;
+    RopeNode *split = rope_node_insert(rope->root, pos, data, piece);
+
+    if (split != NULL) {
+      RopeNode *root = rope_node_new(rope->root->height + 1);
+      root->u.child[0] = rope->root;
+      root->u.child[1] = split;
+      root->count = 2;
+      rope_node_recount(root);
+      rope->root = root;
+    }
+
+    pos += piece;
+    data += piece;
+    len -= piece;
+  }
+  return true;
+}
+
+/**
+ * @brief Insert a NUL-terminated string at a position
+ *
+ * @param rope Rope to modify
+ * @param pos Byte offset to insert at (0..length)
+ * @param str String to insert
+ * @return true on success, false otherwise
+ */
+static inline bool rope_insert_string(Rope *rope, size_t pos,
+                                      const char *str) {
+  if (str == NULL)
+    return false;
+  return rope_insert(rope, pos, str, strlen(str));
+}
+
+/**
+ * @brief Append bytes to the end of a rope
+ *
+ * @param rope Rope to modify
+ * @param data Bytes to append
+ * @param len Number of bytes
+ * @return true on success, false otherwise
+ */
+static inline bool rope_append(Rope *rope, const char *data, size_t len) {
+  if (rope == NULL)
+    return false;
+  return rope_insert(rope, rope->root->len, data, len);
+}
+
+/**
+ * @brief Delete a range of bytes in O(log n)
+ *
+ * @param rope Rope to modify
+ * @param pos Byte offset of the range
+ * @param len Number of bytes to delete
+ * @return true on success, false if the range is out of bounds
+ */
+static inline bool rope_delete(Rope *rope, size_t pos, size_t len) {
+  if (rope == NULL || pos > rope->root->len || len > rope->root->len - pos)
+    return false;
+  if (len == 0)
+    return true;
+
+  if (len == rope->root->len) {
+    rope_node_free(rope->root);
+    rope->root = rope_node_new(0);
+    return true;
+  }
+
+  rope_node_delete(rope->root, pos, pos + len);
+
+  while (rope->root->height > 0 && rope->root->count == 1) {
+    RopeNode *old = rope->root;
+    rope->root = old->u.child[0];
+    free(old);
+  }
+  return true;
+}
+
+#endif /* ROPE_H */
@@ -0,0 +1,444 @@
+/**
+ * @file slog.h
+ * @brief Structured key-value logging as JSON lines or logfmt
+ * @author pucitos
+ *
+ * SLOG(LOG_INFO, "request done", slog_str("path", path),
+ *      slog_int("status", 200), slog_double("ms", 1.5));
+ *
+ * encodes typed fields straight into a stack buffer, one line per call:
+ *
+ *   {"ts":"2025-03-01T12:00:00.123Z","level":"info","msg":"request done",
+ *    "path":"/","status":200,"ms":1.5}                  (SLOG_JSON, default)
+ *   ts=2025-03-01T12:00:00.123Z level=info msg="request done" path=/
+ *    status=200 ms=1.5                                  (SLOG_LOGFMT)
+ *
+ * Integers are written with a two-digit table, timestamps with
+ * isotime_format() and strings with the json.h escaper; nothing is
+ * allocated. Fields that do not fit in SLOG_LINE_MAX are left out and the
+ * line is marked truncated=true. Lines go through log_write(), so the level
+ * filter, file, lock and async queue of the utils.h logger apply.
+ */
+
+#ifndef SLOG_H
+#define SLOG_H
+
+#include "isotime.h"
+#include "json.h"
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * @brief Output encoding
+ */
+typedef enum { SLOG_JSON, SLOG_LOGFMT } SlogFormat;
+
+/**
+ * @brief Encoding used by SLOG() and slog_write()
+ */
+#ifndef SLOG_FORMAT
+#define SLOG_FORMAT SLOG_JSON
+#endif
+
+/**
+ * @brief Longest encoded line, including the newline
+ */
+#ifndef SLOG_LINE_MAX
+#define SLOG_LINE_MAX LOG_ASYNC_LINE_MAX
+#endif
+
+/**
+ * @brief Significant digits for doubles that need printf; 17 reads back as
+ * the same double, 15 is shorter but may not
+ */
+#ifndef SLOG_DOUBLE_DIGITS
+#define SLOG_DOUBLE_DIGITS 17
+#endif
+
+/**
+ * @brief Fractional digits of the timestamp (0-9)
+ */
+#ifndef SLOG_TIME_PRECISION
+#define SLOG_TIME_PRECISION 3
+#endif
+
+typedef enum {
+  SLOG_TYPE_INT,
+  SLOG_TYPE_UINT,
+  SLOG_TYPE_DOUBLE,
+  SLOG_TYPE_BOOL,
+  SLOG_TYPE_STR
+} SlogType;
+
+/**
+ * @brief One typed key-value pair; build with slog_int() etc.
+ */
+typedef struct {
+  const char *key;
+  SlogType type;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    bool b;
+    const char *s;
+  } value;
+} SlogField;
+
+/**
+ * @brief Output buffer that refuses writes that would not fit
+ */
+typedef struct {
+  char *buf;
+  size_t size; /* Usable bytes, excluding room for the line ending */
+  size_t len;
+} SlogWriter;
+
+/* Room kept for the truncation marker and the line ending */
+#define SLOG_RESERVE 24
+
+/* ========== INTERNAL HELPERS ========== */
+
+static inline const char *slog_level_name(LogLevel level) {
+  static const char *names[] = {"debug", "info", "warning", "error", "fatal"};
+  return names[level <= LOG_FATAL ? level : LOG_FATAL];
+}
+
+static inline bool slog_fits(const SlogWriter *w, size_t n) {
+  return w->size - w->len >= n;
+}
+
+static inline void slog_put(SlogWriter *w, const char *s, size_t n) {
+  memcpy(w->buf + w->len, s, n);
+  w->len += n;
+}
+
+/* Writes the decimal digits of v and returns their count (at most 20) */
+static inline size_t slog_put_uint(char *p, uint64_t v) {
+  char tmp[20];
+  size_t n = sizeof(tmp);
+
+  while (v >= 100) {
+    n -= 2;
+    memcpy(tmp + n, isotime_digits + 2 * (v % 100), 2);
+    v /= 100;
+  }
+  if (v >= 10) {
+    n -= 2;
+    memcpy(tmp + n, isotime_digits + 2 * v, 2);
+  } else {
+    tmp[--n] = (char)('0' + v);
+  }
+  memcpy(p, tmp + n, sizeof(tmp) - n);
+  return sizeof(tmp) - n;
+}
+
+static inline size_t slog_put_int(char *p, int64_t v) {
+  if (v >= 0)
+    return slog_put_uint(p, (uint64_t)v);
+  *p = '-';
+  return 1 + slog_put_uint(p + 1, 0 - (uint64_t)v);
+}
+
+/**
+ * @brief Format a number; integral values and up to six decimals skip printf
+ *
+ * The fixed-point form is only used when dividing it back gives exactly v,
+ * so it parses to the same double.
+ *
+ * @return size_t Length written to p (at most 32)
+ */
+static inline size_t slog_put_double(char *p, double v, SlogFormat format) {
+  if (isnan(v) || isinf(v)) {
+    const char *text = format == SLOG_JSON ? "null"
+                       : isnan(v)          ? "NaN"
+                       : v > 0             ? "+Inf"
+                                           : "-Inf";
+    size_t n = strlen(text);
+    memcpy(p, text, n);
+    return n;
+  }
+  if (v > -1e15 && v < 1e15 && v == (double)(int64_t)v)
+    return slog_put_int(p, (int64_t)v);
+
+  for (int k = 1; k <= 6; k++) {
+    double scale = (double)isotime_pow10[k];
+    double scaled = v * scale;
+    if (!(scaled > -1e15 && scaled < 1e15))
+      break;
+    int64_t n = (int64_t)scaled;
+    if ((double)n != scaled || (double)n / scale != v)
+      continue;
+
+    uint64_t digits = n < 0 ? 0 - (uint64_t)n : (uint64_t)n;
+    uint64_t whole = digits / (uint64_t)isotime_pow10[k];
+    uint64_t frac = digits % (uint64_t)isotime_pow10[k];
+    size_t len = 0;
+    if (n < 0)
+      p[len++] = '-';
+    len += slog_put_uint(p + len, whole);
+    p[len] = '.';
+    for (int i = k; i > 0; i--) {
+      p[len + (size_t)i] = (char)('0' + frac % 10);
+      frac /= 10;
+    }
+    return len + (size_t)k + 1;
+  }
+
+  int n = snprintf(p, 32, "%.*g", SLOG_DOUBLE_DIGITS, v);
+  return n < 0 ? 0 : (size_t)n;
+}
+
+/**
+ * @brief Write a JSON string literal, quotes included
+ */
+static inline bool slog_put_json_string(SlogWriter *w, const char *s) {
+  size_t len = strlen(s);
+  size_t escaped = slog_fits(w, 6 * len + 3) ? 6 * len
+                                             : json_escaped_length(s, len);
+  if (!slog_fits(w, escaped + 3))
+    return false;
+  w->buf[w->len++] = '"';
+  w->len += json_escape(s, len, w->buf + w->len);
+  w->buf[w->len++] = '"';
+  return true;
+}
+
+/**
+ * @brief Write a logfmt value, quoting it only when needed
+ */
+static inline bool slog_put_logfmt_string(SlogWriter *w, const char *s) {
+  size_t len = strlen(s);
+  bool quote = len == 0;
+
+  for (size_t i = 0; i < len && !quote; i++) {
+    unsigned char c = (unsigned char)s[i];
+    quote = c <= ' ' || c == '=' || c == '"' || c == '\\' || c == 0x7f;
+  }
+  if (!quote) {
+    if (!slog_fits(w, len))
+      return false;
+    slog_put(w, s, len);
+    return true;
+  }
+  return slog_put_json_string(w, s);
+}
+
+static inline bool slog_put_string(SlogWriter *w, const char *s,
+                                   SlogFormat format) {
+  return format == SLOG_JSON ? slog_put_json_string(w, s)
+                             : slog_put_logfmt_string(w, s);
+}
+
+/**
+ * @brief Write ,"key": or  key= ahead of a value
+ */
+static inline bool slog_put_key(SlogWriter *w, const char *key,
+                                SlogFormat format) {
+  if (format == SLOG_JSON) {
+    if (!slog_fits(w, 1))
+      return false;
+    w->buf[w->len++] = ',';
+    if (!slog_put_json_string(w, key) || !slog_fits(w, 1))
+      return false;
+    w->buf[w->len++] = ':';
+    return true;
+  }
+
+  size_t len = strlen(key);
+  if (!slog_fits(w, len + 2))
+    return false;
+  w->buf[w->len++] = ' ';
+  slog_put(w, key, len);
+  w->buf[w->len++] = '=';
+  return true;
+}
+
+static inline bool slog_put_field(SlogWriter *w, const SlogField *f,
+                                  SlogFormat format) {
+  char number[32];
+  size_t n;
+
+  if (!slog_put_key(w, f->key, format))
+    return false;
+
+  switch (f->type) {
+  case SLOG_TYPE_INT:
+    n = slog_put_int(number, f->value.i);
+    break;
+  case SLOG_TYPE_UINT:
+    n = slog_put_uint(number, f->value.u);
+    break;
+  case SLOG_TYPE_DOUBLE:
+    n = slog_put_double(number, f->value.d, format);
+    break;
+  case SLOG_TYPE_BOOL:
+    n = f->value.b ? 4 : 5;
+    memcpy(number, f->value.b ? "true" : "false", n);
+    break;
+  default:
+    if (f->value.s != NULL)
+      return slog_put_string(w, f->value.s, format);
+    n = format == SLOG_JSON ? 4 : 2;
+    memcpy(number, format == SLOG_JSON ? "null" : "\"\"", n);
+    break;
+  }
+
+  if (!slog_fits(w, n))
+    return false;
+  slog_put(w, number, n);
+  return true;
+}
+
+/* ========== FIELDS ========== */
+
+static inline SlogField slog_int(const char *key, int64_t value) {
+  SlogField f = {key, SLOG_TYPE_INT, {0}};
+  f.value.i = value;
+  return f;
+}
+
+static inline SlogField slog_uint(const char *key, uint64_t value) {
+  SlogField f = {key, SLOG_TYPE_UINT, {0}};
+  f.value.u = value;
+  return f;
+}
+
+static inline SlogField slog_double(const char *key, double value) {
+  SlogField f = {key, SLOG_TYPE_DOUBLE, {0}};
+  f.value.d = value;
+  return f;
+}
+
+static inline SlogField slog_bool(const char *key, bool value) {
+  SlogField f = {key, SLOG_TYPE_BOOL, {0}};
+  f.value.b = value;
+  return f;
+}
+
+/**
+ * @brief String field; the string is encoded during the call, not kept
+ */
+static inline SlogField slog_str(const char *key, const char *value) {
+  SlogField f = {key, SLOG_TYPE_STR, {0}};
+  f.value.s = value;
+  return f;
+}
+
+/* ========== ENCODING ========== */
+
+/**
+ * @brief Encode one log line
+ *
+ * @param format SLOG_JSON or SLOG_LOGFMT
+ * @param buf Destination, at least 128 bytes
+ * @param size Size of buf
+ * @param epoch_ns Timestamp in nanoseconds since the Unix epoch
+ * @param level Log level
+ * @param msg Message (may be NULL)
+ * @param fields Key-value pairs
+ * @param count Number of fields
+ * @return size_t Line length including the trailing newline, or 0 if size is
+ * too small
+ */
+static inline size_t slog_encode(SlogFormat format, char *buf, size_t size,
+                                 int64_t epoch_ns, LogLevel level,
+                                 const char *msg, const SlogField *fields,
+                                 size_t count) {
+  bool json = format == SLOG_JSON;
+  bool truncated = false;
+  const char *name = slog_level_name(level);
+
+  if (size < 128)
+    return 0;
+
+  /* Timestamp and level always fit ahead of the reserve */
+  SlogWriter w = {buf, size - SLOG_RESERVE, 0};
+  slog_put(&w, json ? "{\"ts\":\"" : "ts=", json ? 7 : 3);
+  w.len += isotime_format(epoch_ns, SLOG_TIME_PRECISION, 0, buf + w.len,
+                          ISOTIME_MAX_LEN);
+  slog_put(&w, json ? "\",\"level\":\"" : " level=", json ? 11 : 7);
+  slog_put(&w, name, strlen(name));
+  if (json)
+    w.buf[w.len++] = '"';
+
+  if (msg != NULL) {
+    size_t mark = w.len;
+    if (!slog_put_key(&w, "msg", format) ||
+        !slog_put_string(&w, msg, format)) {
+      w.len = mark;
+      truncated = true;
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    size_t mark = w.len;
+    if (!slog_put_field(&w, &fields[i], format)) {
+      w.len = mark;
+      truncated = true;
+    }
+  }
+
+  /* The reserve covers the marker, closing brace, newline and NUL */
+  if (truncated) {
+    const char *marker = json ? ",\"truncated\":true" : " truncated=true";
+    memcpy(buf + w.len, marker, strlen(marker));
+    w.len += strlen(marker);
+  }
+  if (json)
+    buf[w.len++] = '}';
+  buf[w.len++] = '\n';
+  buf[w.len] = '\0';
+  return w.len;
+}
+
+/* ========== LOGGING ========== */
+
+/**
+ * @brief Log a message with key-value fields in SLOG_FORMAT
+ *
+ * @param level Log level
+ * @param msg Message (may be NULL)
+ * @param fields Key-value pairs
+ * @param count Number of fields
+ */
+static inline void slog_write(LogLevel level, const char *msg,
+                              const SlogField *fields, size_t count) {
+  char line[SLOG_LINE_MAX];
+  struct timespec now;
+
+  if (!log_enabled(level))
+    return;
+
+#ifdef TIME_UTC
+  timespec_get(&now, TIME_UTC);
+#else
+  clock_gettime(CLOCK_REALTIME, &now);
+#endif
+  size_t len = slog_encode(SLOG_FORMAT, line, sizeof(line),
+                           (int64_t)now.tv_sec * 1000000000 + now.tv_nsec,
+                           level, msg, fields, count);
+  log_write(level, line, len);
+}
+
+/**
+ * @brief Log a message with fields: SLOG(LOG_INFO, "msg", slog_int("n", 1))
+ *
+ * The fields are not evaluated when the level is filtered out. Fields may be
+ * left out altogether: SLOG(LOG_INFO, "msg").
+ */
+#define SLOG(...) SLOG_FIELDS_(__VA_ARGS__, SLOG_END_)
+
+/* The sentinel keeps the array non-empty when no fields are given */
+#define SLOG_END_ {NULL, SLOG_TYPE_INT, {0}}
+
+#define SLOG_FIELDS_(level, msg, ...)                                          \
+  do {                                                                         \
+    if (log_enabled(level)) {                                                  \
+      const SlogField slog_fields_[] = {__VA_ARGS__};                          \
+      slog_write(level, msg, slog_fields_,                                     \
+                 sizeof(slog_fields_) / sizeof(slog_fields_[0]) - 1);          \
+    }                                                                          \
+  } while (0)
+
+#endif /* SLOG_H */
@@ -0,0 +1,711 @@
+/**
+ * @file sort.h
+ * @brief Typed introsort templates and radix sorts
+ * @author pucitos
+ *
+ * SORT_DEFINE() instantiates a pattern-defeating quicksort (pdqsort) for one
+ * element type with the comparison inlined, avoiding the indirect call qsort()
+ * pays per comparison. Strings are sorted with an MSD radix sort that looks
+ * at each character once per level instead of re-comparing shared prefixes,
+ * and fixed-width integers with an LSD radix sort. On POSIX systems parallel
+ * variants split the work across threads.
+ */
+
+#ifndef SORT_H
+#define SORT_H
+
+#include "utils.h"
+#include <stdint.h>
+
+#ifndef _WIN32
+#define SORT_HAVE_THREADS 1
+#include <pthread.h>
+#endif
+
+#define SORT_INSERTION_THRESHOLD 24
+#define SORT_NINTHER_THRESHOLD 128
+#define SORT_PARTIAL_INSERTION_LIMIT 8
+
+/**
+ * @brief Default comparison for SORT_DEFINE with built-in types
+ */
+#define SORT_LESS(a, b) ((a) < (b))
+
+/**
+ * @brief Instantiate a pdqsort for arrays of one type
+ *
+ * Defines `void name(type *arr, size_t n)`. The sort is not stable and runs
+ * in O(n log n) worst case (falling back to heapsort on adversarial input)
+ * and O(n) on sorted or reverse-sorted input.
+ *
+ * @param name Name of the generated function; helpers use it as a prefix
+ * @param type Element type
+ * @param less Function or function-like macro taking two elements by value
+ * and returning non-zero if the first orders before the second
+ */
+#define SORT_DEFINE(name, type, less)                                          \
+  static inline void name##_swap(type *a, type *b) {                           \
+    type tmp = *a;                                                             \
+    *a = *b;                                                                   \
+    *b = tmp;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline void name##_sort2(type *a, type *b) {                          \
+    if (less(*b, *a))                                                          \
+      name##_swap(a, b);                                                       \
+  }                                                                            \
+                                                                               \
+  static inline void name##_sort3(type *a, type *b, type *c) {                 \
+    name##_sort2(a, b);                                                        \
+    name##_sort2(b, c);                                                        \
+    name##_sort2(a, b);                                                        \
+  }                                                                            \
+                                                                               \
+  static inline void name##_insertion(type *begin, type *end, bool guarded) {  \
+    if (begin == end)                                                          \
+      return;                                                                  \
+    for (type *cur = begin + 1; cur != end; cur++) {                           \
+      type *sift = cur;                                                        \
+      if (!less(*sift, *(sift - 1)))                                           \
+        continue;                                                              \
+      type tmp = *sift;                                                        \
+      do {                                                                     \
+        *sift = *(sift - 1);                                                   \
+        sift--;                                                                \
+      } while ((!guarded || sift != begin) && less(tmp, *(sift - 1)));         \
+      *sift = tmp;                                                             \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_partial_insertion(type *begin, type *end) {        \
+    size_t moved = 0;                                                          \
+    if (begin == end)                                                          \
+      return true;                                                             \
+    for (type *cur = begin + 1; cur != end; cur++) {                           \
+      type *sift = cur;                                                        \
+      if (!less(*sift, *(sift - 1)))                                           \
+        continue;                                                              \
+      type tmp = *sift;                                                        \
+      do {                                                                     \
+        *sift = *(sift - 1);                                                   \
+        sift--;                                                                \
+      } while (sift != begin && less(tmp, *(sift - 1)));                       \
+      *sift = tmp;                                                             \
+      moved += (size_t)(cur - sift);                                           \
+      if (moved > SORT_PARTIAL_INSERTION_LIMIT)                                \
+        return false;                                                          \
+    }                                                                          \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline void name##_sift_down(type *arr, size_t root, size_t n) {      \
+    for (;;) {                                                                 \
+      size_t child = 2 * root + 1;                                             \
+      if (child >= n)                                                          \
+        return;                                                                \
+      if (child + 1 < n && less(arr[child], arr[child + 1]))                   \
+        child++;                                                               \
+      if (!less(arr[root], arr[child]))                                        \
+        return;                                                                \
+      name##_swap(&arr[root], &arr[child]);                                    \
+      root = child;                                                            \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void name##_heapsort(type *arr, size_t n) {                    \
+    for (size_t i = n / 2; i-- > 0;)                                           \
+      name##_sift_down(arr, i, n);                                             \
+    for (size_t i = n; i-- > 1;) {                                             \
+      name##_swap(&arr[0], &arr[i]);                                           \
+      name##_sift_down(arr, 0, i);                                             \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Partition around *begin, equal elements go right */                      \
+  static inline type *name##_partition_right(type *begin, type *end,          \
+                                             bool *already) {                  \
+    type pivot = *begin;                                                       \
+    type *first = begin;                                                       \
+    type *last = end;                                                          \
+    while (less(*++first, pivot))                                              \
+      ;                                                                        \
+    if (first - 1 == begin) {                                                  \
+      while (first < last && !less(*--last, pivot))                            \
+        ;                                                                      \
+    } else {                                                                   \
+      while (!less(*--last, pivot))                                            \
+        ;                                                                      \
+    }                                                                          \
+    *already = first >= last;                                                  \
+    while (first < last) {                                                     \
+      name##_swap(first, last);                                                \
+      while (less(*++first, pivot))                                            \
+        ;                                                                      \
+      while (!less(*--last, pivot))                                            \
+        ;                                                                      \
+    }                                                                          \
+    type *pivot_pos = first - 1;                                               \
+    *begin = *pivot_pos;                                                       \
+    *pivot_pos = pivot;                                                        \
+    return pivot_pos;                                                          \
+  }                                                                            \
+                                                                               \
+  /* Partition around *begin, equal elements go left */                        \
+  static inline type *name##_partition_left(type *begin, type *end) {          \
+    type pivot = *begin;                                                       \
+    type *first = begin;                                                       \
+    type *last = end;                                                          \
+    while (less(pivot, *--last))                                               \
+      ;                                                                        \
+    if (last + 1 == end) {                                                     \
+      while (first < last && !less(pivot, *++first))                           \
+        ;                                                                      \
+    } else {                                                                   \
+      while (!less(pivot, *++first))                                           \
+        ;                                                                      \
+    }                                                                          \
+    while (first < last) {                                                     \
+      name##_swap(first, last);                                                \
+      while (less(pivot, *--last))                                             \
+        ;                                                                      \
+      while (!less(pivot, *++first))                                           \
+        ;                                                                      \
+    }                                                                          \
+    *begin = *last;                                                            \
+    *last = pivot;                                                             \
+    return last;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline void name##_loop(type *begin, type *end, int bad_allowed,      \
+                                 bool leftmost) {                              \
+    for (;;) {                                                                 \
+      size_t size = (size_t)(end - begin);                                     \
+      if (size < SORT_INSERTION_THRESHOLD) {                                   \
+        name##_insertion(begin, end, leftmost);                                \
+        return;                                                                \
+      }                                                                        \
+                                                                               \
+      size_t half = size / 2;                                                  \
+      if (size > SORT_NINTHER_THRESHOLD) {                                     \
+        name##_sort3(begin, begin + half, end - 1);                            \
+        name##_sort3(begin + 1, begin + (half - 1), end - 2);                  \
+        name##_sort3(begin + 2, begin + (half + 1), end - 3);                  \
+        name##_sort3(begin + (half - 1), begin + half, begin + (half + 1));    \
+        name##_swap(begin, begin + half);                                      \
+      } else {                                                                 \
+        name##_sort3(begin + half, begin, end - 1);                            \
+      }                                                                        \
+                                                                               \
+      /* Pivot equal to the element left of the range: skip the run */         \
+      if (!leftmost && !less(*(begin - 1), *begin)) {                          \
+        begin = name##_partition_left(begin, end) + 1;                         \
+        continue;                                                              \
+      }                                                                        \
+                                                                               \
+      bool already;                                                            \
+      type *pivot = name##_partition_right(begin, end, &already);              \
+      size_t l_size = (size_t)(pivot - begin);                                 \
+      size_t r_size = (size_t)(end - (pivot + 1));                             \
+                                                                               \
+      if (l_size < size / 8 || r_size < size / 8) {                            \
+        if (--bad_allowed == 0) {                                              \
+          name##_heapsort(begin, size);                                        \
+          return;                                                              \
+        }                                                                      \
+        /* Break up patterns that produced the bad partition */               \
+        if (l_size >= SORT_INSERTION_THRESHOLD) {                              \
+          name##_swap(begin, begin + l_size / 4);                              \
+          name##_swap(pivot - 1, pivot - l_size / 4);                          \
+          if (l_size > SORT_NINTHER_THRESHOLD) {                               \
+            name##_swap(begin + 1, begin + (l_size / 4 + 1));                  \
+            name##_swap(begin + 2, begin + (l_size / 4 + 2));                  \
+            name##_swap(pivot - 2, pivot - (l_size / 4 + 1));                  \
+            name##_swap(pivot - 3, pivot - (l_size / 4 + 2));                  \
+          }                                                                    \
+        }                                                                      \
+        if (r_size >= SORT_INSERTION_THRESHOLD) {                              \
+          name##_swap(pivot + 1, pivot + (1 + r_size / 4));                    \
+          name##_swap(end - 1, end - r_size / 4);                              \
+          if (r_size > SORT_NINTHER_THRESHOLD) {                               \
+            name##_swap(pivot + 2, pivot + (2 + r_size / 4));                  \
+            name##_swap(pivot + 3, pivot + (3 + r_size / 4));                  \
+            name##_swap(end - 2, end - (1 + r_size / 4));                      \
+            name##_swap(end - 3, end - (2 + r_size / 4));                      \
+          }                                                                    \
+        }                                                                      \
+      } else if (already && name##_partial_insertion(begin, pivot) &&          \
+                 name##_partial_insertion(pivot + 1, end)) {                   \
+        return;                                                                \
+      }                                                                        \
+                                                                               \
+      name##_loop(begin, pivot, bad_allowed, leftmost);                        \
+      begin = pivot + 1;                                                       \
+      leftmost = false;                                                        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void name(type *arr, size_t n) {                               \
+    int log2 = 0;                                                              \
+    if (arr == NULL || n < 2)                                                  \
+      return;                                                                  \
+    for (size_t k = n; k > 1; k >>= 1)                                         \
+      log2++;                                                                  \
+    name##_loop(arr, arr + n, log2, true);                                     \
+  }                                                                            \
+  SORT_DEFINE_PARALLEL(name, type, less)
+
+#ifdef SORT_HAVE_THREADS
+
+#define SORT_MAX_THREADS 64
+
+/**
+ * @brief Below this size the parallel sorts run on the calling thread
+ */
+#ifndef SORT_PARALLEL_THRESHOLD
+#define SORT_PARALLEL_THRESHOLD 65536
+#endif
+
+/**
+ * @brief Generated by SORT_DEFINE: `void name_parallel(type *arr, size_t n,
+ * int threads)`
+ *
+ * Sorts `threads` slices concurrently, then merges them pairwise with each
+ * round of merges also running in parallel. Needs n extra elements of
+ * scratch space.
+ */
+#define SORT_DEFINE_PARALLEL(name, type, less)                                 \
+  typedef struct {                                                             \
+    type *arr;                                                                 \
+    type *tmp;                                                                 \
+    size_t lo, mid, hi;                                                        \
+  } name##_Task;                                                               \
+                                                                               \
+  static inline void *name##_sort_task(void *arg) {                            \
+    name##_Task *task = (name##_Task *)arg;                                    \
+    name(task->arr + task->lo, task->hi - task->lo);                           \
+    return NULL;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline void *name##_merge_task(void *arg) {                           \
+    name##_Task *task = (name##_Task *)arg;                                    \
+    type *src = task->arr;                                                     \
+    type *dst = task->tmp;                                                     \
+    size_t i = task->lo, j = task->mid, k = task->lo;                          \
+    while (i < task->mid && j < task->hi)                                      \
+      dst[k++] = less(src[j], src[i]) ? src[j++] : src[i++];                   \
+    while (i < task->mid)                                                      \
+      dst[k++] = src[i++];                                                     \
+    while (j < task->hi)                                                       \
+      dst[k++] = src[j++];                                                     \
+    return NULL;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline void name##_parallel(type *arr, size_t n, int threads) {       \
+    pthread_t tid[SORT_MAX_THREADS];                                           \
+    name##_Task task[SORT_MAX_THREADS];                                        \
+    size_t bound[SORT_MAX_THREADS + 1];                                        \
+    if (threads > SORT_MAX_THREADS)                                            \
+      threads = SORT_MAX_THREADS;                                              \
+    if (arr == NULL || threads < 2 || n < SORT_PARALLEL_THRESHOLD) {           \
+      name(arr, n);                                                            \
+      return;                                                                  \
+    }                                                                          \
+    type *orig = arr;                                                          \
+    type *tmp = (type *)safe_malloc(n * sizeof(type));                         \
+    int runs = threads;                                                        \
+    for (int t = 0; t <= runs; t++)                                            \
+      bound[t] = n * (size_t)t / (size_t)runs;                                 \
+    for (int t = 0; t < runs; t++) {                                           \
+      task[t].arr = arr;                                                       \
+      task[t].lo = bound[t];                                                   \
+      task[t].hi = bound[t + 1];                                               \
+      if (pthread_create(&tid[t], NULL, name##_sort_task, &task[t]) != 0) {    \
+        name##_sort_task(&task[t]);                                            \
+        tid[t] = pthread_self();                                               \
+      }                                                                        \
+    }                                                                          \
+    for (int t = 0; t < runs; t++) {                                           \
+      if (!pthread_equal(tid[t], pthread_self()))                              \
+        pthread_join(tid[t], NULL);                                            \
+    }                                                                          \
+    while (runs > 1) {                                                         \
+      int merged = 0;                                                          \
+      for (int t = 0; t < runs; t += 2, merged++) {                            \
+        name##_Task *m = &task[merged];                                        \
+        m->arr = arr;                                                          \
+        m->tmp = tmp;                                                          \
+        m->lo = bound[t];                                                      \
+        m->mid = bound[t + 1];                                                 \
+        m->hi = t + 1 < runs ? bound[t + 2] : bound[t + 1];                    \
+        if (pthread_create(&tid[merged], NULL, name##_merge_task, m) != 0) {   \
+          name##_merge_task(m);                                                \
+          tid[merged] = pthread_self();                                        \
+        }                                                                      \
+      }                                                                        \
+      for (int t = 0; t < merged; t++) {                                       \
+        if (!pthread_equal(tid[t], pthread_self()))                            \
+          pthread_join(tid[t], NULL);                                          \
+      }                                                                        \
+      for (int t = 0; t < merged; t++)                                         \
+        bound[t] = task[t].lo;                                                 \
+      bound[merged] = n;                                                       \
+      runs = merged;                                                           \
+      type *swap = arr;                                                        \
+      arr = tmp;                                                               \
+      tmp = swap;                                                              \
+    }                                                                          \
+    /* After an odd number of rounds the result lives in the scratch buffer */ \
+    if (arr != orig) {                                                         \
+      memcpy(orig, arr, n * sizeof(type));                                     \
+      tmp = arr;                                                               \
+    }                                                                          \
+    free(tmp);                                                                 \
+  }
+
+#else
+#define SORT_DEFINE_PARALLEL(name, type, less)
+#endif /* SORT_HAVE_THREADS */
+
+/* ========== INTEGER RADIX SORT ========== */
+
+/**
+ * @brief LSD radix sort over 64-bit keys, one byte per pass
+ *
+ * Passes where every key has the same byte are skipped, so keys that only
+ * use their low bytes cost proportionally less.
+ *
+ * @param arr Array to sort
+ * @param n Number of elements
+ * @param bytes Low-order key bytes to sort by; values above 8 are clamped
+ */
+static inline void sort_radix_u64(uint64_t *arr, size_t n, int bytes) {
+  if (arr == NULL || n < 2 || bytes <= 0)
+    return;
+  if (bytes > 8)
+    bytes = 8;
+
+  uint64_t *tmp = (uint64_t *)safe_malloc(n * sizeof(uint64_t));
+  uint64_t *src = arr;
+  uint64_t *dst = tmp;
+  size_t count[256];
+
+  for (int pass = 0; pass < bytes; pass++) {
+    int shift = pass * 8;
+    memset(count, 0, sizeof(count));
+    for (size_t i = 0; i < n; i++)
+      count[(src[i] >> shift) & 0xff]++;
+    if (count[(src[0] >> shift) & 0xff] == n)
+      continue;
+
+    size_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t c = count[b];
+      count[b] = sum;
+      sum += c;
+    }
+    for (size_t i = 0; i < n; i++)
+      dst[count[(src[i] >> shift) & 0xff]++] = src[i];
+
+    uint64_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != arr)
+    memcpy(arr, src, n * sizeof(uint64_t));
+  free(tmp);
+}
+
+/**
+ * @brief Sort unsigned 64-bit integers with an LSD radix sort
+ *
+ * @param arr Array to sort
+ * @param n Number of elements
+ */
+static inline void sort_u64(uint64_t *arr, size_t n) {
+  sort_radix_u64(arr, n, 8);
+}
+
+/**
+ * @brief Sort signed 64-bit integers with an LSD radix sort
+ *
+ * @param arr Array to sort
+ * @param n Number of elements
+ */
+static inline void sort_i64(int64_t *arr, size_t n) {
+  uint64_t *keys = (uint64_t *)arr;
+  if (arr == NULL)
+    return;
+
+  // Flipping the sign bit maps signed order onto unsigned order
+  for (size_t i = 0; i < n; i++)
+    keys[i] ^= 1ull << 63;
+  sort_radix_u64(keys, n, 8);
+  for (size_t i = 0; i < n; i++)
+    keys[i] ^= 1ull << 63;
+}
+
+/**
+ * @brief Sort unsigned 32-bit integers with an LSD radix sort
+ *
+ * @param arr Array to sort
+ * @param n Number of elements
+ */
+static inline void sort_u32(uint32_t *arr, size_t n) {
+  if (arr == NULL || n < 2)
+    return;
+
+  uint32_t *tmp = (uint32_t *)safe_malloc(n * sizeof(uint32_t));
+  uint32_t *src = arr;
+  uint32_t *dst = tmp;
+  size_t count[256];
+
+  for (int shift = 0; shift < 32; shift += 8) {
+    memset(count, 0, sizeof(count));
+    for (size_t i = 0; i < n; i++)
+      count[(src[i] >> shift) & 0xff]++;
+    if (count[(src[0] >> shift) & 0xff] == n)
+      continue;
+
+    size_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t c = count[b];
+      count[b] = sum;
+      sum += c;
+    }
+    for (size_t i = 0; i < n; i++)
+      dst[count[(src[i] >> shift) & 0xff]++] = src[i];
+
+    uint32_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != arr)
+    memcpy(arr, src, n * sizeof(uint32_t));
+  free(tmp);
+}
+
+/**
+ * @brief Sort signed 32-bit integers with an LSD radix sort
+ *
+ * @param arr Array to sort
+ * @param n Number of elements
+ */
+static inline void sort_i32(int32_t *arr, size_t n) {
+  uint32_t *keys = (uint32_t *)arr;
+  if (arr == NULL)
+    return;
+
+  for (size_t i = 0; i < n; i++)
+    keys[i] ^= 1u << 31;
+  sort_u32(keys, n);
+  for (size_t i = 0; i < n; i++)
+    keys[i] ^= 1u << 31;
+}
+
+/* ========== STRING RADIX SORT ========== */
+
+#define SORT_STRING_INSERTION_THRESHOLD 32
+
+/**
+ * @brief Pending bucket of the MSD string sort
+ */
+typedef struct {
+  size_t lo;
+  size_t n;
+  size_t depth;
+} SortStringRange;
+
+/**
+ * @brief Insertion sort for strings sharing their first depth characters
+ */
+static inline void sort_strings_insertion(const char **arr, size_t n,
+                                          size_t depth) {
+  for (size_t i = 1; i < n; i++) {
+    const char *cur = arr[i];
+    size_t j = i;
+    while (j > 0 && strcmp(cur + depth, arr[j - 1] + depth) < 0) {
+      arr[j] = arr[j - 1];
+      j--;
+    }
+    arr[j] = cur;
+  }
+}
+
+/**
+ * @brief Sort a range of strings sharing a prefix of depth characters
+ *
+ * Buckets strings by the character at depth, recursing on an explicit stack
+ * so long shared prefixes cannot overflow the call stack.
+ *
+ * @param tmp Scratch array of at least n pointers
+ * @param chars Scratch array of at least n bytes
+ */
+static inline void sort_strings_msd(const char **arr, size_t n, size_t depth,
+                                    const char **tmp, unsigned char *chars) {
+  size_t capacity = 256;
+  size_t top = 0;
+  SortStringRange *stack =
+      (SortStringRange *)safe_malloc(capacity * sizeof(SortStringRange));
+
+  stack[top++] = (SortStringRange){0, n, depth};
+  while (top > 0) {
+    SortStringRange r = stack[--top];
+    const char **a = arr + r.lo;
+    size_t count[256] = {0};
+
+    if (r.n < SORT_STRING_INSERTION_THRESHOLD) {
+      sort_strings_insertion(a, r.n, r.depth);
+      continue;
+    }
+
+    // Cache the current character to avoid a second pointer chase
+    for (size_t i = 0; i < r.n; i++) {
+      chars[i] = (unsigned char)a[i][r.depth];
+      count[chars[i]]++;
+    }
+
+    size_t start[256];
+    size_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+      start[b] = sum;
+      sum += count[b];
+    }
+    for (size_t i = 0; i < r.n; i++)
+      tmp[start[chars[i]]++] = a[i];
+    memcpy(a, tmp, r.n * sizeof(const char *));
+
+    // Bucket 0 holds strings that ended here; they are all equal
+    size_t lo = count[0];
+    for (int b = 1; b < 256; b++) {
+      if (count[b] > 1) {
+        if (top == capacity) {
+          capacity *= 2;
+          stack = (SortStringRange *)safe_realloc(
+              stack, capacity * sizeof(SortStringRange));
+        }
+        stack[top++] = (SortStringRange){r.lo + lo, count[b], r.depth + 1};
+      }
+      lo += count[b];
+    }
+  }
+  free(stack);
+}
+
+/**
+ * @brief Sort NUL-terminated strings in strcmp() order with an MSD radix sort
+ *
+ * @param arr Array of string pointers to sort (the strings are not moved)
+ * @param n Number of strings
+ */
+static inline void sort_strings(const char **arr, size_t n) {
+  if (arr == NULL || n < 2)
+    return;
+
+  const char **tmp = (const char **)safe_malloc(n * sizeof(const char *));
+  unsigned char *chars = (unsigned char *)safe_malloc(n);
+  sort_strings_msd(arr, n, 0, tmp, chars);
+  free(chars);
+  free(tmp);
+}
+
+#ifdef SORT_HAVE_THREADS
+
+/**
+ * @brief Shared state for the parallel string sort
+ */
+typedef struct {
+  const char **arr;
+  const char **tmp;
+  size_t start[257];
+  int next_bucket;
+  pthread_mutex_t lock;
+} SortStringJob;
+
+static inline void *sort_strings_worker(void *arg) {
+  SortStringJob *job = (SortStringJob *)arg;
+  unsigned char *chars = NULL;
+  size_t chars_len = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    int b = job->next_bucket++;
+    pthread_mutex_unlock(&job->lock);
+    if (b > 255)
+      break;
+
+    size_t lo = job->start[b];
+    size_t n = job->start[b + 1] - lo;
+    if (n < 2)
+      continue;
+    if (n > chars_len) {
+      free(chars);
+      chars = (unsigned char *)safe_malloc(n);
+      chars_len = n;
+    }
+    sort_strings_msd(job->arr + lo, n, 1, job->tmp + lo, chars);
+  }
+  free(chars);
+  return NULL;
+}
+
+/**
+ * @brief Sort strings using several threads
+ *
+ * Buckets the input by first character on the calling thread, then hands
+ * the buckets out to workers. Input dominated by one leading character gains
+ * little from extra threads.
+ *
+ * @param arr Array of string pointers to sort
+ * @param n Number of strings
+ * @param threads Number of threads to use
+ */
+static inline void sort_strings_parallel(const char **arr, size_t n,
+                                         int threads) {
+  if (threads > SORT_MAX_THREADS)
+    threads = SORT_MAX_THREADS;
+  if (arr == NULL || threads < 2 || n < SORT_PARALLEL_THRESHOLD) {
+    sort_strings(arr, n);
+    return;
+  }
+
+  SortStringJob job;
+  size_t count[256] = {0};
+  size_t fill[256];
+  pthread_t tid[SORT_MAX_THREADS];
+
+  job.arr = arr;
+  job.tmp = (const char **)safe_malloc(n * sizeof(const char *));
+  job.next_bucket = 1;
+  pthread_mutex_init(&job.lock, NULL);
+
+  for (size_t i = 0; i < n; i++)
+    count[(unsigned char)arr[i][0]]++;
+  size_t sum = 0;
+  for (int b = 0; b < 256; b++) {
+    job.start[b] = fill[b] = sum;
+    sum += count[b];
+  }
+  job.start[256] = n;
+  for (size_t i = 0; i < n; i++)
+    job.tmp[fill[(unsigned char)arr[i][0]]++] = arr[i];
+  memcpy(arr, job.tmp, n * sizeof(const char *));
+
+  int started = 0;
+  for (; started < threads; started++) {
+    if (pthread_create(&tid[started], NULL, sort_strings_worker, &job) != 0)
+      break;
+  }
+  if (started == 0)
+    sort_strings_worker(&job);
+  for (int t = 0; t < started; t++)
+    pthread_join(tid[t], NULL);
+
+  pthread_mutex_destroy(&job.lock);
+  free(job.tmp);
+}
+
+#endif /* SORT_HAVE_THREADS */
+
+#endif /* SORT_H */
@@ -0,0 +1,109 @@
+/**
+ * @file test_binlog.c
+ * @brief BINLOG() records formatted as printf would format them
+ *
+ * Each case is logged through the text output and through the binary
+ * output and binlog_decode(), and the message is compared with snprintf().
+ *
+ * Build and run from the repository root:
+ *   gcc -std=c11 -O2 -pthread -I. tests/test_binlog.c -o test_binlog -lm
+ *   ./test_binlog
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define HRCLOCK_IMPLEMENTATION
+#define BINLOG_IMPLEMENTATION
+
+#include "binlog.h"
+
+#define TEST_TEXT "test_binlog.log"
+#define TEST_BINARY "test_binlog.bin"
+#define TEST_DECODED "test_binlog.txt"
+#define TEST_CASES 12
+
+static char expected[TEST_CASES][256];
+
+#define TEST_CASE(i, ...)                                                      \
+  do {                                                                         \
+    snprintf(expected[i], sizeof(expected[i]), __VA_ARGS__);                   \
+    BINLOG(LOG_WARNING, __VA_ARGS__);                                          \
+  } while (0)
+
+static void binlog_cases(void) {
+  TEST_CASE(0, "val=%d hex=%x", 42, 255);
+  TEST_CASE(1, "int %x %X %o %u", -1, -2, -3, -4);
+  TEST_CASE(2, "unsigned %x %d", 0xffffffffu, 0x80000000u);
+  TEST_CASE(3, "long %ld %lx", -1L, -1L);
+  TEST_CASE(4, "long long %lld %llx", (long long)INT64_MIN, -1LL);
+  TEST_CASE(5, "unsigned long long %llu", (unsigned long long)UINT64_MAX);
+  TEST_CASE(6, "width [%5d] [%-5d] [%05x]", -7, 7, 0xab);
+  TEST_CASE(7, "double %.3f %g %e", 3.14159, 0.5, 1e10);
+  TEST_CASE(8, "char %c string [%s] [%.2s]", 'A', "abc", "xyz");
+  TEST_CASE(9, "%s and %d", "first", -2147483647 - 1);
+  TEST_CASE(10, "percent %% %d%%", 99);
+  TEST_CASE(11, "no arguments");
+}
+
+/* The message is what follows "[timestamp] [LEVEL] " */
+static int binlog_check(const char *path, const char *mode) {
+  FILE *file = fopen(path, "r");
+  char line[512];
+  int failures = 0;
+  int i = 0;
+
+  if (file == NULL) {
+    fprintf(stderr, "FAIL (%s): no output\n", mode);
+    return 1;
+  }
+  while (fgets(line, sizeof(line), file) != NULL && i < TEST_CASES) {
+    char *message = strstr(line, "] [");
+    message = message != NULL ? strstr(message + 3, "] ") : NULL;
+    line[strcspn(line, "\n")] = '\0';
+    if (message == NULL || strcmp(message + 2, expected[i]) != 0) {
+      fprintf(stderr, "FAIL (%s): got \"%s\", expected \"%s\"\n", mode,
+              message != NULL ? message + 2 : line, expected[i]);
+      failures++;
+    }
+    i++;
+  }
+  fclose(file);
+  if (i != TEST_CASES) {
+    fprintf(stderr, "FAIL (%s): %d lines, expected %d\n", mode, i,
+            TEST_CASES);
+    failures++;
+  }
+  return failures;
+}
+
+int main(void) {
+  int failures = 0;
+
+  remove(TEST_TEXT);
+  if (!binlog_start(TEST_TEXT, false))
+    return 1;
+  binlog_cases();
+  binlog_stop();
+  failures += binlog_check(TEST_TEXT, "text");
+
+  if (!binlog_start(TEST_BINARY, true))
+    return 1;
+  binlog_cases();
+  binlog_stop();
+  FILE *in = fopen(TEST_BINARY, "rb");
+  FILE *out = fopen(TEST_DECODED, "w");
+  if (in == NULL || out == NULL || !binlog_decode(in, out)) {
+    fprintf(stderr, "FAIL: binlog_decode() rejected the binary log\n");
+    failures++;
+  }
+  if (in != NULL)
+    fclose(in);
+  if (out != NULL)
+    fclose(out);
+  failures += binlog_check(TEST_DECODED, "binary");
+
+  remove(TEST_TEXT);
+  remove(TEST_BINARY);
+  remove(TEST_DECODED);
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+/**
+ * @file test_codec.c
+ * @brief Base64 and hex against RFC 4648 vectors and a plain reference
+ *
+ * Random buffers of every length up to a few SIMD blocks are encoded with
+ * each flag combination, compared with a byte-at-a-time reference encoder,
+ * decoded back (also in place and in random chunks) and compared with the
+ * input. Build it once as is and once with -DCODEC_NO_SIMD to cover both
+ * paths.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -I. tests/test_codec.c -o test_codec && ./test_codec
+ *   gcc -O2 -DCODEC_NO_SIMD -I. tests/test_codec.c -o test_codec
+ *   ./test_codec
+ */
+
+#include "codec.h"
+
+#define TEST_MAX_LEN 300
+
+static int failures;
+static uint64_t rng = 0x2545f4914f6cdd1dULL;
+
+static uint64_t codec_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static void codec_fail(const char *what, size_t len, int flags) {
+  fprintf(stderr, "FAIL: %s (length %zu, flags %d)\n", what, len, flags);
+  failures++;
+}
+
+static size_t reference_base64(const unsigned char *src, size_t len,
+                               char *dst, int flags) {
+  const char *alphabet =
+      (flags & BASE64_URL)
+          ? "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+          : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t n = 0;
+
+  for (size_t i = 0; i < len; i += 3) {
+    uint32_t v = (uint32_t)src[i] << 16;
+    if (i + 1 < len)
+      v |= (uint32_t)src[i + 1] << 8;
+    if (i + 2 < len)
+      v |= src[i + 2];
+    size_t chars = len - i >= 3 ? 4 : len - i + 1;
+    for (size_t k = 0; k < 4; k++) {
+      if (k < chars)
+        dst[n++] = alphabet[(v >> (18 - 6 * k)) & 63];
+      else if (!(flags & BASE64_NOPAD))
+        dst[n++] = '=';
+    }
+  }
+  dst[n] = '\0';
+  return n;
+}
+
+static void test_vectors(void) {
+  static const char *const plain[] = {"", "f", "fo", "foo", "foob", "fooba",
+                                      "foobar"};
+  static const char *const encoded[] = {
+      "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+  char out[64];
+  size_t n;
+
+  for (size_t i = 0; i < sizeof(plain) / sizeof(plain[0]); i++) {
+    size_t len = strlen(plain[i]);
+    if (base64_encode(plain[i], len, out, 0) != strlen(encoded[i]) ||
+        strcmp(out, encoded[i]) != 0)
+      codec_fail("RFC 4648 encode", len, 0);
+    if (!base64_decode(encoded[i], strlen(encoded[i]), out, &n,
+                       BASE64_STRICT) ||
+        n != len || memcmp(out, plain[i], len) != 0)
+      codec_fail("RFC 4648 decode", len, BASE64_STRICT);
+  }
+
+  /* Lenient decoding skips whitespace and accepts missing padding */
+  if (!base64_decode("Zm9v\r\n YmE", 10, out, &n, 0) || n != 5 ||
+      memcmp(out, "fooba", 5) != 0)
+    codec_fail("lenient decode", 10, 0);
+
+  static const char *const bad[] = {"Zm9v YmFy", "Zg=", "Zg===", "Zh==",
+                                    "Zm9v-_", "Z", "Zg==Zg=="};
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    if (base64_decode(bad[i], strlen(bad[i]), out, &n, BASE64_STRICT))
+      codec_fail(bad[i], strlen(bad[i]), BASE64_STRICT);
+  }
+  if (base64_decode("Zm9v!", 5, out, &n, 0))
+    codec_fail("invalid character accepted", 5, 0);
+
+  if (hex_encode("\x01\xab\xff", 3, out, 0) != 6 ||
+      strcmp(out, "01abff") != 0)
+    codec_fail("hex encode", 3, 0);
+  if (hex_encode("\x01\xab\xff", 3, out, HEX_UPPER) != 6 ||
+      strcmp(out, "01ABFF") != 0)
+    codec_fail("hex encode", 3, HEX_UPPER);
+  if (!hex_decode("01aBfF", 6, out, &n) || n != 3 ||
+      memcmp(out, "\x01\xab\xff", 3) != 0)
+    codec_fail("hex decode mixed case", 6, 0);
+  if (hex_decode("abc", 3, out, &n) || hex_decode("0g", 2, out, &n))
+    codec_fail("bad hex accepted", 3, 0);
+}
+
+static void test_base64_random(const unsigned char *data) {
+  static const int flag_sets[] = {0, BASE64_URL, BASE64_NOPAD,
+                                  BASE64_URL | BASE64_NOPAD};
+  char expect[TEST_MAX_LEN * 2];
+  char out[TEST_MAX_LEN * 2];
+  unsigned char back[TEST_MAX_LEN * 2];
+
+  for (size_t f = 0; f < sizeof(flag_sets) / sizeof(flag_sets[0]); f++) {
+    int flags = flag_sets[f];
+    for (size_t len = 0; len <= TEST_MAX_LEN; len++) {
+      size_t n = reference_base64(data, len, expect, flags);
+      if (base64_encoded_length(len, flags) != n)
+        codec_fail("base64_encoded_length", len, flags);
+      if (base64_encode(data, len, out, flags) != n ||
+          strcmp(out, expect) != 0)
+        codec_fail("base64_encode", len, flags);
+
+      /* Streaming encode in random chunks */
+      Base64Encoder enc;
+      size_t m = 0;
+      base64_encoder_init(&enc, flags);
+      for (size_t i = 0; i < len;) {
+        size_t chunk = (size_t)(codec_rand() % 40);
+        if (chunk > len - i)
+          chunk = len - i;
+        m += base64_encoder_update(&enc, data + i, chunk, out + m);
+        i += chunk;
+      }
+      m += base64_encoder_final(&enc, out + m);
+      if (m != n || memcmp(out, expect, n) != 0)
+        codec_fail("streaming encode", len, flags);
+
+      size_t got;
+      int strict = flags | BASE64_STRICT;
+      if (!base64_decode(expect, n, back, &got, strict) || got != len ||
+          memcmp(back, data, len) != 0)
+        codec_fail("base64_decode", len, strict);
+      if (base64_decoded_max(n) < len)
+        codec_fail("base64_decoded_max", len, flags);
+
+      /* In place: the output overwrites the characters it came from */
+      memcpy(out, expect, n);
+      if (!base64_decode(out, n, out, &got, strict) || got != len ||
+          memcmp(out, data, len) != 0)
+        codec_fail("in-place decode", len, strict);
+
+      /* Streaming decode in random chunks */
+      Base64Decoder dec;
+      size_t total = 0, part;
+      bool ok = true;
+      base64_decoder_init(&dec, strict);
+      for (size_t i = 0; i < n && ok;) {
+        size_t chunk = (size_t)(codec_rand() % 50);
+        if (chunk > n - i)
+          chunk = n - i;
+        ok = base64_decoder_update(&dec, expect + i, chunk, back + total,
+                                   &part);
+        total += part;
+        i += chunk;
+      }
+      ok = ok && base64_decoder_final(&dec, back + total, &part);
+      total += ok ? part : 0;
+      if (!ok || total != len || memcmp(back, data, len) != 0)
+        codec_fail("streaming decode", len, strict);
+
+      /* A bad character anywhere is caught, including in SIMD blocks */
+      if (n > 0) {
+        memcpy(out, expect, n);
+        out[codec_rand() % n] = '!';
+        if (base64_decode(out, n, back, &got, flags))
+          codec_fail("corrupted input accepted", len, flags);
+      }
+    }
+  }
+}
+
+static void test_hex_random(const unsigned char *data) {
+  char expect[TEST_MAX_LEN * 2 + 1];
+  char out[TEST_MAX_LEN * 2 + 1];
+  unsigned char back[TEST_MAX_LEN];
+
+  for (size_t len = 0; len <= TEST_MAX_LEN; len++) {
+    for (int upper = 0; upper <= 1; upper++) {
+      for (size_t i = 0; i < len; i++)
+        snprintf(expect + 2 * i, 3, upper ? "%02X" : "%02x", data[i]);
+      expect[2 * len] = '\0';
+      if (hex_encode(data, len, out, upper ? HEX_UPPER : 0) != 2 * len ||
+          strcmp(out, expect) != 0)
+        codec_fail("hex_encode", len, upper);
+
+      size_t got;
+      if (!hex_decode(expect, 2 * len, back, &got) || got != len ||
+          memcmp(back, data, len) != 0)
+        codec_fail("hex_decode", len, upper);
+
+      /* Split between the two digits of a byte */
+      HexDecoder dec;
+      size_t first = 0, second = 0, cut = len > 0 ? 2 * len - 1 : 0;
+      hex_decoder_init(&dec);
+      if (!hex_decoder_update(&dec, expect, cut, back, &first) ||
+          !hex_decoder_update(&dec, expect + cut, 2 * len - cut, back + first,
+                              &second) ||
+          !hex_decoder_final(&dec) || first + second != len ||
+          memcmp(back, data, len) != 0)
+        codec_fail("streaming hex decode", len, upper);
+
+      if (len > 0) {
+        memcpy(out, expect, 2 * len);
+        out[codec_rand() % (2 * len)] = 'x';
+        if (hex_decode(out, 2 * len, back, &got))
+          codec_fail("corrupted hex accepted", len, upper);
+      }
+    }
+  }
+}
+
+int main(void) {
+  unsigned char data[TEST_MAX_LEN];
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (unsigned char)codec_rand();
+
+  test_vectors();
+  test_base64_random(data);
+  test_hex_random(data);
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,314 @@
+/**
+ * @file test_histogram.c
+ * @brief Histogram percentiles against exact values from a sorted copy
+ *
+ * Random values spread over many orders of magnitude are recorded and every
+ * percentile is checked to land in the same bucket as the exact value at that
+ * rank. Merging, intervals, serialization and concurrent recording are
+ * checked against histograms recorded directly.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -pthread -I. tests/test_histogram.c -o test_histogram
+ *   ./test_histogram
+ */
+
+#include "histogram.h"
+#include <pthread.h>
+
+#define TEST_VALUES 200000
+#define TEST_THREADS 4
+
+static int failures;
+static uint64_t rng = 0x5851f42d4c957f2dULL;
+
+static uint64_t histogram_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static void histogram_fail(const char *what, const Histogram *h) {
+  fprintf(stderr, "FAIL: %s (lowest %llu, highest %llu, digits %d)\n", what,
+          (unsigned long long)h->lowest, (unsigned long long)h->highest,
+          h->digits);
+  failures++;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/* Roughly log-uniform in [0, highest] */
+static uint64_t histogram_rand_value(uint64_t highest) {
+  uint64_t v = histogram_rand() >> (histogram_rand() % 64);
+  return v <= highest ? v : v % (highest + 1);
+}
+
+static bool histogram_same_counts(const Histogram *a, const Histogram *b) {
+  if (a->counts_len != b->counts_len ||
+      histogram_count(a) != histogram_count(b))
+    return false;
+  for (size_t i = 0; i < a->counts_len; i++) {
+    if (HISTOGRAM_LOAD(&a->counts[i]) != HISTOGRAM_LOAD(&b->counts[i]))
+      return false;
+  }
+  return true;
+}
+
+static void test_percentiles(uint64_t lowest, uint64_t highest, int digits) {
+  static const double percentiles[] = {0,  1,  10,   25,    50,    75,
+                                       90, 99, 99.9, 99.99, 99.999, 100};
+  Histogram *h = histogram_new(lowest, highest, digits);
+  uint64_t *values = (uint64_t *)safe_malloc(TEST_VALUES * sizeof(uint64_t));
+  double sum = 0;
+
+  if (h == NULL) {
+    fprintf(stderr, "FAIL: histogram_new(%llu, %llu, %d)\n",
+            (unsigned long long)lowest, (unsigned long long)highest, digits);
+    failures++;
+    free(values);
+    return;
+  }
+
+  if (histogram_count(h) != 0 || histogram_min(h) != 0 ||
+      histogram_max(h) != 0 || histogram_value_at_percentile(h, 50) != 0)
+    histogram_fail("empty histogram", h);
+
+  for (size_t i = 0; i < TEST_VALUES; i++) {
+    values[i] = histogram_rand_value(highest);
+    sum += (double)values[i];
+    if (!histogram_record(h, values[i]))
+      histogram_fail("in-range value rejected", h);
+  }
+  qsort(values, TEST_VALUES, sizeof(uint64_t), cmp_u64);
+
+  if (histogram_count(h) != TEST_VALUES || histogram_min(h) != values[0] ||
+      histogram_max(h) != values[TEST_VALUES - 1])
+    histogram_fail("count, min or max", h);
+
+  for (size_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++) {
+    double exact = percentiles[p] / 100.0 * TEST_VALUES;
+    size_t rank = (size_t)exact;
+    if ((double)rank < exact)
+      rank++;
+    uint64_t expect = values[rank > 0 ? rank - 1 : 0];
+    uint64_t got = histogram_value_at_percentile(h, percentiles[p]);
+    if (got < expect ||
+        histogram_counts_index(h, got) != histogram_counts_index(h, expect)) {
+      fprintf(stderr, "FAIL: p%g is %llu, exact %llu\n", percentiles[p],
+              (unsigned long long)got, (unsigned long long)expect);
+      histogram_fail("percentile outside the exact value's bucket", h);
+    }
+  }
+
+  /* Bucket midpoints keep the mean within the configured precision */
+  double mean = sum / TEST_VALUES, tolerance = mean;
+  for (int i = 0; i < digits; i++)
+    tolerance /= 10;
+  tolerance += (double)(1ULL << h->unit_magnitude);
+  if (histogram_mean(h) < mean - tolerance ||
+      histogram_mean(h) > mean + tolerance)
+    histogram_fail("mean", h);
+
+  /* The last bucket may reach past highest; the next value does not fit */
+  uint64_t last = histogram_value_at_index(h, h->counts_len - 1);
+  if (histogram_highest_equivalent(h, last) < UINT64_MAX) {
+    uint64_t beyond = histogram_highest_equivalent(h, last) + 1;
+    if (histogram_record(h, beyond) || histogram_record_atomic(h, beyond) ||
+        histogram_count(h) != TEST_VALUES)
+      histogram_fail("out-of-range value accepted", h);
+  }
+
+  histogram_reset(h);
+  if (histogram_count(h) != 0 || histogram_min(h) != 0 ||
+      histogram_max(h) != 0 || histogram_mean(h) != 0)
+    histogram_fail("histogram_reset", h);
+
+  free(values);
+  histogram_free(h);
+}
+
+static void test_merge_and_interval(void) {
+  Histogram *a = histogram_new(1, 3600000000000ULL, 3);
+  Histogram *b = histogram_new_like(a);
+  Histogram *both = histogram_new_like(a);
+  Histogram *aggregate = histogram_new_like(a);
+  Histogram *previous = histogram_new_like(a);
+  Histogram *interval = histogram_new_like(a);
+  Histogram *narrow = histogram_new(1, 1000000, 3);
+  Histogram *direct = histogram_new_like(narrow);
+  Histogram *coarse = histogram_new(1, 3600000000000ULL, 1);
+  uint64_t too_big = 0;
+
+  for (size_t i = 0; i < 50000; i++) {
+    uint64_t v = histogram_rand_value(a->highest);
+    histogram_record(i % 3 == 0 ? a : b, v);
+    histogram_record(both, v);
+    if (!histogram_record(direct, v))
+      too_big++;
+  }
+
+  histogram_merge(aggregate, a);
+  if (!histogram_interval(aggregate, previous, interval) ||
+      !histogram_same_counts(interval, a))
+    histogram_fail("first interval", a);
+  histogram_merge(aggregate, b);
+  if (!histogram_same_counts(aggregate, both) ||
+      histogram_min(aggregate) != histogram_min(both) ||
+      histogram_max(aggregate) != histogram_max(both))
+    histogram_fail("histogram_merge", aggregate);
+  if (!histogram_interval(aggregate, previous, interval) ||
+      !histogram_same_counts(interval, b))
+    histogram_fail("second interval", b);
+  if (histogram_min(interval) > histogram_min(b) ||
+      histogram_max(interval) < histogram_max(b) ||
+      histogram_counts_index(b, histogram_min(interval)) !=
+          histogram_counts_index(b, histogram_min(b)) ||
+      histogram_counts_index(b, histogram_max(interval)) !=
+          histogram_counts_index(b, histogram_max(b)))
+    histogram_fail("interval min and max", interval);
+  if (!histogram_interval(aggregate, previous, interval) ||
+      histogram_count(interval) != 0)
+    histogram_fail("empty interval", interval);
+
+  /* Values beyond the destination's range are dropped and counted */
+  if (histogram_merge(narrow, both) != too_big ||
+      !histogram_same_counts(narrow, direct) ||
+      histogram_min(narrow) != histogram_min(direct) ||
+      histogram_counts_index(narrow, histogram_max(narrow)) !=
+          histogram_counts_index(narrow, histogram_max(direct)) ||
+      histogram_value_at_percentile(narrow, 50) !=
+          histogram_value_at_percentile(direct, 50))
+    histogram_fail("merge into a narrower histogram", narrow);
+
+  /* A different precision goes through re-recording */
+  if (histogram_merge(coarse, both) != 0 ||
+      histogram_count(coarse) != histogram_count(both) ||
+      histogram_max(coarse) != histogram_max(both))
+    histogram_fail("merge into a coarser histogram", coarse);
+
+  if (histogram_copy(narrow, both) || histogram_interval(both, narrow, a))
+    histogram_fail("mismatched layouts accepted", narrow);
+  if (!histogram_copy(a, both) || !histogram_same_counts(a, both))
+    histogram_fail("histogram_copy", a);
+
+  histogram_free(coarse);
+  histogram_free(direct);
+  histogram_free(narrow);
+  histogram_free(interval);
+  histogram_free(previous);
+  histogram_free(aggregate);
+  histogram_free(both);
+  histogram_free(b);
+  histogram_free(a);
+}
+
+static void test_serialize(void) {
+  Histogram *h = histogram_new(1000, 3600000000000ULL, 2);
+  size_t len;
+
+  for (size_t i = 0; i < 10000; i++)
+    histogram_record(h, histogram_rand_value(h->highest));
+
+  unsigned char *data = histogram_serialize(h, &len);
+  Histogram *back = histogram_deserialize(data, len);
+  if (back == NULL || !histogram_same_counts(back, h) ||
+      histogram_min(back) != histogram_min(h) ||
+      histogram_max(back) != histogram_max(h) ||
+      histogram_value_at_percentile(back, 99) !=
+          histogram_value_at_percentile(h, 99))
+    histogram_fail("serialization round trip", h);
+  histogram_free(back);
+
+  /* Every truncation is rejected, not read past the end */
+  for (size_t cut = 0; cut < len; cut++) {
+    back = histogram_deserialize(data, cut);
+    if (back != NULL) {
+      histogram_fail("truncated serialization accepted", h);
+      histogram_free(back);
+      break;
+    }
+  }
+  data[0] = 'X';
+  if (histogram_deserialize(data, len) != NULL)
+    histogram_fail("bad magic accepted", h);
+  free(data);
+
+  histogram_reset(h);
+  data = histogram_serialize(h, &len);
+  back = histogram_deserialize(data, len);
+  if (back == NULL || histogram_count(back) != 0 || histogram_min(back) != 0)
+    histogram_fail("empty round trip", h);
+  histogram_free(back);
+  free(data);
+  histogram_free(h);
+}
+
+typedef struct {
+  Histogram *shared;
+  Histogram *own;
+  uint64_t seed;
+} HistogramWorker;
+
+static void *histogram_worker(void *arg) {
+  HistogramWorker *w = (HistogramWorker *)arg;
+  uint64_t x = w->seed;
+  for (size_t i = 0; i < TEST_VALUES / TEST_THREADS; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    uint64_t v = x >> (x % 48);
+    histogram_record_atomic(w->shared, v);
+    histogram_record(w->own, v);
+  }
+  return NULL;
+}
+
+static void test_threads(void) {
+  Histogram *shared = histogram_new(1, UINT64_MAX, 3);
+  Histogram *merged = histogram_new_like(shared);
+  HistogramWorker workers[TEST_THREADS];
+  pthread_t threads[TEST_THREADS];
+
+  for (int i = 0; i < TEST_THREADS; i++) {
+    workers[i].shared = shared;
+    workers[i].own = histogram_new_like(shared);
+    workers[i].seed = histogram_rand() | 1;
+    pthread_create(&threads[i], NULL, histogram_worker, &workers[i]);
+  }
+  for (int i = 0; i < TEST_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    histogram_merge(merged, workers[i].own);
+    histogram_free(workers[i].own);
+  }
+
+  if (!histogram_same_counts(shared, merged) ||
+      histogram_min(shared) != histogram_min(merged) ||
+      histogram_max(shared) != histogram_max(merged))
+    histogram_fail("histogram_record_atomic from several threads", shared);
+
+  histogram_free(merged);
+  histogram_free(shared);
+}
+
+int main(void) {
+  test_percentiles(1, 3600000000000ULL, 3);
+  test_percentiles(1000, 3600000000000ULL, 2);
+  test_percentiles(1, UINT64_MAX, 1);
+  test_percentiles(1, UINT64_MAX, 5);
+  test_percentiles(7, 100000, 4);
+  test_merge_and_interval();
+  test_serialize();
+  test_threads();
+
+  if (histogram_new(0, 100, 3) != NULL || histogram_new(1, 1, 3) != NULL ||
+      histogram_new(1, 100, 0) != NULL || histogram_new(1, 100, 6) != NULL) {
+    fprintf(stderr, "FAIL: invalid parameters accepted\n");
+    failures++;
+  }
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
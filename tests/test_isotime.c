@@ -0,0 +1,258 @@
+/**
+ * @file test_isotime.c
+ * @brief Timestamp formatting and parsing against gmtime_r() and timegm()
+ *
+ * Random nanosecond timestamps over the whole int64_t range are formatted at
+ * every precision and a range of UTC offsets, compared with text built from
+ * gmtime_r(), and parsed back. Random calendar fields are parsed and
+ * compared with timegm(). Fixed cases cover the accepted syntax variants,
+ * leap seconds, the int64_t limits and malformed input.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -I. tests/test_isotime.c -o test_isotime && ./test_isotime
+ */
+
+#define _DEFAULT_SOURCE
+#include "isotime.h"
+#include <time.h>
+
+#define TEST_STEPS 200000
+
+static int failures;
+static uint64_t rng = 0xbf58476d1ce4e5b9ULL;
+
+static uint64_t isotime_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static void isotime_fail(const char *what, const char *text, int64_t ns) {
+  fprintf(stderr, "FAIL: %s (\"%s\", %lld ns)\n", what, text, (long long)ns);
+  failures++;
+}
+
+/* The same text assembled from gmtime_r() and snprintf() */
+static void reference_format(int64_t ns, int precision, int offset,
+                             char *out, size_t size) {
+  int64_t secs = ns / ISOTIME_NS_PER_SEC, nanos = ns % ISOTIME_NS_PER_SEC;
+  if (nanos < 0) {
+    secs--;
+    nanos += ISOTIME_NS_PER_SEC;
+  }
+  time_t local = (time_t)(secs + (int64_t)offset * 60);
+  struct tm tm;
+  gmtime_r(&local, &tm);
+  size_t n = strftime(out, size, "%Y-%m-%dT%H:%M:%S", &tm);
+  if (precision > 0)
+    n += (size_t)snprintf(out + n, size - n, ".%0*lld", precision,
+                          (long long)(nanos / isotime_pow10[9 - precision]));
+  if (offset == 0)
+    snprintf(out + n, size - n, "Z");
+  else
+    snprintf(out + n, size - n, "%c%02d:%02d", offset < 0 ? '-' : '+',
+             abs(offset) / 60, abs(offset) % 60);
+}
+
+static int64_t isotime_truncate(int64_t ns, int precision) {
+  int64_t unit = isotime_pow10[9 - precision];
+  int64_t r = ns % unit;
+  return ns - (r < 0 ? r + unit : r);
+}
+
+static void test_format_random(void) {
+  static const int offsets[] = {0, 60, -60, 330, -570, 845, 1439, -1439};
+  char expect[64], got[ISOTIME_MAX_LEN];
+
+  for (size_t step = 0; step < TEST_STEPS; step++) {
+    int64_t ns = (int64_t)isotime_rand();
+    /* Half of the values within a few years of now */
+    if (step % 2 == 0)
+      ns = 1700000000LL * ISOTIME_NS_PER_SEC + ns % (200000000LL *
+                                                     ISOTIME_NS_PER_SEC);
+    if (ns == ISOTIME_INVALID)
+      continue;
+    int precision = (int)(step % 10);
+    int offset = offsets[isotime_rand() % 8];
+
+    /* Keep the local time inside the int64_t range gmtime_r() sees */
+    if ((ns > INT64_MAX - 86400 * ISOTIME_NS_PER_SEC && offset > 0) ||
+        (ns < INT64_MIN + 86400 * ISOTIME_NS_PER_SEC && offset < 0))
+      offset = 0;
+
+    reference_format(ns, precision, offset, expect, sizeof(expect));
+    size_t len = isotime_format(ns, precision, offset, got, sizeof(got));
+    if (len != strlen(expect) || strcmp(got, expect) != 0) {
+      fprintf(stderr, "  expected \"%s\"\n", expect);
+      isotime_fail("isotime_format", got, ns);
+      continue;
+    }
+
+    int64_t back;
+    int parsed_offset;
+    if (isotime_parse(got, len, &back, &parsed_offset) != len ||
+        back != isotime_truncate(ns, precision) || parsed_offset != offset)
+      isotime_fail("round trip", got, ns);
+  }
+}
+
+static void test_parse_random(void) {
+  char text[64];
+
+  for (size_t step = 0; step < TEST_STEPS; step++) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 1700 + (int)(isotime_rand() % 560) - 1900;
+    tm.tm_mon = (int)(isotime_rand() % 12);
+    tm.tm_mday = 1 + (int)(isotime_rand() %
+                           isotime_days_in_month(tm.tm_year + 1900,
+                                                 (unsigned)tm.tm_mon + 1));
+    tm.tm_hour = (int)(isotime_rand() % 24);
+    tm.tm_min = (int)(isotime_rand() % 60);
+    tm.tm_sec = (int)(isotime_rand() % 60);
+    int offset = (int)(isotime_rand() % 2879) - 1439;
+    unsigned frac = (unsigned)(isotime_rand() % 1000000);
+
+    int n = snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%06u",
+                     tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+                     tm.tm_min, tm.tm_sec, frac);
+    snprintf(text + n, sizeof(text) - (size_t)n, "%c%02d%s%02d",
+             offset < 0 ? '-' : '+', abs(offset) / 60,
+             step % 2 == 0 ? ":" : "", abs(offset) % 60);
+
+    int64_t secs = (int64_t)timegm(&tm) - (int64_t)offset * 60;
+    int64_t got;
+    size_t len = strlen(text);
+    bool in_range = secs > INT64_MIN / ISOTIME_NS_PER_SEC &&
+                    secs < INT64_MAX / ISOTIME_NS_PER_SEC;
+    size_t used = isotime_parse(text, len, &got, NULL);
+    if (!in_range)
+      continue;
+    if (used != len ||
+        got != secs * ISOTIME_NS_PER_SEC + (int64_t)frac * 1000)
+      isotime_fail("isotime_parse against timegm", text, got);
+  }
+}
+
+static void test_parse_cases(void) {
+  static const struct {
+    const char *text;
+    int64_t ns;
+    int offset;
+  } good[] = {
+      {"1970-01-01T00:00:00Z", 0, 0},
+      {"1970-01-01t00:00:00z", 0, 0},
+      {"1970-01-01 00:00:00.5Z", 500000000, 0},
+      {"1969-12-31T23:59:59.999999999Z", -1, 0},
+      {"1970-01-01T01:00:00+01:00", 0, 60},
+      {"1970-01-01T00:00:00-0130", 5400 * ISOTIME_NS_PER_SEC, -90},
+      {"2000-02-29T12:00:00Z", 951825600 * ISOTIME_NS_PER_SEC, 0},
+      {"2016-12-31T23:59:60Z", 1483228800 * ISOTIME_NS_PER_SEC, 0},
+      {"2024-03-01T12:34:56.1234567891234Z",
+       1709296496 * ISOTIME_NS_PER_SEC + 123456789, 0},
+      {"2262-04-11T23:47:16.854775807Z", INT64_MAX, 0},
+      {"1677-09-21T00:12:43.145224193Z", INT64_MIN + 1, 0},
+  };
+  static const char *const bad[] = {
+      "2024-02-30T00:00:00Z",  "2023-02-29T00:00:00Z",
+      "2024-13-01T00:00:00Z",  "2024-00-01T00:00:00Z",
+      "2024-01-00T00:00:00Z",  "2024-01-01T24:00:00Z",
+      "2024-01-01T00:60:00Z",  "2024-01-01T00:00:61Z",
+      "2024-01-01X00:00:00Z",  "2024-01-01T00:00:00",
+      "2024-01-01T00:00:00.Z", "2024-01-01T00:00:00.",
+      "2024-01-01T00:00:00+2400", "2024-01-01T00:00:00+05:60",
+      "2024-01-01T00:00:00+05:3", "2024-01-01T00:00:00+5",
+      "2024-1-01T00:00:00Z",   "2024-01-01T00:00:00Q",
+      "2262-04-11T23:47:16.854775808Z", "1677-09-21T00:12:43.145224192Z",
+      "9999-12-31T23:59:59Z",  "0000-01-01T00:00:00Z", ""};
+  char out[ISOTIME_MAX_LEN];
+  int64_t ns;
+  int offset;
+
+  for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+    size_t len = strlen(good[i].text);
+    if (isotime_parse(good[i].text, len, &ns, &offset) != len ||
+        ns != good[i].ns || offset != good[i].offset)
+      isotime_fail("isotime_parse", good[i].text, ns);
+  }
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    if (isotime_parse(bad[i], strlen(bad[i]), &ns, NULL) != 0)
+      isotime_fail("malformed timestamp accepted", bad[i], ns);
+  }
+
+  /* Only the given length is read, and trailing text is not consumed */
+  if (isotime_parse("2024-01-01T00:00:00Z junk", 25, &ns, NULL) != 20 ||
+      isotime_parse("2024-01-01T00:00:00.123", 23, &ns, NULL) != 0 ||
+      isotime_parse("2024-01-01T00:00:00+01:00", 24, &ns, NULL) != 0)
+    isotime_fail("length handling", "2024-01-01T00:00:00", ns);
+
+  /* The limits format and parse back; INT64_MIN is reserved */
+  if (isotime_format(INT64_MAX, 9, 0, out, sizeof(out)) != 30 ||
+      strcmp(out, "2262-04-11T23:47:16.854775807Z") != 0)
+    isotime_fail("format INT64_MAX", out, INT64_MAX);
+  if (isotime_format(INT64_MIN, 9, 0, out, sizeof(out)) != 30 ||
+      strcmp(out, "1677-09-21T00:12:43.145224192Z") != 0 ||
+      isotime_parse(out, 30, &ns, NULL) != 0)
+    isotime_fail("format INT64_MIN", out, INT64_MIN);
+  if (isotime_format(-1, 3, -1439, out, sizeof(out)) != 29 ||
+      strcmp(out, "1969-12-31T00:00:59.999-23:59") != 0)
+    isotime_fail("format with a negative offset", out, -1);
+
+  if (isotime_format(0, 10, 0, out, sizeof(out)) != 0 ||
+      isotime_format(0, 0, 1440, out, sizeof(out)) != 0 ||
+      isotime_format(0, 3, 0, out, 24) != 0 ||
+      isotime_format(0, 3, 0, out, 25) != 24 ||
+      isotime_format(0, 9, 60, out, ISOTIME_MAX_LEN) != 35)
+    isotime_fail("isotime_format arguments", out, 0);
+}
+
+static void test_batch(void) {
+  enum { N = 500 };
+  int64_t ns[N], back[N];
+  char slots[N][ISOTIME_MAX_LEN];
+  const char *texts[N];
+  char single[ISOTIME_MAX_LEN];
+
+  /* Sorted, crossing midnight and the epoch several times */
+  int64_t t = -2 * ISOTIME_SEC_PER_DAY * ISOTIME_NS_PER_SEC;
+  for (size_t i = 0; i < N; i++) {
+    t += (int64_t)(isotime_rand() % (3600 * ISOTIME_NS_PER_SEC));
+    ns[i] = t;
+  }
+
+  for (int offset = -330; offset <= 330; offset += 330) {
+    if (isotime_format_batch(ns, N, 6, offset, &slots[0][0],
+                             ISOTIME_MAX_LEN) != N)
+      isotime_fail("isotime_format_batch", "", 0);
+    for (size_t i = 0; i < N; i++) {
+      isotime_format(ns[i], 6, offset, single, sizeof(single));
+      if (strcmp(slots[i], single) != 0)
+        isotime_fail("batch differs from single", slots[i], ns[i]);
+      texts[i] = slots[i];
+    }
+    texts[7] = NULL;
+    texts[8] = "not a timestamp";
+    slots[9][strlen(slots[9]) - 1] = '\0';
+    if (isotime_parse_batch(texts, N, back) != N - 3)
+      isotime_fail("isotime_parse_batch count", "", 0);
+    for (size_t i = 0; i < N; i++) {
+      int64_t expect = i >= 7 && i <= 9 ? ISOTIME_INVALID
+                                        : isotime_truncate(ns[i], 6);
+      if (back[i] != expect)
+        isotime_fail("isotime_parse_batch", slots[i], ns[i]);
+    }
+  }
+  if (isotime_format_batch(ns, N, 9, 0, &slots[0][0], 30) != 0)
+    isotime_fail("short stride accepted", "", 0);
+}
+
+int main(void) {
+  test_format_random();
+  test_parse_random();
+  test_parse_cases();
+  test_batch();
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
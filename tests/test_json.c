@@ -0,0 +1,158 @@
+/**
+ * @file test_json.c
+ * @brief JSON escaping against a byte-at-a-time reference, and round trips
+ *
+ * Random buffers of every length up to a few SIMD blocks, with the bytes
+ * that need escaping placed at every offset, are escaped and compared with
+ * a plain reference, then unescaped back (also in place). Fixed cases cover
+ * \uXXXX decoding, surrogate pairs and malformed input. Build it once as is
+ * and once with -DJSON_NO_SIMD to cover both scanners.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -I. tests/test_json.c -o test_json && ./test_json
+ *   gcc -O2 -DJSON_NO_SIMD -I. tests/test_json.c -o test_json && ./test_json
+ */
+
+#include "json.h"
+
+#define TEST_MAX_LEN 130
+
+static int failures;
+static uint64_t rng = 0xda942042e4dd58b5ULL;
+
+static uint64_t json_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static void json_fail(const char *what, const char *input, size_t len) {
+  fprintf(stderr, "FAIL: %s (input \"%.*s\", length %zu)\n", what, (int)len,
+          input, len);
+  failures++;
+}
+
+static size_t reference_escape(const unsigned char *src, size_t len,
+                               char *dst) {
+  size_t o = 0;
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = src[i];
+    const char *short_form = c == '"'    ? "\\\""
+                             : c == '\\' ? "\\\\"
+                             : c == '\b' ? "\\b"
+                             : c == '\f' ? "\\f"
+                             : c == '\n' ? "\\n"
+                             : c == '\r' ? "\\r"
+                             : c == '\t' ? "\\t"
+                                         : NULL;
+    if (short_form != NULL)
+      o += (size_t)sprintf(dst + o, "%s", short_form);
+    else if (c < 0x20)
+      o += (size_t)sprintf(dst + o, "\\u%04x", c);
+    else
+      dst[o++] = (char)c;
+  }
+  dst[o] = '\0';
+  return o;
+}
+
+static void json_round_trip(const char *src, size_t len) {
+  char expect[TEST_MAX_LEN * 6 + 1];
+  char out[TEST_MAX_LEN * 6 + 1];
+  size_t n = reference_escape((const unsigned char *)src, len, expect);
+  size_t got;
+
+  if (json_escaped_length(src, len) != n)
+    json_fail("json_escaped_length", src, len);
+  if (json_escape(src, len, out) != n || strcmp(out, expect) != 0)
+    json_fail("json_escape", src, len);
+
+  char back[TEST_MAX_LEN + 1];
+  if (!json_unescape(expect, n, back, &got) || got != len ||
+      memcmp(back, src, len) != 0)
+    json_fail("json_unescape", src, len);
+
+  /* In place */
+  memcpy(out, expect, n);
+  if (!json_unescape(out, n, out, &got) || got != len ||
+      memcmp(out, src, len) != 0)
+    json_fail("in-place json_unescape", src, len);
+}
+
+static void test_random(void) {
+  static const char special[] = {'"', '\\', '\n', '\t', '\x01', '\x1f', '\0'};
+  char src[TEST_MAX_LEN];
+
+  for (size_t len = 0; len <= TEST_MAX_LEN; len++) {
+    /* Clean text with one byte needing an escape at each offset */
+    for (size_t at = 0; at < len; at++) {
+      for (size_t i = 0; i < len; i++)
+        src[i] = (char)(' ' + json_rand() % 95);
+      for (size_t i = 0; i < len; i++) {
+        if (src[i] == '"' || src[i] == '\\')
+          src[i] = 'x';
+      }
+      src[at] = special[json_rand() % sizeof(special)];
+      json_round_trip(src, len);
+    }
+
+    /* Arbitrary bytes, including UTF-8 lead and continuation bytes */
+    for (size_t i = 0; i < len; i++)
+      src[i] = (char)json_rand();
+    json_round_trip(src, len);
+  }
+}
+
+static void test_unescape_cases(void) {
+  static const struct {
+    const char *input;
+    const char *output;
+    size_t output_len;
+  } good[] = {
+      {"plain", "plain", 5},
+      {"\\/\\b\\f", "/\b\f", 3},
+      {"\\u0041\\u00e9", "A\xc3\xa9", 3},
+      {"\\u20AC", "\xe2\x82\xac", 3},
+      {"\\ud83d\\ude00", "\xf0\x9f\x98\x80", 4},
+      {"a\\u0000b", "a\0b", 3},
+      {"\\uFFFF", "\xef\xbf\xbf", 3},
+  };
+  static const char *const bad[] = {
+      "\\x",           "\\",           "a\"b",   "tab\there", "\\u12",
+      "\\u12g4",       "\\udc00",      "\\ud800", "\\ud800x",  "\\ud800\\u0041",
+      "\\ud800\\udbff", "\\ud800\\ud"};
+  char out[64];
+  size_t n;
+
+  for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+    size_t len = strlen(good[i].input);
+    if (!json_unescape(good[i].input, len, out, &n) ||
+        n != good[i].output_len ||
+        memcmp(out, good[i].output, n) != 0)
+      json_fail("json_unescape", good[i].input, len);
+  }
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    if (json_unescape(bad[i], strlen(bad[i]), out, &n))
+      json_fail("malformed input accepted", bad[i], strlen(bad[i]));
+  }
+
+  char *escaped = json_escape_alloc("say \"hi\"\n");
+  if (escaped == NULL || strcmp(escaped, "say \\\"hi\\\"\\n") != 0)
+    json_fail("json_escape_alloc", "say \"hi\"\n", 9);
+  char *decoded = escaped != NULL ? json_unescape_alloc(escaped) : NULL;
+  if (decoded == NULL || strcmp(decoded, "say \"hi\"\n") != 0)
+    json_fail("json_unescape_alloc", "say \"hi\"\n", 9);
+  if (json_unescape_alloc("\\q") != NULL)
+    json_fail("json_unescape_alloc accepted", "\\q", 2);
+  free(decoded);
+  free(escaped);
+}
+
+int main(void) {
+  test_random();
+  test_unescape_cases();
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
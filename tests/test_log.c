@@ -0,0 +1,583 @@
+/**
+ * @file test_log.c
+ * @brief What the logger writes, read back from its files
+ *
+ * Async mode is checked under each overflow policy: with log_lock held the
+ * writer thread cannot drain the queue, so exactly the queue's capacity is
+ * accepted and the rest is blocked on, dropped or dropped and counted.
+ * Lines from several producer threads must all arrive, in per-thread order,
+ * once log_flush() or log_close() returns. Rotation by size must keep the
+ * newest lines contiguous across the kept files, and rotation on request or
+ * on an interval must switch files between two lines. Category levels set
+ * by name, by spec string, by control file and by signal must decide which
+ * LOG_CAT() lines reach the file. Each sink kind must get exactly the lines
+ * its own level passes, from the caller or from the writer thread, and
+ * buffered sinks must hold them until log_flush() or log_sink_remove().
+ * LOG_FATAL must close the log, writing everything still queued or buffered,
+ * before the process exits.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -pthread -I. tests/test_log.c -o test_log && ./test_log
+ */
+
+#include "utils.h"
+#include <sys/wait.h>
+
+#define TEST_LOG "test_log.log"
+#define TEST_LEVELS "test_log.levels"
+#define TEST_SINK "test_log.sink"
+#define TEST_SYSLOG "test_log.sock"
+#define TEST_THREADS 4
+#define TEST_LINES 5000
+
+static int failures;
+
+static void log_test_fail(const char *what, const char *detail) {
+  fprintf(stderr, "FAIL: %s%s%s\n", what, detail != NULL ? ": " : "",
+          detail != NULL ? detail : "");
+  failures++;
+}
+
+/* Lines in a file that contain text, or -1 if the file is missing */
+static int log_test_count(const char *path, const char *text) {
+  char *content = file_read_all(path);
+  int count = 0;
+  if (content == NULL)
+    return -1;
+  for (char *line = content; *line != '\0';) {
+    char *end = strchr(line, '\n');
+    if (end == NULL)
+      end = line + strlen(line);
+    char saved = *end;
+    *end = '\0';
+    if (strstr(line, text) != NULL)
+      count++;
+    *end = saved;
+    line = saved != '\0' ? end + 1 : end;
+  }
+  free(content);
+  return count;
+}
+
+static void log_test_expect(const char *path, const char *text, int expect) {
+  int got = log_test_count(path, text);
+  if (got != expect) {
+    char detail[256];
+    snprintf(detail, sizeof(detail), "%d lines with \"%s\" in %s, expected %d",
+             got, text, path, expect);
+    log_test_fail("line count", detail);
+  }
+}
+
+/* ========== ASYNC MODE ========== */
+
+static void *log_test_producer(void *arg) {
+  int id = (int)(size_t)arg;
+  for (int i = 0; i < TEST_LINES; i++)
+    log_message(LOG_INFO, "producer t%d n%d", id, i);
+  return NULL;
+}
+
+static void log_test_order(const char *path) {
+  char *content = file_read_all(path);
+  int next[TEST_THREADS] = {0};
+  if (content == NULL) {
+    log_test_fail("no log file", path);
+    return;
+  }
+  for (char *p = strstr(content, "producer t"); p != NULL;
+       p = strstr(p + 1, "producer t")) {
+    int id, n;
+    if (sscanf(p, "producer t%d n%d", &id, &n) != 2 || id < 0 ||
+        id >= TEST_THREADS || n != next[id]) {
+      log_test_fail("producer lines out of order", NULL);
+      break;
+    }
+    next[id]++;
+  }
+  for (int i = 0; i < TEST_THREADS; i++) {
+    if (next[i] != TEST_LINES)
+      log_test_fail("producer lines missing", NULL);
+  }
+  free(content);
+}
+
+static void test_async_producers(void) {
+  pthread_t threads[TEST_THREADS];
+
+  remove(TEST_LOG);
+  log_init(TEST_LOG, LOG_INFO);
+  /* A small queue so producers wait on the writer */
+  if (!log_async_start(16, LOG_OVERFLOW_BLOCK))
+    log_test_fail("log_async_start", NULL);
+  for (size_t i = 0; i < TEST_THREADS; i++)
+    pthread_create(&threads[i], NULL, log_test_producer, (void *)i);
+  for (int i = 0; i < TEST_THREADS; i++)
+    pthread_join(threads[i], NULL);
+
+  /* log_flush() writes everything without stopping the writer */
+  log_message(LOG_INFO, "before flush");
+  log_flush();
+  log_test_expect(TEST_LOG, "before flush", 1);
+  log_test_order(TEST_LOG);
+  if (log_dropped() != 0)
+    log_test_fail("lines dropped under LOG_OVERFLOW_BLOCK", NULL);
+
+  log_message(LOG_INFO, "before close");
+  log_message(LOG_DEBUG, "filtered");
+  log_close();
+  log_test_expect(TEST_LOG, "before close", 1);
+  log_test_expect(TEST_LOG, "filtered", 0);
+  remove(TEST_LOG);
+}
+
+/*
+ * With log_lock held the writer blocks before releasing any slot, so a
+ * queue of 8 takes the first 8 lines and has no room for the rest.
+ */
+static void test_async_overflow(LogOverflow policy) {
+  char detail[64];
+
+  remove(TEST_LOG);
+  log_init(TEST_LOG, LOG_INFO);
+  log_async_start(8, policy);
+  LOG_LOCK();
+  for (int i = 0; i < 100; i++)
+    log_message(LOG_INFO, "overflow n%d", i);
+  LOG_UNLOCK();
+  unsigned long long dropped = log_dropped();
+  log_close();
+
+  snprintf(detail, sizeof(detail), "policy %d, %llu dropped", (int)policy,
+           dropped);
+  if (dropped != 92)
+    log_test_fail("log_dropped", detail);
+  log_test_expect(TEST_LOG, "overflow n", 8);
+  log_test_expect(TEST_LOG, "overflow n7", 1);
+  log_test_expect(TEST_LOG, "[WARNING] 92 log lines dropped",
+                  policy == LOG_OVERFLOW_COUNT ? 1 : 0);
+  remove(TEST_LOG);
+}
+
+/* A blocked producer resumes once the writer frees a slot */
+static void *log_test_blocked(void *arg) {
+  (void)arg;
+  for (int i = 0; i < 20; i++)
+    log_message(LOG_INFO, "blocked n%d", i);
+  return NULL;
+}
+
+static void test_async_block(void) {
+  pthread_t thread;
+
+  remove(TEST_LOG);
+  log_init(TEST_LOG, LOG_INFO);
+  log_async_start(8, LOG_OVERFLOW_BLOCK);
+  LOG_LOCK();
+  pthread_create(&thread, NULL, log_test_blocked, NULL);
+  /* Give the producer time to fill the queue and start waiting */
+  struct timespec pause = {0, 50000000L};
+  nanosleep(&pause, NULL);
+  LOG_UNLOCK();
+  pthread_join(thread, NULL);
+  log_close();
+
+  if (log_dropped() != 0)
+    log_test_fail("lines dropped under LOG_OVERFLOW_BLOCK", NULL);
+  log_test_expect(TEST_LOG, "blocked n", 20);
+  remove(TEST_LOG);
+}
+
+/* ========== ROTATION ========== */
+
+static void log_test_remove_rotated(void) {
+  remove(TEST_LOG);
+  remove(TEST_LOG ".1");
+  remove(TEST_LOG ".2");
+  remove(TEST_LOG ".3");
+}
+
+/* Waits up to two seconds for the rotator to finish a rotation */
+static bool log_test_wait_rotation(const char *path) {
+  struct timespec pause = {0, 10000000L};
+  for (int i = 0; i < 200; i++) {
+    if (file_exists(path) && !UTILS_LOAD(&log_rotation.requested))
+      return true;
+    nanosleep(&pause, NULL);
+  }
+  return false;
+}
+
+static void test_rotation_size(void) {
+  LogRotateConfig config = {4096, 0, 2, NULL, NULL};
+  static const char *const order[] = {TEST_LOG ".2", TEST_LOG ".1", TEST_LOG};
+  int next = -1;
+
+  log_test_remove_rotated();
+  log_init(TEST_LOG, LOG_INFO);
+  if (!log_rotate_start(&config))
+    log_test_fail("log_rotate_start", NULL);
+  for (int i = 0; i < 2000; i++) {
+    log_message(LOG_INFO, "rotate n%d", i);
+    /* Let each rotation finish so the files are cut near the limit */
+    if (UTILS_LOAD(&log_rotation.requested) &&
+        !log_test_wait_rotation(TEST_LOG ".1"))
+      log_test_fail("size rotation", NULL);
+  }
+  log_close();
+
+  if (!file_exists(TEST_LOG ".2") || file_exists(TEST_LOG ".3"))
+    log_test_fail("rotated files kept", NULL);
+  for (int f = 0; f < 2; f++) {
+    long size = file_size(order[f]);
+    if (size < 4096 || size >= 4096 + 64)
+      log_test_fail("rotated file size", order[f]);
+  }
+
+  /* Oldest to newest, the kept lines run without a gap to the last one */
+  for (int f = 0; f < 3; f++) {
+    char *content = file_read_all(order[f]);
+    if (content == NULL)
+      continue;
+    for (char *p = strstr(content, "rotate n"); p != NULL;
+         p = strstr(p + 1, "rotate n")) {
+      int n = atoi(p + 8);
+      if (next >= 0 && n != next) {
+        log_test_fail("gap or repeat across rotated files", order[f]);
+        break;
+      }
+      next = n + 1;
+    }
+    free(content);
+  }
+  if (next != 2000)
+    log_test_fail("last line lost in rotation", NULL);
+  log_test_remove_rotated();
+}
+
+static void test_rotation_request(void) {
+  LogRotateConfig config = {0, 0, 3, NULL, NULL};
+
+  log_test_remove_rotated();
+  log_init(TEST_LOG, LOG_INFO);
+  log_async_start(64, LOG_OVERFLOW_BLOCK);
+  log_rotate_start(&config);
+  log_message(LOG_INFO, "first file");
+  log_flush();
+  log_rotate_now();
+  if (!log_test_wait_rotation(TEST_LOG ".1"))
+    log_test_fail("log_rotate_now", NULL);
+  log_message(LOG_INFO, "second file");
+  log_close();
+  log_test_expect(TEST_LOG ".1", "first file", 1);
+  log_test_expect(TEST_LOG ".1", "second file", 0);
+  log_test_expect(TEST_LOG, "second file", 1);
+
+  /* Once a second, on second boundaries */
+  config.interval = 1;
+  log_test_remove_rotated();
+  log_init(TEST_LOG, LOG_INFO);
+  log_rotate_start(&config);
+  log_message(LOG_INFO, "before interval");
+  if (!log_test_wait_rotation(TEST_LOG ".1"))
+    log_test_fail("interval rotation", NULL);
+  log_message(LOG_INFO, "after interval");
+  log_close();
+  log_test_expect(TEST_LOG ".1", "before interval", 1);
+  log_test_expect(TEST_LOG, "after interval", 1);
+  log_test_remove_rotated();
+
+  if (log_rotate_start(&config))
+    log_test_fail("rotation started without a log file", NULL);
+}
+
+/* ========== CATEGORIES ========== */
+
+LOG_CATEGORY_DEFINE(log_test_net, "net");
+LOG_CATEGORY_DEFINE(log_test_db, "db");
+
+static void log_test_write_levels(const char *spec) {
+  FILE *file = fopen(TEST_LEVELS, "w");
+  if (file != NULL) {
+    fputs(spec, file);
+    fclose(file);
+  }
+}
+
+static void test_categories(void) {
+  remove(TEST_LOG);
+  log_init(TEST_LOG, LOG_WARNING);
+
+  /* A rule set before the category's first use applies on registration */
+  log_category_set("net", LOG_DEBUG);
+  LOG_CAT(log_test_net, LOG_DEBUG, "net debug 1");
+  LOG_CAT(log_test_db, LOG_INFO, "db info 1");
+  LOG_CAT(log_test_db, LOG_ERROR, "db error 1");
+  LOG_INFOF("plain info 1");
+  if (!log_category_enabled(&log_test_net, LOG_DEBUG) ||
+      log_category_enabled(&log_test_db, LOG_INFO) ||
+      log_enabled(LOG_INFO))
+    log_test_fail("category thresholds", NULL);
+
+  /* Categories without a rule follow the default level */
+  log_set_level(LOG_INFO);
+  LOG_CAT(log_test_db, LOG_INFO, "db info 2");
+  if (!log_category_configure("db=debug, *=error"))
+    log_test_fail("log_category_configure", NULL);
+  LOG_CAT(log_test_db, LOG_DEBUG, "db debug 3");
+  LOG_CAT(log_test_net, LOG_DEBUG, "net debug 3");
+  LOG_WARNINGF("plain warning 3");
+  LOG_ERRORF("plain error 3");
+
+  log_category_reset("net");
+  LOG_CAT(log_test_net, LOG_WARNING, "net warning 4");
+
+  /* Invalid settings are reported; the valid ones still apply */
+  if (log_category_configure("db=loud,net=info"))
+    log_test_fail("invalid category level accepted", NULL);
+  LOG_CAT(log_test_net, LOG_INFO, "net info 5");
+
+  /* A control file replaces every rule */
+  log_test_write_levels("# levels\nnet=warning\n*=info # default\n");
+  if (!log_category_load(TEST_LEVELS))
+    log_test_fail("log_category_load", NULL);
+  LOG_CAT(log_test_db, LOG_DEBUG, "db debug 6");
+  LOG_CAT(log_test_db, LOG_INFO, "db info 6");
+  LOG_CAT(log_test_net, LOG_INFO, "net info 6");
+
+  /* The watcher reloads the file when the signal arrives */
+  if (!log_category_watch(TEST_LEVELS, SIGUSR1, 0))
+    log_test_fail("log_category_watch", NULL);
+  log_test_write_levels("net=debug\n");
+  raise(SIGUSR1);
+  struct timespec pause = {0, 10000000L};
+  for (int i = 0; i < 200 && !log_category_enabled(&log_test_net, LOG_DEBUG);
+       i++)
+    nanosleep(&pause, NULL);
+  log_category_unwatch();
+  LOG_CAT(log_test_net, LOG_DEBUG, "net debug 7");
+  log_category_reset("net");
+  log_close();
+
+  log_test_expect(TEST_LOG, "[DEBUG] [net] [", 3);
+  log_test_expect(TEST_LOG, "net debug 1", 1);
+  log_test_expect(TEST_LOG, "db info 1", 0);
+  log_test_expect(TEST_LOG, "[ERROR] [db] [", 1);
+  log_test_expect(TEST_LOG, "plain info 1", 0);
+  log_test_expect(TEST_LOG, "db info 2", 1);
+  log_test_expect(TEST_LOG, "db debug 3", 1);
+  log_test_expect(TEST_LOG, "net debug 3", 1);
+  log_test_expect(TEST_LOG, "plain warning 3", 0);
+  log_test_expect(TEST_LOG, "plain error 3", 1);
+  log_test_expect(TEST_LOG, "net warning 4", 0);
+  log_test_expect(TEST_LOG, "net info 5", 1);
+  log_test_expect(TEST_LOG, "db debug 6", 0);
+  log_test_expect(TEST_LOG, "db info 6", 1);
+  log_test_expect(TEST_LOG, "net info 6", 0);
+  log_test_expect(TEST_LOG, "net debug 7", 1);
+  remove(TEST_LOG);
+  remove(TEST_LEVELS);
+}
+
+/* ========== SINKS ========== */
+
+typedef struct {
+  int lines;
+  int below;     /* Lines under the sink's level */
+  char last[64]; /* Text of the newest line, after the timestamp */
+} LogTestCapture;
+
+static void log_test_capture(void *user, LogLevel level, const char *line,
+                             size_t length) {
+  LogTestCapture *capture = (LogTestCapture *)user;
+  size_t body = log_line_body(line);
+  size_t n = length - body < sizeof(capture->last) - 1
+                 ? length - body
+                 : sizeof(capture->last) - 1;
+  capture->lines++;
+  if (level < LOG_WARNING)
+    capture->below++;
+  memcpy(capture->last, line + body, n);
+  capture->last[n] = '\0';
+}
+
+/* The next datagram must be exactly the syslog form of the text */
+static void log_test_syslog(int server, LogLevel level, const char *text) {
+  char got[256], expect[256];
+  ssize_t n = recv(server, got, sizeof(got) - 1, MSG_DONTWAIT);
+  got[n > 0 ? n : 0] = '\0';
+  snprintf(expect, sizeof(expect), "<%d>test[%ld]: [%s] %s",
+           log_syslog_priority(level), (long)getpid(), log_level_name(level),
+           text);
+  if (strcmp(got, expect) != 0)
+    log_test_fail("syslog datagram", got);
+}
+
+/* The ring's lines, oldest first, end with "ring n99" without a gap */
+static void log_test_ring(LogSink *ring, size_t size) {
+  char *buffer = (char *)safe_malloc(size);
+  size_t length = log_sink_ring_read(ring, buffer, size);
+  int next = -1;
+
+  if (length == 0 || buffer[0] != '[' || buffer[length - 1] != '\n')
+    log_test_fail("ring read not on line boundaries", buffer);
+  for (char *p = strstr(buffer, "ring n"); p != NULL;
+       p = strstr(p + 1, "ring n")) {
+    int n = atoi(p + 6);
+    if (next >= 0 && n != next) {
+      log_test_fail("gap in ring lines", NULL);
+      break;
+    }
+    next = n + 1;
+  }
+  if (next != 100)
+    log_test_fail("newest ring line missing", NULL);
+  free(buffer);
+}
+
+static void test_sinks(bool async) {
+  LogTestCapture capture = {0, 0, ""};
+  struct sockaddr_un address;
+  char ring_text[1024];
+
+  remove(TEST_LOG);
+  remove(TEST_SINK);
+  remove(TEST_SYSLOG);
+  int server = socket(AF_UNIX, SOCK_DGRAM, 0);
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, TEST_SYSLOG);
+  if (bind(server, (struct sockaddr *)&address, sizeof(address)) != 0)
+    log_test_fail("bind", TEST_SYSLOG);
+
+  log_init(TEST_LOG, LOG_ERROR);
+  if (async)
+    log_async_start(64, LOG_OVERFLOW_BLOCK);
+  LogSink *file = log_sink_file(TEST_SINK, LOG_INFO, 4096);
+  LogSink *ring = log_sink_ring(1024, LOG_DEBUG);
+  LogSink *callback =
+      log_sink_callback(log_test_capture, &capture, LOG_WARNING);
+  LogSink *syslog = log_sink_syslog(TEST_SYSLOG, "test", LOG_WARNING);
+  if (!log_sink_add(file) || !log_sink_add(ring) || !log_sink_add(callback) ||
+      !log_sink_add(syslog))
+    log_test_fail("log_sink_add", NULL);
+  if (!log_enabled(LOG_DEBUG))
+    log_test_fail("sink level did not lower log_enabled()", NULL);
+
+  log_message(LOG_DEBUG, "sink debug");
+  log_message(LOG_INFO, "sink info");
+  log_message(LOG_WARNING, "sink warning");
+  log_message(LOG_ERROR, "sink error");
+  /* Buffered lines wait for log_flush() */
+  log_test_expect(TEST_SINK, "sink ", 0);
+  log_flush();
+
+  log_test_expect(TEST_LOG, "sink ", 1);
+  log_test_expect(TEST_LOG, "sink error", 1);
+  log_test_expect(TEST_SINK, "sink ", 3);
+  log_test_expect(TEST_SINK, "sink debug", 0);
+  if (capture.lines != 2 || capture.below != 0 ||
+      strcmp(capture.last, "[ERROR] sink error\n") != 0)
+    log_test_fail("callback sink", capture.last);
+  log_test_syslog(server, LOG_WARNING, "sink warning");
+  log_test_syslog(server, LOG_ERROR, "sink error");
+  if (log_sink_ring_read(ring, ring_text, sizeof(ring_text)) == 0 ||
+      strstr(ring_text, "] [DEBUG] sink debug\n") == NULL ||
+      strstr(ring_text, "] [ERROR] sink error\n") == NULL)
+    log_test_fail("ring sink", ring_text);
+
+  /* Past its size the ring keeps the newest whole lines */
+  for (int i = 0; i < 100; i++)
+    log_message(LOG_DEBUG, "ring n%d", i);
+  log_flush();
+  log_test_ring(ring, 4096);
+  log_test_ring(ring, 200);
+
+  log_sink_set_level(callback, LOG_ERROR);
+  log_message(LOG_WARNING, "after set level");
+  log_message(LOG_INFO, "before remove");
+  log_flush();
+  if (capture.lines != 2)
+    log_test_fail("log_sink_set_level", capture.last);
+  log_test_syslog(server, LOG_WARNING, "after set level");
+
+  /* Removing a sink writes what it buffered */
+  log_sink_remove(file);
+  log_test_expect(TEST_SINK, "before remove", 1);
+  log_sink_remove(ring);
+  if (log_enabled(LOG_INFO) || !log_enabled(LOG_WARNING))
+    log_test_fail("log_enabled() after log_sink_remove", NULL);
+  log_message(LOG_WARNING, "after remove");
+  log_close();
+
+  log_test_expect(TEST_SINK, "after remove", 0);
+  log_test_syslog(server, LOG_WARNING, "after remove");
+  log_test_expect(TEST_LOG, "after ", 0);
+  close(server);
+  remove(TEST_LOG);
+  remove(TEST_SINK);
+  remove(TEST_SYSLOG);
+}
+
+/* ========== FATAL ========== */
+
+typedef enum { FATAL_SYNC, FATAL_SINK, FATAL_ASYNC } LogTestFatal;
+
+/* Runs from exit(): fails the child if LOG_FATAL skipped log_close() */
+static void log_test_closed(void) {
+  if (log_file != NULL)
+    _exit(2);
+}
+
+static void test_fatal(LogTestFatal mode) {
+  char detail[64];
+  int status = 0;
+
+  remove(TEST_LOG);
+  remove(TEST_SINK);
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid == 0) {
+    log_init(TEST_LOG, LOG_INFO);
+    if (mode == FATAL_SINK)
+      log_sink_add(log_sink_file(TEST_SINK, LOG_INFO, 4096));
+    if (mode == FATAL_ASYNC)
+      log_async_start(64, LOG_OVERFLOW_BLOCK);
+    atexit(log_test_closed);
+    log_message(LOG_INFO, "before fatal");
+    LOG_FATALF("fatal %d", (int)mode);
+    _exit(3);
+  }
+
+  if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != EXIT_FAILURE) {
+    snprintf(detail, sizeof(detail), "mode %d, status %d", (int)mode, status);
+    log_test_fail("LOG_FATAL exit", detail);
+  }
+  log_test_expect(TEST_LOG, "before fatal", 1);
+  log_test_expect(TEST_LOG, "[FATAL] [", 1);
+  if (mode == FATAL_SINK) {
+    log_test_expect(TEST_SINK, "before fatal", 1);
+    log_test_expect(TEST_SINK, "[FATAL] [", 1);
+  }
+  remove(TEST_LOG);
+  remove(TEST_SINK);
+}
+
+int main(void) {
+  test_async_producers();
+  test_async_overflow(LOG_OVERFLOW_DROP);
+  test_async_overflow(LOG_OVERFLOW_COUNT);
+  test_async_block();
+  test_rotation_size();
+  test_rotation_request();
+  test_categories();
+  test_sinks(false);
+  test_sinks(true);
+  test_fatal(FATAL_SYNC);
+  test_fatal(FATAL_SINK);
+  test_fatal(FATAL_ASYNC);
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
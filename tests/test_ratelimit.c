@@ -0,0 +1,120 @@
+/**
+ * @file test_ratelimit.c
+ * @brief Admission counts for the token bucket and sliding window
+ *
+ * Every check passes explicit timestamps, so the results do not depend on
+ * the speed of the machine.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -pthread -I. tests/test_ratelimit.c -o test_ratelimit -lm
+ *   ./test_ratelimit
+ */
+
+#define HRCLOCK_IMPLEMENTATION
+#include "ratelimit.h"
+
+static int failures;
+
+static void ratelimit_check(const char *what, uint64_t got, uint64_t expect) {
+  if (got == expect)
+    return;
+  fprintf(stderr, "FAIL: %s gave %llu, expected %llu\n", what,
+          (unsigned long long)got, (unsigned long long)expect);
+  failures++;
+}
+
+static uint64_t ratelimit_take(RateLimiter *rl, uint64_t calls,
+                               uint64_t now_ns) {
+  uint64_t allowed = 0;
+  for (uint64_t i = 0; i < calls; i++)
+    allowed += ratelimit_allow_n_at(rl, 1, now_ns);
+  return allowed;
+}
+
+static void test_token_bucket(void) {
+  RateLimiter rl;
+  const uint64_t t = 5000000000ULL;
+
+  /* 10 per second, bursts of 5 */
+  ratelimit_token_bucket_init(&rl, 10, 5);
+  ratelimit_check("bucket available when full", ratelimit_available_at(&rl, t),
+                  5);
+  ratelimit_check("bucket burst", ratelimit_take(&rl, 8, t), 5);
+  ratelimit_check("bucket empty", ratelimit_available_at(&rl, t), 0);
+  ratelimit_check("bucket after 99 ms", ratelimit_take(&rl, 1, t + 99000000),
+                  0);
+  ratelimit_check("bucket after 100 ms", ratelimit_take(&rl, 2, t + 100000000),
+                  1);
+  ratelimit_check("bucket refilled after 1 s",
+                  ratelimit_available_at(&rl, t + 1100000000), 5);
+  ratelimit_check("bucket n above burst",
+                  ratelimit_allow_n_at(&rl, 6, t + 1100000000), 0);
+  ratelimit_check("bucket n within burst",
+                  ratelimit_allow_n_at(&rl, 5, t + 1100000000), 1);
+  ratelimit_check("bucket invalid rate", ratelimit_token_bucket_init(&rl, 0, 5),
+                  0);
+}
+
+static void test_sliding_window(void) {
+  RateLimiter rl;
+
+  /* 10 per 1000 ns; window 10 starts at 10000 */
+  ratelimit_sliding_window_init(&rl, 10, 1000);
+  ratelimit_check("window fill", ratelimit_take(&rl, 12, 10000), 10);
+  ratelimit_check("window full", ratelimit_available_at(&rl, 10999), 0);
+  /* Halfway through window 11 the previous window still weighs 5 */
+  ratelimit_check("window half overlap", ratelimit_available_at(&rl, 11500),
+                  5);
+  ratelimit_check("window half overlap taken", ratelimit_take(&rl, 8, 11500),
+                  5);
+  /* Two windows later nothing carries over */
+  ratelimit_check("window after gap", ratelimit_take(&rl, 12, 13000), 10);
+  ratelimit_check("window limit above max",
+                  ratelimit_sliding_window_init(&rl, RATELIMIT_WINDOW_MAX + 1,
+                                                1000),
+                  0);
+}
+
+/* A caller whose timestamp trails the stored window must not reset it */
+static void test_window_backwards(void) {
+  RateLimiter rl = RATELIMIT_SLIDING_WINDOW_INIT(10, 1000);
+
+  ratelimit_check("backwards fill", ratelimit_take(&rl, 10, 20900), 10);
+  ratelimit_check("backwards late caller", ratelimit_take(&rl, 1, 19999), 0);
+  ratelimit_check("backwards late caller available",
+                  ratelimit_available_at(&rl, 19999), 0);
+  ratelimit_check("backwards same window", ratelimit_take(&rl, 9, 20950), 0);
+  ratelimit_check("backwards next window", ratelimit_take(&rl, 10, 22000), 10);
+
+  /* Late callers are counted against the newer window */
+  ratelimit_sliding_window_init(&rl, 10, 1000);
+  ratelimit_check("backwards start", ratelimit_take(&rl, 1, 30000), 1);
+  ratelimit_check("backwards counted", ratelimit_take(&rl, 4, 29500), 4);
+  ratelimit_check("backwards rest", ratelimit_take(&rl, 10, 30500), 5);
+}
+
+static void test_map(void) {
+  RateLimiter proto;
+
+  ratelimit_sliding_window_init(&proto, 2, 1000);
+  RateLimitMap *map = ratelimit_map_new(&proto);
+  uint64_t a = 0, b = 0;
+  for (int i = 0; i < 5; i++) {
+    a += ratelimit_map_allow_n_at(map, "a", 1, 5000);
+    b += ratelimit_map_allow_n_at(map, "b", 1, 5000);
+  }
+  ratelimit_check("map key a", a, 2);
+  ratelimit_check("map key b", b, 2);
+  ratelimit_check("map size", ratelimit_map_size(map), 2);
+  ratelimit_map_free(map);
+}
+
+int main(void) {
+  test_token_bucket();
+  test_sliding_window();
+  test_window_backwards();
+  test_map();
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
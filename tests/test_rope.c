@@ -0,0 +1,184 @@
+/**
+ * @file test_rope.c
+ * @brief Random edits of a rope checked against a flat buffer
+ *
+ * Every step inserts or deletes at a random position in both the rope and a
+ * plain buffer, then compares the contents and checks the tree: cached
+ * lengths add up, all leaves sit at the same depth and nodes stay in bounds.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -I. tests/test_rope.c -o test_rope
+ *   ./test_rope
+ */
+
+#include "rope.h"
+#include <stdint.h>
+
+#define TEST_STEPS 4000
+#define TEST_MAX_LEN (256 * 1024)
+
+static int failures;
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rope_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static void rope_fail(const char *what, size_t step) {
+  fprintf(stderr, "FAIL: %s at step %zu\n", what, step);
+  failures++;
+}
+
+/* Returns the subtree length, or SIZE_MAX if the subtree is malformed */
+static size_t rope_check_node(const RopeNode *node, int height, bool root) {
+  if (node->height != height)
+    return SIZE_MAX;
+  if (height == 0)
+    return node->len <= ROPE_LEAF_MAX ? node->len : SIZE_MAX;
+  if (node->count < (root ? 2 : 1) || node->count > ROPE_BRANCH_MAX)
+    return SIZE_MAX;
+  size_t total = 0;
+  for (int i = 0; i < node->count; i++) {
+    size_t len = rope_check_node(node->u.child[i], height - 1, false);
+    if (len == SIZE_MAX || len == 0)
+      return SIZE_MAX;
+    total += len;
+  }
+  return total == node->len ? total : SIZE_MAX;
+}
+
+static void rope_compare(const Rope *rope, const char *model, size_t len,
+                         size_t step) {
+  if (rope_length(rope) != len)
+    rope_fail("length", step);
+  if (rope_check_node(rope->root, rope->root->height, true) != len)
+    rope_fail("tree shape", step);
+
+  char *flat = rope_to_string(rope);
+  if (memcmp(flat, model, len) != 0 || flat[len] != '\0')
+    rope_fail("contents", step);
+  free(flat);
+
+  if (len > 0) {
+    size_t pos = (size_t)(rope_rand() % len);
+    if (rope_char_at(rope, pos) != (unsigned char)model[pos])
+      rope_fail("rope_char_at", step);
+
+    /* Slices that start mid-leaf and cross leaf boundaries */
+    char slice[5000];
+    size_t want = (size_t)(rope_rand() % sizeof(slice));
+    size_t got = rope_slice(rope, pos, want, slice);
+    size_t expect = want < len - pos ? want : len - pos;
+    if (got != expect || memcmp(slice, model + pos, got) != 0)
+      rope_fail("rope_slice", step);
+  }
+  if (rope_char_at(rope, len) != -1)
+    rope_fail("rope_char_at past the end", step);
+}
+
+static void test_random_edits(void) {
+  char *model = (char *)safe_malloc(TEST_MAX_LEN + ROPE_LEAF_MAX * 4);
+  char *data = (char *)safe_malloc(ROPE_LEAF_MAX * 4);
+  size_t len = 0;
+  Rope *rope = rope_new();
+
+  for (size_t step = 0; step < TEST_STEPS; step++) {
+    uint64_t r = rope_rand();
+    /* Mostly small edits, sometimes several leaves at once */
+    size_t n = (size_t)(r % 8 == 0 ? rope_rand() % (ROPE_LEAF_MAX * 4)
+                                   : rope_rand() % 64);
+    size_t pos = (size_t)(rope_rand() % (len + 1));
+
+    if (r % 3 != 0 && len + n <= TEST_MAX_LEN) {
+      for (size_t i = 0; i < n; i++)
+        data[i] = (char)rope_rand(); /* NULs included */
+      if (!rope_insert(rope, pos, data, n))
+        rope_fail("rope_insert", step);
+      memmove(model + pos + n, model + pos, len - pos);
+      memcpy(model + pos, data, n);
+      len += n;
+    } else {
+      if (n > len - pos)
+        n = len - pos;
+      if (!rope_delete(rope, pos, n))
+        rope_fail("rope_delete", step);
+      memmove(model + pos, model + pos + n, len - pos - n);
+      len -= n;
+    }
+    rope_compare(rope, model, len, step);
+  }
+
+  if (rope_insert(rope, len + 1, "x", 1))
+    rope_fail("insert past the end accepted", TEST_STEPS);
+  if (rope_delete(rope, len, 1))
+    rope_fail("delete past the end accepted", TEST_STEPS);
+  if (!rope_delete(rope, 0, len) || rope_length(rope) != 0)
+    rope_fail("delete everything", TEST_STEPS);
+  rope_compare(rope, model, 0, TEST_STEPS);
+
+  rope_free(rope);
+  free(data);
+  free(model);
+}
+
+static void test_build_and_iterate(void) {
+  size_t len = ROPE_LEAF_MAX * ROPE_BRANCH_MAX * 3 + 17;
+  char *text = (char *)safe_malloc(len);
+  for (size_t i = 0; i < len; i++)
+    text[i] = (char)('a' + i % 26);
+
+  Rope *rope = rope_from_buffer(text, len);
+  rope_compare(rope, text, len, 0);
+
+  /* Iterating from any offset yields exactly the rest of the text */
+  size_t starts[] = {0, 1, ROPE_LEAF_MAX - 1, ROPE_LEAF_MAX, len / 2, len - 1,
+                     len};
+  for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); s++) {
+    RopeIter it;
+    const char *chunk;
+    size_t chunk_len, pos = starts[s];
+    bool same = true;
+    rope_iter_init(&it, rope, pos);
+    while (rope_iter_next(&it, &chunk, &chunk_len)) {
+      same = same && chunk_len > 0 && pos + chunk_len <= len &&
+             memcmp(chunk, text + pos, chunk_len) == 0;
+      pos += chunk_len;
+    }
+    if (!same || pos != len)
+      rope_fail("iteration", starts[s]);
+  }
+
+  /* rope_write() and rope_from_file() round trip */
+  FILE *file = fopen("test_rope.txt", "wb");
+  bool written = file != NULL && rope_write(rope, file);
+  if (file != NULL)
+    fclose(file);
+  Rope *loaded = written ? rope_from_file("test_rope.txt") : NULL;
+  if (loaded == NULL)
+    rope_fail("file round trip", 0);
+  else
+    rope_compare(loaded, text, len, 0);
+  rope_free(loaded);
+  remove("test_rope.txt");
+
+  Rope *empty = rope_from_string("");
+  rope_compare(empty, "", 0, 0);
+  if (!rope_insert_string(empty, 0, "abc") || !rope_append(empty, "d", 1))
+    rope_fail("rope_insert_string", 0);
+  rope_compare(empty, "abcd", 4, 0);
+
+  rope_free(empty);
+  rope_free(rope);
+  free(text);
+}
+
+int main(void) {
+  test_random_edits();
+  test_build_and_iterate();
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
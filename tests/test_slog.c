@@ -0,0 +1,65 @@
+/**
+ * @file test_slog.c
+ * @brief Lines written by SLOG() with and without fields
+ *
+ * Build with strict ISO flags, since SLOG() with no fields must compile
+ * there, and run from the repository root:
+ *   gcc -std=c11 -Wpedantic -Werror -O2 -pthread -I. tests/test_slog.c \
+ *     -o test_slog -lm
+ *   ./test_slog
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "slog.h"
+
+#define TEST_LOG "test_slog.log"
+
+static int slog_check(const char *line, const char *expect) {
+  if (line != NULL && strstr(line, expect) != NULL)
+    return 0;
+  fprintf(stderr, "FAIL: expected %s in %s", expect,
+          line != NULL ? line : "(no line)\n");
+  return 1;
+}
+
+int main(void) {
+  char lines[3][SLOG_LINE_MAX];
+  int failures = 0;
+
+  if (!log_init(TEST_LOG, LOG_INFO))
+    return 1;
+  SLOG(LOG_INFO, "no fields");
+  SLOG(LOG_INFO, "fields", slog_int("n", 1), slog_str("s", "x"));
+  SLOG(LOG_DEBUG, "filtered");
+  SLOG(LOG_WARNING, "last");
+  log_close();
+
+  FILE *file = fopen(TEST_LOG, "r");
+  if (file == NULL)
+    return 1;
+  for (int i = 0; i < 3; i++) {
+    if (fgets(lines[i], sizeof(lines[i]), file) == NULL)
+      lines[i][0] = '\0';
+  }
+  bool extra = fgetc(file) != EOF;
+  fclose(file);
+  remove(TEST_LOG);
+
+  static const char *const json[] = {
+      "\"msg\":\"no fields\"}\n", "\"msg\":\"fields\",\"n\":1,\"s\":\"x\"}\n",
+      "\"msg\":\"last\"}\n"};
+  static const char *const logfmt[] = {"msg=\"no fields\"\n",
+                                       "msg=fields n=1 s=x\n", "msg=last\n"};
+  for (int i = 0; i < 3; i++)
+    failures += slog_check(lines[i],
+                           SLOG_FORMAT == SLOG_JSON ? json[i] : logfmt[i]);
+
+  if (extra) {
+    fprintf(stderr, "FAIL: filtered line was written\n");
+    failures++;
+  }
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
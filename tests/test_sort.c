@@ -0,0 +1,304 @@
+/**
+ * @file test_sort.c
+ * @brief Every sort in sort.h checked against qsort()
+ *
+ * Inputs cover random, sorted, reversed, constant, organ-pipe and
+ * few-distinct-value patterns at sizes around the insertion and ninther
+ * thresholds, plus arrays large enough for the parallel variants.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -pthread -I. tests/test_sort.c -o test_sort && ./test_sort
+ */
+
+#include "sort.h"
+
+SORT_DEFINE(sort_test_int, int, SORT_LESS)
+
+typedef struct {
+  double key;
+  int id;
+} SortRecord;
+
+#define SORT_RECORD_LESS(a, b) ((a).key < (b).key)
+SORT_DEFINE(sort_test_records, SortRecord, SORT_RECORD_LESS)
+
+#define TEST_PARALLEL_N (SORT_PARALLEL_THRESHOLD * 3 + 7)
+
+static int failures;
+static uint64_t rng = 0x853c49e6748fea9bULL;
+
+static uint64_t sort_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static void sort_fail(const char *what, size_t n, int pattern) {
+  fprintf(stderr, "FAIL: %s (n %zu, pattern %d)\n", what, n, pattern);
+  failures++;
+}
+
+static int cmp_int(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_i64(const void *a, const void *b) {
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_i32(const void *a, const void *b) {
+  int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_string(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Fills arr with one of the input patterns; returns false past the last */
+static bool sort_fill(uint64_t *arr, size_t n, int pattern) {
+  if (pattern > 6)
+    return false;
+  for (size_t i = 0; i < n; i++) {
+    switch (pattern) {
+    case 0:
+      arr[i] = sort_rand();
+      break;
+    case 1:
+      arr[i] = i;
+      break;
+    case 2:
+      arr[i] = n - i;
+      break;
+    case 3:
+      arr[i] = 42;
+      break;
+    case 4:
+      arr[i] = i < n / 2 ? i : n - i;
+      break;
+    case 5:
+      arr[i] = sort_rand() % 4;
+      break;
+    case 6:
+      /* Sorted with a few elements out of place */
+      arr[i] = i % 97 == 0 ? sort_rand() % (n + 1) : i;
+      break;
+    }
+  }
+  return true;
+}
+
+static void test_pdqsort(void) {
+  static const size_t sizes[] = {0,   1,   2,   3,   23,   24,   25,
+                                 127, 128, 129, 500, 4096, 100000};
+  size_t max = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+  uint64_t *raw = (uint64_t *)safe_malloc(max * sizeof(uint64_t));
+  int *arr = (int *)safe_malloc(max * sizeof(int));
+  int *expect = (int *)safe_malloc(max * sizeof(int));
+  SortRecord *records = (SortRecord *)safe_malloc(max * sizeof(SortRecord));
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t n = sizes[s];
+    for (int pattern = 0; sort_fill(raw, n, pattern); pattern++) {
+      for (size_t i = 0; i < n; i++)
+        arr[i] = expect[i] = (int)(raw[i] % 2000000) - 1000000;
+      qsort(expect, n, sizeof(int), cmp_int);
+      sort_test_int(arr, n);
+      if (n > 0 && memcmp(arr, expect, n * sizeof(int)) != 0)
+        sort_fail("SORT_DEFINE int", n, pattern);
+
+      /* Records carry an id so lost or duplicated elements show up */
+      for (size_t i = 0; i < n; i++) {
+        records[i].key = (double)expect[(i * 7919) % n];
+        records[i].id = (int)i;
+      }
+      sort_test_records(records, n);
+      long long ids = 0;
+      bool ordered = true;
+      for (size_t i = 0; i < n; i++) {
+        ordered = ordered && (i == 0 || records[i - 1].key <= records[i].key);
+        ids += records[i].id;
+      }
+      if (!ordered || ids != (long long)n * ((long long)n - 1) / 2)
+        sort_fail("SORT_DEFINE struct", n, pattern);
+    }
+  }
+  free(records);
+  free(expect);
+  free(arr);
+  free(raw);
+}
+
+static void test_parallel(void) {
+  size_t n = TEST_PARALLEL_N;
+  uint64_t *raw = (uint64_t *)safe_malloc(n * sizeof(uint64_t));
+  int *arr = (int *)safe_malloc(n * sizeof(int));
+  int *expect = (int *)safe_malloc(n * sizeof(int));
+  const char **strings = (const char **)safe_malloc(n * sizeof(char *));
+  const char **sorted = (const char **)safe_malloc(n * sizeof(char *));
+  char *pool = (char *)safe_malloc(n * 8);
+
+  sort_fill(raw, n, 0);
+  for (size_t i = 0; i < n; i++)
+    expect[i] = (int)raw[i];
+  qsort(expect, n, sizeof(int), cmp_int);
+
+  /* Odd thread counts leave a run without a merge partner */
+  for (int threads = 1; threads <= 7; threads += 2) {
+    for (size_t i = 0; i < n; i++)
+      arr[i] = (int)raw[i];
+    sort_test_int_parallel(arr, n, threads);
+    if (memcmp(arr, expect, n * sizeof(int)) != 0)
+      sort_fail("SORT_DEFINE parallel", n, threads);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    char *s = pool + i * 8;
+    size_t len = (size_t)(sort_rand() % 8);
+    for (size_t k = 0; k < len; k++)
+      s[k] = (char)("aab\xe9z"[sort_rand() % 5]);
+    s[len] = '\0';
+    strings[i] = s;
+  }
+  memcpy(sorted, strings, n * sizeof(char *));
+  qsort(sorted, n, sizeof(char *), cmp_string);
+  sort_strings_parallel(strings, n, 4);
+  for (size_t i = 0; i < n; i++) {
+    if (strcmp(strings[i], sorted[i]) != 0) {
+      sort_fail("sort_strings_parallel", n, 4);
+      break;
+    }
+  }
+
+  free(pool);
+  free(sorted);
+  free(strings);
+  free(expect);
+  free(arr);
+  free(raw);
+}
+
+static void test_radix(void) {
+  static const size_t sizes[] = {0, 1, 2, 255, 256, 1000, 65537};
+  size_t max = 65537;
+  uint64_t *raw = (uint64_t *)safe_malloc(max * sizeof(uint64_t));
+  uint64_t *u64 = (uint64_t *)safe_malloc(max * sizeof(uint64_t));
+  uint64_t *e64 = (uint64_t *)safe_malloc(max * sizeof(uint64_t));
+  uint32_t *u32 = (uint32_t *)safe_malloc(max * sizeof(uint32_t));
+  uint32_t *e32 = (uint32_t *)safe_malloc(max * sizeof(uint32_t));
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    size_t n = sizes[s];
+    for (int pattern = 0; sort_fill(raw, n, pattern); pattern++) {
+      /* Extremes make sure the sign flip and top byte are exercised */
+      if (n > 2) {
+        raw[0] = UINT64_MAX;
+        raw[n / 2] = 1ull << 63;
+      }
+
+      memcpy(u64, raw, n * sizeof(uint64_t));
+      memcpy(e64, raw, n * sizeof(uint64_t));
+      qsort(e64, n, sizeof(uint64_t), cmp_u64);
+      sort_u64(u64, n);
+      if (n > 0 && memcmp(u64, e64, n * sizeof(uint64_t)) != 0)
+        sort_fail("sort_u64", n, pattern);
+
+      memcpy(u64, raw, n * sizeof(uint64_t));
+      memcpy(e64, raw, n * sizeof(uint64_t));
+      qsort(e64, n, sizeof(int64_t), cmp_i64);
+      sort_i64((int64_t *)u64, n);
+      if (n > 0 && memcmp(u64, e64, n * sizeof(uint64_t)) != 0)
+        sort_fail("sort_i64", n, pattern);
+
+      for (size_t i = 0; i < n; i++)
+        u32[i] = e32[i] = (uint32_t)(raw[i] ^ (raw[i] >> 32));
+      qsort(e32, n, sizeof(uint32_t), cmp_u32);
+      sort_u32(u32, n);
+      if (n > 0 && memcmp(u32, e32, n * sizeof(uint32_t)) != 0)
+        sort_fail("sort_u32", n, pattern);
+
+      for (size_t i = 0; i < n; i++)
+        u32[i] = e32[i] = (uint32_t)(raw[i] ^ (raw[i] >> 32));
+      qsort(e32, n, sizeof(int32_t), cmp_i32);
+      sort_i32((int32_t *)u32, n);
+      if (n > 0 && memcmp(u32, e32, n * sizeof(uint32_t)) != 0)
+        sort_fail("sort_i32", n, pattern);
+
+      /* Keys that fit in two bytes need only two passes */
+      for (size_t i = 0; i < n; i++)
+        u64[i] = e64[i] = raw[i] & 0xffff;
+      qsort(e64, n, sizeof(uint64_t), cmp_u64);
+      sort_radix_u64(u64, n, 2);
+      if (n > 0 && memcmp(u64, e64, n * sizeof(uint64_t)) != 0)
+        sort_fail("sort_radix_u64 2 bytes", n, pattern);
+    }
+  }
+
+  /* More than 8 key bytes is clamped, not shifted past the key width */
+  sort_fill(raw, 1000, 0);
+  memcpy(u64, raw, 1000 * sizeof(uint64_t));
+  memcpy(e64, raw, 1000 * sizeof(uint64_t));
+  qsort(e64, 1000, sizeof(uint64_t), cmp_u64);
+  sort_radix_u64(u64, 1000, 12);
+  if (memcmp(u64, e64, 1000 * sizeof(uint64_t)) != 0)
+    sort_fail("sort_radix_u64 12 bytes", 1000, 0);
+  memcpy(u64, raw, 1000 * sizeof(uint64_t));
+  sort_radix_u64(u64, 1000, 0);
+  if (memcmp(u64, raw, 1000 * sizeof(uint64_t)) != 0)
+    sort_fail("sort_radix_u64 0 bytes", 1000, 0);
+
+  free(e32);
+  free(u32);
+  free(e64);
+  free(u64);
+  free(raw);
+}
+
+static void test_strings(void) {
+  static const char *const words[] = {
+      "",       "a",      "ab",    "abc",       "abd",     "b",
+      "\xff",   "\x80z",  "Zebra", "zebra",     "apple",   "apples",
+      "applE",  "a",      "",      "prefix",    "prefixes", "pre"};
+  size_t n = sizeof(words) / sizeof(words[0]);
+  const char *arr[64];
+  const char *expect[64];
+
+  /* Repeat the words so buckets exceed the insertion threshold */
+  size_t total = 0;
+  for (size_t r = 0; r < 3; r++) {
+    for (size_t i = 0; i < n; i++)
+      arr[total++] = words[(i * 5 + r) % n];
+  }
+  memcpy(expect, arr, total * sizeof(char *));
+  qsort(expect, total, sizeof(char *), cmp_string);
+  sort_strings(arr, total);
+  for (size_t i = 0; i < total; i++) {
+    if (strcmp(arr[i], expect[i]) != 0) {
+      sort_fail("sort_strings", total, 0);
+      break;
+    }
+  }
+}
+
+int main(void) {
+  test_pdqsort();
+  test_radix();
+  test_strings();
+  test_parallel();
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
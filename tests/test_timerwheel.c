@@ -0,0 +1,245 @@
+/**
+ * @file test_timerwheel.c
+ * @brief Timer wheel expiry ticks checked against a plain model
+ *
+ * Random adds, cancels and advances run against the wheel and against an
+ * array of expected expiry ticks. Every timer must fire exactly on its
+ * expected tick, from callbacks that re-arm and cancel other timers too, and
+ * timerwheel_next_expiry() must never point past the earliest timer.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -pthread -I. tests/test_timerwheel.c -o test_timerwheel
+ *   ./test_timerwheel
+ */
+
+#define HRCLOCK_IMPLEMENTATION
+#include "timerwheel.h"
+
+#define TEST_TIMERS 1000
+#define TEST_STEPS 100000
+#define TEST_IDLE UINT64_MAX
+
+static int failures;
+static uint64_t rng = 0x2f693a2c8b1e4d97ULL;
+
+static TimerWheel wheel;
+static TimerWheelTimer timers[TEST_TIMERS];
+static uint64_t expected[TEST_TIMERS]; /* Tick due, or TEST_IDLE */
+static size_t fired;
+
+static uint64_t timerwheel_rand(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static void timerwheel_fail(const char *what, size_t timer) {
+  fprintf(stderr, "FAIL: %s (timer %zu, tick %llu)\n", what, timer,
+          (unsigned long long)wheel.now);
+  failures++;
+}
+
+/* Delays from the same tick up to past the wheel's range */
+static uint64_t timerwheel_rand_delay(void) {
+  switch (timerwheel_rand() % 8) {
+  case 0:
+    return timerwheel_rand() % 4;
+  case 1:
+  case 2:
+  case 3:
+    return timerwheel_rand() % 300;
+  case 4:
+  case 5:
+    return timerwheel_rand() % (1 << 14);
+  case 6:
+    return timerwheel_rand() % (1 << 20);
+  default:
+    return timerwheel_rand() % (1 << 26);
+  }
+}
+
+static void timerwheel_model_add(size_t i, uint64_t tick) {
+  timerwheel_add_at(&wheel, &timers[i], tick);
+  expected[i] = tick > wheel.now ? tick : wheel.now + 1;
+}
+
+static void timerwheel_model_cancel(size_t i) {
+  if (timerwheel_cancel(&wheel, &timers[i]) != (expected[i] != TEST_IDLE))
+    timerwheel_fail("timerwheel_cancel result", i);
+  expected[i] = TEST_IDLE;
+}
+
+static void timerwheel_on_fire(TimerWheelTimer *t, void *arg) {
+  size_t i = (size_t)(uintptr_t)arg;
+
+  if (t != &timers[i] || timerwheel_pending(t))
+    timerwheel_fail("callback arguments", i);
+  if (expected[i] != wheel.now)
+    timerwheel_fail(expected[i] == TEST_IDLE ? "idle timer fired"
+                                             : "fired on the wrong tick",
+                    i);
+  expected[i] = TEST_IDLE;
+  fired++;
+
+  /* Some callbacks re-arm themselves or cancel a timer, maybe one due now */
+  if (i % 5 == 0)
+    timerwheel_model_add(i, wheel.now + timerwheel_rand_delay());
+  if (i % 7 == 0)
+    timerwheel_model_cancel((size_t)(timerwheel_rand() % TEST_TIMERS));
+}
+
+/* Everything due by now has fired and the rest is still pending */
+static void timerwheel_check_state(void) {
+  size_t pending = 0;
+  uint64_t earliest = UINT64_MAX;
+
+  for (size_t i = 0; i < TEST_TIMERS; i++) {
+    if (expected[i] == TEST_IDLE) {
+      if (timerwheel_pending(&timers[i]))
+        timerwheel_fail("idle timer still pending", i);
+      continue;
+    }
+    if (expected[i] <= wheel.now)
+      timerwheel_fail("due timer did not fire", i);
+    if (!timerwheel_pending(&timers[i]))
+      timerwheel_fail("pending timer lost", i);
+    if (expected[i] < earliest)
+      earliest = expected[i];
+    pending++;
+  }
+  if (timerwheel_count(&wheel) != pending)
+    timerwheel_fail("timerwheel_count", pending);
+
+  uint64_t next = timerwheel_next_expiry(&wheel);
+  if (pending == 0 ? next != UINT64_MAX
+                   : next == 0 || wheel.now + next > earliest)
+    timerwheel_fail("timerwheel_next_expiry past the earliest timer",
+                    (size_t)next);
+}
+
+static void test_random(void) {
+  timerwheel_init(&wheel, 1000000);
+  for (size_t i = 0; i < TEST_TIMERS; i++) {
+    timerwheel_timer_init(&timers[i], timerwheel_on_fire, (void *)i);
+    expected[i] = TEST_IDLE;
+  }
+
+  for (size_t step = 0; step < TEST_STEPS; step++) {
+    uint64_t r = timerwheel_rand() % 16;
+    size_t i = (size_t)(timerwheel_rand() % TEST_TIMERS);
+
+    if (r < 8) {
+      timerwheel_model_add(i, wheel.now + timerwheel_rand_delay());
+    } else if (r < 9) {
+      /* Already in the past: fires on the next tick */
+      uint64_t back = timerwheel_rand() % 1000;
+      timerwheel_model_add(i, wheel.now > back ? wheel.now - back : 0);
+    } else if (r < 11) {
+      timerwheel_model_cancel(i);
+    } else {
+      uint64_t target = wheel.now + (r < 15 ? timerwheel_rand() % 300
+                                            : timerwheel_rand_delay());
+      size_t before = fired;
+      size_t n = timerwheel_advance(&wheel, target);
+      if (wheel.now != target || n != fired - before)
+        timerwheel_fail("timerwheel_advance", (size_t)target);
+    }
+    timerwheel_check_state();
+  }
+
+  /* Drain everything that is left */
+  for (size_t i = 0; i < TEST_TIMERS; i++) {
+    if (i % 5 == 0 && expected[i] != TEST_IDLE)
+      timerwheel_model_cancel(i);
+  }
+  timerwheel_advance(&wheel, wheel.now + (1 << 26) + 300);
+  for (size_t i = 0; i < TEST_TIMERS; i++) {
+    if (i % 5 == 0)
+      timerwheel_model_cancel(i);
+  }
+  timerwheel_check_state();
+  if (timerwheel_count(&wheel) != 0)
+    timerwheel_fail("wheel not empty after draining", 0);
+}
+
+static void timerwheel_count_fire(TimerWheelTimer *t, void *arg) {
+  (void)t;
+  *(uint64_t *)arg = wheel.now;
+}
+
+static void test_edges(void) {
+  TimerWheelTimer far, a, b;
+  uint64_t far_at = 0, a_at = 0, b_at = 0;
+
+  /* Beyond the wheel's range: parked at the top and re-placed on cascade */
+  timerwheel_init(&wheel, 1);
+  timerwheel_advance(&wheel, 12345);
+  timerwheel_timer_init(&far, timerwheel_count_fire, &far_at);
+  timerwheel_add(&wheel, &far, TIMERWHEEL_MAX_DELTA + 1000);
+  timerwheel_advance(&wheel, 12345 + TIMERWHEEL_MAX_DELTA + 999);
+  if (far_at != 0)
+    timerwheel_fail("timer beyond the range fired early", 0);
+  timerwheel_advance(&wheel, 12345 + TIMERWHEEL_MAX_DELTA + 2000);
+  if (far_at != 12345 + TIMERWHEEL_MAX_DELTA + 1000)
+    timerwheel_fail("timer beyond the range", (size_t)far_at);
+
+  /* Rescheduling a pending timer moves it instead of adding it twice */
+  timerwheel_timer_init(&a, timerwheel_count_fire, &a_at);
+  timerwheel_timer_init(&b, timerwheel_count_fire, &b_at);
+  timerwheel_add(&wheel, &a, 10);
+  timerwheel_add(&wheel, &a, 500);
+  timerwheel_add(&wheel, &b, 0);
+  if (timerwheel_count(&wheel) != 2 || timerwheel_next_expiry(&wheel) != 1)
+    timerwheel_fail("reschedule", 0);
+  uint64_t start = wheel.now;
+  if (timerwheel_advance(&wheel, start + 499) != 1 || b_at != start + 1 ||
+      a_at != 0)
+    timerwheel_fail("rescheduled timer fired early", 0);
+  if (timerwheel_advance(&wheel, start + 499) != 0 ||
+      timerwheel_advance(&wheel, start + 500) != 1 || a_at != start + 500)
+    timerwheel_fail("rescheduled timer", 0);
+  if (timerwheel_cancel(&wheel, &a) ||
+      timerwheel_next_expiry(&wheel) != UINT64_MAX)
+    timerwheel_fail("idle wheel", 0);
+
+  /* Ticks round deadlines up so timers never fire early */
+  wheel.origin = 1000;
+  wheel.tick_ns = 10;
+  if (timerwheel_tick_at_ns(&wheel, 999) != 0 ||
+      timerwheel_tick_at_ns(&wheel, 1000) != 0 ||
+      timerwheel_tick_at_ns(&wheel, 1001) != 1 ||
+      timerwheel_tick_at_ns(&wheel, 1010) != 1 ||
+      timerwheel_tick_at_ns(&wheel, 1011) != 2)
+    timerwheel_fail("timerwheel_tick_at_ns", 0);
+}
+
+static void test_clock(void) {
+  TimerWheelTimer t;
+  uint64_t at = 0;
+
+  /* 100 us ticks, 2 ms timeout */
+  timerwheel_init(&wheel, 100000);
+  timerwheel_timer_init(&t, timerwheel_count_fire, &at);
+  uint64_t start = hrclock_ns();
+  timerwheel_add_ns(&wheel, &t, 2000000);
+  uint64_t timeout = timerwheel_next_timeout_ns(&wheel);
+  if (timeout == 0 || timeout > 2000000 + wheel.tick_ns)
+    timerwheel_fail("timerwheel_next_timeout_ns", (size_t)timeout);
+
+  while (timerwheel_poll(&wheel) == 0) {
+    if (hrclock_ns() - start > 1000000000ULL)
+      break;
+  }
+  if (at == 0 || hrclock_ns() - start < 2000000)
+    timerwheel_fail("timerwheel_poll", (size_t)(hrclock_ns() - start));
+}
+
+int main(void) {
+  test_random();
+  test_edges();
+  test_clock();
+
+  printf("%d failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file test_wildcard.c
+ * @brief Matching cases for wildcard.h
+ *
+ * Each case is checked through the DFA and through the NFA fallback.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -I. tests/test_wildcard.c -o test_wildcard
+ *   ./test_wildcard
+ */
+
+#include "wildcard.h"
+
+static const struct {
+  const char *pattern;
+  int flags;
+  const char *input;
+  bool match;
+} wildcard_cases[] = {
+    {"*.c", 0, "main.c", true},
+    {"*.c", 0, "src/main.c", false},
+    {"?.c", 0, "a.c", true},
+    {"[a-c]x", 0, "bx", true},
+    {"[!a-c]x", 0, "bx", false},
+    {"a**b", 0, "a/x/b", true},
+    {"**", 0, "a/b/c", true},
+    {"**/*.c", 0, "main.c", true},
+    {"**/*.c", 0, "src/lib/main.c", true},
+    {"**/x", 0, "x", true},
+    {"**/x", 0, "a/b/x", true},
+    {"a/**/b", 0, "a/b", true},
+    {"a/**/b", 0, "a/x/y/b", true},
+    {"a/**", 0, "a/b/c", true},
+    /* The globstar loop may only be left through the '/' */
+    {"**/x", 0, "ax", false},
+    {"**/x", 0, "a/bx", false},
+    {"a/**/b", 0, "a/xb", false},
+    /* An unterminated '[' is a literal and keeps nothing of the set */
+    {"[/", 0, "[/", true},
+    {"[/", 0, "//", false},
+    {"[ab", 0, "[ab", true},
+    {"[ab", 0, "aab", false},
+    {"[*a", 0, "[xa", true},
+    {"[*a", 0, "aa", false},
+    /* Case is folded before a bracket is negated */
+    {"[!a]x", WILDCARD_NOCASE, "ax", false},
+    {"[!a]x", WILDCARD_NOCASE, "Ax", false},
+    {"[!a]x", WILDCARD_NOCASE, "bx", true},
+    {"[!c?a]", WILDCARD_NOCASE, "c", false},
+    {"[!c?a]", WILDCARD_NOCASE, "C", false},
+    {"[!c?a]", WILDCARD_NOCASE, "d", true},
+    {"[a-c]X", WILDCARD_NOCASE, "Bx", true},
+};
+
+static int wildcard_check(const WildcardSet *ws, size_t i, const char *mode) {
+  bool got = wildcard_matches(ws, wildcard_cases[i].input);
+  if (got == wildcard_cases[i].match)
+    return 0;
+  fprintf(stderr, "FAIL (%s): \"%s\" against \"%s\" gave %s\n", mode,
+          wildcard_cases[i].pattern, wildcard_cases[i].input,
+          got ? "match" : "no match");
+  return 1;
+}
+
+int main(void) {
+  size_t count = sizeof(wildcard_cases) / sizeof(wildcard_cases[0]);
+  int failures = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    WildcardSet *ws = wildcard_compile(wildcard_cases[i].pattern,
+                                       wildcard_cases[i].flags);
+    failures += wildcard_check(ws, i, "dfa");
+
+    /* Drop the DFA to exercise the NFA simulation */
+    free(ws->next);
+    ws->next = NULL;
+    failures += wildcard_check(ws, i, "nfa");
+    wildcard_free(ws);
+  }
+
+  printf("%zu cases, %d failures\n", count, failures);
+  return failures == 0 ? 0 : 1;
+}
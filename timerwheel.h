@@ -0,0 +1,374 @@
+/**
+ * @file timerwheel.h
+ * @brief Hierarchical hashed timer wheel
+ * @author pucitos
+ *
+ * Five levels of slots cover 2^32 ticks (about 49 days at 1 ms ticks): 256
+ * slots of one tick each, then four levels of 64 slots, each slot spanning
+ * the whole level below. A timer is placed by how far away it is; when the
+ * lowest level wraps, the next slot of the level above is cascaded down.
+ * Insert and cancel are O(1) and never allocate because timers are intrusive:
+ * embed a TimerWheelTimer in the object it times out.
+ *
+ * timerwheel_advance() moves time forward and fires everything due, skipping
+ * idle stretches a whole lowest-level rotation at a time. A timer fires on
+ * its expiry tick, or on the next tick if that is already past. The *_ns
+ * functions map hrclock.h monotonic time onto ticks, rounding deadlines up
+ * so timers never fire early, and timerwheel_next_timeout_ns() gives a
+ * poll()/epoll_wait() timeout.
+ *
+ * A wheel is not thread-safe; drive it from one thread, such as an event
+ * loop.
+ */
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "hrclock.h"
+#include <stdint.h>
+
+#define TIMERWHEEL_LEVELS 5
+#define TIMERWHEEL_ROOT_BITS 8
+#define TIMERWHEEL_LEVEL_BITS 6
+#define TIMERWHEEL_ROOT_SLOTS (1 << TIMERWHEEL_ROOT_BITS)
+#define TIMERWHEEL_LEVEL_SLOTS (1 << TIMERWHEEL_LEVEL_BITS)
+#define TIMERWHEEL_MAX_DELTA                                                   \
+  ((1ULL << (TIMERWHEEL_ROOT_BITS +                                            \
+             TIMERWHEEL_LEVEL_BITS * (TIMERWHEEL_LEVELS - 1))) -               \
+   1)
+
+typedef struct TimerWheelTimer TimerWheelTimer;
+
+/**
+ * @brief Expiry callback; may add, cancel or re-add any timer
+ */
+typedef void (*TimerWheelFn)(TimerWheelTimer *timer, void *arg);
+
+/**
+ * @brief A timer; embed it in the object being timed and keep it alive while
+ * it is pending
+ */
+struct TimerWheelTimer {
+  TimerWheelTimer *next;
+  TimerWheelTimer **pprev; /* Link pointing at this timer, NULL if idle */
+  uint64_t expires;        /* Absolute tick */
+  TimerWheelFn fn;
+  void *arg;
+  int level;
+};
+
+/**
+ * @brief Timer wheel state
+ */
+typedef struct {
+  uint64_t now;      /* Last processed tick */
+  uint64_t tick_ns;  /* Tick length for the *_ns functions */
+  uint64_t origin;   /* hrclock_ns() at tick 0 */
+  size_t count;      /* Pending timers */
+  size_t level_count[TIMERWHEEL_LEVELS];
+  TimerWheelTimer *slots[TIMERWHEEL_LEVELS][TIMERWHEEL_ROOT_SLOTS];
+} TimerWheel;
+
+/* ========== INTERNAL HELPERS ========== */
+
+static inline int timerwheel_shift(int level) {
+  if (level == 0)
+    return 0;
+  return TIMERWHEEL_ROOT_BITS + TIMERWHEEL_LEVEL_BITS * (level - 1);
+}
+
+static inline size_t timerwheel_slot(int level, uint64_t tick) {
+  uint64_t mask = level == 0 ? TIMERWHEEL_ROOT_SLOTS - 1
+                             : TIMERWHEEL_LEVEL_SLOTS - 1;
+  return (size_t)((tick >> timerwheel_shift(level)) & mask);
+}
+
+/**
+ * @brief Insert a timer into the level and slot for its distance from base
+ *
+ * base is the current tick for new timers (which then fire no earlier than
+ * base + 1) and the tick being cascaded into for cascades (which may fire on
+ * that tick).
+ */
+static inline void timerwheel_link(TimerWheel *w, TimerWheelTimer *t,
+                                   uint64_t base, uint64_t earliest) {
+  uint64_t when = t->expires > earliest ? t->expires : earliest;
+  uint64_t delta = when - base;
+  int level = 0;
+
+  if (delta > TIMERWHEEL_MAX_DELTA) {
+    delta = TIMERWHEEL_MAX_DELTA;
+    when = base + delta;
+  }
+  while (level < TIMERWHEEL_LEVELS - 1 &&
+         delta >= 1ULL << timerwheel_shift(level + 1))
+    level++;
+
+  TimerWheelTimer **head = &w->slots[level][timerwheel_slot(level, when)];
+  t->next = *head;
+  if (t->next != NULL)
+    t->next->pprev = &t->next;
+  t->pprev = head;
+  *head = t;
+  t->level = level;
+  w->level_count[level]++;
+  w->count++;
+}
+
+static inline void timerwheel_unlink(TimerWheel *w, TimerWheelTimer *t) {
+  *t->pprev = t->next;
+  if (t->next != NULL)
+    t->next->pprev = t->pprev;
+  t->next = NULL;
+  t->pprev = NULL;
+  w->level_count[t->level]--;
+  w->count--;
+}
+
+/**
+ * @brief Detach a slot's list, marking its timers idle
+ */
+static inline TimerWheelTimer *timerwheel_take(TimerWheel *w, int level,
+                                               size_t slot) {
+  TimerWheelTimer *list = w->slots[level][slot];
+  size_t n = 0;
+
+  w->slots[level][slot] = NULL;
+  for (TimerWheelTimer *t = list; t != NULL; t = t->next) {
+    t->pprev = NULL;
+    n++;
+  }
+  w->level_count[level] -= n;
+  w->count -= n;
+  return list;
+}
+
+/**
+ * @brief Move timers from higher levels down when the level below wraps
+ */
+static inline void timerwheel_cascade(TimerWheel *w, uint64_t tick) {
+  for (int level = 1; level < TIMERWHEEL_LEVELS; level++) {
+    TimerWheelTimer *list =
+        timerwheel_take(w, level, timerwheel_slot(level, tick));
+    while (list != NULL) {
+      TimerWheelTimer *t = list;
+      list = t->next;
+      timerwheel_link(w, t, tick, tick);
+    }
+    if (timerwheel_slot(level, tick) != 0)
+      break;
+  }
+}
+
+/* ========== SETUP ========== */
+
+/**
+ * @brief Initialize a wheel at tick 0
+ *
+ * @param w Wheel to initialize
+ * @param tick_ns Tick length in nanoseconds for the *_ns functions (e.g.
+ * 1000000 for 1 ms)
+ */
+static inline void timerwheel_init(TimerWheel *w, uint64_t tick_ns) {
+  memset(w, 0, sizeof(*w));
+  w->tick_ns = tick_ns > 0 ? tick_ns : 1;
+  w->origin = hrclock_ns();
+}
+
+/**
+ * @brief Prepare a timer before its first use
+ *
+ * @param t Timer to initialize
+ * @param fn Callback run on expiry
+ * @param arg Passed to fn
+ */
+static inline void timerwheel_timer_init(TimerWheelTimer *t, TimerWheelFn fn,
+                                         void *arg) {
+  memset(t, 0, sizeof(*t));
+  t->fn = fn;
+  t->arg = arg;
+}
+
+/**
+ * @brief Whether a timer is waiting to fire
+ */
+static inline bool timerwheel_pending(const TimerWheelTimer *t) {
+  return t->pprev != NULL;
+}
+
+/**
+ * @brief Number of pending timers
+ */
+static inline size_t timerwheel_count(const TimerWheel *w) { return w->count; }
+
+/* ========== SCHEDULING ========== */
+
+/**
+ * @brief Cancel a pending timer in O(1)
+ *
+ * @param w Wheel
+ * @param t Timer
+ * @return true if the timer was pending, false if it was idle
+ */
+static inline bool timerwheel_cancel(TimerWheel *w, TimerWheelTimer *t) {
+  if (!timerwheel_pending(t))
+    return false;
+  timerwheel_unlink(w, t);
+  return true;
+}
+
+/**
+ * @brief Schedule a timer at an absolute tick, rescheduling it if pending
+ *
+ * A tick that is not in the future fires on the next advance.
+ *
+ * @param w Wheel
+ * @param t Initialized timer
+ * @param tick Absolute expiry tick
+ */
+static inline void timerwheel_add_at(TimerWheel *w, TimerWheelTimer *t,
+                                     uint64_t tick) {
+  timerwheel_cancel(w, t);
+  t->expires = tick;
+  timerwheel_link(w, t, w->now, w->now + 1);
+}
+
+/**
+ * @brief Schedule a timer a number of ticks from now
+ *
+ * @param w Wheel
+ * @param t Initialized timer
+ * @param ticks Delay in ticks
+ */
+static inline void timerwheel_add(TimerWheel *w, TimerWheelTimer *t,
+                                  uint64_t ticks) {
+  timerwheel_add_at(w, t, w->now + ticks);
+}
+
+/* ========== EXPIRY ========== */
+
+/**
+ * @brief Advance to a tick, firing every timer due on the way
+ *
+ * All timers due on a tick are run from one slot in a batch. Callbacks may
+ * re-arm or cancel any timer, including others in the same batch. Idle
+ * stretches are skipped a full lowest-level rotation at a time.
+ *
+ * @param w Wheel
+ * @param tick Target tick; ignored if not ahead of the current tick
+ * @return size_t Number of timers fired
+ */
+static inline size_t timerwheel_advance(TimerWheel *w, uint64_t tick) {
+  size_t fired = 0;
+
+  while (w->now < tick) {
+    if (w->count == 0) {
+      w->now = tick;
+      break;
+    }
+    if (w->level_count[0] == 0) {
+      /* Nothing can fire before the next cascade */
+      uint64_t skip = w->now | (TIMERWHEEL_ROOT_SLOTS - 1);
+      if (skip >= tick) {
+        w->now = tick;
+        break;
+      }
+      w->now = skip;
+    }
+
+    uint64_t next = w->now + 1;
+    if (timerwheel_slot(0, next) == 0)
+      timerwheel_cascade(w, next);
+    w->now = next;
+
+    /* Re-armed timers land in a later slot, so this drains the batch */
+    TimerWheelTimer **slot = &w->slots[0][timerwheel_slot(0, next)];
+    while (*slot != NULL) {
+      TimerWheelTimer *t = *slot;
+      timerwheel_unlink(w, t);
+      t->fn(t, t->arg);
+      fired++;
+    }
+  }
+  return fired;
+}
+
+/**
+ * @brief Ticks until the earliest pending timer may fire
+ *
+ * Exact for timers in the lowest level; for timers further out it returns
+ * the next cascade point, which is never later than the real expiry.
+ *
+ * @param w Wheel
+ * @return uint64_t Ticks to wait, or UINT64_MAX if nothing is pending
+ */
+static inline uint64_t timerwheel_next_expiry(const TimerWheel *w) {
+  if (w->count == 0)
+    return UINT64_MAX;
+
+  /* Higher levels move down at the next cascade */
+  uint64_t cascade = TIMERWHEEL_ROOT_SLOTS - timerwheel_slot(0, w->now);
+  uint64_t limit = w->count > w->level_count[0] ? cascade : UINT64_MAX;
+
+  if (w->level_count[0] > 0) {
+    for (uint64_t d = 1; d <= TIMERWHEEL_ROOT_SLOTS && d < limit; d++)
+      if (w->slots[0][timerwheel_slot(0, w->now + d)] != NULL)
+        return d;
+  }
+  return limit != UINT64_MAX ? limit : cascade;
+}
+
+/* ========== MONOTONIC CLOCK ========== */
+
+/**
+ * @brief Convert a monotonic hrclock_ns() timestamp to a tick, rounding up
+ */
+static inline uint64_t timerwheel_tick_at_ns(const TimerWheel *w,
+                                             uint64_t ns) {
+  if (ns <= w->origin)
+    return 0;
+  return (ns - w->origin + w->tick_ns - 1) / w->tick_ns;
+}
+
+/**
+ * @brief Schedule a timer a number of nanoseconds from the current clock
+ *
+ * @param w Wheel
+ * @param t Initialized timer
+ * @param timeout_ns Delay in nanoseconds
+ */
+static inline void timerwheel_add_ns(TimerWheel *w, TimerWheelTimer *t,
+                                     uint64_t timeout_ns) {
+  timerwheel_add_at(w, t, timerwheel_tick_at_ns(w, hrclock_ns() + timeout_ns));
+}
+
+/**
+ * @brief Advance the wheel to the current monotonic time
+ *
+ * @param w Wheel
+ * @return size_t Number of timers fired
+ */
+static inline size_t timerwheel_poll(TimerWheel *w) {
+  uint64_t ns = hrclock_ns();
+  uint64_t tick = ns > w->origin ? (ns - w->origin) / w->tick_ns : 0;
+  return timerwheel_advance(w, tick);
+}
+
+/**
+ * @brief Nanoseconds until the next timer may fire, for poll-style waits
+ *
+ * @param w Wheel
+ * @return uint64_t Nanoseconds to wait (0 if overdue), or UINT64_MAX if no
+ * timer is pending
+ */
+static inline uint64_t timerwheel_next_timeout_ns(const TimerWheel *w) {
+  uint64_t ticks = timerwheel_next_expiry(w);
+  if (ticks == UINT64_MAX)
+    return UINT64_MAX;
+
+  uint64_t deadline = w->origin + (w->now + ticks) * w->tick_ns;
+  uint64_t now = hrclock_ns();
+  return deadline > now ? deadline - now : 0;
+}
+
+#endif /* TIMERWHEEL_H */
@@ -0,0 +1,43 @@
+/**
+ * @file binlog_decode.c
+ * @brief Convert binary logs written by binlog.h to text
+ *
+ * Build from the repository root:
+ *   gcc -O2 -pthread -I. tools/binlog_decode.c -o binlog_decode
+ *
+ * Usage:
+ *   ./binlog_decode app.binlog [app.log]
+ *
+ * Lines go to stdout when no output file is given.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define HRCLOCK_IMPLEMENTATION
+#define BINLOG_IMPLEMENTATION
+
+#include "binlog.h"
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <binary log> [output]\n", argv[0]);
+    return 2;
+  }
+
+  FILE *in = fopen(argv[1], "rb");
+  if (in == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", argv[1]);
+    return 1;
+  }
+  FILE *out = argc == 3 ? fopen(argv[2], "w") : stdout;
+  if (out == NULL) {
+    fprintf(stderr, "Error: Could not open %s\n", argv[2]);
+    fclose(in);
+    return 1;
+  }
+
+  bool ok = binlog_decode(in, out);
+  fclose(in);
+  if (out != stdout)
+    fclose(out);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,530 @@
+/**
+ * @file trace.h
+ * @brief Scoped tracing spans with Chrome trace-event export
+ * @author pucitos
+ *
+ * TRACE_SCOPE("name") records the time spent in the enclosing block as one
+ * complete ("X") event in a per-thread ring buffer. Each ring has a single
+ * producer (its thread) and a single consumer (the flusher), so recording is
+ * lock-free: two clock reads and a few stores. Full rings drop events rather
+ * than block. trace_flush() drains every ring into a JSON array file that
+ * chrome://tracing and Perfetto (ui.perfetto.dev) open directly.
+ *
+ * When tracing is stopped, a span costs one relaxed load and a branch.
+ * Define TRACE_DISABLE to compile the macros out entirely.
+ *
+ * Span names are stored by pointer and must outlive the trace (string
+ * literals or __func__). A thread's ring is handed to the next new thread
+ * after it exits, but only once its events have been flushed, so exiting
+ * threads never lose events and short-lived threads do not leak rings.
+ *
+ * The registry is shared across translation units: define
+ * TRACE_IMPLEMENTATION in exactly one source file before including this
+ * header. TRACE_SCOPE and TRACE_FUNCTION need GCC/Clang cleanup attributes;
+ * elsewhere pair trace_begin() with trace_end().
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "hrclock.h"
+#include "json.h"
+#include <stdint.h>
+
+#ifndef _WIN32
+#define TRACE_HAVE_THREADS 1
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L &&               \
+    !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define TRACE_ATOMIC _Atomic
+#define TRACE_LOAD(p) atomic_load_explicit(p, memory_order_relaxed)
+#define TRACE_LOAD_ACQUIRE(p) atomic_load_explicit(p, memory_order_acquire)
+#define TRACE_STORE(p, v) atomic_store_explicit(p, v, memory_order_relaxed)
+#define TRACE_FETCH_ADD(p, v)                                                  \
+  atomic_fetch_add_explicit(p, v, memory_order_relaxed)
+#define TRACE_STORE_RELEASE(p, v)                                              \
+  atomic_store_explicit(p, v, memory_order_release)
+#define TRACE_CAS(p, expected, v)                                              \
+  atomic_compare_exchange_weak_explicit(p, expected, v, memory_order_release, \
+                                        memory_order_relaxed)
+#elif defined(__GNUC__)
+#define TRACE_ATOMIC
+#define TRACE_LOAD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define TRACE_LOAD_ACQUIRE(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define TRACE_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define TRACE_FETCH_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define TRACE_STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define TRACE_CAS(p, expected, v)                                              \
+  __atomic_compare_exchange_n(p, expected, v, true, __ATOMIC_RELEASE,          \
+                              __ATOMIC_RELAXED)
+#else
+#error "trace.h needs C11 atomics or GCC-compatible atomic builtins"
+#endif
+
+/**
+ * @brief Events per thread ring buffer; must be a power of two
+ */
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS 16384
+#endif
+
+/**
+ * @brief Duration value marking an instant event
+ */
+#define TRACE_INSTANT_EVENT UINT64_MAX
+
+/**
+ * @brief One recorded event
+ */
+typedef struct {
+  const char *name;
+  uint64_t start;    /* hrclock ticks */
+  uint64_t duration; /* ticks, or TRACE_INSTANT_EVENT */
+} TraceEvent;
+
+/**
+ * @brief Single-producer, single-consumer ring owned by one thread
+ */
+typedef struct TraceBuffer {
+  TRACE_ATOMIC size_t head; /* Next slot to write; advanced by the owner */
+  TRACE_ATOMIC size_t tail; /* Next slot to read; advanced by the flusher */
+  TRACE_ATOMIC uint64_t dropped;
+  TRACE_ATOMIC int owned; /* Cleared when the owning thread exits */
+  uint32_t tid;           /* The fields below are guarded by trace_flush_lock */
+  char thread_name[32];
+  bool name_written;
+  struct TraceBuffer *next;
+  TraceEvent events[TRACE_BUFFER_EVENTS];
+} TraceBuffer;
+
+/**
+ * @brief An open span; returned by trace_begin()
+ */
+typedef struct {
+  const char *name;
+  uint64_t start; /* 0 if tracing was off when the span began */
+} TraceSpan;
+
+/* ========== SHARED STATE ========== */
+
+#ifdef TRACE_IMPLEMENTATION
+TRACE_ATOMIC int trace_active;
+TRACE_ATOMIC uint32_t trace_next_tid;
+TraceBuffer *TRACE_ATOMIC trace_buffers;
+UTILS_THREAD_LOCAL TraceBuffer *trace_local;
+FILE *trace_file;
+size_t trace_file_events;
+uint64_t trace_origin;
+#ifdef TRACE_HAVE_THREADS
+pthread_mutex_t trace_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+pthread_key_t trace_key;
+pthread_t trace_flusher;
+TRACE_ATOMIC int trace_flusher_state;
+#endif
+#else
+extern TRACE_ATOMIC int trace_active;
+extern TRACE_ATOMIC uint32_t trace_next_tid;
+extern TraceBuffer *TRACE_ATOMIC trace_buffers;
+extern UTILS_THREAD_LOCAL TraceBuffer *trace_local;
+extern FILE *trace_file;
+extern size_t trace_file_events;
+extern uint64_t trace_origin;
+#ifdef TRACE_HAVE_THREADS
+extern pthread_mutex_t trace_flush_lock;
+extern pthread_once_t trace_key_once;
+extern pthread_key_t trace_key;
+extern pthread_t trace_flusher;
+extern TRACE_ATOMIC int trace_flusher_state;
+#endif
+#endif /* TRACE_IMPLEMENTATION */
+
+/* ========== INTERNAL HELPERS ========== */
+
+#ifdef TRACE_HAVE_THREADS
+/* Lets the next new thread reuse the ring once it has been flushed */
+static void trace_release_thread(void *arg) {
+  TRACE_STORE_RELEASE(&((TraceBuffer *)arg)->owned, 0);
+}
+
+static void trace_create_key(void) {
+  pthread_key_create(&trace_key, trace_release_thread);
+}
+#endif
+
+/**
+ * @brief Give the calling thread a ring, reusing a flushed one from an exited
+ * thread, and publish it to the flusher
+ */
+static inline TraceBuffer *trace_register_thread(void) {
+  TraceBuffer *b = NULL;
+  uint32_t tid = TRACE_FETCH_ADD(&trace_next_tid, 1) + 1;
+
+#ifdef TRACE_HAVE_THREADS
+  /* Unflushed events must keep the id of the thread that recorded them */
+  pthread_mutex_lock(&trace_flush_lock);
+  for (b = TRACE_LOAD_ACQUIRE(&trace_buffers); b != NULL; b = b->next) {
+    if (TRACE_LOAD_ACQUIRE(&b->owned) == 0 &&
+        TRACE_LOAD(&b->head) == TRACE_LOAD(&b->tail)) {
+      TRACE_STORE(&b->owned, 1);
+      b->tid = tid;
+      b->thread_name[0] = '\0';
+      b->name_written = false;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&trace_flush_lock);
+#endif
+
+  if (b == NULL) {
+    b = (TraceBuffer *)safe_calloc(1, sizeof(TraceBuffer));
+    b->owned = 1;
+    b->tid = tid;
+
+    TraceBuffer *head = TRACE_LOAD(&trace_buffers);
+    do {
+      b->next = head;
+    } while (!TRACE_CAS(&trace_buffers, &head, b));
+  }
+
+#ifdef TRACE_HAVE_THREADS
+  pthread_once(&trace_key_once, trace_create_key);
+  pthread_setspecific(trace_key, b);
+#endif
+  trace_local = b;
+  return b;
+}
+
+static inline void trace_emit(const char *name, uint64_t start,
+                              uint64_t duration) {
+  TraceBuffer *b = trace_local != NULL ? trace_local : trace_register_thread();
+  size_t head = TRACE_LOAD(&b->head);
+
+  if (head - TRACE_LOAD_ACQUIRE(&b->tail) >= TRACE_BUFFER_EVENTS) {
+    TRACE_STORE(&b->dropped, TRACE_LOAD(&b->dropped) + 1);
+    return;
+  }
+
+  TraceEvent *e = &b->events[head & (TRACE_BUFFER_EVENTS - 1)];
+  e->name = name;
+  e->start = start;
+  e->duration = duration;
+  TRACE_STORE_RELEASE(&b->head, head + 1);
+}
+
+static inline void trace_write_string(FILE *file, const char *str) {
+  size_t len = strlen(str);
+  if (json_find_escape(str, len) == len) {
+    fwrite(str, 1, len, file);
+    return;
+  }
+  char *escaped = json_escape_alloc(str);
+  fputs(escaped, file);
+  free(escaped);
+}
+
+static inline void trace_write_separator(void) {
+  fputs(trace_file_events++ > 0 ? ",\n" : "\n", trace_file);
+}
+
+static inline int trace_pid(void) {
+#ifdef TRACE_HAVE_THREADS
+  return (int)getpid();
+#else
+  return 1;
+#endif
+}
+
+/* ========== RECORDING ========== */
+
+/**
+ * @brief Whether events are currently being recorded
+ */
+static inline bool trace_enabled(void) { return TRACE_LOAD(&trace_active); }
+
+/**
+ * @brief Pause or resume recording without closing the output file
+ *
+ * @param enabled true to record events
+ */
+static inline void trace_set_enabled(bool enabled) {
+  TRACE_STORE(&trace_active, enabled && trace_file != NULL);
+}
+
+/**
+ * @brief Open a span
+ *
+ * @param name Span name; must stay valid until the trace is flushed
+ * @return TraceSpan Span to pass to trace_end()
+ */
+static inline TraceSpan trace_begin(const char *name) {
+  TraceSpan span = {name, 0};
+  if (TRACE_LOAD(&trace_active))
+    span.start = hrclock_ticks();
+  return span;
+}
+
+/**
+ * @brief Close a span and record it
+ *
+ * @param span Span returned by trace_begin()
+ */
+static inline void trace_end(TraceSpan *span) {
+  if (span->start == 0)
+    return;
+  trace_emit(span->name, span->start, hrclock_ticks() - span->start);
+}
+
+/**
+ * @brief Record a zero-duration event
+ *
+ * @param name Event name; must stay valid until the trace is flushed
+ */
+static inline void trace_instant(const char *name) {
+  if (TRACE_LOAD(&trace_active))
+    trace_emit(name, hrclock_ticks(), TRACE_INSTANT_EVENT);
+}
+
+/**
+ * @brief Name the calling thread in the trace viewer
+ *
+ * Takes the flush lock, so the flusher never sees a half-written name.
+ *
+ * @param name Thread name (copied, truncated to 31 characters)
+ */
+static inline void trace_set_thread_name(const char *name) {
+  TraceBuffer *b = trace_local != NULL ? trace_local : trace_register_thread();
+#ifdef TRACE_HAVE_THREADS
+  pthread_mutex_lock(&trace_flush_lock);
+#endif
+  snprintf(b->thread_name, sizeof(b->thread_name), "%s", name);
+  b->name_written = false;
+#ifdef TRACE_HAVE_THREADS
+  pthread_mutex_unlock(&trace_flush_lock);
+#endif
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if defined(TRACE_DISABLE)
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_FUNCTION() ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#else
+#ifdef __GNUC__
+/**
+ * @brief Record the rest of the enclosing block as a span
+ */
+#define TRACE_SCOPE(name)                                                      \
+  TraceSpan TRACE_CONCAT(trace_span_, __LINE__)                                \
+      __attribute__((cleanup(trace_end))) = trace_begin(name)
+
+/**
+ * @brief Record the rest of the enclosing function as a span named after it
+ */
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+#endif
+#define TRACE_INSTANT(name) trace_instant(name)
+#endif
+
+/* ========== OUTPUT ========== */
+
+/**
+ * @brief Drain every thread's ring into the trace file
+ *
+ * Safe to call from any thread while others keep recording.
+ *
+ * @return size_t Number of events written
+ */
+static inline size_t trace_flush(void) {
+  size_t written = 0;
+  int pid = trace_pid();
+
+#ifdef TRACE_HAVE_THREADS
+  pthread_mutex_lock(&trace_flush_lock);
+#endif
+  if (trace_file == NULL)
+    goto done;
+
+  for (TraceBuffer *b = TRACE_LOAD_ACQUIRE(&trace_buffers); b != NULL;
+       b = b->next) {
+    size_t head = TRACE_LOAD_ACQUIRE(&b->head);
+    size_t tail = TRACE_LOAD(&b->tail);
+
+    if (b->thread_name[0] != '\0' && !b->name_written) {
+      trace_write_separator();
+      fprintf(trace_file,
+              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"tid\":%u,\"args\":{\"name\":\"",
+              pid, b->tid);
+      trace_write_string(trace_file, b->thread_name);
+      fputs("\"}}", trace_file);
+      b->name_written = true;
+    }
+
+    for (; tail != head; tail++) {
+      const TraceEvent *e = &b->events[tail & (TRACE_BUFFER_EVENTS - 1)];
+      if (e->start < trace_origin)
+        continue; /* Span opened during an earlier trace */
+      double ts = (double)hrclock_ticks_to_ns(e->start - trace_origin) / 1e3;
+
+      trace_write_separator();
+      fputs("{\"name\":\"", trace_file);
+      trace_write_string(trace_file, e->name);
+      if (e->duration == TRACE_INSTANT_EVENT)
+        fprintf(trace_file,
+                "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,"
+                "\"tid\":%u}",
+                ts, pid, b->tid);
+      else
+        fprintf(trace_file,
+                "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,"
+                "\"tid\":%u}",
+                ts, (double)hrclock_ticks_to_ns(e->duration) / 1e3, pid,
+                b->tid);
+      written++;
+    }
+    TRACE_STORE_RELEASE(&b->tail, tail);
+  }
+  fflush(trace_file);
+
+done:
+#ifdef TRACE_HAVE_THREADS
+  pthread_mutex_unlock(&trace_flush_lock);
+#endif
+  return written;
+}
+
+/**
+ * @brief Number of events lost because a ring buffer was full
+ */
+static inline uint64_t trace_dropped(void) {
+  uint64_t total = 0;
+  for (TraceBuffer *b = TRACE_LOAD_ACQUIRE(&trace_buffers); b != NULL;
+       b = b->next)
+    total += TRACE_LOAD(&b->dropped);
+  return total;
+}
+
+/**
+ * @brief Open the output file and start recording
+ *
+ * @param path Output file; open it in chrome://tracing or ui.perfetto.dev
+ * @return true on success, false if the file cannot be opened or a trace is
+ * already running
+ */
+static inline bool trace_start(const char *path) {
+  if (path == NULL)
+    return false;
+
+  /* A running flusher reads trace_file, so set it up under the lock */
+#ifdef TRACE_HAVE_THREADS
+  pthread_mutex_lock(&trace_flush_lock);
+#endif
+  FILE *file = NULL;
+  if (trace_file == NULL) {
+    file = fopen(path, "w");
+    if (file == NULL)
+      fprintf(stderr, "Error: Could not open trace file %s\n", path);
+  }
+  if (file != NULL) {
+    /* Discard events left over from a previous trace */
+    for (TraceBuffer *b = TRACE_LOAD_ACQUIRE(&trace_buffers); b != NULL;
+         b = b->next) {
+      TRACE_STORE_RELEASE(&b->tail, TRACE_LOAD_ACQUIRE(&b->head));
+      TRACE_STORE(&b->dropped, 0);
+      b->name_written = false;
+    }
+    fputs("[", file);
+    trace_file_events = 0;
+    trace_origin = hrclock_ticks();
+    trace_file = file;
+  }
+#ifdef TRACE_HAVE_THREADS
+  pthread_mutex_unlock(&trace_flush_lock);
+#endif
+
+  if (file == NULL)
+    return false;
+  TRACE_STORE(&trace_active, 1);
+  return true;
+}
+
+#ifdef TRACE_HAVE_THREADS
+
+static void *trace_flusher_main(void *arg) {
+  unsigned int interval_ms = *(unsigned int *)arg;
+  struct timespec delay = {(time_t)(interval_ms / 1000),
+                           (long)(interval_ms % 1000) * 1000000L};
+  free(arg);
+
+  while (TRACE_LOAD_ACQUIRE(&trace_flusher_state) == 1) {
+    nanosleep(&delay, NULL);
+    trace_flush();
+  }
+  return NULL;
+}
+
+/**
+ * @brief Flush periodically on a background thread until trace_stop()
+ *
+ * @param interval_ms Time between flushes in milliseconds
+ * @return true if the thread was started, false if one is already running
+ */
+static inline bool trace_start_flusher(unsigned int interval_ms) {
+  if (TRACE_LOAD(&trace_flusher_state) != 0)
+    return false;
+
+  unsigned int *arg = (unsigned int *)safe_malloc(sizeof(unsigned int));
+  *arg = interval_ms > 0 ? interval_ms : 1;
+  TRACE_STORE_RELEASE(&trace_flusher_state, 1);
+  if (pthread_create(&trace_flusher, NULL, trace_flusher_main, arg) != 0) {
+    TRACE_STORE(&trace_flusher_state, 0);
+    free(arg);
+    return false;
+  }
+  return true;
+}
+
+#endif /* TRACE_HAVE_THREADS */
+
+/**
+ * @brief Stop recording, flush remaining events and close the file
+ *
+ * Stops the background flusher first, waiting up to one interval.
+ *
+ * @return uint64_t Events dropped during the trace
+ */
+static inline uint64_t trace_stop(void) {
+  TRACE_STORE(&trace_active, 0);
+
+#ifdef TRACE_HAVE_THREADS
+  if (TRACE_LOAD(&trace_flusher_state) == 1) {
+    TRACE_STORE_RELEASE(&trace_flusher_state, 0);
+    pthread_join(trace_flusher, NULL);
+  }
+#endif
+
+  trace_flush();
+  uint64_t dropped = trace_dropped();
+
+#ifdef TRACE_HAVE_THREADS
+  pthread_mutex_lock(&trace_flush_lock);
+#endif
+  if (trace_file != NULL) {
+    fputs("\n]\n", trace_file);
+    fclose(trace_file);
+    trace_file = NULL;
+  }
+#ifdef TRACE_HAVE_THREADS
+  pthread_mutex_unlock(&trace_flush_lock);
+#endif
+  return dropped;
+}
+
+#endif /* TRACE_H */
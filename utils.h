@@ -11,6 +11,11 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+/* Strict ISO modes hide POSIX declarations such as localtime_r */
+#if !defined(_WIN32) && defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -30,6 +35,90 @@
 #define CLEAR "clear"
 #endif
 
+/**
+ * @brief Storage class for per-thread state
+ */
+#if defined(_MSC_VER)
+#define UTILS_THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define UTILS_THREAD_LOCAL _Thread_local
+#else
+#define UTILS_THREAD_LOCAL __thread
+#endif
+
+/**
+ * @brief Branch hints for conditions that are almost always true or false
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define UTILS_LIKELY(x) __builtin_expect(!!(x), 1)
+#define UTILS_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define UTILS_LIKELY(x) (x)
+#define UTILS_UNLIKELY(x) (x)
+#endif
+
+/**
+ * @brief Atomics for state shared between threads (async logging)
+ */
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L &&               \
+    !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define UTILS_HAVE_ATOMICS 1
+#define UTILS_ATOMIC _Atomic
+#define UTILS_LOAD(p) atomic_load(p)
+#define UTILS_STORE(p, v) atomic_store(p, v)
+#define UTILS_FETCH_ADD(p, v) atomic_fetch_add(p, v)
+#define UTILS_FETCH_SUB(p, v) atomic_fetch_sub(p, v)
+#define UTILS_CAS(p, expected, v) atomic_compare_exchange_weak(p, expected, v)
+#define UTILS_LOAD_RELAXED(p) atomic_load_explicit(p, memory_order_relaxed)
+#define UTILS_LOAD_ACQUIRE(p) atomic_load_explicit(p, memory_order_acquire)
+#define UTILS_STORE_RELEASE(p, v)                                              \
+  atomic_store_explicit(p, v, memory_order_release)
+#define UTILS_FENCE() atomic_thread_fence(memory_order_seq_cst)
+#elif defined(__GNUC__)
+#define UTILS_HAVE_ATOMICS 1
+#define UTILS_ATOMIC
+#define UTILS_LOAD(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define UTILS_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define UTILS_FETCH_ADD(p, v) __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST)
+#define UTILS_FETCH_SUB(p, v) __atomic_fetch_sub(p, v, __ATOMIC_SEQ_CST)
+#define UTILS_CAS(p, expected, v)                                              \
+  __atomic_compare_exchange_n(p, expected, v, true, __ATOMIC_SEQ_CST,          \
+                              __ATOMIC_SEQ_CST)
+#define UTILS_LOAD_RELAXED(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define UTILS_LOAD_ACQUIRE(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define UTILS_STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define UTILS_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+/* No threads to guard against; plain accesses for the logger state */
+#define UTILS_ATOMIC
+#define UTILS_LOAD_RELAXED(p) (*(p))
+#define UTILS_STORE(p, v) (*(p) = (v))
+#define UTILS_FETCH_ADD(p, v) ((*(p) += (v)) - (v))
+#define UTILS_LOAD_ACQUIRE(p) (*(p))
+#define UTILS_STORE_RELEASE(p, v) (*(p) = (v))
+#endif
+
+/**
+ * @brief POSIX threads for the background log writer
+ */
+#if !defined(_WIN32) && defined(UTILS_HAVE_ATOMICS)
+#define UTILS_HAVE_THREADS 1
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#if defined(__GLIBC__) || defined(__APPLE__)
+#define UTILS_HAVE_BACKTRACE 1
+#include <execinfo.h>
+#endif
+#endif
+
 /* ========== CONSOLE UTILITIES ========== */
 
 /**
@@ -199,23 +288,104 @@ static inline char *str_trim(char *str) {
 
 /* ========== TIME UTILITIES ========== */
 
+/**
+ * @brief Timestamp format flags
+ */
+#define TIMESTAMP_UTC 0x1 /* Use UTC instead of local time */
+#define TIMESTAMP_MS 0x2  /* Append milliseconds: .mmm */
+#define TIMESTAMP_US 0x4  /* Append microseconds: .uuuuuu */
+
+/**
+ * @brief Flags used by get_timestamp(); define UTILS_TIMESTAMP_UTC to skip
+ * local time conversion (and timezone lookups) entirely
+ */
+#ifdef UTILS_TIMESTAMP_UTC
+#define TIMESTAMP_DEFAULT TIMESTAMP_UTC
+#else
+#define TIMESTAMP_DEFAULT 0
+#endif
+
+/**
+ * @brief Per-thread cache of the formatted date and time for one second
+ */
+typedef struct {
+  time_t second;
+  bool valid;
+  char text[20];
+} TimestampCache;
+
+/**
+ * @brief Get current timestamp as string with optional sub-second digits
+ *
+ * The "YYYY-MM-DD HH:MM:SS" part is formatted at most once per second per
+ * thread with localtime_r()/gmtime_r() and cached; other calls only copy it
+ * and patch in the sub-second digits.
+ *
+ * @param buffer Buffer to store the timestamp string (at least 20 chars, 24
+ * with TIMESTAMP_MS, 27 with TIMESTAMP_US)
+ * @param size Size of the buffer
+ * @param flags Bitwise OR of TIMESTAMP_* flags
+ * @return char* Pointer to the buffer containing the timestamp string, or
+ * NULL if the buffer is too small
+ */
+static inline char *get_timestamp_ex(char *buffer, size_t size, int flags) {
+  static UTILS_THREAD_LOCAL TimestampCache cache[2];
+  size_t digits = (flags & TIMESTAMP_US) ? 6 : (flags & TIMESTAMP_MS) ? 3 : 0;
+
+  if (buffer == NULL || size < 20 + (digits ? digits + 1 : 0))
+    return NULL;
+
+  struct timespec now;
+#ifdef TIME_UTC
+  timespec_get(&now, TIME_UTC);
+#else
+  clock_gettime(CLOCK_REALTIME, &now);
+#endif
+
+  TimestampCache *c = &cache[(flags & TIMESTAMP_UTC) ? 1 : 0];
+  if (!c->valid || c->second != now.tv_sec) {
+    struct tm t;
+#ifdef _WIN32
+    if (flags & TIMESTAMP_UTC)
+      gmtime_s(&t, &now.tv_sec);
+    else
+      localtime_s(&t, &now.tv_sec);
+#else
+    if (flags & TIMESTAMP_UTC)
+      gmtime_r(&now.tv_sec, &t);
+    else
+      localtime_r(&now.tv_sec, &t);
+#endif
+    strftime(c->text, sizeof(c->text), "%Y-%m-%d %H:%M:%S", &t);
+    c->second = now.tv_sec;
+    c->valid = true;
+  }
+
+  memcpy(buffer, c->text, 19);
+  if (digits > 0) {
+    long frac = now.tv_nsec / (digits == 3 ? 1000000L : 1000L);
+    buffer[19] = '.';
+    for (size_t i = digits; i > 0; i--) {
+      buffer[19 + i] = (char)('0' + frac % 10);
+      frac /= 10;
+    }
+  }
+  buffer[19 + (digits ? digits + 1 : 0)] = '\0';
+  return buffer;
+}
+
 /**
  * @brief Get current timestamp as string in format YYYY-MM-DD HH:MM:SS
  *
+ * Thread-safe; uses the cache described in get_timestamp_ex().
+ *
  * @param buffer Buffer to store the timestamp string (must be at least 20
  * chars)
  * @param size Size of the buffer
  * @return char* Pointer to the buffer containing the timestamp string
  */
 static inline char *get_timestamp(char *buffer, size_t size) {
-  if (buffer == NULL || size < 20)
-    return NULL;
-
-  time_t now = time(NULL);
-  struct tm *t = localtime(&now);
-
-  strftime(buffer, size, "%Y-%m-%d %H:%M:%S", t);
-  return buffer;
+  return get_timestamp_ex(buffer, size, TIMESTAMP_DEFAULT);
 }
 
 /**
@@ -244,75 +414,2402 @@ typedef enum {
   LOG_FATAL
 } LogLevel;
 
-static FILE *log_file = NULL;
-static LogLevel current_log_level = LOG_INFO;
+/**
+ * @brief Timestamp flags for log lines, e.g. TIMESTAMP_MS for milliseconds
+ */
+#ifndef LOG_TIMESTAMP_FLAGS
+#define LOG_TIMESTAMP_FLAGS TIMESTAMP_DEFAULT
+#endif
 
 /**
- * @brief Initialize the logging system
+ * @brief Lowest level the LOG_*F() macros compile in, e.g.
+ * -DLOG_MIN_LEVEL=LOG_WARNING; calls below it and their arguments are removed
+ */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_DEBUG
+#endif
+
+/**
+ * @brief A named log category (subsystem) with its own level
  *
- * @param filename Name of the log file (NULL for stdout)
- * @param level Minimum log level to record
- * @return true if initialized successfully, false otherwise
+ * Define each category once with LOG_CATEGORY_DEFINE() and log through it
+ * with LOG_CAT(). A category joins the registry the first time one of its
+ * call sites passes the level check, then takes its level from a rule set by
+ * log_category_set() or a control file, or else follows log_set_level().
  */
-static inline bool log_init(const char *filename, LogLevel level) {
-  current_log_level = level;
+typedef struct LogCategory {
+  const char *name;
+  UTILS_ATOMIC int level;  /* Filter for LOG_CAT(); -1 until registered */
+  UTILS_ATOMIC int source; /* Level of the category itself, for log_file */
+  struct LogCategory *next;
+} LogCategory;
 
-  if (filename == NULL) {
-    log_file = stdout;
+/**
+ * @brief Level for every category with this name, see log_category_set()
+ */
+typedef struct LogCategoryRule {
+  struct LogCategoryRule *next;
+  LogLevel level;
+  char name[];
+} LogCategoryRule;
+
+/**
+ * @brief Define a category variable, e.g. LOG_CATEGORY_DEFINE(log_net, "net")
+ *
+ * Other files refer to it after LOG_CATEGORY_DECLARE(log_net). Share
+ * categories between files only with UTILS_LOG_SHARED, since each file
+ * otherwise has a private registry.
+ */
+#define LOG_CATEGORY_DEFINE(var, name) LogCategory var = {name, -1, 0, NULL}
+#define LOG_CATEGORY_DECLARE(var) extern LogCategory var
+
+/**
+ * @brief Source location of a log call, filled in by the LOG_*F() macros
+ */
+typedef struct {
+  const char *file;
+  int line;
+  const char *function;
+  LogCategory *category; /* Set by LOG_CAT(), NULL otherwise */
+} LogSite;
+
+/**
+ * @brief Logger linkage
+ *
+ * By default each translation unit that includes utils.h has its own private
+ * logger, so log_init() in one file does not configure the others. Compile
+ * every file with -DUTILS_LOG_SHARED for one process-wide logger, and define
+ * UTILS_LOG_IMPLEMENTATION in exactly one of them before including utils.h;
+ * the logging functions and state then live in that file only.
+ */
+#ifdef UTILS_LOG_SHARED
+#define UTILS_LOG_API
+#if defined(UTILS_LOG_IMPLEMENTATION)
+#define UTILS_LOG_DEFINE 1
+#define UTILS_LOG_STATE
+#else
+#define UTILS_LOG_STATE extern
+#endif
+#else
+#define UTILS_LOG_API static inline
+#define UTILS_LOG_DEFINE 1
+#define UTILS_LOG_STATE static
+#endif
+
+#ifdef UTILS_LOG_DEFINE
+UTILS_LOG_STATE FILE *log_file = NULL;
+UTILS_LOG_STATE UTILS_ATOMIC LogLevel current_log_level = LOG_INFO;
+/* Lowest of current_log_level and the sink levels */
+UTILS_LOG_STATE UTILS_ATOMIC int log_threshold = LOG_INFO;
+UTILS_LOG_STATE char *log_path = NULL; /* File given to log_init() */
+/* Both guarded by log_lock */
+UTILS_LOG_STATE LogCategory *log_categories = NULL;
+UTILS_LOG_STATE LogCategoryRule *log_category_rules = NULL;
+#else
+UTILS_LOG_STATE FILE *log_file;
+UTILS_LOG_STATE UTILS_ATOMIC LogLevel current_log_level;
+UTILS_LOG_STATE UTILS_ATOMIC int log_threshold;
+#endif
+
+/**
+ * @brief Whether a message at this level would be logged
+ *
+ * @param level Log level
+ * @return true if level passes the filter set by log_init() or the level of
+ * a sink, see log_sink_add()
+ */
+static inline bool log_enabled(LogLevel level) {
+  return (int)level >= UTILS_LOAD_RELAXED(&log_threshold);
+}
+
+/**
+ * @brief What log_message() does when the async queue is full
+ */
+typedef enum {
+  LOG_OVERFLOW_BLOCK, /* Wait for the writer to free a slot */
+  LOG_OVERFLOW_DROP,  /* Discard the line; see log_dropped() */
+  LOG_OVERFLOW_COUNT  /* Discard, then log how many lines were lost */
+} LogOverflow;
+
+/**
+ * @brief Longest line (including timestamp and level) kept in async mode,
+ * for log_file and every sink alike, and longest syslog sink message; longer
+ * lines are truncated but still end with '\n'
+ */
+#ifndef LOG_ASYNC_LINE_MAX
+#define LOG_ASYNC_LINE_MAX 1024
+#endif
+
+/**
+ * @brief Most lines the writer thread hands to one writev() call
+ */
+#ifndef LOG_ASYNC_BATCH
+#define LOG_ASYNC_BATCH 64
+#endif
+
+/**
+ * @brief Longest log file path that can be rotated
+ */
+#ifndef LOG_PATH_MAX
+#define LOG_PATH_MAX 4096
+#endif
+
+/**
+ * @brief Frames in the stack trace written by the crash handler
+ */
+#ifndef LOG_CRASH_FRAMES
+#define LOG_CRASH_FRAMES 64
+#endif
+
+/**
+ * @brief Size of the alternate stack the crash handler runs on, so a stack
+ * overflow can still be reported; allocated by log_crash_install()
+ */
+#ifndef LOG_CRASH_STACK_BYTES
+#define LOG_CRASH_STACK_BYTES 65536
+#endif
+
+/**
+ * @brief When and how log_rotate_start() rotates the log file
+ */
+typedef struct {
+  unsigned long long max_bytes; /* Rotate at this size; 0 for no limit */
+  long interval;                /* Rotate on multiples of this many seconds
+                                   since the epoch (3600: hourly); 0 never */
+  int keep;                     /* Rotated files kept: name.1 .. name.keep */
+  const char *compress;         /* Command run on each rotated file, e.g.
+                                   "gzip -f"; NULL for none */
+  const char *compress_suffix;  /* Suffix the command adds, e.g. ".gz" */
+} LogRotateConfig;
+
+#ifdef UTILS_HAVE_THREADS
+/**
+ * @brief One queued log line; seq tells producers and the writer whose turn
+ * the slot is
+ */
+typedef struct {
+  UTILS_ATOMIC size_t seq;
+  size_t length;
+  size_t body;  /* Offset of the text after the timestamp */
+  LogLevel level;
+  bool primary; /* Goes to log_file, not only to sinks */
+  char text[LOG_ASYNC_LINE_MAX];
+} LogSlot;
+
+/**
+ * @brief Bounded multi-producer queue drained by one writer thread
+ */
+typedef struct {
+  LogSlot *slots;
+  size_t mask;
+  LogOverflow policy;
+  bool running;                  /* Writer thread exists */
+  size_t read;                   /* Next slot to write; writer only */
+  unsigned long long reported;   /* Drops already logged; writer only */
+  UTILS_ATOMIC int active;       /* log_message() may enqueue */
+  UTILS_ATOMIC int stop;         /* Writer should exit once drained */
+  UTILS_ATOMIC int sleeping;     /* Writer waits on wake */
+  UTILS_ATOMIC size_t enqueue;   /* Next slot to claim */
+  UTILS_ATOMIC size_t written;   /* Lines handed to the kernel */
+  UTILS_ATOMIC size_t inflight;  /* Producers inside log_async_enqueue() */
+  UTILS_ATOMIC size_t waiters;   /* Producers or flushers on progress */
+  UTILS_ATOMIC unsigned long long dropped;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t progress;
+} LogAsync;
+
+/**
+ * @brief Background rotation; the rotator thread renames and reopens the
+ * file, swaps log_file under log_lock, then closes and compresses the old one
+ */
+typedef struct {
+  LogRotateConfig config;
+  char *compress; /* Copies of the config strings */
+  char *compress_suffix;
+  bool running;                         /* Rotator thread exists */
+  UTILS_ATOMIC int active;              /* Writers count bytes */
+  UTILS_ATOMIC int requested;           /* Size limit or log_rotate_now() */
+  UTILS_ATOMIC int stop;                /* Rotator should exit */
+  UTILS_ATOMIC unsigned long long size; /* Bytes in the current file */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} LogRotation;
+
+/**
+ * @brief Thread that reloads category levels from a control file when it
+ * changes or when a signal arrives (the handler writes to a pipe)
+ */
+typedef struct {
+  bool running;
+  UTILS_ATOMIC int stop;
+  int pipe[2];
+  int signo; /* 0 when no signal is watched */
+  struct sigaction previous;
+  char *path;
+  long interval_ms;
+  struct stat seen; /* File state when last loaded */
+  pthread_t thread;
+} LogCategoryWatch;
+
+#define LOG_CRASH_SIGNALS 5
+
+/**
+ * @brief Fatal-signal handler state, see log_crash_install()
+ */
+typedef struct {
+  bool installed;
+  bool on_stack;           /* Handlers use the alternate stack */
+  UTILS_ATOMIC int inside; /* Threads that entered the handler */
+  struct sigaction previous[LOG_CRASH_SIGNALS];
+  char *stack; /* Allocated on install, never freed: may still be in use */
+} LogCrash;
+
+/**
+ * @brief Where a sink sends its lines
+ */
+typedef enum {
+  LOG_SINK_FD,       /* File or descriptor, optionally buffered */
+  LOG_SINK_RING,     /* Most recent bytes kept in memory */
+  LOG_SINK_CALLBACK, /* Function called with each line */
+  LOG_SINK_SYSLOG    /* One datagram per line to a local syslog socket */
+} LogSinkKind;
+
+/**
+ * @brief Called with each line, under log_lock; must not log itself
+ */
+typedef void (*LogSinkCallback)(void *user, LogLevel level, const char *line,
+                                size_t length);
+
+/**
+ * @brief An extra log destination with its own level, see log_sink_add()
+ */
+typedef struct LogSink {
+  LogSinkKind kind;
+  UTILS_ATOMIC int level;
+  int fd; /* FD and SYSLOG sinks */
+  bool owns_fd;
+  char *buffer;    /* FD: pending output. RING: the ring */
+  size_t capacity; /* 0 for an unbuffered FD sink */
+  size_t used;     /* FD: pending bytes. RING: bytes ever written */
+  LogSinkCallback callback;
+  void *user;
+  char *address; /* SYSLOG: socket path, for reconnecting */
+  char ident[48];
+  struct LogSink *next;
+} LogSink;
+
+#ifdef UTILS_LOG_DEFINE
+/* Guards log_file and the categories, keeps lines from interleaving */
+UTILS_LOG_STATE pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+UTILS_LOG_STATE LogAsync log_async;
+/* Never destroyed: writers may still signal it while rotation stops */
+UTILS_LOG_STATE LogRotation log_rotation = {
+    {0, 0, 0, NULL, NULL}, NULL, NULL, false, 0, 0, 0, 0, 0,
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+/* Zeroed; log_category_watch() creates the pipe before anything reads it */
+UTILS_LOG_STATE LogCategoryWatch log_category_watcher;
+UTILS_LOG_STATE LogCrash log_crash;
+UTILS_LOG_STATE LogSink *log_sinks = NULL; /* Guarded by log_lock */
+UTILS_LOG_STATE UTILS_ATOMIC int log_sink_count = 0;
+#endif
+#define LOG_LOCK() pthread_mutex_lock(&log_lock)
+#define LOG_UNLOCK() pthread_mutex_unlock(&log_lock)
+#else
+#define LOG_LOCK() ((void)0)
+#define LOG_UNLOCK() ((void)0)
+#endif
+
+static inline const char *log_level_name(LogLevel level) {
+  static const char *names[] = {"DEBUG", "INFO", "WARNING", "ERROR", "FATAL"};
+  return names[level];
+}
+
+/**
+ * @brief Parse a level name such as "debug" or "WARNING" (case-insensitive;
+ * "warn" is accepted too)
+ *
+ * @param name Level name, not necessarily NUL-terminated
+ * @param length Length of name
+ * @param level Output
+ * @return true if the name is a level
+ */
+static inline bool log_level_parse(const char *name, size_t length,
+                                   LogLevel *level) {
+  char lower[8];
+  if (length == 0 || length >= sizeof(lower))
+    return false;
+  for (size_t i = 0; i < length; i++) {
+    char c = name[i];
+    lower[i] = (char)(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+  }
+  lower[length] = '\0';
+
+  static const char *names[] = {"debug", "info", "warning", "error", "fatal"};
+  for (int i = LOG_DEBUG; i <= LOG_FATAL; i++) {
+    if (strcmp(lower, names[i]) == 0) {
+      *level = (LogLevel)i;
+      return true;
+    }
+  }
+  if (strcmp(lower, "warn") == 0) {
+    *level = LOG_WARNING;
     return true;
   }
+  return false;
+}
 
-  log_file = fopen(filename, "a");
-  if (log_file == NULL) {
-    fprintf(stderr, "Error: Could not open log file %s\n", filename);
+UTILS_LOG_API int log_category_attach(LogCategory *category);
+
+/**
+ * @brief Whether a message at this level would be logged in a category
+ *
+ * One relaxed load and a compare once the category is registered; the first
+ * call that gets past the compare registers it.
+ *
+ * @param category Category
+ * @param level Log level
+ * @return true if level passes the category's filter
+ */
+static inline bool log_category_enabled(LogCategory *category,
+                                        LogLevel level) {
+  int threshold = UTILS_LOAD_RELAXED(&category->level);
+  if ((int)level < threshold)
     return false;
-  }
+  return threshold >= 0 || (int)level >= log_category_attach(category);
+}
 
-  return true;
+/**
+ * @brief Whether a message from this call site would be logged, using its
+ * category's level when it has one
+ */
+static inline bool log_site_enabled(LogLevel level, const LogSite *site) {
+  if (site != NULL && site->category != NULL)
+    return log_category_enabled(site->category, level);
+  return log_enabled(level);
 }
 
 /**
- * @brief Close the logging system
+ * @brief Whether an enabled message also goes to log_file, rather than only
+ * to sinks with a lower level
  */
-static inline void log_close(void) {
-  if (log_file != NULL && log_file != stdout) {
-    fclose(log_file);
-    log_file = NULL;
-  }
+static inline bool log_site_primary(LogLevel level, const LogSite *site) {
+  if (site != NULL && site->category != NULL)
+    return (int)level >= UTILS_LOAD_RELAXED(&site->category->source);
+  return level >= UTILS_LOAD_RELAXED(&current_log_level);
 }
 
 /**
- * @brief Log a message with the specified level
+ * @brief File name without its directories
+ */
+static inline const char *log_site_file(const LogSite *site) {
+  const char *name = site->file;
+  for (const char *p = site->file; *p != '\0'; p++)
+    if (*p == '/' || *p == '\\')
+      name = p + 1;
+  return name;
+}
+
+/**
+ * @brief "[category] " for a site logged through LOG_CAT(), "" otherwise
+ */
+static inline const char *log_site_category(const LogSite *site, char *buffer,
+                                            size_t size) {
+  if (site == NULL || site->category == NULL)
+    return "";
+  snprintf(buffer, size, "[%s] ", site->category->name);
+  return buffer;
+}
+
+/**
+ * @brief Format "[timestamp] [LEVEL] [category] [file:line function]
+ * message\n" into buffer, truncating; the location is left out when site is
+ * NULL and the category when the site has none
  *
- * @param level Log level
- * @param format Format string (printf-style)
- * @param ... Additional arguments for the format string
+ * @param needed Receives the untruncated length, newline included (may be
+ * NULL)
+ * @return size_t Length written, including the newline
  */
-static inline void log_message(LogLevel level, const char *format, ...) {
-  if (log_file == NULL)
-    log_file = stdout;
-  if (level < current_log_level)
+static inline size_t log_format_line(char *buffer, size_t size,
+                                     LogLevel level, const LogSite *site,
+                                     const char *format, va_list args,
+                                     size_t *needed) {
+  char timestamp[32];
+  char category[64];
+  get_timestamp_ex(timestamp, sizeof(timestamp), LOG_TIMESTAMP_FLAGS);
+
+  int head = site == NULL
+                 ? snprintf(buffer, size, "[%s] [%s] ", timestamp,
+                            log_level_name(level))
+                 : snprintf(buffer, size, "[%s] [%s] %s[%s:%d %s] ", timestamp,
+                            log_level_name(level),
+                            log_site_category(site, category, sizeof(category)),
+                            log_site_file(site), site->line, site->function);
+  size_t length = head < 0 ? 0 : (size_t)head;
+  int body = length < size - 1
+                 ? vsnprintf(buffer + length, size - length, format, args)
+                 : vsnprintf(NULL, 0, format, args);
+  length += body < 0 ? 0 : (size_t)body;
+  if (needed != NULL)
+    *needed = length + 1;
+  if (length > size - 2)
+    length = size - 2;
+  buffer[length++] = '\n';
+  buffer[length] = '\0';
+  return length;
+}
+
+/**
+ * @brief Offset of the text after "[timestamp] " in a formatted line
+ */
+static inline size_t log_line_body(const char *line) {
+  const char *end = strchr(line, ']');
+  return end != NULL && end[1] == ' ' ? (size_t)(end - line) + 2 : 0;
+}
+
+#ifdef UTILS_LOG_DEFINE
+#ifdef UTILS_HAVE_THREADS
+/**
+ * @brief Wait on a condition for at most ms milliseconds
+ */
+static inline void log_async_wait(pthread_cond_t *cond, long ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += ms / 1000;
+  deadline.tv_nsec += (ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  pthread_cond_timedwait(cond, &log_async.lock, &deadline);
+}
+
+/**
+ * @brief Count bytes written to the current file and wake the rotator once
+ * it reaches the size limit
+ */
+static inline void log_rotate_count(size_t bytes) {
+  if (!UTILS_LOAD_ACQUIRE(&log_rotation.active))
     return;
 
-  const char *level_str[] = {"DEBUG", "INFO", "WARNING", "ERROR", "FATAL"};
-  char timestamp[20];
-  get_timestamp(timestamp, sizeof(timestamp));
+  unsigned long long size =
+      UTILS_FETCH_ADD(&log_rotation.size, (unsigned long long)bytes) + bytes;
+  unsigned long long limit = log_rotation.config.max_bytes;
+  int idle = 0;
+  if (limit > 0 && size >= limit &&
+      UTILS_CAS(&log_rotation.requested, &idle, 1)) {
+    pthread_mutex_lock(&log_rotation.lock);
+    pthread_cond_broadcast(&log_rotation.wake);
+    pthread_mutex_unlock(&log_rotation.lock);
+  }
+}
 
-  fprintf(log_file, "[%s] [%s] ", timestamp, level_str[level]);
+/**
+ * @brief write() all of a buffer, retrying short writes and EINTR;
+ * async-signal-safe
+ */
+static inline void log_write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return;
+    data += n;
+    length -= (size_t)n;
+  }
+}
 
-  va_list args;
-  va_start(args, format);
-  vfprintf(log_file, format, args);
-  va_end(args);
+/**
+ * @brief Lowest sink level, or LOG_FATAL + 1 without sinks; call with
+ * log_lock held
+ */
+static inline int log_sinks_floor(void) {
+  int floor = LOG_FATAL + 1;
+  for (LogSink *sink = log_sinks; sink != NULL; sink = sink->next) {
+    int level = UTILS_LOAD_RELAXED(&sink->level);
+    if (level < floor)
+      floor = level;
+  }
+  return floor;
+}
 
-  fprintf(log_file, "\n");
-  fflush(log_file);
+static inline void log_sink_flush_locked(LogSink *sink) {
+  if (sink->kind == LOG_SINK_FD && sink->used > 0) {
+    log_write_all(sink->fd, sink->buffer, sink->used);
+    sink->used = 0;
+  }
+}
 
-  if (level == LOG_FATAL) {
-    exit(EXIT_FAILURE);
+static inline void log_sinks_flush(void) {
+  for (LogSink *sink = log_sinks; sink != NULL; sink = sink->next)
+    log_sink_flush_locked(sink);
+}
+
+static inline bool log_sink_connect(int fd, const char *path) {
+  struct sockaddr_un address;
+  if (strlen(path) >= sizeof(address.sun_path))
+    return false;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+  return connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+}
+
+/**
+ * @brief Syslog priority: facility "user", severity from the level
+ */
+static inline int log_syslog_priority(LogLevel level) {
+  static const int severity[] = {7, 6, 4, 3, 2};
+  return 8 + severity[level];
+}
+
+static inline void log_sink_emit(LogSink *sink, LogLevel level,
+                                 const char *line, size_t length) {
+  switch (sink->kind) {
+  case LOG_SINK_FD:
+    if (sink->used + length > sink->capacity) {
+      log_sink_flush_locked(sink);
+      if (length > sink->capacity) {
+        log_write_all(sink->fd, line, length);
+        break;
+      }
+    }
+    memcpy(sink->buffer + sink->used, line, length);
+    sink->used += length;
+    break;
+  case LOG_SINK_RING:
+    for (size_t done = 0; done < length;) {
+      size_t at = (sink->used + done) % sink->capacity;
+      size_t n = length - done < sink->capacity - at ? length - done
+                                                     : sink->capacity - at;
+      memcpy(sink->buffer + at, line + done, n);
+      done += n;
+    }
+    sink->used += length;
+    break;
+  case LOG_SINK_CALLBACK:
+    sink->callback(sink->user, level, line, length);
+    break;
+  case LOG_SINK_SYSLOG:
+    /* The syslog daemon may have restarted; reconnect once */
+    if (send(sink->fd, line, length, 0) < 0 &&
+        log_sink_connect(sink->fd, sink->address))
+      send(sink->fd, line, length, 0);
+    break;
+  }
+}
+
+/**
+ * @brief Hand one line to every sink whose level it passes; call with
+ * log_lock held
+ *
+ * Text sinks share the line as formatted. The syslog form is built from it
+ * once and reused by every syslog sink with the same ident.
+ *
+ * @param level Level of the line
+ * @param line Text line, ending with '\n'
+ * @param length Length of line
+ * @param body Offset of the text after the timestamp
+ */
+static inline void log_sinks_dispatch(LogLevel level, const char *line,
+                                      size_t length, size_t body) {
+  char syslog_line[LOG_ASYNC_LINE_MAX + 64];
+  size_t syslog_length = 0;
+  const char *syslog_ident = NULL;
+
+  for (LogSink *sink = log_sinks; sink != NULL; sink = sink->next) {
+    if ((int)level < UTILS_LOAD_RELAXED(&sink->level))
+      continue;
+    if (sink->kind != LOG_SINK_SYSLOG) {
+      log_sink_emit(sink, level, line, length);
+      continue;
+    }
+
+    if (syslog_ident == NULL || strcmp(syslog_ident, sink->ident) != 0) {
+      size_t text = length > body ? length - body : 0;
+      if (text > 0 && line[body + text - 1] == '\n')
+        text--;
+      int head = snprintf(syslog_line, sizeof(syslog_line), "<%d>%s: ",
+                          log_syslog_priority(level), sink->ident);
+      syslog_length = head < 0 ? 0 : (size_t)head;
+      if (text > sizeof(syslog_line) - syslog_length)
+        text = sizeof(syslog_line) - syslog_length;
+      memcpy(syslog_line + syslog_length, line + body, text);
+      syslog_length += text;
+      syslog_ident = sink->ident;
+    }
+    log_sink_emit(sink, level, syslog_line, syslog_length);
+  }
+}
+
+/**
+ * @brief The ring's contents, oldest first, as two spans that start at a
+ * line boundary
+ *
+ * @return size_t Total length of the spans
+ */
+static inline size_t log_sink_ring_spans(const LogSink *sink,
+                                         const char *span[2],
+                                         size_t length[2]) {
+  size_t used = sink->used;
+  if (used <= sink->capacity) {
+    span[0] = sink->buffer;
+    length[0] = used;
+    span[1] = NULL;
+    length[1] = 0;
+    return used;
+  }
+
+  size_t start = used % sink->capacity;
+  span[0] = sink->buffer + start;
+  length[0] = sink->capacity - start;
+  span[1] = sink->buffer;
+  length[1] = start;
+  /* The oldest line was partly overwritten */
+  for (int i = 0; i < 2; i++) {
+    const char *newline = (const char *)memchr(span[i], '\n', length[i]);
+    if (newline != NULL) {
+      length[i] -= (size_t)(newline + 1 - span[i]);
+      span[i] = newline + 1;
+      break;
+    }
+    length[i] = 0;
+  }
+  return length[0] + length[1];
+}
+
+/**
+ * @brief writev() all of iov to log_file, retrying short writes and EINTR
+ *
+ * The descriptor is looked up under log_lock for each batch, so a rotation
+ * can swap the file between batches.
+ */
+static inline void log_async_writev(struct iovec *iov, int count) {
+  size_t total = 0;
+  for (int i = 0; i < count; i++)
+    total += iov[i].iov_len;
+
+  LOG_LOCK();
+  int fd = fileno(log_file);
+  while (count > 0) {
+    ssize_t n = writev(fd, iov, count);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    while (count > 0 && (size_t)n >= iov->iov_len) {
+      n -= (ssize_t)iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= (size_t)n;
+    }
   }
+  LOG_UNLOCK();
+  log_rotate_count(total);
+}
+
+static inline bool log_async_ready(size_t position) {
+  LogSlot *slot = &log_async.slots[position & log_async.mask];
+  return UTILS_LOAD_ACQUIRE(&slot->seq) == position + 1;
 }
 
+static inline void log_async_report_dropped(void) {
+  unsigned long long dropped = UTILS_LOAD(&log_async.dropped);
+  if (log_async.policy != LOG_OVERFLOW_COUNT || dropped == log_async.reported)
+    return;
+
+  char timestamp[32];
+  char line[128];
+  get_timestamp_ex(timestamp, sizeof(timestamp), LOG_TIMESTAMP_FLAGS);
+  int n = snprintf(line, sizeof(line),
+                   "[%s] [WARNING] %llu log lines dropped\n", timestamp,
+                   dropped - log_async.reported);
+  struct iovec iov = {line, (size_t)n};
+  log_async_writev(&iov, 1);
+  log_async.reported = dropped;
+}
+
+/**
+ * @brief Hand the next count queued lines to the sinks
+ */
+static inline void log_async_dispatch(int count) {
+  LOG_LOCK();
+  for (int i = 0; i < count; i++) {
+    LogSlot *slot =
+        &log_async.slots[(log_async.read + (size_t)i) & log_async.mask];
+    log_sinks_dispatch(slot->level, slot->text, slot->length, slot->body);
+  }
+  LOG_UNLOCK();
+}
+
+/**
+ * @brief Writer thread: drain ready slots in batches until stopped
+ */
+static inline void *log_async_main(void *arg) {
+  struct iovec iov[LOG_ASYNC_BATCH];
+  (void)arg;
+
+  for (;;) {
+    int count = 0, lines = 0;
+    while (count < LOG_ASYNC_BATCH &&
+           log_async_ready(log_async.read + (size_t)count)) {
+      LogSlot *slot =
+          &log_async.slots[(log_async.read + (size_t)count) & log_async.mask];
+      if (slot->primary) {
+        iov[lines].iov_base = slot->text;
+        iov[lines].iov_len = slot->length;
+        lines++;
+      }
+      count++;
+    }
+
+    if (count > 0) {
+      if (lines > 0)
+        log_async_writev(iov, lines);
+      if (UTILS_LOAD_RELAXED(&log_sink_count) > 0)
+        log_async_dispatch(count);
+      for (int i = 0; i < count; i++) {
+        LogSlot *slot = &log_async.slots[log_async.read & log_async.mask];
+        UTILS_STORE_RELEASE(&slot->seq, log_async.read + log_async.mask + 1);
+        log_async.read++;
+      }
+      UTILS_STORE(&log_async.written, log_async.read);
+      if (UTILS_LOAD(&log_async.waiters) > 0) {
+        pthread_mutex_lock(&log_async.lock);
+        pthread_cond_broadcast(&log_async.progress);
+        pthread_mutex_unlock(&log_async.lock);
+      }
+      continue;
+    }
+
+    log_async_report_dropped();
+    if (UTILS_LOAD(&log_async.stop) &&
+        UTILS_LOAD(&log_async.enqueue) == log_async.read)
+      break;
+
+    pthread_mutex_lock(&log_async.lock);
+    UTILS_STORE(&log_async.sleeping, 1);
+    UTILS_FENCE();
+    if (!log_async_ready(log_async.read) && !UTILS_LOAD(&log_async.stop))
+      log_async_wait(&log_async.wake, 100);
+    UTILS_STORE(&log_async.sleeping, 0);
+    pthread_mutex_unlock(&log_async.lock);
+  }
+  return NULL;
+}
+
+static inline void log_async_wake_writer(void) {
+  UTILS_FENCE();
+  if (UTILS_LOAD(&log_async.sleeping)) {
+    pthread_mutex_lock(&log_async.lock);
+    pthread_cond_signal(&log_async.wake);
+    pthread_mutex_unlock(&log_async.lock);
+  }
+}
+
+/**
+ * @brief Claim the next queue slot; fill it, then call log_async_publish()
+ *
+ * @param position_out Set to the claimed position
+ * @param queued Set to false if async mode is off and the caller should
+ * write directly, true if the line was taken care of
+ * @return LogSlot* Slot to fill, or NULL if async mode is off or the line
+ * was dropped
+ */
+static inline LogSlot *log_async_claim(size_t *position_out, bool *queued) {
+  UTILS_FETCH_ADD(&log_async.inflight, 1);
+  if (!UTILS_LOAD(&log_async.active)) {
+    UTILS_FETCH_SUB(&log_async.inflight, 1);
+    *queued = false;
+    return NULL;
+  }
+  *queued = true;
+
+  size_t position = UTILS_LOAD_RELAXED(&log_async.enqueue);
+  LogSlot *slot;
+  for (;;) {
+    slot = &log_async.slots[position & log_async.mask];
+    size_t seq = UTILS_LOAD_ACQUIRE(&slot->seq);
+    if (seq == position) {
+      if (UTILS_CAS(&log_async.enqueue, &position, position + 1))
+        break;
+    } else if (seq < position + 1) {
+      /* Full: the slot still holds a line from the previous lap */
+      if (log_async.policy != LOG_OVERFLOW_BLOCK) {
+        UTILS_FETCH_ADD(&log_async.dropped, 1ULL);
+        UTILS_FETCH_SUB(&log_async.inflight, 1);
+        return NULL;
+      }
+      UTILS_FETCH_ADD(&log_async.waiters, 1);
+      pthread_mutex_lock(&log_async.lock);
+      pthread_cond_signal(&log_async.wake);
+      log_async_wait(&log_async.progress, 10);
+      pthread_mutex_unlock(&log_async.lock);
+      UTILS_FETCH_SUB(&log_async.waiters, 1);
+      position = UTILS_LOAD_RELAXED(&log_async.enqueue);
+    } else {
+      position = UTILS_LOAD_RELAXED(&log_async.enqueue);
+    }
+  }
+
+  *position_out = position;
+  return slot;
+}
+
+/**
+ * @brief Hand a filled slot to the writer
+ */
+static inline void log_async_publish(LogSlot *slot, size_t position) {
+  UTILS_STORE_RELEASE(&slot->seq, position + 1);
+  UTILS_FETCH_SUB(&log_async.inflight, 1);
+  log_async_wake_writer();
+}
+
+/**
+ * @brief Format a line into the queue
+ *
+ * @return false if async mode is off and the caller should write directly
+ */
+static inline bool log_async_enqueue(LogLevel level, const LogSite *site,
+                                     const char *format, va_list args) {
+  size_t position;
+  bool queued;
+  LogSlot *slot = log_async_claim(&position, &queued);
+  if (slot == NULL)
+    return queued;
+
+  slot->length = log_format_line(slot->text, sizeof(slot->text), level, site,
+                                 format, args, NULL);
+  slot->body = log_line_body(slot->text);
+  slot->level = level;
+  slot->primary = log_site_primary(level, site);
+  log_async_publish(slot, position);
+  return true;
+}
+
+/**
+ * @brief Copy a finished line into the queue, truncating it to
+ * LOG_ASYNC_LINE_MAX
+ *
+ * @return false if async mode is off and the caller should write directly
+ */
+static inline bool log_async_enqueue_line(LogLevel level, const char *line,
+                                          size_t length) {
+  size_t position;
+  bool queued;
+  LogSlot *slot = log_async_claim(&position, &queued);
+  if (slot == NULL)
+    return queued;
+
+  if (length > sizeof(slot->text)) {
+    length = sizeof(slot->text);
+    memcpy(slot->text, line, length - 1);
+    slot->text[length - 1] = '\n';
+  } else {
+    memcpy(slot->text, line, length);
+  }
+  slot->length = length;
+  slot->body = 0;
+  slot->level = level;
+  slot->primary = level >= UTILS_LOAD_RELAXED(&current_log_level);
+  log_async_publish(slot, position);
+  return true;
+}
+
+static inline void log_async_atexit(void);
+
+/**
+ * @brief Name of rotated file number index, with or without suffix
+ */
+static inline void log_rotate_name(char *buffer, size_t size, int index,
+                                   const char *suffix) {
+  snprintf(buffer, size, "%s.%d%s", log_path, index, suffix);
+}
+
+/**
+ * @brief Run the compress command on a rotated file
+ */
+static inline void log_rotate_compress(const char *path) {
+  char command[LOG_PATH_MAX + 256];
+
+  if (strchr(path, '\'') != NULL) {
+    fprintf(stderr, "Error: Could not compress %s\n", path);
+    return;
+  }
+  snprintf(command, sizeof(command), "%s '%s'", log_rotation.compress, path);
+  if (system(command) != 0)
+    fprintf(stderr, "Error: Could not compress %s\n", path);
+}
+
+/**
+ * @brief Rotate once: shift name.N up, rename the live file to name.1, open
+ * a fresh file and swap it in, then close and compress the old one
+ *
+ * Writers keep appending to the renamed file until the swap, so no line is
+ * lost; only the pointer swap happens under log_lock.
+ */
+static inline void log_rotate_once(void) {
+  const char *suffix =
+      log_rotation.compress_suffix != NULL ? log_rotation.compress_suffix : "";
+  char from[LOG_PATH_MAX + 32];
+  char to[LOG_PATH_MAX + 32];
+
+  /* Uncompressed leftovers (a failed compress) are shifted too */
+  for (int i = log_rotation.config.keep - 1; i >= 1; i--) {
+    log_rotate_name(from, sizeof(from), i, suffix);
+    log_rotate_name(to, sizeof(to), i + 1, suffix);
+    rename(from, to);
+    if (*suffix != '\0') {
+      log_rotate_name(from, sizeof(from), i, "");
+      log_rotate_name(to, sizeof(to), i + 1, "");
+      rename(from, to);
+    }
+  }
+  log_rotate_name(to, sizeof(to), 1, "");
+  if (rename(log_path, to) != 0) {
+    fprintf(stderr, "Error: Could not rotate log file %s\n", log_path);
+    UTILS_STORE(&log_rotation.requested, 0);
+    return;
+  }
+
+  FILE *next = fopen(log_path, "a");
+  if (next == NULL) {
+    fprintf(stderr, "Error: Could not open log file %s\n", log_path);
+    UTILS_STORE(&log_rotation.requested, 0);
+    return;
+  }
+
+  LOG_LOCK();
+  FILE *old = log_file;
+  log_file = next;
+  UTILS_STORE(&log_rotation.size, 0ULL);
+  LOG_UNLOCK();
+  UTILS_STORE(&log_rotation.requested, 0);
+
+  if (old != NULL && old != stdout)
+    fclose(old);
+  if (log_rotation.compress != NULL)
+    log_rotate_compress(to);
+}
+
+/**
+ * @brief Rotator thread: rotate on request or at each interval boundary
+ */
+static inline void *log_rotate_main(void *arg) {
+  long interval = log_rotation.config.interval;
+  time_t next = interval > 0 ? (time(NULL) / interval + 1) * interval : 0;
+  (void)arg;
+
+  pthread_mutex_lock(&log_rotation.lock);
+  while (!UTILS_LOAD(&log_rotation.stop)) {
+    time_t now = time(NULL);
+    bool due = UTILS_LOAD(&log_rotation.requested) ||
+               (interval > 0 && now >= next);
+    if (!due) {
+      struct timespec deadline = {interval > 0 ? next : now + 3600, 0};
+      pthread_cond_timedwait(&log_rotation.wake, &log_rotation.lock,
+                             &deadline);
+      continue;
+    }
+
+    pthread_mutex_unlock(&log_rotation.lock);
+    log_rotate_once();
+    if (interval > 0)
+      next = (time(NULL) / interval + 1) * interval;
+    pthread_mutex_lock(&log_rotation.lock);
+  }
+  pthread_mutex_unlock(&log_rotation.lock);
+  return NULL;
+}
+#else
+static inline void log_rotate_count(size_t bytes) { (void)bytes; }
+static inline int log_sinks_floor(void) { return LOG_FATAL + 1; }
+#endif
+
+/**
+ * @brief Give a registered category the level of its rule, or the default;
+ * call with log_lock held
+ *
+ * @param floor Lowest sink level; LOG_CAT() lets lines through for sinks
+ * even when the category itself would drop them
+ */
+static inline void log_category_update(LogCategory *category, int floor) {
+  LogLevel level = UTILS_LOAD_RELAXED(&current_log_level);
+  for (LogCategoryRule *r = log_category_rules; r != NULL; r = r->next) {
+    if (strcmp(r->name, category->name) == 0) {
+      level = r->level;
+      break;
+    }
+  }
+  UTILS_STORE(&category->source, (int)level);
+  UTILS_STORE(&category->level, (int)level < floor ? (int)level : floor);
+}
+
+/**
+ * @brief Recompute the filters after a level, rule or sink changed; call
+ * with log_lock held
+ */
+static inline void log_levels_update(void) {
+  int current = (int)UTILS_LOAD_RELAXED(&current_log_level);
+  int floor = log_sinks_floor();
+  UTILS_STORE(&log_threshold, current < floor ? current : floor);
+  for (LogCategory *c = log_categories; c != NULL; c = c->next)
+    log_category_update(c, floor);
+}
+
+/**
+ * @brief Add or replace the rule for a name; call with log_lock held
+ */
+static inline void log_category_rule_set(const char *name, size_t length,
+                                         LogLevel level) {
+  for (LogCategoryRule *r = log_category_rules; r != NULL; r = r->next) {
+    if (strncmp(r->name, name, length) == 0 && r->name[length] == '\0') {
+      r->level = level;
+      return;
+    }
+  }
+  LogCategoryRule *rule =
+      (LogCategoryRule *)malloc(sizeof(LogCategoryRule) + length + 1);
+  if (rule == NULL) {
+    fprintf(stderr, "Error: Could not allocate log category rule\n");
+    return;
+  }
+  memcpy(rule->name, name, length);
+  rule->name[length] = '\0';
+  rule->level = level;
+  rule->next = log_category_rules;
+  log_category_rules = rule;
+}
+
+/**
+ * @brief Remove the rule for a name, or every rule when name is NULL; call
+ * with log_lock held
+ */
+static inline void log_category_rule_remove(const char *name, size_t length) {
+  LogCategoryRule **link = &log_category_rules;
+  while (*link != NULL) {
+    LogCategoryRule *r = *link;
+    if (name == NULL ||
+        (strncmp(r->name, name, length) == 0 && r->name[length] == '\0')) {
+      *link = r->next;
+      free(r);
+    } else {
+      link = &r->next;
+    }
+  }
+}
+
+/**
+ * @brief Apply "name=level" settings separated by commas, spaces or newlines
+ *
+ * "*" sets the default level, "default" removes a category's rule and '#'
+ * starts a comment running to the end of the line. Valid settings are applied
+ * even when others are not.
+ *
+ * @param spec Settings
+ * @param replace Drop every existing rule first
+ * @return true if every setting was valid
+ */
+static inline bool log_category_apply(const char *spec, bool replace) {
+  bool valid = true;
+
+  LOG_LOCK();
+  if (replace)
+    log_category_rule_remove(NULL, 0);
+  for (const char *p = spec; *p != '\0';) {
+    if (*p == '#') {
+      while (*p != '\0' && *p != '\n')
+        p++;
+      continue;
+    }
+    if (strchr(", \t\r\n", *p) != NULL) {
+      p++;
+      continue;
+    }
+
+    const char *name = p;
+    while (*p != '\0' && strchr(", \t\r\n#", *p) == NULL)
+      p++;
+    const char *value = (const char *)memchr(name, '=', (size_t)(p - name));
+    size_t name_length = value != NULL ? (size_t)(value - name) : 0;
+    size_t value_length = value != NULL ? (size_t)(p - value - 1) : 0;
+    LogLevel level;
+    if (value != NULL)
+      value++;
+
+    if (name_length > 0 && value_length == 7 &&
+        strncmp(value, "default", 7) == 0) {
+      log_category_rule_remove(name, name_length);
+    } else if (name_length == 0 ||
+               !log_level_parse(value, value_length, &level)) {
+      fprintf(stderr, "Error: Invalid log category setting %.*s\n",
+              (int)(p - name), name);
+      valid = false;
+    } else if (name_length == 1 && *name == '*') {
+      UTILS_STORE(&current_log_level, level);
+    } else {
+      log_category_rule_set(name, name_length, level);
+    }
+  }
+  log_levels_update();
+  LOG_UNLOCK();
+  return valid;
+}
+
+/**
+ * @brief Register a category on first use
+ *
+ * @return int The category's level
+ */
+UTILS_LOG_API int log_category_attach(LogCategory *category) {
+  LOG_LOCK();
+  if (UTILS_LOAD_RELAXED(&category->level) < 0) {
+    category->next = log_categories;
+    log_categories = category;
+    log_category_update(category, log_sinks_floor());
+  }
+  int level = UTILS_LOAD_RELAXED(&category->level);
+  LOG_UNLOCK();
+  return level;
+}
+
+/**
+ * @brief Initialize the logging system
+ *
+ * @param filename Name of the log file (NULL for stdout)
+ * @param level Minimum log level to record
+ * @return true if initialized successfully, false otherwise
+ */
+UTILS_LOG_API bool log_init(const char *filename, LogLevel level) {
+  FILE *file = stdout;
+
+  if (filename != NULL) {
+    file = fopen(filename, "a");
+    if (file == NULL)
+      fprintf(stderr, "Error: Could not open log file %s\n", filename);
+  }
+
+  LOG_LOCK();
+  UTILS_STORE(&current_log_level, level);
+  log_levels_update();
+  log_file = file;
+  free(log_path);
+  log_path = file != NULL && filename != NULL ? str_duplicate(filename) : NULL;
+  LOG_UNLOCK();
+  return file != NULL;
+}
+
+/**
+ * @brief Change the minimum level without reopening the log
+ *
+ * Also the level of every category without its own, see log_category_set().
+ *
+ * @param level Minimum log level to record
+ */
+UTILS_LOG_API void log_set_level(LogLevel level) {
+  LOG_LOCK();
+  UTILS_STORE(&current_log_level, level);
+  log_levels_update();
+  LOG_UNLOCK();
+}
+
+/**
+ * @brief Move log writes off the calling threads
+ *
+ * After this call log_message() formats into a bounded lock-free queue and a
+ * background thread writes the lines with batched writev() calls, so a slow
+ * disk no longer stalls callers. Call after log_init(); log_close() (or
+ * process exit) drains the queue. Only available on POSIX systems.
+ *
+ * @param capacity Queued lines (rounded up to a power of two, at least 2)
+ * @param policy What to do when the queue is full
+ * @return true if the writer thread is running
+ */
+UTILS_LOG_API bool log_async_start(size_t capacity, LogOverflow policy) {
+#ifdef UTILS_HAVE_THREADS
+  static bool atexit_registered = false;
+
+  if (log_async.running)
+    return true;
+  LOG_LOCK();
+  if (log_file == NULL)
+    log_file = stdout;
+  fflush(log_file);
+  LOG_UNLOCK();
+
+  size_t slots = 2;
+  while (slots < capacity)
+    slots *= 2;
+
+  log_async.slots = (LogSlot *)safe_calloc(slots, sizeof(LogSlot));
+  for (size_t i = 0; i < slots; i++)
+    UTILS_STORE(&log_async.slots[i].seq, i);
+  log_async.mask = slots - 1;
+  log_async.policy = policy;
+  log_async.read = 0;
+  log_async.reported = 0;
+  UTILS_STORE(&log_async.stop, 0);
+  UTILS_STORE(&log_async.sleeping, 0);
+  UTILS_STORE(&log_async.enqueue, (size_t)0);
+  UTILS_STORE(&log_async.written, (size_t)0);
+  UTILS_STORE(&log_async.dropped, 0ULL);
+  pthread_mutex_init(&log_async.lock, NULL);
+  pthread_cond_init(&log_async.wake, NULL);
+  pthread_cond_init(&log_async.progress, NULL);
+
+  if (pthread_create(&log_async.thread, NULL, log_async_main, NULL) != 0) {
+    fprintf(stderr, "Error: Could not start log writer thread\n");
+    pthread_cond_destroy(&log_async.progress);
+    pthread_cond_destroy(&log_async.wake);
+    pthread_mutex_destroy(&log_async.lock);
+    free(log_async.slots);
+    log_async.slots = NULL;
+    return false;
+  }
+
+  log_async.running = true;
+  UTILS_STORE(&log_async.active, 1);
+  if (!atexit_registered) {
+    atexit(log_async_atexit);
+    atexit_registered = true;
+  }
+  return true;
+#else
+  (void)capacity;
+  (void)policy;
+  return false;
+#endif
+}
+
+/**
+ * @brief Write every queued line, stop the writer thread and return to
+ * synchronous logging
+ */
+UTILS_LOG_API void log_async_stop(void) {
+#ifdef UTILS_HAVE_THREADS
+  if (!log_async.running)
+    return;
+
+  UTILS_STORE(&log_async.active, 0);
+  pthread_mutex_lock(&log_async.lock);
+  while (UTILS_LOAD(&log_async.inflight) > 0)
+    log_async_wait(&log_async.progress, 1);
+  UTILS_STORE(&log_async.stop, 1);
+  pthread_cond_signal(&log_async.wake);
+  pthread_mutex_unlock(&log_async.lock);
+
+  pthread_join(log_async.thread, NULL);
+  pthread_cond_destroy(&log_async.progress);
+  pthread_cond_destroy(&log_async.wake);
+  pthread_mutex_destroy(&log_async.lock);
+  free(log_async.slots);
+  log_async.slots = NULL;
+  log_async.running = false;
+#endif
+}
+
+/**
+ * @brief Block until every line logged so far has been written, including
+ * lines buffered by sinks
+ */
+UTILS_LOG_API void log_flush(void) {
+#ifdef UTILS_HAVE_THREADS
+  if (UTILS_LOAD(&log_async.active)) {
+    size_t target = UTILS_LOAD(&log_async.enqueue);
+    UTILS_FETCH_ADD(&log_async.waiters, 1);
+    pthread_mutex_lock(&log_async.lock);
+    pthread_cond_signal(&log_async.wake);
+    while (UTILS_LOAD(&log_async.written) < target)
+      log_async_wait(&log_async.progress, 10);
+    pthread_mutex_unlock(&log_async.lock);
+    UTILS_FETCH_SUB(&log_async.waiters, 1);
+  }
+#endif
+  LOG_LOCK();
+  if (log_file != NULL)
+    fflush(log_file);
+#ifdef UTILS_HAVE_THREADS
+  log_sinks_flush();
+#endif
+  LOG_UNLOCK();
+}
+
+/**
+ * @brief Lines discarded because the async queue was full
+ */
+UTILS_LOG_API unsigned long long log_dropped(void) {
+#ifdef UTILS_HAVE_THREADS
+  return UTILS_LOAD(&log_async.dropped);
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Rotate the log file in the background by size and/or time
+ *
+ * A rotator thread renames the file to name.1 (shifting older ones up to
+ * name.keep, discarding the oldest), opens a new file and swaps it in under
+ * the log lock. Writers never wait for the old file to be closed or
+ * compressed. Requires log_init() with a file name; only available on POSIX
+ * systems. log_close() stops rotation.
+ *
+ * @param config Size limit, interval, retention and optional compression
+ * @return true if the rotator thread is running
+ */
+UTILS_LOG_API bool log_rotate_start(const LogRotateConfig *config) {
+#ifdef UTILS_HAVE_THREADS
+  if (log_rotation.running)
+    return false;
+  if (log_path == NULL || config->keep < 1 ||
+      strlen(log_path) >= LOG_PATH_MAX) {
+    fprintf(stderr, "Error: Could not start log rotation\n");
+    return false;
+  }
+
+  log_rotation.config = *config;
+  log_rotation.compress =
+      config->compress != NULL ? str_duplicate(config->compress) : NULL;
+  log_rotation.compress_suffix = config->compress_suffix != NULL
+                                     ? str_duplicate(config->compress_suffix)
+                                     : NULL;
+
+  LOG_LOCK();
+  fseek(log_file, 0, SEEK_END);
+  long size = ftell(log_file);
+  LOG_UNLOCK();
+  UTILS_STORE(&log_rotation.size, size > 0 ? (unsigned long long)size : 0ULL);
+  UTILS_STORE(&log_rotation.requested, 0);
+  UTILS_STORE(&log_rotation.stop, 0);
+
+  if (pthread_create(&log_rotation.thread, NULL, log_rotate_main, NULL) != 0) {
+    fprintf(stderr, "Error: Could not start log rotation thread\n");
+    free(log_rotation.compress);
+    free(log_rotation.compress_suffix);
+    return false;
+  }
+  log_rotation.running = true;
+  UTILS_STORE(&log_rotation.active, 1);
+  log_rotate_count(0);
+  return true;
+#else
+  (void)config;
+  return false;
+#endif
+}
+
+/**
+ * @brief Ask the rotator thread to rotate now (e.g. from a SIGHUP handler's
+ * follow-up code); returns immediately
+ */
+UTILS_LOG_API void log_rotate_now(void) {
+#ifdef UTILS_HAVE_THREADS
+  if (!log_rotation.running)
+    return;
+  pthread_mutex_lock(&log_rotation.lock);
+  UTILS_STORE(&log_rotation.requested, 1);
+  pthread_cond_broadcast(&log_rotation.wake);
+  pthread_mutex_unlock(&log_rotation.lock);
+#endif
+}
+
+/**
+ * @brief Stop the rotator thread; the current file stays open
+ */
+UTILS_LOG_API void log_rotate_stop(void) {
+#ifdef UTILS_HAVE_THREADS
+  if (!log_rotation.running)
+    return;
+
+  UTILS_STORE(&log_rotation.active, 0);
+  pthread_mutex_lock(&log_rotation.lock);
+  UTILS_STORE(&log_rotation.stop, 1);
+  pthread_cond_broadcast(&log_rotation.wake);
+  pthread_mutex_unlock(&log_rotation.lock);
+
+  pthread_join(log_rotation.thread, NULL);
+  free(log_rotation.compress);
+  free(log_rotation.compress_suffix);
+  log_rotation.compress = NULL;
+  log_rotation.compress_suffix = NULL;
+  log_rotation.running = false;
+#endif
+}
+
+/**
+ * @brief Set the level of every category with this name
+ *
+ * Takes effect immediately for registered categories and on registration
+ * for the others, and overrides log_set_level() until log_category_reset().
+ *
+ * @param name Category name
+ * @param level Minimum log level to record in that category
+ */
+UTILS_LOG_API void log_category_set(const char *name, LogLevel level) {
+  LOG_LOCK();
+  log_category_rule_set(name, strlen(name), level);
+  log_levels_update();
+  LOG_UNLOCK();
+}
+
+/**
+ * @brief Make a category follow log_set_level() again
+ *
+ * @param name Category name
+ */
+UTILS_LOG_API void log_category_reset(const char *name) {
+  LOG_LOCK();
+  log_category_rule_remove(name, strlen(name));
+  log_levels_update();
+  LOG_UNLOCK();
+}
+
+/**
+ * @brief Change category levels from a string such as "net=debug,db=error"
+ *
+ * Settings are "name=level" separated by commas, spaces or newlines; "*=level"
+ * sets the default level and "name=default" undoes log_category_set(). Rules
+ * not mentioned are kept.
+ *
+ * @param spec Settings
+ * @return true if every setting was valid; the valid ones are applied anyway
+ */
+UTILS_LOG_API bool log_category_configure(const char *spec) {
+  return spec != NULL && log_category_apply(spec, false);
+}
+
+/**
+ * @brief Replace all category rules with the settings in a control file
+ *
+ * Same syntax as log_category_configure(), with '#' comments. Categories the
+ * file does not mention go back to the default level.
+ *
+ * @param path Control file
+ * @return true if the file was read and every setting was valid
+ */
+UTILS_LOG_API bool log_category_load(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Error: Could not open log category file %s\n", path);
+    return false;
+  }
+
+  size_t capacity = 1024, length = 0;
+  char *spec = (char *)malloc(capacity);
+  while (spec != NULL) {
+    length += fread(spec + length, 1, capacity - length - 1, file);
+    if (length < capacity - 1)
+      break;
+    char *grown = (char *)realloc(spec, capacity *= 2);
+    if (grown == NULL)
+      free(spec);
+    spec = grown;
+  }
+  bool failed = ferror(file) != 0;
+  fclose(file);
+  if (spec == NULL || failed) {
+    fprintf(stderr, "Error: Could not read log category file %s\n", path);
+    free(spec);
+    return false;
+  }
+
+  spec[length] = '\0';
+  bool valid = log_category_apply(spec, true);
+  free(spec);
+  return valid;
+}
+
+#ifdef UTILS_HAVE_THREADS
+static inline void log_category_signal(int signo) {
+  int saved = errno;
+  char byte = (char)signo;
+  ssize_t written = write(log_category_watcher.pipe[1], &byte, 1);
+  (void)written;
+  errno = saved;
+}
+
+static inline bool log_category_changed(const struct stat *a,
+                                        const struct stat *b) {
+  return a->st_mtime != b->st_mtime || a->st_size != b->st_size ||
+         a->st_ino != b->st_ino || a->st_dev != b->st_dev;
+}
+
+static inline void *log_category_watch_main(void *arg) {
+  LogCategoryWatch *w = &log_category_watcher;
+  (void)arg;
+
+  while (!UTILS_LOAD(&w->stop)) {
+    struct pollfd wake = {w->pipe[0], POLLIN, 0};
+    bool signaled = false;
+    if (poll(&wake, 1, w->interval_ms > 0 ? (int)w->interval_ms : -1) > 0) {
+      char drain[64];
+      while (read(w->pipe[0], drain, sizeof(drain)) > 0)
+        ;
+      signaled = true;
+    }
+    if (UTILS_LOAD(&w->stop))
+      break;
+
+    /* A missing file keeps the current levels */
+    struct stat now;
+    if (stat(w->path, &now) != 0)
+      continue;
+    if (signaled || log_category_changed(&now, &w->seen)) {
+      w->seen = now;
+      log_category_load(w->path);
+    }
+  }
+  return NULL;
+}
+#endif
+
+/**
+ * @brief Reload category levels from a control file while the program runs
+ *
+ * The file is loaded now if it exists, then again from a background thread
+ * whenever its modification time, size or inode changes (checked every
+ * interval_ms) or signo is delivered, e.g. after `kill -USR1 <pid>`.
+ * Modification times have one-second resolution on some file systems; send
+ * the signal to force a reload. Only available on POSIX systems.
+ *
+ * @param path Control file, see log_category_load()
+ * @param signo Signal that forces a reload, or 0 for none
+ * @param interval_ms How often to check the file, or 0 to only reload on
+ * signo
+ * @return true if the watcher thread is running
+ */
+UTILS_LOG_API bool log_category_watch(const char *path, int signo,
+                                      long interval_ms) {
+#ifdef UTILS_HAVE_THREADS
+  LogCategoryWatch *w = &log_category_watcher;
+  if (path == NULL || w->running || (signo == 0 && interval_ms <= 0))
+    return false;
+
+  if (pipe(w->pipe) != 0) {
+    fprintf(stderr, "Error: Could not create log category pipe\n");
+    w->pipe[0] = w->pipe[1] = -1;
+    return false;
+  }
+  for (int i = 0; i < 2; i++) {
+    fcntl(w->pipe[i], F_SETFL, fcntl(w->pipe[i], F_GETFL) | O_NONBLOCK);
+    fcntl(w->pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+
+  w->path = str_duplicate(path);
+  w->signo = signo;
+  w->interval_ms = interval_ms;
+  UTILS_STORE(&w->stop, 0);
+  memset(&w->seen, 0, sizeof(w->seen));
+  if (stat(path, &w->seen) == 0)
+    log_category_load(path);
+
+  if (signo != 0) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = log_category_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(signo, &action, &w->previous) != 0)
+      w->signo = 0;
+  }
+
+  if (w->path == NULL || (signo != 0 && w->signo == 0) ||
+      pthread_create(&w->thread, NULL, log_category_watch_main, NULL) != 0) {
+    fprintf(stderr, "Error: Could not start log category watcher\n");
+    if (w->signo != 0)
+      sigaction(w->signo, &w->previous, NULL);
+    close(w->pipe[0]);
+    close(w->pipe[1]);
+    w->pipe[0] = w->pipe[1] = -1;
+    free(w->path);
+    w->path = NULL;
+    return false;
+  }
+  w->running = true;
+  return true;
+#else
+  (void)path;
+  (void)signo;
+  (void)interval_ms;
+  return false;
+#endif
+}
+
+/**
+ * @brief Stop the thread started by log_category_watch(); the levels it
+ * loaded stay in effect
+ */
+UTILS_LOG_API void log_category_unwatch(void) {
+#ifdef UTILS_HAVE_THREADS
+  LogCategoryWatch *w = &log_category_watcher;
+  if (!w->running)
+    return;
+
+  if (w->signo != 0)
+    sigaction(w->signo, &w->previous, NULL);
+  UTILS_STORE(&w->stop, 1);
+  char byte = 0;
+  ssize_t written = write(w->pipe[1], &byte, 1);
+  (void)written;
+  pthread_join(w->thread, NULL);
+
+  close(w->pipe[0]);
+  close(w->pipe[1]);
+  w->pipe[0] = w->pipe[1] = -1;
+  free(w->path);
+  w->path = NULL;
+  w->running = false;
+#endif
+}
+
+#ifdef UTILS_HAVE_THREADS
+static const struct {
+  int signo;
+  const char *name;
+} log_crash_signals[LOG_CRASH_SIGNALS] = {
+    {SIGSEGV, "SIGSEGV"}, {SIGBUS, "SIGBUS"},   {SIGFPE, "SIGFPE"},
+    {SIGILL, "SIGILL"},   {SIGABRT, "SIGABRT"},
+};
+
+static inline void log_crash_puts(int fd, const char *text) {
+  log_write_all(fd, text, strlen(text));
+}
+
+/**
+ * @brief Write queued lines the writer thread has not finished with to
+ * log_file and to the descriptor and memory sinks
+ *
+ * Lines in the batch being written at the time of the crash may appear twice;
+ * lines still being formatted are lost.
+ */
+static inline void log_crash_drain(int fd) {
+  for (LogSink *sink = log_sinks; sink != NULL; sink = sink->next)
+    log_sink_flush_locked(sink);
+
+  if (log_async.slots == NULL)
+    return;
+
+  /* written may lag read; skip slots already recycled for the next lap */
+  size_t position = UTILS_LOAD(&log_async.written);
+  for (size_t i = 0; i <= log_async.mask && !log_async_ready(position); i++) {
+    LogSlot *slot = &log_async.slots[position & log_async.mask];
+    if (UTILS_LOAD_ACQUIRE(&slot->seq) != position + log_async.mask + 1)
+      return;
+    position++;
+  }
+  for (size_t i = 0; i <= log_async.mask && log_async_ready(position); i++) {
+    LogSlot *slot = &log_async.slots[position & log_async.mask];
+    if (slot->primary)
+      log_write_all(fd, slot->text, slot->length);
+    for (LogSink *sink = log_sinks; sink != NULL; sink = sink->next) {
+      if ((int)slot->level < UTILS_LOAD_RELAXED(&sink->level))
+        continue;
+      if (sink->kind == LOG_SINK_FD)
+        log_write_all(sink->fd, slot->text, slot->length);
+      else if (sink->kind == LOG_SINK_RING)
+        log_sink_emit(sink, slot->level, slot->text, slot->length);
+    }
+    position++;
+  }
+}
+
+/**
+ * @brief Write what the memory sinks hold; they may have lines below the
+ * log_file level that led up to the crash
+ */
+static inline void log_crash_dump_rings(int fd) {
+  for (LogSink *sink = log_sinks; sink != NULL; sink = sink->next) {
+    const char *span[2];
+    size_t length[2];
+    if (sink->kind != LOG_SINK_RING ||
+        log_sink_ring_spans(sink, span, length) == 0)
+      continue;
+    log_crash_puts(fd, "[FATAL] Recent lines kept in memory:\n");
+    log_write_all(fd, span[0], length[0]);
+    log_write_all(fd, span[1], length[1]);
+  }
+}
+
+static inline void log_crash_handler(int signo) {
+  static UTILS_THREAD_LOCAL int reporting;
+
+  /* Fatal signal while reporting: die with the default action right away */
+  if (reporting) {
+    struct sigaction action;
+    sigset_t set;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SIG_DFL;
+    sigemptyset(&action.sa_mask);
+    sigaction(signo, &action, NULL);
+    sigemptyset(&set);
+    sigaddset(&set, signo);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+    raise(signo);
+    _exit(128 + signo);
+  }
+
+  /* Another thread is already reporting; it ends the process */
+  if (UTILS_FETCH_ADD(&log_crash.inside, 1) != 0)
+    for (;;)
+      pause();
+  reporting = 1;
+
+  FILE *file = log_file;
+  int fd = file != NULL ? fileno(file) : STDERR_FILENO;
+  log_crash_drain(fd);
+
+  const char *name = "unknown signal";
+  int index = 0;
+  for (int i = 0; i < LOG_CRASH_SIGNALS; i++) {
+    if (log_crash_signals[i].signo == signo) {
+      name = log_crash_signals[i].name;
+      index = i;
+    }
+  }
+  log_crash_puts(fd, "[FATAL] Caught ");
+  log_crash_puts(fd, name);
+  log_crash_puts(fd, ", stack trace:\n");
+#ifdef UTILS_HAVE_BACKTRACE
+  void *frames[LOG_CRASH_FRAMES];
+  int count = backtrace(frames, LOG_CRASH_FRAMES);
+  backtrace_symbols_fd(frames, count, fd);
+#else
+  log_crash_puts(fd, "(not available on this platform)\n");
+#endif
+  log_crash_dump_rings(fd);
+
+  /* Let the previous disposition (normally the default: core dump) finish */
+  struct sigaction *previous = &log_crash.previous[index];
+  if (previous->sa_handler == SIG_IGN)
+    previous->sa_handler = SIG_DFL;
+  sigaction(signo, previous, NULL);
+  raise(signo);
+}
+#endif
+
+/**
+ * @brief Report fatal signals in the log before the process dies
+ *
+ * On SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT the handler writes the lines
+ * still queued for the async writer and buffered by sinks with raw write()
+ * calls, then a stack trace (glibc and macOS) and the contents of memory
+ * sinks, and re-raises the signal under the handler that was installed
+ * before. It only uses async-signal-safe calls. A fatal signal in the
+ * reporting thread while the handler runs ends the process with the default
+ * action; one in another thread waits for the report to finish.
+ *
+ * Where sigaltstack() is declared (XSI or default GNU feature macros) the
+ * handler runs on an alternate stack, but only in the thread that calls this
+ * function: an alternate stack belongs to one thread. A stack overflow in any
+ * other thread kills the process without a report. Only available on POSIX
+ * systems.
+ *
+ * @return true if the handlers are installed
+ */
+UTILS_LOG_API bool log_crash_install(void) {
+#ifdef UTILS_HAVE_THREADS
+  if (log_crash.installed)
+    return true;
+
+#ifdef UTILS_HAVE_BACKTRACE
+  /* The first backtrace() may load libgcc, which is not safe in a handler */
+  void *frame;
+  backtrace(&frame, 1);
+#endif
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = log_crash_handler;
+  sigemptyset(&action.sa_mask);
+#ifdef SA_ONSTACK
+  /* Without memory for the stack the handler runs on the thread's own */
+  if (log_crash.stack == NULL)
+    log_crash.stack = (char *)malloc(LOG_CRASH_STACK_BYTES);
+  log_crash.on_stack = false;
+  if (log_crash.stack != NULL) {
+    stack_t stack;
+    memset(&stack, 0, sizeof(stack));
+    stack.ss_sp = log_crash.stack;
+    stack.ss_size = LOG_CRASH_STACK_BYTES;
+    log_crash.on_stack = sigaltstack(&stack, NULL) == 0;
+  }
+  if (log_crash.on_stack)
+    action.sa_flags = SA_ONSTACK;
+#endif
+  for (int i = 0; i < LOG_CRASH_SIGNALS; i++) {
+    if (sigaction(log_crash_signals[i].signo, &action,
+                  &log_crash.previous[i]) != 0) {
+      fprintf(stderr, "Error: Could not install crash handler\n");
+      while (--i >= 0)
+        sigaction(log_crash_signals[i].signo, &log_crash.previous[i], NULL);
+      return false;
+    }
+  }
+  log_crash.installed = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Restore the signal handlers replaced by log_crash_install()
+ */
+UTILS_LOG_API void log_crash_uninstall(void) {
+#ifdef UTILS_HAVE_THREADS
+  if (!log_crash.installed)
+    return;
+  for (int i = 0; i < LOG_CRASH_SIGNALS; i++)
+    sigaction(log_crash_signals[i].signo, &log_crash.previous[i], NULL);
+  log_crash.installed = false;
+#endif
+}
+
+#ifdef UTILS_HAVE_THREADS
+static inline LogSink *log_sink_new(LogSinkKind kind, LogLevel level,
+                                    size_t capacity) {
+  LogSink *sink = (LogSink *)safe_calloc(1, sizeof(LogSink));
+  sink->kind = kind;
+  UTILS_STORE(&sink->level, (int)level);
+  sink->fd = -1;
+  sink->capacity = capacity;
+  if (capacity > 0)
+    sink->buffer = (char *)safe_malloc(capacity);
+  return sink;
+}
+
+/**
+ * @brief Create a sink that writes to a file descriptor
+ *
+ * @param fd Descriptor, e.g. STDERR_FILENO; not closed by the sink
+ * @param level Minimum level this sink records
+ * @param buffer_bytes Bytes collected before each write(), or 0 to write
+ * every line at once; buffered lines are written by log_flush() and
+ * log_close(), and by the crash handler
+ * @return LogSink* Sink to pass to log_sink_add()
+ */
+UTILS_LOG_API LogSink *log_sink_fd(int fd, LogLevel level,
+                                   size_t buffer_bytes) {
+  LogSink *sink = log_sink_new(LOG_SINK_FD, level, buffer_bytes);
+  sink->fd = fd;
+  return sink;
+}
+
+/**
+ * @brief Create a sink that appends to a file
+ *
+ * @param path File to append to
+ * @param level Minimum level this sink records
+ * @param buffer_bytes As for log_sink_fd()
+ * @return LogSink* Sink to pass to log_sink_add(), or NULL on error
+ */
+UTILS_LOG_API LogSink *log_sink_file(const char *path, LogLevel level,
+                                     size_t buffer_bytes) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Could not open log file %s\n", path);
+    return NULL;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  LogSink *sink = log_sink_fd(fd, level, buffer_bytes);
+  sink->owns_fd = true;
+  return sink;
+}
+
+/**
+ * @brief Create a sink that keeps the most recent lines in memory
+ *
+ * Read it with log_sink_ring_read(); the crash handler writes it to the log.
+ *
+ * @param bytes Ring size (> 0)
+ * @param level Minimum level this sink records
+ * @return LogSink* Sink to pass to log_sink_add(), or NULL if bytes is 0
+ */
+UTILS_LOG_API LogSink *log_sink_ring(size_t bytes, LogLevel level) {
+  return bytes > 0 ? log_sink_new(LOG_SINK_RING, level, bytes) : NULL;
+}
+
+/**
+ * @brief Create a sink that calls a function with each line
+ *
+ * @param callback Called under log_lock with the formatted line (ending with
+ * '\n'); it must not log
+ * @param user Passed to callback
+ * @param level Minimum level this sink records
+ * @return LogSink* Sink to pass to log_sink_add(), or NULL if callback is
+ * NULL
+ */
+UTILS_LOG_API LogSink *log_sink_callback(LogSinkCallback callback, void *user,
+                                         LogLevel level) {
+  if (callback == NULL)
+    return NULL;
+  LogSink *sink = log_sink_new(LOG_SINK_CALLBACK, level, 0);
+  sink->callback = callback;
+  sink->user = user;
+  return sink;
+}
+
+/**
+ * @brief Create a sink that sends each line to the local syslog daemon
+ *
+ * Lines are sent as "<priority>ident[pid]: [LEVEL] ... message" datagrams,
+ * with facility "user" and a severity matching the level.
+ *
+ * @param path Socket path, or NULL for /dev/log
+ * @param ident Program name for the messages
+ * @param level Minimum level this sink records
+ * @return LogSink* Sink to pass to log_sink_add(), or NULL on error
+ */
+UTILS_LOG_API LogSink *log_sink_syslog(const char *path, const char *ident,
+                                       LogLevel level) {
+  if (path == NULL)
+    path = "/dev/log";
+  int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (fd < 0 || !log_sink_connect(fd, path)) {
+    fprintf(stderr, "Error: Could not connect to syslog socket %s\n", path);
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  LogSink *sink = log_sink_new(LOG_SINK_SYSLOG, level, 0);
+  sink->fd = fd;
+  sink->owns_fd = true;
+  sink->address = str_duplicate(path);
+  snprintf(sink->ident, sizeof(sink->ident), "%.32s[%ld]",
+           ident != NULL ? ident : "log", (long)getpid());
+  return sink;
+}
+
+static inline void log_sink_free(LogSink *sink) {
+  log_sink_flush_locked(sink);
+  if (sink->owns_fd)
+    close(sink->fd);
+  free(sink->buffer);
+  free(sink->address);
+  free(sink);
+}
+
+/**
+ * @brief Send log lines to another destination as well
+ *
+ * Each line is formatted once and handed to log_file (if it passes
+ * log_set_level() or its category's level) and to every sink whose own
+ * level it passes. A sink level below log_set_level() lowers the level
+ * log_enabled() checks, so those lines are formatted for the sink only. In
+ * async mode the writer thread feeds the sinks. Only available on POSIX
+ * systems.
+ *
+ * @param sink Sink from log_sink_fd(), log_sink_file(), log_sink_ring(),
+ * log_sink_callback() or log_sink_syslog(); the logger takes ownership
+ * @return true if the sink was added
+ */
+UTILS_LOG_API bool log_sink_add(LogSink *sink) {
+  if (sink == NULL)
+    return false;
+
+  LOG_LOCK();
+  LogSink **link = &log_sinks;
+  while (*link != NULL)
+    link = &(*link)->next;
+  sink->next = NULL;
+  *link = sink;
+  UTILS_FETCH_ADD(&log_sink_count, 1);
+  log_levels_update();
+  LOG_UNLOCK();
+  return true;
+}
+
+/**
+ * @brief Detach a sink, write what it buffered and free it
+ *
+ * @param sink Sink added with log_sink_add()
+ */
+UTILS_LOG_API void log_sink_remove(LogSink *sink) {
+  bool found = false;
+
+  LOG_LOCK();
+  for (LogSink **link = &log_sinks; *link != NULL; link = &(*link)->next) {
+    if (*link == sink) {
+      *link = sink->next;
+      found = true;
+      break;
+    }
+  }
+  if (found) {
+    UTILS_FETCH_SUB(&log_sink_count, 1);
+    log_levels_update();
+  }
+  LOG_UNLOCK();
+  if (found)
+    log_sink_free(sink);
+}
+
+/**
+ * @brief Change the minimum level of one sink
+ *
+ * @param sink Sink added with log_sink_add()
+ * @param level Minimum level this sink records
+ */
+UTILS_LOG_API void log_sink_set_level(LogSink *sink, LogLevel level) {
+  LOG_LOCK();
+  UTILS_STORE(&sink->level, (int)level);
+  log_levels_update();
+  LOG_UNLOCK();
+}
+
+/**
+ * @brief Copy the newest whole lines held by a memory sink
+ *
+ * @param sink Sink from log_sink_ring()
+ * @param buffer Output, NUL-terminated
+ * @param size Size of buffer
+ * @return size_t Bytes copied, without the terminator
+ */
+UTILS_LOG_API size_t log_sink_ring_read(LogSink *sink, char *buffer,
+                                        size_t size) {
+  const char *span[2];
+  size_t length[2];
+  size_t copied = 0;
+  bool truncated = false;
+  if (size == 0)
+    return 0;
+
+  LOG_LOCK();
+  if (sink->kind == LOG_SINK_RING) {
+    size_t total = log_sink_ring_spans(sink, span, length);
+    size_t skip = total > size - 1 ? total - (size - 1) : 0;
+    truncated = skip > 0;
+    for (int i = 0; i < 2; i++) {
+      size_t from = skip < length[i] ? skip : length[i];
+      skip -= from;
+      if (length[i] > from) {
+        memcpy(buffer + copied, span[i] + from, length[i] - from);
+        copied += length[i] - from;
+      }
+    }
+  }
+  LOG_UNLOCK();
+
+  /* Start at a line boundary when the oldest lines did not fit */
+  if (truncated) {
+    const char *newline = (const char *)memchr(buffer, '\n', copied);
+    size_t drop = newline != NULL ? (size_t)(newline + 1 - buffer) : copied;
+    memmove(buffer, buffer + drop, copied - drop);
+    copied -= drop;
+  }
+  buffer[copied] = '\0';
+  return copied;
+}
+#endif
+
+/**
+ * @brief Close the logging system
+ *
+ * In async mode, every queued line is written before the file is closed.
+ */
+UTILS_LOG_API void log_close(void) {
+  log_category_unwatch();
+  log_rotate_stop();
+  log_async_stop();
+#ifdef UTILS_HAVE_THREADS
+  while (UTILS_LOAD(&log_sink_count) > 0)
+    log_sink_remove(log_sinks);
+#endif
+  LOG_LOCK();
+  if (log_file != NULL && log_file != stdout) {
+    fclose(log_file);
+    log_file = NULL;
+  }
+  free(log_path);
+  log_path = NULL;
+  LOG_UNLOCK();
+}
+
+#ifdef UTILS_HAVE_THREADS
+static inline void log_async_atexit(void) { log_async_stop(); }
+#endif
+
+/**
+ * @brief Shared body of log_message() and log_message_at()
+ */
+static inline void log_vmessage(LogLevel level, const LogSite *site,
+                                const char *format, va_list args) {
+#ifdef UTILS_HAVE_THREADS
+  if (UTILS_LOAD_RELAXED(&log_async.active)) {
+    va_list copy;
+    va_copy(copy, args);
+    bool queued = log_async_enqueue(level, site, format, copy);
+    va_end(copy);
+    if (queued) {
+      if (level == LOG_FATAL) {
+        log_close();
+        exit(EXIT_FAILURE);
+      }
+      return;
+    }
+  }
+#endif
+
+  bool primary = log_site_primary(level, site);
+#ifdef UTILS_HAVE_THREADS
+  if (UTILS_LOAD_RELAXED(&log_sink_count) > 0) {
+    /* Format once for log_file and every sink */
+    char stack[LOG_ASYNC_LINE_MAX];
+    char *line = stack;
+    size_t needed;
+    va_list copy;
+    va_copy(copy, args);
+    size_t length = log_format_line(stack, sizeof(stack), level, site, format,
+                                    args, &needed);
+    if (needed > length) {
+      /* Too long for the stack buffer; format again at full size */
+      char *heap = (char *)malloc(needed + 1);
+      if (heap != NULL) {
+        line = heap;
+        length = log_format_line(heap, needed + 1, level, site, format, copy,
+                                 NULL);
+      }
+    }
+    va_end(copy);
+    LOG_LOCK();
+    if (primary) {
+      if (log_file == NULL)
+        log_file = stdout;
+      fwrite(line, 1, length, log_file);
+      fflush(log_file);
+    }
+    log_sinks_dispatch(level, line, length, log_line_body(line));
+    LOG_UNLOCK();
+    if (line != stack)
+      free(line);
+    if (primary)
+      log_rotate_count(length);
+
+    if (level == LOG_FATAL) {
+      log_close();
+      exit(EXIT_FAILURE);
+    }
+    return;
+  }
+#endif
+  if (!primary)
+    return;
+
+  char timestamp[32];
+  char category[64];
+  get_timestamp_ex(timestamp, sizeof(timestamp), LOG_TIMESTAMP_FLAGS);
+
+  LOG_LOCK();
+  if (log_file == NULL)
+    log_file = stdout;
+  int head = site == NULL
+                 ? fprintf(log_file, "[%s] [%s] ", timestamp,
+                           log_level_name(level))
+                 : fprintf(log_file, "[%s] [%s] %s[%s:%d %s] ", timestamp,
+                           log_level_name(level),
+                           log_site_category(site, category, sizeof(category)),
+                           log_site_file(site), site->line, site->function);
+  int body = vfprintf(log_file, format, args);
+  fprintf(log_file, "\n");
+  fflush(log_file);
+  LOG_UNLOCK();
+  log_rotate_count((size_t)(head > 0 ? head : 0) +
+                   (size_t)(body > 0 ? body : 0) + 1);
+
+  if (level == LOG_FATAL) {
+    log_close();
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief Log a message with the specified level
+ *
+ * A LOG_FATAL line is followed by log_close() and exit(EXIT_FAILURE), so
+ * queued and buffered lines are written first.
+ *
+ * @param level Log level
+ * @param format Format string (printf-style)
+ * @param ... Additional arguments for the format string
+ */
+UTILS_LOG_API void log_message(LogLevel level, const char *format, ...) {
+  if (!log_enabled(level))
+    return;
+
+  va_list args;
+  va_start(args, format);
+  log_vmessage(level, NULL, format, args);
+  va_end(args);
+}
+
+/**
+ * @brief Log a message tagged with its source location
+ *
+ * Normally called through LOG_DEBUGF() .. LOG_FATALF() or LOG_CAT().
+ *
+ * @param level Log level
+ * @param site File, line and function of the call, and its category
+ * @param format Format string (printf-style)
+ * @param ... Additional arguments for the format string
+ */
+UTILS_LOG_API void log_message_at(LogLevel level, const LogSite *site,
+                                  const char *format, ...) {
+  if (!log_site_enabled(level, site))
+    return;
+
+  va_list args;
+  va_start(args, format);
+  log_vmessage(level, site, format, args);
+  va_end(args);
+}
+
+/**
+ * @brief Write an already formatted line to the log
+ *
+ * For encoders that produce the whole line themselves (see slog.h). The line
+ * goes through the same file, lock and async queue as log_message(), with no
+ * timestamp or level prefix added. Callers check log_enabled() first; the
+ * line then goes to log_file if it passes log_set_level() and to each sink
+ * whose level it passes. LOG_FATAL still exits.
+ *
+ * @param level Log level of the line
+ * @param line Line text, ending with '\n'
+ * @param length Length of line in bytes
+ */
+UTILS_LOG_API void log_write(LogLevel level, const char *line,
+                             size_t length) {
+#ifdef UTILS_HAVE_THREADS
+  if (UTILS_LOAD_RELAXED(&log_async.active) &&
+      log_async_enqueue_line(level, line, length)) {
+    if (level == LOG_FATAL) {
+      log_close();
+      exit(EXIT_FAILURE);
+    }
+    return;
+  }
+#endif
+
+  bool primary = level >= UTILS_LOAD_RELAXED(&current_log_level);
+  LOG_LOCK();
+  if (primary) {
+    if (log_file == NULL)
+      log_file = stdout;
+    fwrite(line, 1, length, log_file);
+    fflush(log_file);
+  }
+#ifdef UTILS_HAVE_THREADS
+  log_sinks_dispatch(level, line, length, 0);
+#endif
+  LOG_UNLOCK();
+  if (primary)
+    log_rotate_count(length);
+
+  if (level == LOG_FATAL) {
+    log_close();
+    exit(EXIT_FAILURE);
+  }
+}
+#else
+bool log_init(const char *filename, LogLevel level);
+void log_set_level(LogLevel level);
+bool log_async_start(size_t capacity, LogOverflow policy);
+void log_async_stop(void);
+void log_flush(void);
+unsigned long long log_dropped(void);
+void log_close(void);
+bool log_rotate_start(const LogRotateConfig *config);
+void log_rotate_now(void);
+void log_rotate_stop(void);
+void log_category_set(const char *name, LogLevel level);
+void log_category_reset(const char *name);
+bool log_category_configure(const char *spec);
+bool log_category_load(const char *path);
+bool log_category_watch(const char *path, int signo, long interval_ms);
+void log_category_unwatch(void);
+bool log_crash_install(void);
+void log_crash_uninstall(void);
+#ifdef UTILS_HAVE_THREADS
+LogSink *log_sink_fd(int fd, LogLevel level, size_t buffer_bytes);
+LogSink *log_sink_file(const char *path, LogLevel level, size_t buffer_bytes);
+LogSink *log_sink_ring(size_t bytes, LogLevel level);
+LogSink *log_sink_callback(LogSinkCallback callback, void *user,
+                           LogLevel level);
+LogSink *log_sink_syslog(const char *path, const char *ident, LogLevel level);
+bool log_sink_add(LogSink *sink);
+void log_sink_remove(LogSink *sink);
+void log_sink_set_level(LogSink *sink, LogLevel level);
+size_t log_sink_ring_read(LogSink *sink, char *buffer, size_t size);
+#endif
+void log_message(LogLevel level, const char *format, ...);
+void log_message_at(LogLevel level, const LogSite *site, const char *format,
+                    ...);
+void log_write(LogLevel level, const char *line, size_t length);
+#endif /* UTILS_LOG_DEFINE */
+
+/**
+ * @brief Log with the caller's file, line and function
+ *
+ * Calls below LOG_MIN_LEVEL compile to nothing and their arguments are never
+ * evaluated; otherwise the runtime level check is inlined so a filtered call
+ * costs one load and a compare.
+ */
+#define LOG_AT(level, ...)                                                     \
+  do {                                                                         \
+    if ((level) >= LOG_MIN_LEVEL && log_enabled(level)) {                      \
+      static const LogSite log_site_ = {__FILE__, __LINE__, __func__, NULL};   \
+      log_message_at(level, &log_site_, __VA_ARGS__);                          \
+    }                                                                          \
+  } while (0)
+
+/**
+ * @brief Log only every n-th call from this call site (1st, n+1th, ...)
+ *
+ * The counter is a static atomic per call site and is only touched once the
+ * level check passes, so filtered calls cost the same as LOG_AT(). n must be
+ * at least 1 and is evaluated on every enabled call.
+ */
+#define LOG_EVERY_N(level, n, ...)                                             \
+  do {                                                                         \
+    if ((level) >= LOG_MIN_LEVEL && log_enabled(level)) {                      \
+      static const LogSite log_site_ = {__FILE__, __LINE__, __func__, NULL};   \
+      static UTILS_ATOMIC unsigned long long log_calls_;                       \
+      if (UTILS_FETCH_ADD(&log_calls_, 1ULL) % (unsigned long long)(n) == 0)   \
+        log_message_at(level, &log_site_, __VA_ARGS__);                        \
+    }                                                                          \
+  } while (0)
+
+/**
+ * @brief Log in a category, checked against the category's own level
+ *
+ * The category is a variable from LOG_CATEGORY_DEFINE(), so the check is one
+ * load of its level and a compare, with no lookup by name. The line carries
+ * the category name after the level.
+ */
+#define LOG_CAT(category, level, ...)                                          \
+  do {                                                                         \
+    if ((level) >= LOG_MIN_LEVEL &&                                            \
+        log_category_enabled(&(category), level)) {                            \
+      static const LogSite log_site_ = {__FILE__, __LINE__, __func__,          \
+                                        &(category)};                          \
+      log_message_at(level, &log_site_, __VA_ARGS__);                          \
+    }                                                                          \
+  } while (0)
+
+#define LOG_DEBUGF(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+#define LOG_INFOF(...) LOG_AT(LOG_INFO, __VA_ARGS__)
+#define LOG_WARNINGF(...) LOG_AT(LOG_WARNING, __VA_ARGS__)
+#define LOG_ERRORF(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+#define LOG_FATALF(...) LOG_AT(LOG_FATAL, __VA_ARGS__)
+
 /* ========== FILE UTILITIES ========== */
 
 /**
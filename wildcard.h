@@ -0,0 +1,664 @@
+/**
+ * @file wildcard.h
+ * @brief Shell glob matching compiled to a DFA
+ * @author pucitos
+ *
+ * A set of glob patterns is compiled into a single deterministic automaton
+ * over byte equivalence classes. Matching walks the input once with one table
+ * lookup per byte, so it is linear in the input length no matter how many
+ * stars a pattern contains, and testing against many patterns costs the same
+ * as testing against one.
+ *
+ * Supported syntax:
+ * - `*` matches any run of characters except '/'
+ * - `?` matches any single character except '/'
+ * - `[abc]`, `[a-z]`, `[!a-z]`, `[^a-z]` and POSIX classes like `[[:digit:]]`
+ * - `**` matches any run of characters including '/'; when it starts a path
+ *   component and is followed by '/', it matches zero or more whole
+ *   directories
+ * - `\` escapes the next character
+ */
+
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+#include "utils.h"
+#include <ctype.h>
+#include <stdint.h>
+
+/**
+ * @brief Compile flags
+ */
+#define WILDCARD_NOCASE 0x1 /* Match letters case-insensitively */
+#define WILDCARD_NOPATH 0x2 /* Treat '/' as an ordinary character */
+
+/**
+ * @brief Upper bound on DFA states before falling back to NFA simulation
+ */
+#ifndef WILDCARD_MAX_DFA_STATES
+#define WILDCARD_MAX_DFA_STATES 4096
+#endif
+
+/**
+ * @brief One pattern element: a byte set consumed once or repeatedly
+ */
+typedef struct {
+  uint8_t set[32];
+  bool loop; /* set may repeat zero or more times */
+  bool skip; /* may also jump past the loop and '/' tokens that follow */
+} WildcardToken;
+
+/**
+ * @brief Compiled set of glob patterns
+ */
+typedef struct {
+  size_t pattern_count;
+
+  /* NFA: one state per token plus one accepting state per pattern */
+  size_t nfa_count;
+  size_t words; /* 64-bit words per NFA state set */
+  WildcardToken *tokens;
+  int *owner; /* pattern index of accepting states, -1 otherwise */
+  uint64_t *start_set;
+
+  /* DFA over byte classes, NULL when it would exceed the state limit */
+  uint8_t byte_class[256];
+  int class_count;
+  size_t dfa_count;
+  uint32_t *next;
+  int *first_match;        /* lowest accepted pattern per state, or -1 */
+  size_t *match_offset;    /* match_ids range per state, dfa_count + 1 */
+  unsigned int *match_ids; /* all accepted patterns, ascending */
+} WildcardSet;
+
+/* ========== INTERNAL HELPERS ========== */
+
+static inline void wildcard_byte_add(uint8_t *set, int c) {
+  set[(unsigned char)c >> 3] |= (uint8_t)(1u << (c & 7));
+}
+
+static inline bool wildcard_byte_has(const uint8_t *set, int c) {
+  return (set[(unsigned char)c >> 3] >> (c & 7)) & 1;
+}
+
+/**
+ * @brief Add the other case of every letter in a set
+ */
+static inline void wildcard_fold_case(uint8_t *set) {
+  for (int c = 'a'; c <= 'z'; c++) {
+    if (wildcard_byte_has(set, c) || wildcard_byte_has(set, c - 32)) {
+      wildcard_byte_add(set, c);
+      wildcard_byte_add(set, c - 32);
+    }
+  }
+}
+
+static inline int wildcard_ctz(uint64_t x) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/**
+ * @brief Parse a bracket expression starting after '['
+ *
+ * Case is folded before negation, so [!a] excludes 'A' as well under
+ * WILDCARD_NOCASE.
+ *
+ * @return const char* Position after the closing ']', or NULL if unterminated
+ */
+static inline const char *wildcard_parse_bracket(const char *p, uint8_t *set,
+                                                 bool nocase) {
+  static const struct {
+    const char *name;
+    int (*test)(int);
+  } classes[] = {{"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank},
+                 {"cntrl", iscntrl}, {"digit", isdigit}, {"graph", isgraph},
+                 {"lower", islower}, {"print", isprint}, {"punct", ispunct},
+                 {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit}};
+  bool negate = false;
+  bool first = true;
+
+  memset(set, 0, 32);
+  if (*p == '!' || *p == '^') {
+    negate = true;
+    p++;
+  }
+
+  while (*p != '\0' && (*p != ']' || first)) {
+    first = false;
+
+    if (p[0] == '[' && p[1] == ':') {
+      const char *end = strstr(p + 2, ":]");
+      size_t k = 0;
+      for (; end != NULL && k < sizeof(classes) / sizeof(classes[0]); k++) {
+        size_t len = strlen(classes[k].name);
+        if ((size_t)(end - p - 2) == len &&
+            strncmp(p + 2, classes[k].name, len) == 0)
+          break;
+      }
+      if (end != NULL && k < sizeof(classes) / sizeof(classes[0])) {
+        for (int c = 0; c < 256; c++) {
+          if (classes[k].test(c))
+            wildcard_byte_add(set, c);
+        }
+        p = end + 2;
+        continue;
+      }
+    }
+
+    if (*p == '\\' && p[1] != '\0')
+      p++;
+    unsigned char lo = (unsigned char)*p++;
+    unsigned char hi = lo;
+
+    if (p[0] == '-' && p[1] != ']' && p[1] != '\0') {
+      p++;
+      if (*p == '\\' && p[1] != '\0')
+        p++;
+      hi = (unsigned char)*p++;
+    }
+    for (int c = lo; c <= hi; c++)
+      wildcard_byte_add(set, c);
+  }
+
+  if (*p != ']')
+    return NULL;
+
+  if (nocase)
+    wildcard_fold_case(set);
+  if (negate) {
+    for (int i = 0; i < 32; i++)
+      set[i] = (uint8_t)~set[i];
+  }
+  return p + 1;
+}
+
+/**
+ * @brief Translate one pattern into tokens
+ *
+ * @param out Token array with room for strlen(pattern) entries
+ * @return size_t Number of tokens written
+ */
+static inline size_t wildcard_parse(const char *pattern, int flags,
+                                    WildcardToken *out) {
+  bool path = !(flags & WILDCARD_NOPATH);
+  const char *p = pattern;
+  size_t n = 0;
+
+  while (*p != '\0') {
+    WildcardToken *t = &out[n++];
+    bool component_start = p == pattern || p[-1] == '/';
+    bool wild = true;
+    bool bracket = false;
+    memset(t, 0, sizeof(*t));
+
+    if (*p == '*') {
+      bool deep = p[1] == '*';
+      while (*p == '*')
+        p++;
+
+      if (path && deep) {
+        // `**/` as a whole component: zero or more directories. An entry
+        // token that consumes nothing either skips the component or enters
+        // the loop, which can then only be left through the '/'.
+        bool component = component_start && *p == '/';
+        if (component) {
+          t->loop = true;
+          t->skip = true;
+          t = &out[n++];
+          memset(t, 0, sizeof(*t));
+        }
+        memset(t->set, 0xff, sizeof(t->set));
+        t->loop = true;
+        if (component) {
+          t = &out[n++];
+          memset(t, 0, sizeof(*t));
+          wildcard_byte_add(t->set, '/');
+          p++;
+        }
+        continue;
+      }
+      memset(t->set, 0xff, sizeof(t->set));
+      t->loop = true;
+    } else if (*p == '?') {
+      memset(t->set, 0xff, sizeof(t->set));
+      p++;
+    } else if (*p == '[') {
+      const char *end =
+          wildcard_parse_bracket(p + 1, t->set, flags & WILDCARD_NOCASE);
+      if (end == NULL) {
+        /* Unterminated: a literal '[', and the rest is parsed again */
+        memset(t->set, 0, sizeof(t->set));
+        wildcard_byte_add(t->set, '[');
+        wild = false;
+        p++;
+      } else {
+        p = end;
+        bracket = true;
+      }
+    } else {
+      if (*p == '\\' && p[1] != '\0')
+        p++;
+      wildcard_byte_add(t->set, *p++);
+      wild = false;
+    }
+
+    if (path && wild)
+      t->set['/' >> 3] &= (uint8_t) ~(1u << ('/' & 7));
+
+    /* Brackets were folded before negation */
+    if ((flags & WILDCARD_NOCASE) && !bracket)
+      wildcard_fold_case(t->set);
+  }
+  return n;
+}
+
+/**
+ * @brief Add the epsilon successors of every state in a set
+ */
+static inline void wildcard_closure(const WildcardSet *ws, uint64_t *set) {
+  for (size_t w = 0; w < ws->words; w++) {
+    uint64_t bits = set[w];
+    while (bits != 0) {
+      int b = wildcard_ctz(bits);
+      size_t s = w * 64 + (size_t)b;
+      const WildcardToken *t = &ws->tokens[s];
+
+      if (t->loop)
+        set[(s + 1) >> 6] |= 1ull << ((s + 1) & 63);
+      if (t->skip)
+        set[(s + 3) >> 6] |= 1ull << ((s + 3) & 63);
+      bits = set[w] & ~((2ull << b) - 1);
+    }
+  }
+}
+
+/**
+ * @brief Advance an NFA state set over one byte
+ */
+static inline void wildcard_step(const WildcardSet *ws, const uint64_t *in,
+                                 unsigned char c, uint64_t *out) {
+  memset(out, 0, ws->words * sizeof(uint64_t));
+  for (size_t w = 0; w < ws->words; w++) {
+    uint64_t bits = in[w];
+    while (bits != 0) {
+      int b = wildcard_ctz(bits);
+      size_t s = w * 64 + (size_t)b;
+      const WildcardToken *t = &ws->tokens[s];
+
+      bits &= bits - 1;
+      if (!wildcard_byte_has(t->set, c))
+        continue;
+      if (!t->loop)
+        s++;
+      out[s >> 6] |= 1ull << (s & 63);
+    }
+  }
+  wildcard_closure(ws, out);
+}
+
+/**
+ * @brief Split the byte alphabet into classes no token can tell apart
+ */
+static inline void wildcard_build_classes(WildcardSet *ws) {
+  memset(ws->byte_class, 0, sizeof(ws->byte_class));
+  ws->class_count = 1;
+
+  for (size_t s = 0; s < ws->nfa_count; s++) {
+    const uint8_t *set = ws->tokens[s].set;
+    int remap[2][256];
+    int count = 0;
+
+    memset(remap, -1, sizeof(remap));
+    for (int c = 0; c < 256; c++) {
+      int in = wildcard_byte_has(set, c);
+      int *slot = &remap[in][ws->byte_class[c]];
+      if (*slot < 0)
+        *slot = count++;
+      ws->byte_class[c] = (uint8_t)*slot;
+    }
+    ws->class_count = count;
+  }
+}
+
+static inline uint64_t wildcard_hash(const uint64_t *set, size_t words) {
+  uint64_t h = 1469598103934665603ull;
+  for (size_t i = 0; i < words; i++) {
+    h ^= set[i];
+    h *= 1099511628211ull;
+  }
+  return h ^ (h >> 29);
+}
+
+/**
+ * @brief Run the subset construction
+ *
+ * @return true if the DFA fits in WILDCARD_MAX_DFA_STATES states
+ */
+static inline bool wildcard_build_dfa(WildcardSet *ws) {
+  size_t words = ws->words;
+  size_t capacity = 64;
+  size_t table_size = 128;
+  uint64_t *sets = (uint64_t *)safe_malloc(capacity * words * sizeof(uint64_t));
+  uint32_t *table = (uint32_t *)safe_malloc(table_size * sizeof(uint32_t));
+  uint64_t *scratch = (uint64_t *)safe_malloc(words * sizeof(uint64_t));
+  size_t classes = (size_t)ws->class_count;
+  uint32_t *next = (uint32_t *)safe_malloc(capacity * classes *
+                                           sizeof(uint32_t));
+  size_t count = 0;
+  bool ok = true;
+
+  memset(table, 0xff, table_size * sizeof(uint32_t));
+
+  // State 0 is the dead state, state 1 the start state
+  for (int init = 0; init < 2; init++) {
+    uint64_t *set = sets + count * words;
+    if (init == 0)
+      memset(set, 0, words * sizeof(uint64_t));
+    else
+      memcpy(set, ws->start_set, words * sizeof(uint64_t));
+    size_t slot = wildcard_hash(set, words) & (table_size - 1);
+    while (table[slot] != UINT32_MAX)
+      slot = (slot + 1) & (table_size - 1);
+    table[slot] = (uint32_t)count++;
+  }
+
+  for (size_t id = 0; id < count && ok; id++) {
+    for (int cls = 0; cls < ws->class_count; cls++) {
+      int rep = 0;
+      while (ws->byte_class[rep] != cls)
+        rep++;
+      wildcard_step(ws, sets + id * words, (unsigned char)rep, scratch);
+
+      uint64_t h = wildcard_hash(scratch, words);
+      size_t slot = h & (table_size - 1);
+      uint32_t target = UINT32_MAX;
+      while (table[slot] != UINT32_MAX) {
+        if (memcmp(sets + table[slot] * words, scratch,
+                   words * sizeof(uint64_t)) == 0) {
+          target = table[slot];
+          break;
+        }
+        slot = (slot + 1) & (table_size - 1);
+      }
+
+      if (target == UINT32_MAX) {
+        if (count >= WILDCARD_MAX_DFA_STATES) {
+          ok = false;
+          break;
+        }
+        if (count == capacity) {
+          capacity *= 2;
+          sets = (uint64_t *)safe_realloc(sets, capacity * words *
+                                                    sizeof(uint64_t));
+          next = (uint32_t *)safe_realloc(next, capacity * classes *
+                                                    sizeof(uint32_t));
+        }
+        memcpy(sets + count * words, scratch, words * sizeof(uint64_t));
+        target = (uint32_t)count++;
+        table[slot] = target;
+
+        if (count * 2 > table_size) {
+          free(table);
+          table_size *= 2;
+          table = (uint32_t *)safe_malloc(table_size * sizeof(uint32_t));
+          memset(table, 0xff, table_size * sizeof(uint32_t));
+          for (size_t k = 0; k < count; k++) {
+            size_t s = wildcard_hash(sets + k * words, words) &
+                       (table_size - 1);
+            while (table[s] != UINT32_MAX)
+              s = (s + 1) & (table_size - 1);
+            table[s] = (uint32_t)k;
+          }
+        }
+      }
+      next[id * classes + (size_t)cls] = target;
+    }
+  }
+
+  if (ok) {
+    size_t total = 0;
+    ws->dfa_count = count;
+    ws->next = (uint32_t *)safe_realloc(next, count * classes *
+                                                  sizeof(uint32_t));
+    ws->first_match = (int *)safe_malloc(count * sizeof(int));
+    ws->match_offset = (size_t *)safe_malloc((count + 1) * sizeof(size_t));
+
+    for (size_t id = 0; id < count; id++) {
+      const uint64_t *set = sets + id * words;
+      ws->match_offset[id] = total;
+      for (size_t s = 0; s < ws->nfa_count; s++) {
+        if (ws->owner[s] >= 0 && ((set[s >> 6] >> (s & 63)) & 1))
+          total++;
+      }
+    }
+    ws->match_offset[count] = total;
+    ws->match_ids = (unsigned int *)safe_malloc((total + 1) *
+                                                sizeof(unsigned int));
+
+    for (size_t id = 0; id < count; id++) {
+      const uint64_t *set = sets + id * words;
+      size_t k = ws->match_offset[id];
+      ws->first_match[id] = -1;
+      for (size_t s = 0; s < ws->nfa_count; s++) {
+        if (ws->owner[s] < 0 || !((set[s >> 6] >> (s & 63)) & 1))
+          continue;
+        ws->match_ids[k++] = (unsigned int)ws->owner[s];
+        if (ws->first_match[id] < 0)
+          ws->first_match[id] = ws->owner[s];
+      }
+    }
+  } else {
+    free(next);
+  }
+
+  free(scratch);
+  free(table);
+  free(sets);
+  return ok;
+}
+
+/* ========== COMPILATION ========== */
+
+/**
+ * @brief Compile several glob patterns into one matcher
+ *
+ * Patterns are numbered by their position in the array. If the combined DFA
+ * would exceed WILDCARD_MAX_DFA_STATES states, the matcher simulates the
+ * underlying NFA instead, which is still linear-time but slower per byte.
+ *
+ * @param patterns Array of NUL-terminated patterns
+ * @param count Number of patterns
+ * @param flags Bitwise OR of WILDCARD_* flags
+ * @return WildcardSet* Compiled matcher, or NULL on invalid arguments
+ */
+static inline WildcardSet *wildcard_compile_set(const char *const *patterns,
+                                                size_t count, int flags) {
+  if (patterns == NULL || count == 0)
+    return NULL;
+
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (patterns[i] == NULL)
+      return NULL;
+    total += strlen(patterns[i]) + 1;
+  }
+
+  WildcardSet *ws = (WildcardSet *)safe_calloc(1, sizeof(WildcardSet));
+  ws->pattern_count = count;
+  ws->tokens = (WildcardToken *)safe_calloc(total, sizeof(WildcardToken));
+  ws->owner = (int *)safe_malloc(total * sizeof(int));
+  ws->words = (total + 63) / 64;
+  ws->start_set = (uint64_t *)safe_calloc(ws->words, sizeof(uint64_t));
+
+  for (size_t i = 0; i < count; i++) {
+    size_t base = ws->nfa_count;
+    size_t n = wildcard_parse(patterns[i], flags, ws->tokens + base);
+
+    for (size_t k = 0; k < n; k++)
+      ws->owner[base + k] = -1;
+    ws->owner[base + n] = (int)i;
+    ws->start_set[base >> 6] |= 1ull << (base & 63);
+    ws->nfa_count = base + n + 1;
+  }
+
+  wildcard_closure(ws, ws->start_set);
+  wildcard_build_classes(ws);
+  wildcard_build_dfa(ws);
+  return ws;
+}
+
+/**
+ * @brief Compile a single glob pattern
+ *
+ * @param pattern NUL-terminated pattern
+ * @param flags Bitwise OR of WILDCARD_* flags
+ * @return WildcardSet* Compiled matcher, or NULL if pattern is NULL
+ */
+static inline WildcardSet *wildcard_compile(const char *pattern, int flags) {
+  return wildcard_compile_set(&pattern, 1, flags);
+}
+
+/**
+ * @brief Free a compiled matcher
+ *
+ * @param ws Matcher to free (may be NULL)
+ */
+static inline void wildcard_free(WildcardSet *ws) {
+  if (ws == NULL)
+    return;
+  free(ws->tokens);
+  free(ws->owner);
+  free(ws->start_set);
+  free(ws->next);
+  free(ws->first_match);
+  free(ws->match_offset);
+  free(ws->match_ids);
+  free(ws);
+}
+
+/* ========== MATCHING ========== */
+
+/**
+ * @brief Match a buffer and report every pattern that accepts it
+ *
+ * @param ws Compiled matcher
+ * @param str Input bytes
+ * @param len Input length
+ * @param ids Receives matching pattern indices in ascending order (may be
+ * NULL)
+ * @param max Capacity of ids
+ * @return size_t Total number of matching patterns (may exceed max)
+ */
+static inline size_t wildcard_match_all_n(const WildcardSet *ws,
+                                          const char *str, size_t len,
+                                          unsigned int *ids, size_t max) {
+  if (ws == NULL || (str == NULL && len > 0))
+    return 0;
+
+  if (ws->next != NULL) {
+    const uint32_t *next = ws->next;
+    size_t classes = (size_t)ws->class_count;
+    uint32_t state = 1;
+
+    for (size_t i = 0; i < len && state != 0; i++)
+      state = next[state * classes + ws->byte_class[(unsigned char)str[i]]];
+
+    size_t from = ws->match_offset[state];
+    size_t found = ws->match_offset[state + 1] - from;
+    for (size_t k = 0; ids != NULL && k < found && k < max; k++)
+      ids[k] = ws->match_ids[from + k];
+    return found;
+  }
+
+  uint64_t local[2][64];
+  uint64_t *cur = local[0];
+  uint64_t *alt = local[1];
+  if (ws->words > 64) {
+    cur = (uint64_t *)safe_malloc(2 * ws->words * sizeof(uint64_t));
+    alt = cur + ws->words;
+  }
+
+  memcpy(cur, ws->start_set, ws->words * sizeof(uint64_t));
+  for (size_t i = 0; i < len; i++) {
+    uint64_t *tmp;
+    wildcard_step(ws, cur, (unsigned char)str[i], alt);
+    tmp = cur;
+    cur = alt;
+    alt = tmp;
+  }
+
+  size_t found = 0;
+  for (size_t s = 0; s < ws->nfa_count; s++) {
+    if (ws->owner[s] < 0 || !((cur[s >> 6] >> (s & 63)) & 1))
+      continue;
+    if (ids != NULL && found < max)
+      ids[found] = (unsigned int)ws->owner[s];
+    found++;
+  }
+
+  if (ws->words > 64)
+    free(cur < alt ? cur : alt);
+  return found;
+}
+
+/**
+ * @brief Match a buffer against the compiled patterns
+ *
+ * @param ws Compiled matcher
+ * @param str Input bytes
+ * @param len Input length
+ * @return int Index of the first matching pattern, or -1 if none match
+ */
+static inline int wildcard_match_n(const WildcardSet *ws, const char *str,
+                                   size_t len) {
+  if (ws == NULL || (str == NULL && len > 0))
+    return -1;
+
+  if (ws->next != NULL) {
+    const uint32_t *next = ws->next;
+    size_t classes = (size_t)ws->class_count;
+    uint32_t state = 1;
+
+    for (size_t i = 0; i < len && state != 0; i++)
+      state = next[state * classes + ws->byte_class[(unsigned char)str[i]]];
+    return ws->first_match[state];
+  }
+
+  unsigned int id = 0;
+  return wildcard_match_all_n(ws, str, len, &id, 1) > 0 ? (int)id : -1;
+}
+
+/**
+ * @brief Match a NUL-terminated string against the compiled patterns
+ *
+ * @param ws Compiled matcher
+ * @param str String to test
+ * @return int Index of the first matching pattern, or -1 if none match
+ */
+static inline int wildcard_match(const WildcardSet *ws, const char *str) {
+  if (str == NULL)
+    return -1;
+  return wildcard_match_n(ws, str, strlen(str));
+}
+
+/**
+ * @brief Check whether any compiled pattern matches a string
+ *
+ * @param ws Compiled matcher
+ * @param str String to test
+ * @return true if at least one pattern matches, false otherwise
+ */
+static inline bool wildcard_matches(const WildcardSet *ws, const char *str) {
+  return wildcard_match(ws, str) >= 0;
+}
+
+#endif /* WILDCARD_H */